@@ -0,0 +1,162 @@
+#include <stdint.h> // uint64_t
+#include <string.h> // strcmp, memset
+
+#include "predictor.h"
+
+// History lengths of the tagged tables, geometric series
+static const uint64_t __tage_history[TAGE_NTABLES] = { 4, 10, 24, 56 };
+
+predictor_kind_t predictor_kind_from_name(const char *name)
+{
+  if (name && strcmp(name, "bimodal") == 0)
+    return PREDICTOR_BIMODAL;
+  else if (name && strcmp(name, "tage") == 0)
+    return PREDICTOR_TAGE;
+
+  return PREDICTOR_GSHARE;
+}
+
+const char *predictor_name(predictor_kind_t kind)
+{
+  switch (kind)
+    {
+    case PREDICTOR_BIMODAL: return "bimodal";
+    case PREDICTOR_TAGE: return "tage";
+    default: return "gshare";
+    }
+}
+
+void predictor_init(predictor_t *p, predictor_kind_t kind)
+{
+  memset(p, 0, sizeof(predictor_t));
+  p->kind = kind;
+
+  // Weakly taken
+  memset(p->bimodal, 2, sizeof(p->bimodal));
+  memset(p->gshare, 2, sizeof(p->gshare));
+}
+
+static uint64_t hash_id(uint64_t id)
+{
+  return id * 0x9e3779b97f4a7c15UL >> 32;
+}
+
+static void update_counter(uint8_t *ctr, int taken, uint8_t max)
+{
+  if (taken && *ctr < max)
+    (*ctr)++;
+  else if (!taken && *ctr > 0)
+    (*ctr)--;
+}
+
+// Fold the last length bits of the history on bits
+static uint64_t fold(uint64_t history, uint64_t length, uint64_t bits)
+{
+  uint64_t h = length < 64 ? history & ((1UL << length) - 1) : history;
+  uint64_t folded = 0;
+
+  for (; h; h >>= bits)
+    folded ^= h & ((1UL << bits) - 1);
+
+  return folded;
+}
+
+static int bimodal_update(predictor_t *p, uint64_t id, int taken)
+{
+  uint8_t *ctr = p->bimodal + (hash_id(id) & ((1 << BIMODAL_LOG) - 1));
+  int prediction = *ctr >= 2;
+
+  update_counter(ctr, taken, 3);
+  return prediction != taken;
+}
+
+static int gshare_update(predictor_t *p, uint64_t id, int taken)
+{
+  uint64_t index = (hash_id(id) ^ p->history) & ((1 << GSHARE_LOG) - 1);
+  uint8_t *ctr = p->gshare + index;
+  int prediction = *ctr >= 2;
+
+  update_counter(ctr, taken, 3);
+  return prediction != taken;
+}
+
+static int tage_update(predictor_t *p, uint64_t id, int taken)
+{
+  uint64_t h = hash_id(id);
+  tage_entry_t *entries[TAGE_NTABLES];
+  uint8_t tags[TAGE_NTABLES];
+  int provider = -1;
+  int alternate = -1;
+
+  // Find the two longest matching histories
+  for (int t = 0; t < TAGE_NTABLES; t++)
+    {
+      uint64_t index = (h ^ (h >> TAGE_LOG)
+                        ^ fold(p->history, __tage_history[t], TAGE_LOG)) & ((1 << TAGE_LOG) - 1);
+
+      tags[t] = (h ^ fold(p->history, __tage_history[t], TAGE_TAG_BITS)
+                 ^ (fold(p->history, __tage_history[t], TAGE_TAG_BITS - 1) << 1))
+        & ((1 << TAGE_TAG_BITS) - 1);
+      entries[t] = p->tage[t] + index;
+
+      if (entries[t]->valid && entries[t]->tag == tags[t])
+        {
+          alternate = provider;
+          provider = t;
+        }
+    }
+
+  uint8_t *base = p->bimodal + (h & ((1 << BIMODAL_LOG) - 1));
+  int base_prediction = *base >= 2;
+  int alt_prediction = alternate >= 0 ? entries[alternate]->ctr >= 4 : base_prediction;
+  int prediction = provider >= 0 ? entries[provider]->ctr >= 4 : base_prediction;
+
+  // Train the provider
+  if (provider >= 0)
+    {
+      if (prediction != alt_prediction)
+        update_counter(&entries[provider]->useful, prediction == taken, 3);
+
+      update_counter(&entries[provider]->ctr, taken, 7);
+    }
+  else
+    update_counter(base, taken, 3);
+
+  // Allocate an entry with a longer history on a misprediction
+  if (prediction != taken)
+    {
+      int allocated = 0;
+
+      for (int t = provider + 1; t < TAGE_NTABLES && !allocated; t++)
+        {
+          if (entries[t]->useful == 0)
+            {
+              entries[t]->valid = 1;
+              entries[t]->tag = tags[t];
+              entries[t]->ctr = taken ? 4 : 3;
+              allocated = 1;
+            }
+        }
+
+      for (int t = provider + 1; t < TAGE_NTABLES && !allocated; t++)
+        entries[t]->useful--;
+    }
+
+  return prediction != taken;
+}
+
+int predictor_update(predictor_t *p, uint64_t id, int taken)
+{
+  int mispredicted;
+
+  switch (p->kind)
+    {
+    case PREDICTOR_BIMODAL: mispredicted = bimodal_update(p, id, taken); break;
+    case PREDICTOR_TAGE: mispredicted = tage_update(p, id, taken); break;
+    default: mispredicted = gshare_update(p, id, taken); break;
+    }
+
+  p->history = (p->history << 1) | (taken ? 1 : 0);
+
+  return mispredicted;
+}
@@ -0,0 +1,79 @@
+#ifndef _PREDICTOR_H_
+#define _PREDICTOR_H_
+
+//
+#include <stdint.h> // uint64_t, uint8_t
+
+//
+#define BIMODAL_LOG 12
+#define GSHARE_LOG 14
+#define TAGE_NTABLES 4
+#define TAGE_LOG 10
+#define TAGE_TAG_BITS 8
+
+/**
+ * Simulated predictors
+ */
+typedef enum predictor_kind_e
+{
+  PREDICTOR_BIMODAL,
+  PREDICTOR_GSHARE,
+  PREDICTOR_TAGE
+} predictor_kind_t;
+
+/**
+ * Store a tagged entry of the TAGE predictor
+ */
+typedef struct tage_entry_s
+{
+  uint8_t ctr;    // 3-bit counter, predict taken when >= 4
+  uint8_t tag;
+  uint8_t useful; // 2-bit usefulness
+  uint8_t valid;
+} tage_entry_t;
+
+/**
+ * Store the state of a predictor (one per thread, like one per core)
+ */
+typedef struct predictor_s
+{
+  predictor_kind_t kind;
+  uint64_t history;
+  uint8_t bimodal[1 << BIMODAL_LOG];
+  uint8_t gshare[1 << GSHARE_LOG];
+  tage_entry_t tage[TAGE_NTABLES][1 << TAGE_LOG];
+} predictor_t;
+
+/**
+ * predictor_kind_from_name - Parse a predictor name
+ * @param name: bimodal, gshare or tage
+ * @return the predictor kind, gshare by default
+ */
+predictor_kind_t predictor_kind_from_name(const char *name);
+
+/**
+ * predictor_name - Get the name of a predictor kind
+ * @param kind: predictor kind
+ * @return the name
+ */
+const char *predictor_name(predictor_kind_t kind);
+
+/**
+ * predictor_init - Initialize a predictor with weakly taken counters
+ * @param p   : predictor
+ * @param kind: predictor kind
+ * @return
+ */
+void predictor_init(predictor_t *p, predictor_kind_t kind);
+
+/**
+ * predictor_update - Predict a branch, then train the predictor with the
+ *                    actual outcome
+ * @param p    : predictor
+ * @param id   : branch id (stands for the branch address)
+ * @param taken: actual outcome
+ * @return 1 when the prediction was wrong, 0 otherwise
+ */
+int predictor_update(predictor_t *p, uint64_t id, int taken);
+
+#endif // _PREDICTOR_H_
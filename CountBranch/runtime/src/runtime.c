@@ -0,0 +1,369 @@
+#include <stdio.h>    // fprintf
+#include <stdlib.h>   // getenv, calloc, qsort
+#include <stdint.h>   // uint64_t
+#include <pthread.h>  // pthread_mutex_lock
+#include <sys/mman.h> // mmap, munmap
+
+#include "runtime.h"
+
+//
+runtime_t __rt = { PTHREAD_MUTEX_INITIALIZER, 0, 0, { { 0 } }, NULL,
+                   PREDICTOR_GSHARE, DEFAULT_PENALTY };
+
+// Counters of the current thread
+static __thread thread_t *__thread_info = NULL;
+
+// Used when a thread cannot get its own counters
+static uint64_t __dummy_counters[2 * COUNTER_LIMIT];
+
+/**
+ * Store the cost of a branch or of a function in the reports
+ */
+typedef struct cost_s
+{
+  const char *func_name;
+  uint64_t index;
+  uint64_t executions;
+  uint64_t taken;
+  uint64_t mispredicts;
+} cost_t;
+
+static void *map(uint64_t size)
+{
+  // Pages are only touched by the branches that run
+  void *ptr = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+  return ptr == MAP_FAILED ? NULL : ptr;
+}
+
+void libcountbranch_initialize()
+{
+  const char *penalty = getenv("COUNT_BRANCH_PENALTY");
+
+  __rt.predictor_kind = predictor_kind_from_name(getenv("COUNT_BRANCH_PREDICTOR"));
+
+  if (penalty)
+    __rt.penalty = strtoull(penalty, NULL, 10);
+}
+
+uint64_t count_branch_register(uint64_t nbranches, const char **func_names,
+                               const uint64_t *indexes)
+{
+  uint64_t base;
+
+  pthread_mutex_lock(&__rt.mutex);
+
+  if (__rt.nmodules >= MODULE_LIMIT || __rt.nbranches + nbranches > BRANCH_LIMIT)
+    {
+      fprintf(stderr, "countbranch: too many branches, increase BRANCH_LIMIT\n");
+      pthread_mutex_unlock(&__rt.mutex);
+
+      // The counters of the module cannot even be discarded
+      if (nbranches > DISCARD_LIMIT)
+        exit(13);
+
+      // Share the discarded counters, the module is not written in the profile
+      return BRANCH_LIMIT;
+    }
+
+  base = __rt.nbranches;
+  __rt.modules[__rt.nmodules].base = base;
+  __rt.modules[__rt.nmodules].nbranches = nbranches;
+  __rt.modules[__rt.nmodules].func_names = func_names;
+  __rt.modules[__rt.nmodules].indexes = indexes;
+  __rt.nmodules++;
+  __rt.nbranches += nbranches;
+
+  pthread_mutex_unlock(&__rt.mutex);
+
+  return base;
+}
+
+static thread_t *get_thread(void)
+{
+  if (__thread_info)
+    return __thread_info;
+
+  thread_t *thread = calloc(1, sizeof(thread_t));
+
+  if (!thread)
+    return NULL;
+
+  thread->counters = map(sizeof(uint64_t) * 2 * COUNTER_LIMIT);
+  thread->mispredicts = map(sizeof(uint64_t) * BRANCH_LIMIT);
+  thread->predictor = malloc(sizeof(predictor_t));
+
+  if (!thread->counters || !thread->mispredicts || !thread->predictor)
+    {
+      if (thread->counters)
+        munmap(thread->counters, sizeof(uint64_t) * 2 * COUNTER_LIMIT);
+      if (thread->mispredicts)
+        munmap(thread->mispredicts, sizeof(uint64_t) * BRANCH_LIMIT);
+      free(thread->predictor);
+      free(thread);
+      return NULL;
+    }
+
+  predictor_init(thread->predictor, __rt.predictor_kind);
+
+  // Counters outlive their thread, they are merged by the destructor
+  pthread_mutex_lock(&__rt.mutex);
+  thread->next = __rt.threads;
+  __rt.threads = thread;
+  pthread_mutex_unlock(&__rt.mutex);
+
+  __thread_info = thread;
+  return thread;
+}
+
+uint64_t *count_branch_counters(void)
+{
+  thread_t *thread = get_thread();
+
+  return thread ? thread->counters : __dummy_counters;
+}
+
+void count_branch_outcome(uint64_t id, uint64_t taken)
+{
+  // Branch of a module that does not fit
+  if (id >= BRANCH_LIMIT)
+    return;
+
+  thread_t *thread = get_thread();
+
+  // Without counters of its own, the outcome is lost: not a misprediction
+  if (!thread)
+    {
+      __dummy_counters[2 * id + !taken]++;
+      return;
+    }
+
+  thread->counters[2 * id + !taken]++;
+  thread->mispredicts[id] += predictor_update(thread->predictor, id, taken != 0);
+  thread->simulated = 1;
+}
+
+void libcountbranch_finalize()
+{
+  if (!__rt.threads)
+    return;
+
+  uint64_t *counters = calloc(2 * __rt.nbranches + 1, sizeof(uint64_t));
+  uint64_t *mispredicts = calloc(__rt.nbranches + 1, sizeof(uint64_t));
+
+  if (!counters || !mispredicts)
+    {
+      free(counters);
+      free(mispredicts);
+      return;
+    }
+
+  thread_t *thread = __rt.threads;
+  uint64_t simulated = 0;
+
+  while (thread)
+    {
+      thread_t *next = thread->next;
+
+      simulated |= thread->simulated;
+
+      for (uint64_t i = 0; i < __rt.nbranches; i++)
+        {
+          counters[2 * i] += thread->counters[2 * i];
+          counters[2 * i + 1] += thread->counters[2 * i + 1];
+          mispredicts[i] += thread->mispredicts[i];
+        }
+
+      munmap(thread->counters, sizeof(uint64_t) * 2 * COUNTER_LIMIT);
+      munmap(thread->mispredicts, sizeof(uint64_t) * BRANCH_LIMIT);
+      free(thread->predictor);
+      free(thread);
+      thread = next;
+    }
+
+  __rt.threads = NULL;
+
+  write_branch_profile(counters);
+
+  if (simulated)
+    {
+      write_predictor_summary(counters, mispredicts);
+      write_predictor_info_in_csv_file(counters, mispredicts);
+    }
+
+  free(mispredicts);
+  free(counters);
+}
+
+void write_branch_profile(const uint64_t *counters)
+{
+  //
+  const char *name = getenv("COUNT_BRANCH_PROFILE");
+  FILE *file = fopen(name ? name : DEFAULT_PROFILE, "w");
+
+  if (!file)
+    exit(13);
+
+  //
+  fprintf(file, "FUNCTION NAME,INDEX,TAKEN,NOT TAKEN\n");
+
+  //
+  for (uint64_t m = 0; m < __rt.nmodules; m++)
+    {
+      module_t *mod = __rt.modules + m;
+
+      for (uint64_t i = 0; i < mod->nbranches; i++)
+        {
+          uint64_t id = mod->base + i;
+
+          fprintf(file, "%s,%ld,%ld,%ld\n",
+                  mod->func_names[i],
+                  mod->indexes[i],
+                  counters[2 * id],
+                  counters[2 * id + 1]);
+        }
+    }
+
+  //
+  fflush(file);
+  fclose(file);
+}
+
+static int compare_mispredicts(const void *a, const void *b)
+{
+  const cost_t *ca = a;
+  const cost_t *cb = b;
+
+  return (ca->mispredicts < cb->mispredicts) - (ca->mispredicts > cb->mispredicts);
+}
+
+// Get the cost of every branch (by_function = 0) or of every function
+// (by_function = 1), sorted by mispredictions
+static cost_t *get_costs(const uint64_t *counters, const uint64_t *mispredicts,
+                         int by_function, uint64_t *n)
+{
+  cost_t *costs = calloc(__rt.nbranches + 1, sizeof(cost_t));
+
+  *n = 0;
+
+  if (!costs)
+    return NULL;
+
+  for (uint64_t m = 0; m < __rt.nmodules; m++)
+    {
+      module_t *mod = __rt.modules + m;
+
+      for (uint64_t i = 0; i < mod->nbranches; i++)
+        {
+          uint64_t id = mod->base + i;
+          cost_t *c;
+
+          // The branches of a function are contiguous and share its name
+          if (by_function && *n > 0 && costs[*n - 1].func_name == mod->func_names[i])
+            c = costs + *n - 1;
+          else
+            {
+              c = costs + *n;
+              c->func_name = mod->func_names[i];
+              c->index = mod->indexes[i];
+              (*n)++;
+            }
+
+          c->executions += counters[2 * id] + counters[2 * id + 1];
+          c->taken += counters[2 * id];
+          c->mispredicts += mispredicts[id];
+        }
+    }
+
+  qsort(costs, *n, sizeof(cost_t), compare_mispredicts);
+
+  return costs;
+}
+
+void write_predictor_summary(const uint64_t *counters, const uint64_t *mispredicts)
+{
+  uint64_t n;
+  cost_t *costs = get_costs(counters, mispredicts, 1, &n);
+
+  if (!costs)
+    return;
+
+  //
+  fflush(stdout);
+
+  //
+  fprintf(stdout,
+          "========================== BRANCH PREDICTOR SUMMARY ==========================\n"
+          "\n"
+          "%28s: %s\n"
+          "%28s: %ld\n"
+          "\n"
+          "%16s  %16s  %10s  %16s  %s"
+          "\n",
+          "predictor", predictor_name(__rt.predictor_kind),
+          "misprediction penalty", __rt.penalty,
+          "EXECUTIONS",
+          "MISPREDICTS",
+          "RATE",
+          "WASTED CYCLES",
+          "FUNCTION NAME");
+
+  //
+  for (uint64_t i = 0; i < n; i++)
+    {
+      fprintf(stdout, "%16ld  %16ld  %8.2lf %c  %16ld  %s\n",
+              costs[i].executions,
+              costs[i].mispredicts,
+              costs[i].executions ? 100.0 * costs[i].mispredicts / costs[i].executions : 0.0,
+              '%',
+              costs[i].mispredicts * __rt.penalty,
+              costs[i].func_name);
+    }
+
+  //
+  fprintf(stdout, "\n");
+  fflush(stdout);
+
+  free(costs);
+}
+
+void write_predictor_info_in_csv_file(const uint64_t *counters, const uint64_t *mispredicts)
+{
+  uint64_t n;
+  cost_t *costs = get_costs(counters, mispredicts, 0, &n);
+
+  if (!costs)
+    return;
+
+  //
+  FILE *file = fopen("count-branch-predictor.csv", "w");
+
+  if (!file)
+    exit(13);
+
+  //
+  fprintf(file,
+          "FUNCTION NAME,INDEX,EXECUTIONS,TAKEN RATE,MISPREDICTS,MISPREDICT RATE,WASTED CYCLES\n");
+
+  //
+  for (uint64_t i = 0; i < n; i++)
+    {
+      double executions = costs[i].executions ? (double)costs[i].executions : 1.0;
+
+      fprintf(file, "%s,%ld,%ld,%.4lf,%ld,%.4lf,%ld\n",
+              costs[i].func_name,
+              costs[i].index,
+              costs[i].executions,
+              costs[i].taken / executions,
+              costs[i].mispredicts,
+              costs[i].mispredicts / executions,
+              costs[i].mispredicts * __rt.penalty);
+    }
+
+  //
+  fflush(file);
+  fclose(file);
+
+  free(costs);
+}
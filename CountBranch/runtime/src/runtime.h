@@ -0,0 +1,128 @@
+#ifndef _RUNTIME_H_
+#define _RUNTIME_H_
+
+//
+#include <stdint.h>  // uint64_t
+#include <pthread.h> // pthread_mutex_t
+
+#include "predictor.h"
+
+//
+#define BRANCH_LIMIT (1 << 19)
+// Counters past BRANCH_LIMIT, shared by the modules that do not fit and never
+// written in the profile
+#define DISCARD_LIMIT BRANCH_LIMIT
+#define COUNTER_LIMIT (BRANCH_LIMIT + DISCARD_LIMIT)
+#define MODULE_LIMIT 1024
+#define DEFAULT_PROFILE "count-branch.prof"
+#define DEFAULT_PENALTY 15
+
+/**
+ * Store the branches of an instrumented module
+ */
+typedef struct module_s
+{
+  uint64_t base;
+  uint64_t nbranches;
+  const char **func_names;
+  const uint64_t *indexes;
+} module_t;
+
+/**
+ * Store the counters of one thread: counters[2 * id] counts the taken edges of
+ * branch id and counters[2 * id + 1] the not taken ones, mispredicts[id] the
+ * mispredictions of the simulated predictor, simulated is set by the first
+ * outcome that goes through it
+ */
+typedef struct thread_s
+{
+  uint64_t *counters;
+  uint64_t *mispredicts;
+  predictor_t *predictor;
+  uint64_t simulated;
+  struct thread_s *next;
+} thread_t;
+
+/**
+ * Store the runtime information
+ */
+typedef struct runtime_s
+{
+  pthread_mutex_t mutex;
+  uint64_t nbranches;
+  uint64_t nmodules;
+  module_t modules[MODULE_LIMIT];
+  thread_t *threads;
+  predictor_kind_t predictor_kind;
+  uint64_t penalty;
+} runtime_t;
+
+extern runtime_t __rt;
+
+/**
+ * Library constructor - read COUNT_BRANCH_PREDICTOR (bimodal, gshare or tage)
+ * and COUNT_BRANCH_PENALTY (cycles per misprediction)
+ */
+void libcountbranch_initialize() __attribute__((constructor));
+
+/**
+ * Library destructor - merge the counters of every thread, write the profile
+ * and the predictor report
+ */
+void libcountbranch_finalize() __attribute__((destructor));
+
+/**
+ * count_branch_register - Register the branches of a module (called by the
+ *                         module constructor inserted by the pass)
+ * @param nbranches : number of conditional branches of the module
+ * @param func_names: function of each branch
+ * @param indexes   : index of each branch in its function
+ * @return the id of the first branch of the module, BRANCH_LIMIT (the discarded
+ *         counters) when the module does not fit
+ */
+uint64_t count_branch_register(uint64_t nbranches, const char **func_names,
+                               const uint64_t *indexes);
+
+/**
+ * count_branch_counters - Get the counters of the current thread
+ * @return the counters
+ */
+uint64_t *count_branch_counters(void);
+
+/**
+ * count_branch_outcome - Count a branch outcome and run it through the
+ *                        simulated predictor of the current thread
+ * @param id   : branch id
+ * @param taken: 1 if the branch is taken, 0 otherwise
+ * @return
+ */
+void count_branch_outcome(uint64_t id, uint64_t taken);
+
+/**
+ * write_branch_profile - Write the merged counters in the profile file
+ *                        (COUNT_BRANCH_PROFILE or count-branch.prof)
+ * @param counters: merged counters
+ * @return
+ */
+void write_branch_profile(const uint64_t *counters);
+
+/**
+ * write_predictor_summary - Write per-function mispredictions in stdout,
+ *                           ranked by wasted cycles
+ * @param counters   : merged counters
+ * @param mispredicts: merged mispredictions
+ * @return
+ */
+void write_predictor_summary(const uint64_t *counters, const uint64_t *mispredicts);
+
+/**
+ * write_predictor_info_in_csv_file - Write per-branch mispredictions in
+ *                                    count-branch-predictor.csv, ranked by
+ *                                    wasted cycles
+ * @param counters   : merged counters
+ * @param mispredicts: merged mispredictions
+ * @return
+ */
+void write_predictor_info_in_csv_file(const uint64_t *counters, const uint64_t *mispredicts);
+
+#endif // _RUNTIME_H_
@@ -0,0 +1,355 @@
+//===- BlockLayout.cpp - Profile-driven basic block layout ----------------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// This file implements a pass that reorders the basic blocks of each function
+// so that the hot successors fall through (Pettis-Hansen chain merging on the
+// edge frequencies given by the profile written by libcountbranch.so), and
+// outlines the blocks never executed by the profiled run into .cold functions.
+//
+//===----------------------------------------------------------------------===//
+
+#include "BranchProfile.h"
+
+#include "llvm/Pass.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/DenseSet.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/Analysis/BlockFrequencyInfo.h"
+#include "llvm/Analysis/BranchProbabilityInfo.h"
+#include "llvm/Analysis/LoopInfo.h"
+#include "llvm/IR/CFG.h"
+#include "llvm/IR/Dominators.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/InstrTypes.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Transforms/Utils/CodeExtractor.h"
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+using namespace llvm;
+using namespace countbranch;
+
+#define DEBUG_TYPE "branch-layout"
+
+static cl::opt<std::string>
+ProfileFile("branch-layout-profile",
+            cl::desc("Branch counts written by libcountbranch.so"),
+            cl::value_desc("filename"), cl::init("count-branch.prof"));
+
+static cl::opt<bool>
+SplitCold("branch-layout-split",
+          cl::desc("Outline the blocks never executed by the profiled run "
+                   "into .cold functions"),
+          cl::init(true));
+
+namespace {
+  // Taken branches of a layout: transfers that do not fall through
+  struct TakenBranches {
+    uint64_t edges = 0;    // Static
+    double per_call = 0.0; // Dynamic, relative to the entry frequency
+  };
+
+  // BlockLayout - The first implementation
+  struct BlockLayout : public ModulePass {
+    static char ID; // Pass identification, replacement for typeid
+    static uint64_t count_functions;
+    static uint64_t count_outlined;
+
+    BranchProfile profile;
+
+    BlockLayout() : ModulePass(ID) {}
+
+    bool runOnModule(Module &M) override {
+      bool modified = false;
+
+      if (!profile.readCounts(ProfileFile))
+        return false;
+
+      // Outlining adds functions to the module
+      std::vector<Function *> Functions;
+      for (Function &F : M)
+        if (!F.isDeclaration())
+          Functions.push_back(&F);
+
+      for (Function *F : Functions)
+        modified |= runOnFunction(*F);
+
+      errs() << "Functions laid out: " << count_functions
+             << ", cold regions outlined: " << count_outlined << '\n';
+
+      return modified;
+    }
+
+    bool runOnFunction(Function &F) {
+      SmallVector<BranchInst *, 16> Branches;
+      getConditionalBranches(F, Branches);
+
+      // Branch indexes refer to the original IR, weights are attached first
+      if (Branches.empty() || !profile.attachBranchWeights(F, Branches))
+        return false;
+
+      DominatorTree DT(F);
+      LoopInfo LI(DT);
+      BranchProbabilityInfo BPI(F, LI);
+      BlockFrequencyInfo BFI(F, BPI, LI);
+
+      DenseSet<BasicBlock *> Cold;
+      getColdBlocks(F, Cold);
+      size_t ColdBlocks = Cold.size();
+
+      TakenBranches Before = countTakenBranches(F, BFI, BPI);
+
+      std::vector<BasicBlock *> Order;
+      layout(F, BFI, BPI, Cold, Order);
+
+      for (size_t i = 1; i < Order.size(); i++)
+        Order[i]->moveAfter(Order[i - 1]);
+
+      TakenBranches After = countTakenBranches(F, BFI, BPI);
+
+      unsigned Outlined = SplitCold ? outline(F, Cold) : 0;
+
+      errs() << "Function: " << F.getName() << " taken branches "
+             << Before.edges << " -> " << After.edges << ", per call "
+             << format("%.2f -> %.2f", Before.per_call, After.per_call)
+             << ", cold blocks " << ColdBlocks << ", outlined regions "
+             << Outlined << "\n";
+
+      count_functions++;
+      count_outlined += Outlined;
+
+      return true;
+    }
+
+    // Blocks not reachable from the entry through edges executed by the
+    // profiled run
+    void getColdBlocks(Function &F, DenseSet<BasicBlock *> &Cold) {
+      DenseSet<BasicBlock *> Hot;
+      SmallVector<BasicBlock *, 16> Worklist;
+
+      Hot.insert(&F.getEntryBlock());
+      Worklist.push_back(&F.getEntryBlock());
+
+      while (!Worklist.empty()) {
+        BasicBlock *BB = Worklist.pop_back_val();
+        Instruction *Term = BB->getTerminator();
+        uint64_t TrueWeight, FalseWeight;
+        bool Weighted = isa<BranchInst>(Term)
+          && Term->extractProfMetadata(TrueWeight, FalseWeight);
+
+        for (unsigned i = 0; i < Term->getNumSuccessors(); i++) {
+          if (Weighted && (i == 0 ? TrueWeight : FalseWeight) == 0)
+            continue;
+
+          if (Hot.insert(Term->getSuccessor(i)).second)
+            Worklist.push_back(Term->getSuccessor(i));
+        }
+      }
+
+      for (BasicBlock &BB : F)
+        if (!Hot.count(&BB) && !pred_empty(&BB))
+          Cold.insert(&BB);
+    }
+
+    double edgeFrequency(BlockFrequencyInfo &BFI, BranchProbabilityInfo &BPI,
+                         BasicBlock *BB, unsigned Succ) {
+      BranchProbability Prob = BPI.getEdgeProbability(BB, Succ);
+
+      return (double)BFI.getBlockFreq(BB).getFrequency()
+        * Prob.getNumerator() / Prob.getDenominator();
+    }
+
+    // Walk the branches in layout order: every edge to a block that is not
+    // the next one is a jump (a conditional branch with no successor next
+    // needs a conditional and an unconditional jump)
+    TakenBranches countTakenBranches(Function &F, BlockFrequencyInfo &BFI,
+                                     BranchProbabilityInfo &BPI) {
+      TakenBranches Taken;
+      double Entry = (double)BFI.getEntryFreq();
+
+      for (BasicBlock &BB : F) {
+        BranchInst *BI = dyn_cast_or_null<BranchInst>(BB.getTerminator());
+        if (!BI)
+          continue;
+
+        BasicBlock *Next = BB.getNextNode();
+
+        for (unsigned i = 0; i < BI->getNumSuccessors(); i++) {
+          if (BI->getSuccessor(i) == Next)
+            continue;
+
+          Taken.edges++;
+          Taken.per_call += edgeFrequency(BFI, BPI, &BB, i) / Entry;
+        }
+      }
+
+      return Taken;
+    }
+
+    // Pettis-Hansen: merge the chain ending at the source of the hottest
+    // edges with the chain starting at their destination, then place the
+    // chains by decreasing frequency after the entry chain, cold blocks last
+    void layout(Function &F, BlockFrequencyInfo &BFI, BranchProbabilityInfo &BPI,
+                DenseSet<BasicBlock *> &Cold, std::vector<BasicBlock *> &Order) {
+      struct Edge {
+        BasicBlock *Src;
+        BasicBlock *Dst;
+        double Freq;
+      };
+
+      std::vector<std::vector<BasicBlock *>> Chains;
+      DenseMap<BasicBlock *, unsigned> ChainOf;
+      std::vector<Edge> Edges;
+      BasicBlock *EntryBB = &F.getEntryBlock();
+
+      for (BasicBlock &BB : F) {
+        if (Cold.count(&BB))
+          continue;
+
+        ChainOf[&BB] = Chains.size();
+        Chains.push_back({&BB});
+
+        Instruction *Term = BB.getTerminator();
+        for (unsigned i = 0; i < Term->getNumSuccessors(); i++)
+          if (!Cold.count(Term->getSuccessor(i)))
+            Edges.push_back({&BB, Term->getSuccessor(i),
+                             edgeFrequency(BFI, BPI, &BB, i)});
+      }
+
+      std::stable_sort(Edges.begin(), Edges.end(),
+                       [](const Edge &A, const Edge &B) { return A.Freq > B.Freq; });
+
+      for (Edge &E : Edges) {
+        unsigned Src = ChainOf[E.Src];
+        unsigned Dst = ChainOf[E.Dst];
+
+        if (Src == Dst || E.Dst == EntryBB || Chains[Src].back() != E.Src
+            || Chains[Dst].front() != E.Dst)
+          continue;
+
+        for (BasicBlock *BB : Chains[Dst]) {
+          Chains[Src].push_back(BB);
+          ChainOf[BB] = Src;
+        }
+        Chains[Dst].clear();
+      }
+
+      // Hottest block of each chain
+      std::vector<std::pair<uint64_t, unsigned>> Placed;
+      for (unsigned i = 0; i < Chains.size(); i++) {
+        if (Chains[i].empty() || i == ChainOf[EntryBB])
+          continue;
+
+        uint64_t Freq = 0;
+        for (BasicBlock *BB : Chains[i])
+          Freq = std::max(Freq, BFI.getBlockFreq(BB).getFrequency());
+
+        Placed.push_back({Freq, i});
+      }
+
+      std::stable_sort(Placed.begin(), Placed.end(),
+                       [](const std::pair<uint64_t, unsigned> &A,
+                          const std::pair<uint64_t, unsigned> &B) {
+                         return A.first > B.first;
+                       });
+
+      Order = Chains[ChainOf[EntryBB]];
+      for (auto &P : Placed)
+        Order.insert(Order.end(), Chains[P.second].begin(), Chains[P.second].end());
+
+      for (BasicBlock &BB : F)
+        if (Cold.count(&BB))
+          Order.push_back(&BB);
+    }
+
+    // Outline each single-entry cold region: the cold blocks dominated by a
+    // cold block entered from hot code
+    unsigned outline(Function &F, DenseSet<BasicBlock *> &Cold) {
+      SmallVector<BasicBlock *, 8> Heads;
+      unsigned Outlined = 0;
+
+      for (BasicBlock &BB : F) {
+        if (!Cold.count(&BB))
+          continue;
+
+        bool Entered = false;
+        for (BasicBlock *Pred : predecessors(&BB))
+          Entered |= !Cold.count(Pred);
+
+        if (Entered)
+          Heads.push_back(&BB);
+      }
+
+      for (BasicBlock *Head : Heads) {
+        // Every extraction changes the CFG
+        DominatorTree DT(F);
+
+        if (Head->getParent() != &F || !DT.isReachableFromEntry(Head))
+          continue;
+
+        SmallVector<BasicBlock *, 8> Region;
+        SmallVector<BasicBlock *, 8> Worklist;
+        DenseSet<BasicBlock *> Visited;
+
+        Worklist.push_back(Head);
+        Visited.insert(Head);
+
+        while (!Worklist.empty()) {
+          BasicBlock *BB = Worklist.pop_back_val();
+          Region.push_back(BB);
+
+          for (BasicBlock *Succ : successors(BB))
+            if (Cold.count(Succ) && DT.dominates(Head, Succ)
+                && Visited.insert(Succ).second)
+              Worklist.push_back(Succ);
+        }
+
+        CodeExtractor CE(Region, &DT, /*AggregateArgs=*/false, nullptr,
+                         nullptr, nullptr, /*AllowVarArgs=*/false,
+                         /*AllowAlloca=*/false,
+                         "cold." + std::to_string(Outlined + 1));
+
+        if (!CE.isEligible()) {
+          errs() << "Function: " << F.getName() << " cold region at "
+                 << Head->getName() << " cannot be outlined\n";
+          continue;
+        }
+
+        CodeExtractorAnalysisCache CEAC(F);
+        Function *ColdF = CE.extractCodeRegion(CEAC);
+        if (!ColdF)
+          continue;
+
+        for (BasicBlock *BB : Region)
+          Cold.erase(BB);
+
+        ColdF->addFnAttr(Attribute::Cold);
+        ColdF->addFnAttr(Attribute::MinSize);
+
+        for (User *U : ColdF->users())
+          if (CallInst *CI = dyn_cast<CallInst>(U))
+            CI->addFnAttr(Attribute::Cold);
+
+        Outlined++;
+      }
+
+      return Outlined;
+    }
+  };
+}
+
+char BlockLayout::ID = 0;
+uint64_t BlockLayout::count_functions = 0;
+uint64_t BlockLayout::count_outlined = 0;
+static RegisterPass<BlockLayout> X("branch-layout", "Branch Layout Pass");
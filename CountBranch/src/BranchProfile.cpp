@@ -0,0 +1,166 @@
+//===- BranchProfile.cpp - Branch profiles of the CountBranch runtime -----===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+
+#include "BranchProfile.h"
+
+#include "llvm/IR/MDBuilder.h"
+#include "llvm/Support/LineIterator.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <algorithm>
+
+using namespace llvm;
+
+namespace countbranch {
+
+  void getConditionalBranches(Function &F,
+                              SmallVectorImpl<BranchInst *> &Branches) {
+    for (BasicBlock &BB : F)
+      if (BranchInst *BI = dyn_cast_or_null<BranchInst>(BB.getTerminator()))
+        if (BI->isConditional())
+          Branches.push_back(BI);
+  }
+
+  double BranchCounts::bias() const {
+    if (executions() == 0)
+      return 1.0;
+
+    return (double)std::max(taken, not_taken) / (double)executions();
+  }
+
+  double BranchCounts::mispredictRate() const {
+    if (executions() == 0)
+      return 0.0;
+
+    if (has_mispredicts)
+      return (double)mispredicts / (double)executions();
+
+    return 1.0 - bias();
+  }
+
+  BranchCounts &BranchProfile::get(StringRef FuncName, uint64_t Index) {
+    auto &Counts = Functions[FuncName];
+
+    if (Counts.size() <= Index)
+      Counts.resize(Index + 1);
+
+    return Counts[Index];
+  }
+
+  bool BranchProfile::readCounts(StringRef Path) {
+    auto Buffer = MemoryBuffer::getFile(Path);
+
+    if (!Buffer) {
+      errs() << "Cannot read branch profile: " << Path << "\n";
+      return false;
+    }
+
+    for (line_iterator Line(**Buffer, /*SkipBlanks=*/true); !Line.is_at_end(); ++Line) {
+      SmallVector<StringRef, 4> Fields;
+      Line->split(Fields, ',');
+
+      uint64_t Index, Taken, NotTaken;
+      if (Fields.size() != 4 || Fields[1].getAsInteger(10, Index)
+          || Fields[2].getAsInteger(10, Taken)
+          || Fields[3].getAsInteger(10, NotTaken))
+        continue;
+
+      // Runs can be concatenated in one profile
+      BranchCounts &Counts = get(Fields[0], Index);
+      Counts.taken += Taken;
+      Counts.not_taken += NotTaken;
+    }
+
+    return true;
+  }
+
+  bool BranchProfile::readPredictor(StringRef Path) {
+    auto Buffer = MemoryBuffer::getFile(Path);
+
+    if (!Buffer) {
+      errs() << "Cannot read predictor report: " << Path << "\n";
+      return false;
+    }
+
+    for (line_iterator Line(**Buffer, /*SkipBlanks=*/true); !Line.is_at_end(); ++Line) {
+      SmallVector<StringRef, 7> Fields;
+      Line->split(Fields, ',');
+
+      uint64_t Index, Executions, Mispredicts;
+      double TakenRate;
+      if (Fields.size() != 7 || Fields[1].getAsInteger(10, Index)
+          || Fields[2].getAsInteger(10, Executions)
+          || Fields[3].getAsDouble(TakenRate)
+          || Fields[4].getAsInteger(10, Mispredicts))
+        continue;
+
+      BranchCounts &Counts = get(Fields[0], Index);
+      Counts.mispredicts += Mispredicts;
+      Counts.has_mispredicts = true;
+
+      // The report is enough without count-branch.prof
+      if (Counts.executions() == 0) {
+        Counts.taken = (uint64_t)(TakenRate * Executions + 0.5);
+        Counts.not_taken = Executions - Counts.taken;
+      }
+    }
+
+    return true;
+  }
+
+  const std::vector<BranchCounts> *BranchProfile::lookup(StringRef FuncName) const {
+    auto It = Functions.find(FuncName);
+
+    return It == Functions.end() ? nullptr : &It->second;
+  }
+
+  const BranchCounts *BranchProfile::lookup(StringRef FuncName, uint64_t Index) const {
+    const std::vector<BranchCounts> *Counts = lookup(FuncName);
+
+    if (!Counts || Index >= Counts->size())
+      return nullptr;
+
+    return &(*Counts)[Index];
+  }
+
+  bool BranchProfile::attachBranchWeights(Function &F,
+                                          ArrayRef<BranchInst *> Branches) const {
+    const std::vector<BranchCounts> *Counts = lookup(F.getName());
+    if (!Counts)
+      return false;
+
+    if (Counts->size() != Branches.size())
+      errs() << "Function: " << F.getName()
+             << " does not match the branch profile\n";
+
+    MDBuilder MDB(F.getContext());
+    bool modified = false;
+
+    for (uint64_t i = 0; i < Branches.size() && i < Counts->size(); i++) {
+      uint64_t taken = (*Counts)[i].taken;
+      uint64_t not_taken = (*Counts)[i].not_taken;
+
+      if (taken == 0 && not_taken == 0)
+        continue;
+
+      // Weights are 32 bits
+      while (taken > UINT32_MAX || not_taken > UINT32_MAX) {
+        taken >>= 1;
+        not_taken >>= 1;
+      }
+
+      Branches[i]->setMetadata(LLVMContext::MD_prof,
+                               MDB.createBranchWeights(taken, not_taken));
+      modified = true;
+    }
+
+    return modified;
+  }
+
+} // namespace countbranch
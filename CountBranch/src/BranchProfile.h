@@ -0,0 +1,81 @@
+//===- BranchProfile.h - Branch profiles of the CountBranch runtime -------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// This file declares the reader of the profiles written by libcountbranch.so,
+// shared by the passes that consume them.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef COUNTBRANCH_BRANCHPROFILE_H
+#define COUNTBRANCH_BRANCHPROFILE_H
+
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/Instructions.h"
+
+#include <vector>
+
+namespace countbranch {
+
+  // Get the conditional branches of a function, in a stable order that
+  // identifies them across the instrumentation and the profile use
+  void getConditionalBranches(llvm::Function &F,
+                              llvm::SmallVectorImpl<llvm::BranchInst *> &Branches);
+
+  // Counts of one branch
+  struct BranchCounts {
+    uint64_t taken = 0;
+    uint64_t not_taken = 0;
+    uint64_t mispredicts = 0;
+    bool has_mispredicts = false;
+
+    uint64_t executions() const { return taken + not_taken; }
+
+    // Probability of the most frequent direction
+    double bias() const;
+
+    // Simulated misprediction rate, or the rate of the least frequent
+    // direction when the predictor was not simulated
+    double mispredictRate() const;
+  };
+
+  // Branch profile: counts of each branch of each function
+  class BranchProfile {
+  public:
+    // Read count-branch.prof (FUNCTION NAME,INDEX,TAKEN,NOT TAKEN)
+    bool readCounts(llvm::StringRef Path);
+
+    // Read count-branch-predictor.csv (FUNCTION NAME,INDEX,EXECUTIONS,
+    // TAKEN RATE,MISPREDICTS,MISPREDICT RATE,WASTED CYCLES)
+    bool readPredictor(llvm::StringRef Path);
+
+    // Get the branches of a function or nullptr
+    const std::vector<BranchCounts> *lookup(llvm::StringRef FuncName) const;
+
+    // Get the counts of a branch or nullptr
+    const BranchCounts *lookup(llvm::StringRef FuncName, uint64_t Index) const;
+
+    // Attach branch_weights to the conditional branches of a function, as
+    // returned by getConditionalBranches
+    bool attachBranchWeights(llvm::Function &F,
+                             llvm::ArrayRef<llvm::BranchInst *> Branches) const;
+
+    bool empty() const { return Functions.empty(); }
+
+  private:
+    BranchCounts &get(llvm::StringRef FuncName, uint64_t Index);
+
+    llvm::StringMap<std::vector<BranchCounts>> Functions;
+  };
+
+} // namespace countbranch
+
+#endif // COUNTBRANCH_BRANCHPROFILE_H
@@ -0,0 +1,190 @@
+//===- BranchStats.cpp - Static control-flow statistics -------------------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+
+#include "BranchStats.h"
+
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/IR/CFG.h"
+#include "llvm/IR/Dominators.h"
+#include "llvm/IR/Instructions.h"
+
+using namespace llvm;
+
+namespace countbranch {
+
+  void TerminatorCounts::add(const Instruction &Term) {
+    switch (Term.getOpcode()) {
+    case Instruction::Br:
+      if (cast<BranchInst>(Term).isConditional())
+        cond_br++;
+      else
+        br++;
+      break;
+    case Instruction::Switch:
+      switches++;
+      switch_cases += cast<SwitchInst>(Term).getNumCases();
+      break;
+    case Instruction::IndirectBr: indirect_br++; break;
+    case Instruction::Invoke: invoke++; break;
+    case Instruction::CallBr: callbr++; break;
+    case Instruction::Ret: ret++; break;
+    case Instruction::Resume: resume++; break;
+    case Instruction::Unreachable: unreachable++; break;
+    default: other++; break;
+    }
+  }
+
+  TerminatorCounts &TerminatorCounts::operator+=(const TerminatorCounts &Other) {
+    br += Other.br;
+    cond_br += Other.cond_br;
+    switches += Other.switches;
+    switch_cases += Other.switch_cases;
+    indirect_br += Other.indirect_br;
+    invoke += Other.invoke;
+    callbr += Other.callbr;
+    ret += Other.ret;
+    resume += Other.resume;
+    unreachable += Other.unreachable;
+    other += Other.other;
+
+    return *this;
+  }
+
+  void TerminatorCounts::writeJSON(json::OStream &J) const {
+    J.attributeObject("terminators", [&] {
+      J.attribute("br", br);
+      J.attribute("cond_br", cond_br);
+      J.attribute("switch", switches);
+      J.attribute("switch_cases", switch_cases);
+      J.attribute("indirectbr", indirect_br);
+      J.attribute("invoke", invoke);
+      J.attribute("callbr", callbr);
+      J.attribute("ret", ret);
+      J.attribute("resume", resume);
+      J.attribute("unreachable", unreachable);
+      J.attribute("other", other);
+    });
+  }
+
+  FunctionStats analyzeFunction(Function &F, LoopInfo &LI) {
+    FunctionStats Stats;
+    DenseMap<const BasicBlock *, uint64_t> Index;
+
+    Stats.name = F.getName().str();
+
+    for (BasicBlock &BB : F) {
+      Index[&BB] = Stats.blocks++;
+
+      if (const Instruction *Term = BB.getTerminator())
+        Stats.terminators.add(*Term);
+    }
+
+    for (Loop *L : LI.getLoopsInPreorder()) {
+      LoopStats LS;
+      BasicBlock *Header = L->getHeader();
+
+      // Unnamed headers are identified by their position in the function
+      LS.header = Header->hasName() ? Header->getName().str()
+                                    : "bb" + std::to_string(Index[Header]);
+      LS.depth = L->getLoopDepth();
+      LS.blocks = L->getNumBlocks();
+
+      // One back-edge per edge from the loop to its header
+      for (BasicBlock *Pred : predecessors(Header))
+        if (L->contains(Pred))
+          LS.back_edges++;
+
+      SmallVector<Loop::Edge, 8> Exits;
+      L->getExitEdges(Exits);
+      LS.exit_edges = Exits.size();
+
+      for (BasicBlock *BB : L->blocks())
+        if (const Instruction *Term = BB->getTerminator())
+          LS.terminators.add(*Term);
+
+      Stats.back_edges += LS.back_edges;
+      Stats.loops.push_back(std::move(LS));
+    }
+
+    return Stats;
+  }
+
+  ModuleStats analyzeModule(Module &M) {
+    ModuleStats Stats;
+
+    Stats.name = M.getModuleIdentifier();
+
+    for (Function &F : M) {
+      if (F.isDeclaration())
+        continue;
+
+      DominatorTree DT(F);
+      LoopInfo LI(DT);
+      Stats.functions.push_back(analyzeFunction(F, LI));
+    }
+
+    return Stats;
+  }
+
+  void writeJSON(raw_ostream &OS, ArrayRef<ModuleStats> Modules) {
+    json::OStream J(OS, /*IndentSize=*/2);
+    TerminatorCounts Terminators;
+    uint64_t Functions = 0, Blocks = 0, Loops = 0, BackEdges = 0;
+
+    J.object([&] {
+      J.attributeArray("modules", [&] {
+        for (const ModuleStats &M : Modules) {
+          J.object([&] {
+            J.attribute("name", M.name);
+            J.attributeArray("functions", [&] {
+              for (const FunctionStats &F : M.functions) {
+                J.object([&] {
+                  J.attribute("name", F.name);
+                  J.attribute("blocks", F.blocks);
+                  J.attribute("back_edges", F.back_edges);
+                  F.terminators.writeJSON(J);
+                  J.attributeArray("loops", [&] {
+                    for (const LoopStats &L : F.loops) {
+                      J.object([&] {
+                        J.attribute("header", L.header);
+                        J.attribute("depth", L.depth);
+                        J.attribute("blocks", L.blocks);
+                        J.attribute("back_edges", L.back_edges);
+                        J.attribute("exit_edges", L.exit_edges);
+                        L.terminators.writeJSON(J);
+                      });
+                    }
+                  });
+                });
+
+                Functions++;
+                Blocks += F.blocks;
+                Loops += F.loops.size();
+                BackEdges += F.back_edges;
+                Terminators += F.terminators;
+              }
+            });
+          });
+        }
+      });
+
+      J.attributeObject("totals", [&] {
+        J.attribute("modules", (uint64_t)Modules.size());
+        J.attribute("functions", Functions);
+        J.attribute("blocks", Blocks);
+        J.attribute("loops", Loops);
+        J.attribute("back_edges", BackEdges);
+        Terminators.writeJSON(J);
+      });
+    });
+
+    OS << "\n";
+  }
+
+} // namespace countbranch
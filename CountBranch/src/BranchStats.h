@@ -0,0 +1,85 @@
+//===- BranchStats.h - Static control-flow statistics ---------------------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// This file declares the static control-flow statistics of CountBranch: the
+// terminators of each function and of each loop, the loop back-edges, and
+// their JSON output. They are shared by the pass and count-branch-batch.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef COUNTBRANCH_BRANCHSTATS_H
+#define COUNTBRANCH_BRANCHSTATS_H
+
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/Analysis/LoopInfo.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/Instruction.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Support/JSON.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <string>
+#include <vector>
+
+namespace countbranch {
+
+  // Terminators by kind
+  struct TerminatorCounts {
+    uint64_t br = 0;          // Unconditional branches
+    uint64_t cond_br = 0;     // Conditional branches
+    uint64_t switches = 0;
+    uint64_t switch_cases = 0; // Cases of the switches, default excluded
+    uint64_t indirect_br = 0;
+    uint64_t invoke = 0;
+    uint64_t callbr = 0;
+    uint64_t ret = 0;
+    uint64_t resume = 0;
+    uint64_t unreachable = 0;
+    uint64_t other = 0;       // Exception handling pads
+
+    void add(const llvm::Instruction &Term);
+    TerminatorCounts &operator+=(const TerminatorCounts &Other);
+    void writeJSON(llvm::json::OStream &J) const;
+  };
+
+  // Loop, counts include the inner loops
+  struct LoopStats {
+    std::string header;
+    unsigned depth = 0;
+    uint64_t blocks = 0;
+    uint64_t back_edges = 0;
+    uint64_t exit_edges = 0;
+    TerminatorCounts terminators;
+  };
+
+  struct FunctionStats {
+    std::string name;
+    uint64_t blocks = 0;
+    uint64_t back_edges = 0;
+    TerminatorCounts terminators;
+    std::vector<LoopStats> loops;
+  };
+
+  struct ModuleStats {
+    std::string name;
+    std::vector<FunctionStats> functions;
+  };
+
+  // Classify the terminators of a function and find the back-edges of its
+  // loops
+  FunctionStats analyzeFunction(llvm::Function &F, llvm::LoopInfo &LI);
+
+  // Analyze every function defined in a module
+  ModuleStats analyzeModule(llvm::Module &M);
+
+  // Write the modules and their totals
+  void writeJSON(llvm::raw_ostream &OS, llvm::ArrayRef<ModuleStats> Modules);
+
+} // namespace countbranch
+
+#endif // COUNTBRANCH_BRANCHSTATS_H
@@ -0,0 +1,355 @@
+//===- BranchToSelect.cpp - Profile-driven if-conversion ------------------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// This file implements a pass that converts small if/else diamonds and
+// triangles into selects when the branch profile written by libcountbranch.so
+// says the branch is poorly predictable and TargetTransformInfo says the
+// branchless version is cheaper.
+//
+//===----------------------------------------------------------------------===//
+
+#include "BranchProfile.h"
+
+#include "llvm/Pass.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/Analysis/TargetTransformInfo.h"
+#include "llvm/Analysis/ValueTracking.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/raw_ostream.h"
+
+using namespace llvm;
+using namespace countbranch;
+
+#define DEBUG_TYPE "branch-to-select"
+
+static cl::opt<std::string>
+ProfileFile("branch-to-select-profile",
+            cl::desc("Branch counts written by libcountbranch.so"),
+            cl::value_desc("filename"), cl::init("count-branch.prof"));
+
+static cl::opt<std::string>
+PredictorFile("branch-to-select-predictor",
+              cl::desc("Predictor report written by libcountbranch.so "
+                       "(misprediction rates)"),
+              cl::value_desc("filename"), cl::init(""));
+
+static cl::opt<double>
+MaxBias("branch-to-select-max-bias",
+        cl::desc("Keep the branches whose most frequent direction is taken "
+                 "at least this often"),
+        cl::init(0.9));
+
+static cl::opt<unsigned>
+MaxInstructions("branch-to-select-max-insts",
+                cl::desc("Maximum number of instructions of each side"),
+                cl::init(8));
+
+static cl::opt<unsigned>
+MispredictPenalty("branch-to-select-penalty",
+                  cl::desc("Cycles lost by a misprediction"),
+                  cl::init(15));
+
+namespace {
+  double toDouble(InstructionCost Cost) {
+    auto Value = Cost.getValue();
+    return Value ? (double)*Value : 1e9;
+  }
+
+  // A diamond (Then and Else) or a triangle (only one of them) headed by a
+  // conditional branch
+  struct Candidate {
+    BranchInst *BI = nullptr;
+    BasicBlock *Then = nullptr; // nullptr when the true edge goes to Join
+    BasicBlock *Else = nullptr; // nullptr when the false edge goes to Join
+    BasicBlock *Join = nullptr;
+  };
+
+  // BranchToSelect - The first implementation
+  struct BranchToSelect : public FunctionPass {
+    static char ID; // Pass identification, replacement for typeid
+    static uint64_t count_converted;
+    static uint64_t count_branches;
+
+    BranchProfile profile;
+
+    BranchToSelect() : FunctionPass(ID) {}
+
+    void getAnalysisUsage(AnalysisUsage &AU) const override {
+      AU.addRequired<TargetTransformInfoWrapperPass>();
+    }
+
+    bool doInitialization(Module &M) override {
+      profile.readCounts(ProfileFile);
+
+      if (!PredictorFile.empty())
+        profile.readPredictor(PredictorFile);
+
+      return false;
+    }
+
+    bool runOnFunction(Function &F) override {
+      const TargetTransformInfo &TTI =
+        getAnalysis<TargetTransformInfoWrapperPass>().getTTI(F);
+
+      SmallVector<BranchInst *, 16> Branches;
+      getConditionalBranches(F, Branches);
+
+      // Decide everything first: branch indexes refer to the original IR
+      SmallVector<Candidate, 8> Converted;
+
+      for (uint64_t i = 0; i < Branches.size(); i++) {
+        Candidate C;
+        std::string Reason;
+
+        count_branches++;
+
+        if (decide(TTI, F, i, Branches[i], C, Reason))
+          Converted.push_back(C);
+
+        errs() << "Function: " << F.getName() << " branch " << i << ": "
+               << Reason << "\n";
+      }
+
+      for (Candidate &C : Converted)
+        convert(C);
+
+      count_converted += Converted.size();
+
+      return !Converted.empty();
+    }
+
+    bool doFinalization(Module &M) override {
+      errs() << "Branches converted to select: " << count_converted << " / "
+             << count_branches << '\n';
+      return false;
+    }
+
+    // Side block: single predecessor, unconditional branch to Join, only
+    // speculatable instructions and trailing stores (Stores holds only the
+    // ones of BB, even when it fails)
+    bool isSideBlock(BasicBlock *BB, BasicBlock *Head,
+                     SmallVectorImpl<StoreInst *> &Stores) {
+      Stores.clear();
+
+      if (BB->getSinglePredecessor() != Head || !BB->getSingleSuccessor()
+          || isa<PHINode>(BB->front()) || BB->size() - 1 > MaxInstructions)
+        return false;
+
+      for (Instruction &I : *BB) {
+        if (I.isTerminator())
+          break;
+
+        if (StoreInst *SI = dyn_cast<StoreInst>(&I)) {
+          if (!SI->isSimple())
+            return false;
+          Stores.push_back(SI);
+        }
+        else if (!Stores.empty() || !isSafeToSpeculativelyExecute(&I))
+          return false;
+      }
+
+      return true;
+    }
+
+    // Cost of the instructions of a side block
+    double blockCost(const TargetTransformInfo &TTI, BasicBlock *BB) {
+      double Cost = 0.0;
+
+      if (!BB)
+        return Cost;
+
+      for (Instruction &I : *BB)
+        if (!I.isTerminator() && !isa<StoreInst>(&I))
+          Cost += toDouble(TTI.getInstructionCost(&I, TargetTransformInfo::TCK_Latency));
+
+      return Cost;
+    }
+
+    double selectCost(const TargetTransformInfo &TTI, Type *Ty, Type *CondTy) {
+      return toDouble(TTI.getCmpSelInstrCost(Instruction::Select, Ty, CondTy,
+                                             CmpInst::BAD_ICMP_PREDICATE,
+                                             TargetTransformInfo::TCK_Latency));
+    }
+
+    bool decide(const TargetTransformInfo &TTI, Function &F, uint64_t Index,
+                BranchInst *BI, Candidate &C, std::string &Reason) {
+      raw_string_ostream OS(Reason);
+      const BranchCounts *Counts = profile.lookup(F.getName(), Index);
+
+      if (!Counts || Counts->executions() == 0) {
+        OS << "kept, no profile";
+        return false;
+      }
+
+      double Bias = Counts->bias();
+      double Mispredict = Counts->mispredictRate();
+
+      OS << format("bias %.2f, mispredict rate %.2f, ", Bias, Mispredict);
+
+      if (Bias >= MaxBias) {
+        OS << "kept, biased";
+        return false;
+      }
+
+      // Match a diamond or a triangle
+      BasicBlock *Head = BI->getParent();
+      BasicBlock *True = BI->getSuccessor(0);
+      BasicBlock *False = BI->getSuccessor(1);
+      SmallVector<StoreInst *, 4> ThenStores, ElseStores;
+
+      C.BI = BI;
+
+      if (True != False && isSideBlock(True, Head, ThenStores)
+          && True->getSingleSuccessor() == False) {
+        C.Then = True;
+        C.Join = False;
+      }
+      else if (True != False && isSideBlock(False, Head, ElseStores)
+               && False->getSingleSuccessor() == True) {
+        // Filled by the attempt at the other triangle
+        ThenStores.clear();
+        C.Else = False;
+        C.Join = True;
+      }
+      else if (True != False && isSideBlock(True, Head, ThenStores)
+               && isSideBlock(False, Head, ElseStores)
+               && True->getSingleSuccessor() == False->getSingleSuccessor()) {
+        C.Then = True;
+        C.Else = False;
+        C.Join = True->getSingleSuccessor();
+      }
+      else {
+        OS << "kept, not a small diamond or triangle";
+        return false;
+      }
+
+      // Join is only reached through the candidate
+      if (C.Join == Head || pred_size(C.Join) != 2) {
+        OS << "kept, join block has other predecessors";
+        return false;
+      }
+
+      // Stores become one select and one store per address: both sides must
+      // store to the same addresses in the same order
+      if (!C.Then || !C.Else) {
+        if (!ThenStores.empty() || !ElseStores.empty()) {
+          OS << "kept, store in a triangle";
+          return false;
+        }
+      }
+      else {
+        if (ThenStores.size() != ElseStores.size()) {
+          OS << "kept, stores do not match";
+          return false;
+        }
+
+        for (uint64_t i = 0; i < ThenStores.size(); i++) {
+          if (ThenStores[i]->getPointerOperand() != ElseStores[i]->getPointerOperand()
+              || ThenStores[i]->getValueOperand()->getType()
+                 != ElseStores[i]->getValueOperand()->getType()) {
+            OS << "kept, stores do not match";
+            return false;
+          }
+        }
+      }
+
+      // Branchy version: the executed side, the branch and the expected
+      // mispredictions. Branchless version: both sides and the selects.
+      double ThenCost = blockCost(TTI, C.Then);
+      double ElseCost = blockCost(TTI, C.Else);
+      double TakenRate = (double)Counts->taken / (double)Counts->executions();
+      Type *CondTy = BI->getCondition()->getType();
+
+      double BranchCost =
+        TakenRate * ThenCost + (1.0 - TakenRate) * ElseCost
+        + toDouble(TTI.getInstructionCost(BI, TargetTransformInfo::TCK_Latency))
+        + Mispredict * MispredictPenalty;
+
+      double SelectCost = ThenCost + ElseCost;
+
+      for (PHINode &Phi : C.Join->phis())
+        SelectCost += selectCost(TTI, Phi.getType(), CondTy);
+
+      for (StoreInst *SI : ThenStores)
+        SelectCost += selectCost(TTI, SI->getValueOperand()->getType(), CondTy);
+
+      OS << format("branch cost %.1f, select cost %.1f, ", BranchCost, SelectCost);
+
+      if (SelectCost >= BranchCost) {
+        OS << "kept, not profitable";
+        return false;
+      }
+
+      OS << "converted";
+      return true;
+    }
+
+    void convert(Candidate &C) {
+      BasicBlock *Head = C.BI->getParent();
+      Value *Cond = C.BI->getCondition();
+      IRBuilder<> Builder(C.BI);
+      SmallVector<StoreInst *, 4> ThenStores, ElseStores;
+
+      // Hoist both sides above the branch
+      for (BasicBlock *Side : {C.Then, C.Else}) {
+        if (!Side)
+          continue;
+
+        while (Side->size() > 1) {
+          Instruction *I = &Side->front();
+
+          if (StoreInst *SI = dyn_cast<StoreInst>(I)) {
+            (Side == C.Then ? ThenStores : ElseStores).push_back(SI);
+            SI->removeFromParent();
+          }
+          else
+            I->moveBefore(C.BI);
+        }
+      }
+
+      for (uint64_t i = 0; i < ThenStores.size(); i++) {
+        Value *V = Builder.CreateSelect(Cond, ThenStores[i]->getValueOperand(),
+                                        ElseStores[i]->getValueOperand());
+        StoreInst *SI = Builder.CreateStore(V, ThenStores[i]->getPointerOperand());
+        SI->setAlignment(std::min(ThenStores[i]->getAlign(), ElseStores[i]->getAlign()));
+
+        ThenStores[i]->deleteValue();
+        ElseStores[i]->deleteValue();
+      }
+
+      // Replace the phis of Join
+      BasicBlock *TrueIn = C.Then ? C.Then : Head;
+      BasicBlock *FalseIn = C.Else ? C.Else : Head;
+
+      for (auto It = C.Join->begin(); isa<PHINode>(It);) {
+        PHINode *Phi = cast<PHINode>(&*It++);
+        Value *V = Builder.CreateSelect(Cond, Phi->getIncomingValueForBlock(TrueIn),
+                                        Phi->getIncomingValueForBlock(FalseIn));
+        V->takeName(Phi);
+        Phi->replaceAllUsesWith(V);
+        Phi->eraseFromParent();
+      }
+
+      Builder.CreateBr(C.Join);
+      C.BI->eraseFromParent();
+
+      if (C.Then)
+        C.Then->eraseFromParent();
+      if (C.Else)
+        C.Else->eraseFromParent();
+    }
+  };
+}
+
+char BranchToSelect::ID = 0;
+uint64_t BranchToSelect::count_converted = 0;
+uint64_t BranchToSelect::count_branches = 0;
+static RegisterPass<BranchToSelect> X("branch-to-select", "Branch To Select Pass");
@@ -11,16 +11,64 @@
 //
 //===----------------------------------------------------------------------===//
 
+#include "BranchProfile.h"
+#include "BranchStats.h"
+
 #include "llvm/Pass.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/Analysis/LoopInfo.h"
+#include "llvm/IR/Constants.h"
 #include "llvm/IR/Function.h"
+#include "llvm/IR/IRBuilder.h"
 #include "llvm/IR/Instruction.h"
 #include "llvm/IR/Instructions.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/FileSystem.h"
 #include "llvm/Support/raw_ostream.h"
+#include "llvm/Transforms/Utils/ModuleUtils.h"
+
+#include <vector>
 
 using namespace llvm;
+using namespace countbranch;
 
 #define DEBUG_TYPE "count-branch"
 
+// Dynamic branch profiling
+static cl::opt<bool>
+Instrument("count-branch-instrument",
+           cl::desc("Count the taken and not taken edges of each conditional "
+                    "branch at runtime (link with libcountbranch.so)"),
+           cl::init(false));
+
+static cl::opt<bool>
+Predictor("count-branch-predictor",
+          cl::desc("Send each conditional branch outcome to the predictor "
+                   "simulated by libcountbranch.so (implies "
+                   "-count-branch-instrument)"),
+          cl::init(false));
+
+static cl::opt<std::string>
+ProfileFile("count-branch-profile",
+            cl::desc("Attach branch_weights metadata read from a profile "
+                     "written by an instrumented run"),
+            cl::value_desc("filename"), cl::init(""));
+
+// Static analysis
+static cl::opt<bool>
+Quiet("count-branch-quiet",
+      cl::desc("Do not print the branches and the per function counts"),
+      cl::init(false));
+
+static cl::opt<std::string>
+JSONFile("count-branch-json",
+         cl::desc("Write the terminators, loops and back-edges of each "
+                  "function as JSON (implies -count-branch-quiet, - for "
+                  "stdout)"),
+         cl::value_desc("filename"), cl::init(""));
+
 namespace {
   // CountBranch - The first implementation
   struct CountBranch : public FunctionPass {
@@ -28,9 +76,50 @@ namespace {
     static uint64_t global_counter;
     uint64_t local_counter = 0;
 
+    // Instrumentation: id of the first branch of each function in the module
+    DenseMap<Function *, uint64_t> first_branch;
+    GlobalVariable *branch_base = nullptr;
+    FunctionCallee branch_counters;
+    FunctionCallee branch_outcome;
+
+    // Profile: taken and not taken counts of each branch of each function
+    BranchProfile profile;
+
+    // Static analysis of the module
+    ModuleStats stats;
+
     CountBranch() : FunctionPass(ID) {}
 
+    void getAnalysisUsage(AnalysisUsage &AU) const override {
+      if (!JSONFile.empty())
+        AU.addRequired<LoopInfoWrapperPass>();
+    }
+
+    bool quiet() const { return Quiet || !JSONFile.empty(); }
+
+    bool doInitialization(Module &M) override {
+      bool modified = false;
+
+      if (Instrument || Predictor)
+        modified |= insertModuleConstructor(M);
+
+      if (!ProfileFile.empty())
+        profile.readCounts(ProfileFile);
+
+      stats.name = M.getModuleIdentifier();
+
+      return modified;
+    }
+
     bool runOnFunction(Function &F) override {
+      bool modified = false;
+
+      local_counter = 0;
+
+      if (!JSONFile.empty())
+        stats.functions.push_back(
+          analyzeFunction(F, getAnalysis<LoopInfoWrapperPass>().getLoopInfo()));
+
       // Function
 #ifdef DEBUG
       errs() << "Visiting function: " << F.getName() << "\n";
@@ -51,22 +140,213 @@ namespace {
           // work
           Instruction *I = &II;
           if (BranchInst *BI = dyn_cast<BranchInst>(I)) {
-            errs() << "Encountered a branch instruction " << BB << "\n";
+            if (!quiet())
+              errs() << "Encountered a branch instruction " << BB << "\n";
             ++local_counter;
           }
         }
       }
 
       global_counter += local_counter;
-      errs() << "Function: " << F.getName() << " have " << local_counter << " branch instruction" << "\n";
+      if (!quiet())
+        errs() << "Function: " << F.getName() << " have " << local_counter << " branch instruction" << "\n";
 
-      return false;
+      SmallVector<BranchInst *, 16> Branches;
+      getConditionalBranches(F, Branches);
+
+      if (Predictor && !Branches.empty())
+        modified |= instrumentOutcomes(F, Branches);
+      else if (Instrument && !Branches.empty())
+        modified |= instrumentBranches(F, Branches);
+
+      if (!ProfileFile.empty() && !Branches.empty())
+        modified |= profile.attachBranchWeights(F, Branches);
+
+      return modified;
     }
 
     bool doFinalization(Module &M) override {
-      errs() << "Global Branch Counter: " << global_counter << '\n';
+      if (!quiet())
+        errs() << "Global Branch Counter: " << global_counter << '\n';
+
+      if (!JSONFile.empty()) {
+        std::error_code EC;
+        raw_fd_ostream OS(JSONFile, EC, sys::fs::OF_Text);
+
+        if (EC)
+          errs() << "Cannot write " << JSONFile << ": " << EC.message() << "\n";
+        else
+          writeJSON(OS, stats);
+      }
+
       return false;
     }
+
+    // Register the branches of the module in the runtime at load time
+    bool insertModuleConstructor(Module &M) {
+      auto &CTX = M.getContext();
+      IntegerType *Int64Ty = Type::getInt64Ty(CTX);
+      PointerType *PointerInt8Ty = Type::getInt8PtrTy(CTX);
+      PointerType *PointerInt64Ty = Type::getInt64PtrTy(CTX);
+
+      // Name and index of every conditional branch of the module
+      std::vector<Constant *> names;
+      std::vector<Constant *> indexes;
+
+      for (Function &F : M) {
+        if (F.isDeclaration())
+          continue;
+
+        SmallVector<BranchInst *, 16> Branches;
+        getConditionalBranches(F, Branches);
+
+        if (Branches.empty())
+          continue;
+
+        first_branch[&F] = names.size();
+
+        Constant *name =
+          ConstantExpr::getPointerCast(
+            new GlobalVariable(M, ArrayType::get(Type::getInt8Ty(CTX),
+                                                 F.getName().size() + 1),
+                               /*isConstant=*/true,
+                               GlobalValue::PrivateLinkage,
+                               ConstantDataArray::getString(CTX, F.getName()),
+                               "__count_branch_name"),
+            PointerInt8Ty);
+
+        for (uint64_t i = 0; i < Branches.size(); i++) {
+          names.push_back(name);
+          indexes.push_back(ConstantInt::get(Int64Ty, i));
+        }
+      }
+
+      if (names.empty())
+        return false;
+
+      ArrayType *NamesTy = ArrayType::get(PointerInt8Ty, names.size());
+      ArrayType *IndexesTy = ArrayType::get(Int64Ty, indexes.size());
+
+      GlobalVariable *names_array =
+        new GlobalVariable(M, NamesTy, /*isConstant=*/true,
+                           GlobalValue::PrivateLinkage,
+                           ConstantArray::get(NamesTy, names),
+                           "__count_branch_names");
+
+      GlobalVariable *indexes_array =
+        new GlobalVariable(M, IndexesTy, /*isConstant=*/true,
+                           GlobalValue::PrivateLinkage,
+                           ConstantArray::get(IndexesTy, indexes),
+                           "__count_branch_indexes");
+
+      // Id of the first branch of the module, given by the runtime
+      branch_base =
+        new GlobalVariable(M, Int64Ty, /*isConstant=*/false,
+                           GlobalValue::InternalLinkage,
+                           ConstantInt::get(Int64Ty, 0),
+                           "__count_branch_base");
+
+      /* Get count_branch_register */
+      FunctionCallee branch_register =
+        M.getOrInsertFunction("count_branch_register",
+                              FunctionType::get(/*ReturnType=*/Int64Ty,
+                                                /*ArgType=*/
+                                                {Int64Ty,
+                                                 PointerInt8Ty->getPointerTo(),
+                                                 PointerInt64Ty},
+                                                /*IsVarArgs=*/false));
+
+      /* Get count_branch_counters */
+      branch_counters =
+        M.getOrInsertFunction("count_branch_counters",
+                              FunctionType::get(/*ReturnType=*/PointerInt64Ty,
+                                                /*IsVarArgs=*/false));
+
+      /* Get count_branch_outcome */
+      branch_outcome =
+        M.getOrInsertFunction("count_branch_outcome",
+                              FunctionType::get(/*ReturnType=*/Type::getVoidTy(CTX),
+                                                /*ArgType=*/{Int64Ty, Int64Ty},
+                                                /*IsVarArgs=*/false));
+
+      // Module constructor
+      Function *ctor =
+        Function::Create(FunctionType::get(Type::getVoidTy(CTX), false),
+                         GlobalValue::InternalLinkage,
+                         "__count_branch_module_ctor", M);
+
+      IRBuilder<> Builder(BasicBlock::Create(CTX, "entry", ctor));
+
+      Value *base =
+        Builder.CreateCall(branch_register,
+                           {ConstantInt::get(Int64Ty, names.size()),
+                            Builder.CreateConstInBoundsGEP2_64(NamesTy, names_array, 0, 0),
+                            Builder.CreateConstInBoundsGEP2_64(IndexesTy, indexes_array, 0, 0)});
+      Builder.CreateStore(base, branch_base);
+      Builder.CreateRetVoid();
+
+      appendToGlobalCtors(M, ctor, /*Priority=*/0);
+
+      return true;
+    }
+
+    // counters[2 * id] counts the taken edges, counters[2 * id + 1] the
+    // not taken ones
+    bool instrumentBranches(Function &F, SmallVectorImpl<BranchInst *> &Branches) {
+      auto It = first_branch.find(&F);
+      if (It == first_branch.end())
+        return false;
+
+      IntegerType *Int64Ty = Type::getInt64Ty(F.getContext());
+
+      // Get the counters of the thread once per call
+      IRBuilder<> BuilderEntry(&*F.getEntryBlock().getFirstInsertionPt());
+      Value *counters = BuilderEntry.CreateCall(branch_counters, {}, "counters");
+      Value *base = BuilderEntry.CreateLoad(Int64Ty, branch_base, "branch_base");
+
+      for (uint64_t i = 0; i < Branches.size(); i++) {
+        BranchInst *BI = Branches[i];
+        IRBuilder<> Builder(BI);
+
+        Value *not_taken =
+          Builder.CreateZExt(Builder.CreateNot(BI->getCondition()), Int64Ty);
+        Value *index =
+          Builder.CreateAdd(Builder.CreateAdd(base,
+                                              ConstantInt::get(Int64Ty, 2 * (It->second + i))),
+                            not_taken, "branch_index");
+        Value *counter = Builder.CreateInBoundsGEP(Int64Ty, counters, index);
+        Value *count = Builder.CreateLoad(Int64Ty, counter);
+        Builder.CreateStore(Builder.CreateAdd(count, ConstantInt::get(Int64Ty, 1)),
+                            counter);
+      }
+
+      return true;
+    }
+
+    // Every outcome goes through the runtime, which simulates the predictor
+    // in the order the branches execute
+    bool instrumentOutcomes(Function &F, SmallVectorImpl<BranchInst *> &Branches) {
+      auto It = first_branch.find(&F);
+      if (It == first_branch.end())
+        return false;
+
+      IntegerType *Int64Ty = Type::getInt64Ty(F.getContext());
+
+      IRBuilder<> BuilderEntry(&*F.getEntryBlock().getFirstInsertionPt());
+      Value *base = BuilderEntry.CreateLoad(Int64Ty, branch_base, "branch_base");
+
+      for (uint64_t i = 0; i < Branches.size(); i++) {
+        BranchInst *BI = Branches[i];
+        IRBuilder<> Builder(BI);
+
+        Value *id = Builder.CreateAdd(base, ConstantInt::get(Int64Ty, It->second + i),
+                                      "branch_id");
+        Builder.CreateCall(branch_outcome,
+                           {id, Builder.CreateZExt(BI->getCondition(), Int64Ty)});
+      }
+
+      return true;
+    }
   };
 }
 
@@ -0,0 +1,60 @@
+#include <stdio.h>
+#include <stdint.h>
+
+#define N 1000000
+
+uint64_t biased(uint64_t n)
+{
+  uint64_t count = 0;
+
+  for (uint64_t i = 0; i < n; i++)
+    {
+      if (i % 100 == 0)
+        count += 3;
+      else
+        count++;
+    }
+
+  return count;
+}
+
+uint64_t alternating(uint64_t n)
+{
+  uint64_t count = 0;
+
+  for (uint64_t i = 0; i < n; i++)
+    {
+      if (i & 1)
+        count += 3;
+      else
+        count++;
+    }
+
+  return count;
+}
+
+uint64_t checked(uint64_t n)
+{
+  uint64_t count = 0;
+
+  for (uint64_t i = 0; i < n; i++)
+    {
+      // Never taken: cold path of the layout
+      if (i > n)
+        {
+          fprintf(stderr, "Error: %lu out of bounds\n", i);
+          return 0;
+        }
+
+      count += i & 3;
+    }
+
+  return count;
+}
+
+int main(int argc, char **argv)
+{
+  printf("%lu %lu %lu\n", biased(N), alternating(N), checked(N));
+
+  return 0;
+}
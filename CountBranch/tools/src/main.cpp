@@ -0,0 +1,148 @@
+//===- main.cpp - Static control-flow analysis of many bitcode files ------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// count-branch-batch runs the analysis of -count-branch-json over many .bc
+// files. Each worker thread owns an LLVMContext, parses its files one after
+// the other and keeps only their statistics; the modules are merged in the
+// order of the command line.
+//
+//===----------------------------------------------------------------------===//
+
+#include "BranchStats.h"
+
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IRReader/IRReader.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/LineIterator.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/SourceMgr.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <unistd.h>
+
+using namespace llvm;
+using namespace countbranch;
+
+// Shared state of the workers
+struct Batch {
+  std::vector<std::string> paths;
+  std::vector<ModuleStats> modules; // Same order as paths
+  std::atomic<size_t> next{0};
+  std::atomic<bool> error{false};
+  std::mutex errs_mutex;
+};
+
+static void usage(const char *prog)
+{
+  errs() << "usage: " << prog << " [-j JOBS] [-o OUTPUT] [-l LIST] FILE.bc...\n"
+         << "\n"
+         << "Classify the terminators, loops and back-edges of every function\n"
+         << "of the bitcode files and write them as JSON (stdout by default).\n"
+         << "LIST is a file with one bitcode path per line.\n";
+  exit(1);
+}
+
+static void worker(Batch &B)
+{
+  LLVMContext Ctx;
+
+  for (size_t i = B.next++; i < B.paths.size(); i = B.next++) {
+    SMDiagnostic Err;
+    std::unique_ptr<Module> M = parseIRFile(B.paths[i], Err, Ctx);
+
+    if (!M) {
+      std::lock_guard<std::mutex> Lock(B.errs_mutex);
+      Err.print("count-branch-batch", errs());
+      B.error = true;
+      continue;
+    }
+
+    B.modules[i] = analyzeModule(*M);
+  }
+}
+
+static bool readList(const char *Path, std::vector<std::string> &Paths)
+{
+  auto Buffer = MemoryBuffer::getFile(Path);
+
+  if (!Buffer) {
+    errs() << "Cannot read file list: " << Path << "\n";
+    return false;
+  }
+
+  for (line_iterator Line(**Buffer, /*SkipBlanks=*/true); !Line.is_at_end(); ++Line)
+    Paths.push_back(Line->trim().str());
+
+  return true;
+}
+
+int main(int argc, char **argv)
+{
+  unsigned njobs = std::thread::hardware_concurrency();
+  const char *output = "-";
+  Batch B;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "j:o:l:")) != -1) {
+    switch (opt) {
+    case 'j': njobs = strtoul(optarg, NULL, 10); break;
+    case 'o': output = optarg; break;
+    case 'l':
+      if (!readList(optarg, B.paths))
+        return 1;
+      break;
+    default: usage(argv[0]);
+    }
+  }
+
+  for (int i = optind; i < argc; i++)
+    B.paths.push_back(argv[i]);
+
+  if (B.paths.empty())
+    usage(argv[0]);
+
+  if (njobs == 0)
+    njobs = 1;
+  if (njobs > B.paths.size())
+    njobs = B.paths.size();
+
+  B.modules.resize(B.paths.size());
+
+  std::vector<std::thread> workers;
+  for (unsigned i = 0; i < njobs; i++)
+    workers.emplace_back(worker, std::ref(B));
+
+  for (std::thread &T : workers)
+    T.join();
+
+  // Drop the files that could not be read
+  std::vector<ModuleStats> modules;
+  for (size_t i = 0; i < B.paths.size(); i++)
+    if (!B.modules[i].name.empty())
+      modules.push_back(std::move(B.modules[i]));
+
+  std::error_code EC;
+  raw_fd_ostream OS(output, EC, sys::fs::OF_Text);
+
+  if (EC) {
+    errs() << "Cannot write " << output << ": " << EC.message() << "\n";
+    return 1;
+  }
+
+  writeJSON(OS, modules);
+
+  return B.error ? 1 : 0;
+}
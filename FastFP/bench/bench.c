@@ -0,0 +1,270 @@
+#include <math.h>     // fabs, sin
+#include <stdio.h>    // fprintf, printf, fopen
+#include <stdint.h>   // uint64_t
+#include <stdlib.h>   // aligned_alloc, strtoull
+#include <string.h>   // strcmp, memcpy
+#include <time.h>     // clock_gettime
+
+#include "kernels.h"
+
+#define ALIGN 64
+
+// Problem sizes: about the same time for every kernel
+#define N_VECTOR (1 << 22)
+#define N_GRID 1024
+#define N_STEPS 10
+#define N_MATRIX 256
+#define N_BODIES 2048
+
+// Mode of the reference build: writes the outputs instead of reading them
+#define REFERENCE_MODE "double"
+
+/**
+ * Data of a kernel: inputs are set once, outputs are reset before each run
+ */
+struct bench
+{
+  const char *name;
+  uint64_t n;          // problem size
+  double flops;        // floating-point operations of one run
+  uint64_t n_out;      // number of outputs compared with the reference
+  double *in[2];
+  double *out;
+  double *init;        // initial value of out, or NULL
+};
+
+static double *alloc(uint64_t n)
+{
+  uint64_t size = (sizeof(double) * n + ALIGN - 1) / ALIGN * ALIGN;
+  double *p = aligned_alloc(ALIGN, size);
+
+  if (!p)
+    {
+      fprintf(stderr, "cannot allocate %lu doubles\n", n);
+      exit(1);
+    }
+
+  return p;
+}
+
+// Deterministic inputs in [lo, hi), far from the float limits
+static double *input(uint64_t n, uint64_t seed, double lo, double hi)
+{
+  double *p = alloc(n);
+
+  for (uint64_t i = 0; i < n; i++)
+    p[i] = lo + (hi - lo) * (0.5 + 0.5 * sin(1.0 + i * 0.7548776662 + seed * 0.5698402910));
+
+  return p;
+}
+
+static int setup(struct bench *b, const char *kernel)
+{
+  b->name = kernel;
+  b->init = NULL;
+  b->in[0] = b->in[1] = NULL;
+
+  if (strcmp(kernel, "dot") == 0)
+    {
+      b->n = N_VECTOR;
+      b->flops = 2.0 * b->n;
+      b->n_out = 1;
+      b->in[0] = input(b->n, 0, -1.0, 1.0);
+      b->in[1] = input(b->n, 1, -1.0, 1.0);
+    }
+  else if (strcmp(kernel, "reduc") == 0)
+    {
+      b->n = N_VECTOR;
+      b->flops = b->n;
+      b->n_out = 1;
+      b->in[0] = input(b->n, 0, 0.0, 1.0);
+    }
+  else if (strcmp(kernel, "axpy") == 0)
+    {
+      b->n = N_VECTOR;
+      b->flops = 2.0 * b->n;
+      b->n_out = b->n;
+      b->in[0] = input(b->n, 0, -1.0, 1.0);
+      b->init = input(b->n, 1, -1.0, 1.0);
+    }
+  else if (strcmp(kernel, "stencil2d") == 0)
+    {
+      b->n = N_GRID;
+      b->flops = 4.0 * (b->n - 2) * (b->n - 2) * N_STEPS;
+      b->n_out = b->n * b->n;
+      b->init = input(b->n_out, 0, 0.0, 100.0);
+
+      // Second grid of the sweeps, whose borders stay at their initial value
+      b->in[0] = alloc(b->n_out);
+      memcpy(b->in[0], b->init, sizeof(double) * b->n_out);
+    }
+  else if (strcmp(kernel, "matmul") == 0)
+    {
+      b->n = N_MATRIX;
+      b->flops = 2.0 * b->n * b->n * b->n;
+      b->n_out = b->n * b->n;
+      b->in[0] = input(b->n_out, 0, 0.0, 1.0);
+      b->in[1] = input(b->n_out, 1, 0.0, 1.0);
+    }
+  else if (strcmp(kernel, "nbody") == 0)
+    {
+      b->n = N_BODIES;
+      b->flops = 18.0 * b->n * b->n; // sqrt and division counted as one
+      b->n_out = 3 * b->n;
+      b->in[0] = input(3 * b->n, 0, -10.0, 10.0);
+      b->in[1] = input(b->n, 1, 0.1, 1.0);
+    }
+  else if (strcmp(kernel, "sqrtexp") == 0)
+    {
+      b->n = N_VECTOR;
+      b->flops = 3.0 * b->n; // sqrt and exp counted as one
+      b->n_out = b->n;
+      b->in[0] = input(b->n, 0, 0.0, 10.0);
+    }
+  else
+    return 0;
+
+  b->out = alloc(b->n_out);
+  return 1;
+}
+
+static void run(struct bench *b)
+{
+  const char *k = b->name;
+
+  if (strcmp(k, "dot") == 0)
+    dot(b->n, b->in[0], b->in[1], b->out);
+  else if (strcmp(k, "reduc") == 0)
+    reduc(b->n, b->in[0], b->out);
+  else if (strcmp(k, "axpy") == 0)
+    axpy(b->n, 1.5, b->in[0], b->out);
+  else if (strcmp(k, "stencil2d") == 0)
+    stencil2d(b->n, N_STEPS, b->out, b->in[0]);
+  else if (strcmp(k, "matmul") == 0)
+    matmul(b->n, b->in[0], b->in[1], b->out);
+  else if (strcmp(k, "nbody") == 0)
+    nbody(b->n, b->in[0], b->in[1], b->out);
+  else if (strcmp(k, "sqrtexp") == 0)
+    sqrtexp(b->n, b->in[0], b->out);
+}
+
+static double now(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1.0e-9;
+}
+
+// Maximum and mean relative error of the outputs, absolute error where the
+// reference is zero
+static void compare(struct bench *b, double *ref, double *max, double *mean)
+{
+  double sum = 0.0;
+
+  *max = 0.0;
+  for (uint64_t i = 0; i < b->n_out; i++)
+    {
+      double err = fabs(b->out[i] - ref[i]);
+
+      if (ref[i] != 0.0)
+        err /= fabs(ref[i]);
+
+      if (err > *max || err != err)
+        *max = err;
+
+      sum += err;
+    }
+
+  *mean = sum / b->n_out;
+}
+
+/**
+ * Usage: bench MODE KERNEL REPEAT REFERENCE
+ *
+ * The double build writes the outputs of the kernel to the file REFERENCE,
+ * the builds of the other modes compare theirs with it. Print one CSV line:
+ *
+ *   mode,kernel,size,flops,seconds,gflops,max_rel_err,mean_rel_err
+ *
+ * where seconds is the minimum over REPEAT runs.
+ */
+int main(int argc, char **argv)
+{
+  if (argc != 5)
+    {
+      fprintf(stderr, "usage: %s MODE KERNEL REPEAT REFERENCE\n", argv[0]);
+      return 1;
+    }
+
+  char *mode = argv[1];
+  char *kernel = argv[2];
+  uint64_t repeat = strtoull(argv[3], NULL, 10);
+  char *reference = argv[4];
+  int is_reference = strcmp(mode, REFERENCE_MODE) == 0;
+  struct bench b;
+
+  if (repeat == 0)
+    {
+      fprintf(stderr, "REPEAT must be at least 1\n");
+      return 1;
+    }
+
+  if (!setup(&b, kernel))
+    {
+      fprintf(stderr, "unknown kernel: %s\n", kernel);
+      return 1;
+    }
+
+  double best = 0.0;
+
+  for (uint64_t r = 0; r < repeat; r++)
+    {
+      if (b.init)
+        memcpy(b.out, b.init, sizeof(double) * b.n_out);
+
+      double beg = now();
+      run(&b);
+      double end = now();
+
+      if (r == 0 || end - beg < best)
+        best = end - beg;
+    }
+
+  double max = 0.0, mean = 0.0;
+  FILE *f = fopen(reference, is_reference ? "wb" : "rb");
+
+  if (!f)
+    {
+      fprintf(stderr, "cannot open reference: %s\n", reference);
+      return 1;
+    }
+
+  if (is_reference)
+    fwrite(b.out, sizeof(double), b.n_out, f);
+  else
+    {
+      double *ref = alloc(b.n_out);
+
+      if (fread(ref, sizeof(double), b.n_out, f) != b.n_out)
+        {
+          fprintf(stderr, "truncated reference: %s\n", reference);
+          return 1;
+        }
+
+      compare(&b, ref, &max, &mean);
+      free(ref);
+    }
+
+  fclose(f);
+
+  printf("%s,%s,%lu,%.0f,%.6f,%.3f,%.3e,%.3e\n",
+         mode, kernel, b.n, b.flops, best, b.flops / best * 1.0e-9, max, mean);
+
+  free(b.out);
+  free(b.init);
+  free(b.in[1]);
+  free(b.in[0]);
+
+  return 0;
+}
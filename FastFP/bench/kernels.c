@@ -0,0 +1,92 @@
+#include <math.h>
+
+#include "kernels.h"
+
+#define SOFTENING 1.0e-3
+
+void dot(const uint64_t n, double *restrict x, double *restrict y, double *restrict out)
+{
+  double res = 0.0;
+
+  for (uint64_t i = 0; i < n; i++)
+    res += x[i] * y[i];
+
+  out[0] = res;
+}
+
+void reduc(const uint64_t n, double *restrict x, double *restrict out)
+{
+  double res = 0.0;
+
+  for (uint64_t i = 0; i < n; i++)
+    res += x[i];
+
+  out[0] = res;
+}
+
+void axpy(const uint64_t n, const double a, double *restrict x, double *restrict y)
+{
+  for (uint64_t i = 0; i < n; i++)
+    y[i] = a * x[i] + y[i];
+}
+
+static void sweep(const uint64_t n, double *restrict u, double *restrict v)
+{
+  for (uint64_t i = 1; i < n - 1; i++)
+    for (uint64_t j = 1; j < n - 1; j++)
+      v[i * n + j] = 0.25 * (u[(i - 1) * n + j] + u[(i + 1) * n + j]
+                             + u[i * n + j - 1] + u[i * n + j + 1]);
+}
+
+void stencil2d(const uint64_t n, const uint64_t steps, double *restrict u, double *restrict v)
+{
+  for (uint64_t s = 0; s < steps; s += 2)
+    {
+      sweep(n, u, v);
+      sweep(n, v, u);
+    }
+}
+
+void matmul(const uint64_t n, double *restrict a, double *restrict b, double *restrict c)
+{
+  for (uint64_t i = 0; i < n; i++)
+    {
+      for (uint64_t j = 0; j < n; j++)
+        c[i * n + j] = 0.0;
+
+      for (uint64_t k = 0; k < n; k++)
+        for (uint64_t j = 0; j < n; j++)
+          c[i * n + j] += a[i * n + k] * b[k * n + j];
+    }
+}
+
+void nbody(const uint64_t n, double *restrict pos, double *restrict m, double *restrict acc)
+{
+  for (uint64_t i = 0; i < n; i++)
+    {
+      double ax = 0.0, ay = 0.0, az = 0.0;
+
+      for (uint64_t j = 0; j < n; j++)
+        {
+          double dx = pos[3 * j] - pos[3 * i];
+          double dy = pos[3 * j + 1] - pos[3 * i + 1];
+          double dz = pos[3 * j + 2] - pos[3 * i + 2];
+          double r2 = dx * dx + dy * dy + dz * dz + SOFTENING;
+          double s = m[j] / (r2 * sqrt(r2));
+
+          ax += s * dx;
+          ay += s * dy;
+          az += s * dz;
+        }
+
+      acc[3 * i] = ax;
+      acc[3 * i + 1] = ay;
+      acc[3 * i + 2] = az;
+    }
+}
+
+void sqrtexp(const uint64_t n, double *restrict x, double *restrict y)
+{
+  for (uint64_t i = 0; i < n; i++)
+    y[i] = sqrt(x[i]) * exp(-x[i]);
+}
@@ -0,0 +1,31 @@
+#ifndef FASTFP_BENCH_KERNELS_H
+#define FASTFP_BENCH_KERNELS_H
+
+#include <stdint.h>
+
+// Kernels transformed by FastFP: bench.c, the harness, is always built in
+// double so that the timers, the inputs and the errors are not demoted
+
+// out[0] = x . y
+void dot(const uint64_t n, double *restrict x, double *restrict y, double *restrict out);
+
+// out[0] = sum of x
+void reduc(const uint64_t n, double *restrict x, double *restrict out);
+
+// y = a * x + y
+void axpy(const uint64_t n, const double a, double *restrict x, double *restrict y);
+
+// Jacobi sweeps of a 5-point stencil over an n * n grid, steps must be even
+// so that the result is in u
+void stencil2d(const uint64_t n, const uint64_t steps, double *restrict u, double *restrict v);
+
+// c = a * b, n * n matrices
+void matmul(const uint64_t n, double *restrict a, double *restrict b, double *restrict c);
+
+// Acceleration of n bodies (x, y, z) of mass m
+void nbody(const uint64_t n, double *restrict pos, double *restrict m, double *restrict acc);
+
+// y = sqrt(x) * exp(-x)
+void sqrtexp(const uint64_t n, double *restrict x, double *restrict y);
+
+#endif // FASTFP_BENCH_KERNELS_H
@@ -0,0 +1,43 @@
+#!/bin/sh
+#
+# FastFP kernel benchmark
+#
+# Run every kernel with the double build, which writes the reference outputs,
+# then with the build of each FastFP mode, and print one CSV line per
+# (mode, kernel):
+#
+#   mode,kernel,size,flops,seconds,gflops,speedup,max_rel_err,mean_rel_err
+#
+#   seconds     : minimum over REPEAT runs of the kernel
+#   speedup     : seconds of the double build / seconds
+#   max_rel_err : maximum relative error of the outputs against the double
+#                 build (absolute error where the reference is zero)
+#   mean_rel_err: mean of the same errors
+
+MODES=${MODES:-"fast-fp"}
+KERNELS=${KERNELS:-"dot reduc axpy stencil2d matmul nbody sqrtexp"}
+REPEAT=${REPEAT:-5}
+
+# report LINE BASE_SECONDS - insert the speedup after gflops
+report()
+{
+  echo $1 | awk -F, -v base=$2 '{
+    printf "%s,%s,%s,%s,%s,%s,%.3f,%s,%s\n",
+           $1, $2, $3, $4, $5, $6, base / $5, $7, $8
+  }'
+}
+
+echo "mode,kernel,size,flops,seconds,gflops,speedup,max_rel_err,mean_rel_err"
+
+for kernel in $KERNELS; do
+  ref=reference-$kernel.bin
+
+  line=$(./bench double $kernel $REPEAT $ref) || exit 1
+  base=$(echo $line | cut -d, -f5)
+  report $line $base
+
+  for mode in $MODES; do
+    line=$(./bench_$mode $mode $kernel $REPEAT $ref) || exit 1
+    report $line $base
+  done
+done
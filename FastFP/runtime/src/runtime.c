@@ -0,0 +1,333 @@
+#include <stdio.h>    // fprintf
+#include <stdlib.h>   // getenv, calloc, qsort
+#include <stdint.h>   // uint64_t
+#include <math.h>     // fabs, ilogb, isfinite, isnan
+#include <pthread.h>  // pthread_mutex_lock
+#include <sys/mman.h> // mmap, munmap
+
+#include "runtime.h"
+
+//
+runtime_t __rt = { PTHREAD_MUTEX_INITIALIZER, 0, 0, { { 0 } }, NULL,
+                   DEFAULT_CANCELLATION_BITS };
+
+// Statistics of the current thread
+static __thread thread_t *__thread_info = NULL;
+
+// Used when a thread cannot get its own statistics
+static shadow_stats_t __dummy_stats[OP_LIMIT];
+
+/**
+ * Store the error of a function in the summary
+ */
+typedef struct cost_s
+{
+  const char *func_name;
+  uint64_t nops;
+  uint64_t executions;
+  double max_error;
+  uint64_t cancellations;
+} cost_t;
+
+static void *map(uint64_t size)
+{
+  // Pages are only touched by the operations that run
+  void *ptr = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+  return ptr == MAP_FAILED ? NULL : ptr;
+}
+
+void libfastfp_initialize()
+{
+  const char *bits = getenv("FASTFP_CANCELLATION_BITS");
+
+  if (bits)
+    __rt.cancellation_bits = strtoull(bits, NULL, 10);
+}
+
+uint64_t fastfp_shadow_register(uint64_t nops, const char **func_names,
+                                const uint64_t *indexes, const char **opcodes)
+{
+  uint64_t base;
+
+  pthread_mutex_lock(&__rt.mutex);
+
+  if (__rt.nmodules >= MODULE_LIMIT || __rt.nops + nops > OP_LIMIT)
+    {
+      fprintf(stderr, "fastfp: too many operations, increase OP_LIMIT\n");
+      pthread_mutex_unlock(&__rt.mutex);
+
+      // Out of range, the operations of the module are not recorded
+      return OP_LIMIT;
+    }
+
+  base = __rt.nops;
+  __rt.modules[__rt.nmodules].base = base;
+  __rt.modules[__rt.nmodules].nops = nops;
+  __rt.modules[__rt.nmodules].func_names = func_names;
+  __rt.modules[__rt.nmodules].indexes = indexes;
+  __rt.modules[__rt.nmodules].opcodes = opcodes;
+  __rt.nmodules++;
+  __rt.nops += nops;
+
+  pthread_mutex_unlock(&__rt.mutex);
+
+  return base;
+}
+
+static shadow_stats_t *get_stats(void)
+{
+  if (__thread_info)
+    return __thread_info->stats;
+
+  thread_t *thread = calloc(1, sizeof(thread_t));
+
+  if (!thread)
+    return __dummy_stats;
+
+  thread->stats = map(sizeof(shadow_stats_t) * OP_LIMIT);
+
+  if (!thread->stats)
+    {
+      free(thread);
+      return __dummy_stats;
+    }
+
+  // Statistics outlive their thread, they are merged by the destructor
+  pthread_mutex_lock(&__rt.mutex);
+  thread->next = __rt.threads;
+  __rt.threads = thread;
+  pthread_mutex_unlock(&__rt.mutex);
+
+  __thread_info = thread;
+  return thread->stats;
+}
+
+static double relative_error(double value, float shadow)
+{
+  double error;
+
+  if (!isfinite(value))
+    return value == (double)shadow || (isnan(value) && isnan(shadow)) ? 0.0 : 1.0;
+
+  if (value == 0.0)
+    error = shadow == 0.0f ? 0.0 : 1.0;
+  else
+    error = fabs(((double)shadow - value) / value);
+
+  // Overflow of the shadow or NaN
+  return error < 1.0 ? error : 1.0;
+}
+
+static shadow_stats_t *record(uint64_t id, double value, float shadow)
+{
+  // Operation of a module that does not fit
+  if (id >= OP_LIMIT)
+    return NULL;
+
+  shadow_stats_t *s = get_stats() + id;
+  double error = relative_error(value, shadow);
+
+  s->executions++;
+  s->sum_error += error;
+
+  if (error > s->max_error)
+    s->max_error = error;
+
+  return s;
+}
+
+void fastfp_shadow_record(uint64_t id, double value, float shadow)
+{
+  record(id, value, shadow);
+}
+
+void fastfp_shadow_record_add(uint64_t id, double a, double b, double value,
+                              float shadow)
+{
+  shadow_stats_t *s = record(id, value, shadow);
+
+  if (!s || a == 0.0 || b == 0.0 || !isfinite(a) || !isfinite(b))
+    return;
+
+  // Leading bits of the largest operand lost in the result
+  int ea = ilogb(a);
+  int eb = ilogb(b);
+  int emax = ea > eb ? ea : eb;
+  uint64_t bits = value == 0.0 ? 53 : (emax > ilogb(value) ? emax - ilogb(value) : 0);
+
+  if (bits > 53)
+    bits = 53;
+
+  if (bits >= __rt.cancellation_bits)
+    s->cancellations++;
+
+  if (bits > s->max_cancelled_bits)
+    s->max_cancelled_bits = bits;
+}
+
+void libfastfp_finalize()
+{
+  if (!__rt.threads)
+    return;
+
+  shadow_stats_t *stats = calloc(__rt.nops + 1, sizeof(shadow_stats_t));
+
+  if (!stats)
+    return;
+
+  thread_t *thread = __rt.threads;
+
+  while (thread)
+    {
+      thread_t *next = thread->next;
+
+      for (uint64_t i = 0; i < __rt.nops; i++)
+        {
+          shadow_stats_t *s = thread->stats + i;
+
+          stats[i].executions += s->executions;
+          stats[i].sum_error += s->sum_error;
+          stats[i].cancellations += s->cancellations;
+
+          if (s->max_error > stats[i].max_error)
+            stats[i].max_error = s->max_error;
+          if (s->max_cancelled_bits > stats[i].max_cancelled_bits)
+            stats[i].max_cancelled_bits = s->max_cancelled_bits;
+        }
+
+      munmap(thread->stats, sizeof(shadow_stats_t) * OP_LIMIT);
+      free(thread);
+      thread = next;
+    }
+
+  __rt.threads = NULL;
+
+  write_shadow_profile(stats);
+  write_shadow_summary(stats);
+
+  free(stats);
+}
+
+void write_shadow_profile(const shadow_stats_t *stats)
+{
+  //
+  const char *name = getenv("FASTFP_SHADOW_PROFILE");
+  FILE *file = fopen(name ? name : DEFAULT_PROFILE, "w");
+
+  if (!file)
+    exit(13);
+
+  //
+  fprintf(file,
+          "FUNCTION NAME,INDEX,OPCODE,EXECUTIONS,MEAN ERROR,MAX ERROR,"
+          "CANCELLATIONS,MAX CANCELLED BITS\n");
+
+  //
+  for (uint64_t m = 0; m < __rt.nmodules; m++)
+    {
+      module_t *mod = __rt.modules + m;
+
+      for (uint64_t i = 0; i < mod->nops; i++)
+        {
+          const shadow_stats_t *s = stats + mod->base + i;
+
+          fprintf(file, "%s,%ld,%s,%ld,%.3le,%.3le,%ld,%ld\n",
+                  mod->func_names[i],
+                  mod->indexes[i],
+                  mod->opcodes[i],
+                  s->executions,
+                  s->executions ? s->sum_error / s->executions : 0.0,
+                  s->max_error,
+                  s->cancellations,
+                  s->max_cancelled_bits);
+        }
+    }
+
+  //
+  fflush(file);
+  fclose(file);
+}
+
+static int compare_max_error(const void *a, const void *b)
+{
+  const cost_t *ca = a;
+  const cost_t *cb = b;
+
+  return (ca->max_error < cb->max_error) - (ca->max_error > cb->max_error);
+}
+
+void write_shadow_summary(const shadow_stats_t *stats)
+{
+  cost_t *costs = calloc(__rt.nops + 1, sizeof(cost_t));
+  uint64_t n = 0;
+
+  if (!costs)
+    return;
+
+  for (uint64_t m = 0; m < __rt.nmodules; m++)
+    {
+      module_t *mod = __rt.modules + m;
+
+      for (uint64_t i = 0; i < mod->nops; i++)
+        {
+          const shadow_stats_t *s = stats + mod->base + i;
+          cost_t *c;
+
+          // The operations of a function are contiguous and share its name
+          if (n > 0 && costs[n - 1].func_name == mod->func_names[i])
+            c = costs + n - 1;
+          else
+            {
+              c = costs + n;
+              c->func_name = mod->func_names[i];
+              n++;
+            }
+
+          c->nops++;
+          c->executions += s->executions;
+          c->cancellations += s->cancellations;
+
+          if (s->max_error > c->max_error)
+            c->max_error = s->max_error;
+        }
+    }
+
+  qsort(costs, n, sizeof(cost_t), compare_max_error);
+
+  //
+  fflush(stdout);
+
+  //
+  fprintf(stdout,
+          "=========================== FASTFP SHADOW SUMMARY ============================\n"
+          "\n"
+          "%28s: %ld\n"
+          "\n"
+          "%10s  %16s  %12s  %16s  %s"
+          "\n",
+          "cancellation bits", __rt.cancellation_bits,
+          "OPERATIONS",
+          "EXECUTIONS",
+          "MAX ERROR",
+          "CANCELLATIONS",
+          "FUNCTION NAME");
+
+  //
+  for (uint64_t i = 0; i < n; i++)
+    {
+      fprintf(stdout, "%10ld  %16ld  %12.3le  %16ld  %s\n",
+              costs[i].nops,
+              costs[i].executions,
+              costs[i].max_error,
+              costs[i].cancellations,
+              costs[i].func_name);
+    }
+
+  //
+  fprintf(stdout, "\n");
+  fflush(stdout);
+
+  free(costs);
+}
@@ -0,0 +1,127 @@
+#ifndef _RUNTIME_H_
+#define _RUNTIME_H_
+
+//
+#include <stdint.h>  // uint64_t
+#include <pthread.h> // pthread_mutex_t
+
+//
+#define OP_LIMIT (1 << 18)
+#define MODULE_LIMIT 1024
+#define DEFAULT_PROFILE "fastfp-shadow.csv"
+#define DEFAULT_CANCELLATION_BITS 12
+
+/**
+ * Store the operations of an instrumented module
+ */
+typedef struct module_s
+{
+  uint64_t base;
+  uint64_t nops;
+  const char **func_names;
+  const uint64_t *indexes;
+  const char **opcodes;
+} module_t;
+
+/**
+ * Store the error of the float shadow of one operation: the relative error is
+ * capped to 1, an overflow or a wrong sign counts as 1
+ */
+typedef struct shadow_stats_s
+{
+  uint64_t executions;
+  double sum_error;
+  double max_error;
+  uint64_t cancellations;
+  uint64_t max_cancelled_bits;
+} shadow_stats_t;
+
+/**
+ * Store the statistics of one thread
+ */
+typedef struct thread_s
+{
+  shadow_stats_t *stats;
+  struct thread_s *next;
+} thread_t;
+
+/**
+ * Store the runtime information
+ */
+typedef struct runtime_s
+{
+  pthread_mutex_t mutex;
+  uint64_t nops;
+  uint64_t nmodules;
+  module_t modules[MODULE_LIMIT];
+  thread_t *threads;
+  uint64_t cancellation_bits;
+} runtime_t;
+
+extern runtime_t __rt;
+
+/**
+ * Library constructor - read FASTFP_CANCELLATION_BITS (bits lost by an
+ * addition to count it as a cancellation)
+ */
+void libfastfp_initialize() __attribute__((constructor));
+
+/**
+ * Library destructor - merge the statistics of every thread, write the
+ * profile and the summary
+ */
+void libfastfp_finalize() __attribute__((destructor));
+
+/**
+ * fastfp_shadow_register - Register the operations of a module (called by the
+ *                          module constructor inserted by the pass)
+ * @param nops      : number of double arithmetic operations of the module
+ * @param func_names: function of each operation
+ * @param indexes   : index of each operation in its function
+ * @param opcodes   : opcode or intrinsic of each operation
+ * @return the id of the first operation of the module, OP_LIMIT (ignored by
+ *         the record functions) when the module does not fit
+ */
+uint64_t fastfp_shadow_register(uint64_t nops, const char **func_names,
+                                const uint64_t *indexes, const char **opcodes);
+
+/**
+ * fastfp_shadow_record - Record the error of a float shadow
+ * @param id    : operation id
+ * @param value : double result
+ * @param shadow: float result
+ * @return
+ */
+void fastfp_shadow_record(uint64_t id, double value, float shadow);
+
+/**
+ * fastfp_shadow_record_add - Record the error of the float shadow of an
+ *                            addition or a subtraction, and the bits its
+ *                            double version cancels
+ * @param id    : operation id
+ * @param a     : first double operand
+ * @param b     : second double operand
+ * @param value : double result
+ * @param shadow: float result
+ * @return
+ */
+void fastfp_shadow_record_add(uint64_t id, double a, double b, double value,
+                              float shadow);
+
+/**
+ * write_shadow_profile - Write the merged statistics in the profile file
+ *                        (FASTFP_SHADOW_PROFILE or fastfp-shadow.csv)
+ * @param stats: merged statistics
+ * @return
+ */
+void write_shadow_profile(const shadow_stats_t *stats);
+
+/**
+ * write_shadow_summary - Write per-function errors in stdout, ranked by
+ *                        maximum relative error
+ * @param stats: merged statistics
+ * @return
+ */
+void write_shadow_summary(const shadow_stats_t *stats);
+
+#endif // _RUNTIME_H_
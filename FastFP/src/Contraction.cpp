@@ -0,0 +1,184 @@
+//===- Contraction.cpp - Fuse multiplications and additions ---------------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// This file implements a pass that fuses a floating-point multiplication and
+// the addition or subtraction using it into one llvm.fmuladd or llvm.fma,
+// like -ffp-contract=fast, but only where both operations allow contraction
+// (contract) or in the functions the policy names. The multiplication can be
+// in another block than the addition, as after inlining, but must have no
+// other use. The number of fused operations goes to stderr for every loop.
+//
+//===----------------------------------------------------------------------===//
+
+#include "llvm/Pass.h"
+#include "llvm/ADT/MapVector.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/Analysis/LoopInfo.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/InstIterator.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/Intrinsics.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <string>
+
+using namespace llvm;
+
+#define DEBUG_TYPE "fast-fp-contract"
+
+static cl::list<std::string>
+Functions("fast-fp-contract-functions",
+          cl::desc("Functions where every multiplication may be fused with "
+                   "the addition using it, with or without contract (* for "
+                   "all the functions)"),
+          cl::CommaSeparated);
+
+enum FusedIntrinsic { FMulAdd, FMA };
+
+static cl::opt<FusedIntrinsic>
+FusedWith("fast-fp-contract-intrinsic",
+          cl::desc("Intrinsic of the fused operations"),
+          cl::values(clEnumValN(FMulAdd, "fmuladd",
+                                "llvm.fmuladd, fused where the target has FMA (default)"),
+                     clEnumValN(FMA, "fma",
+                                "llvm.fma, always fused")),
+          cl::init(FMulAdd));
+
+namespace {
+  struct Contraction : public FunctionPass {
+    static char ID; // Pass identification, replacement for typeid
+    static uint64_t count_fused;
+    static uint64_t count_shared;
+
+    Contraction() : FunctionPass(ID) {}
+
+    void getAnalysisUsage(AnalysisUsage &AU) const override {
+      AU.setPreservesCFG();
+      AU.addRequired<LoopInfoWrapperPass>();
+    }
+
+    static bool allowed(Instruction *I, bool Policy) {
+      return Policy || I->hasAllowContract();
+    }
+
+    // Multiplication an operand of Add is, if it can be fused into it
+    static BinaryOperator *getFusable(Value *Op, Instruction *Add, bool Policy,
+                                      bool &Shared) {
+      BinaryOperator *Mul = dyn_cast<BinaryOperator>(Op);
+      if (!Mul || Mul->getOpcode() != Instruction::FMul
+          || !allowed(Mul, Policy) || !allowed(Add, Policy))
+        return nullptr;
+
+      // Fusing would compute the product twice, rounded and unrounded
+      if (!Mul->hasOneUse()) {
+        Shared = true;
+        return nullptr;
+      }
+
+      return Mul;
+    }
+
+    // a * b + c, c + a * b: fma(a, b, c); a * b - c: fma(a, b, -c);
+    // c - a * b: fma(-a, b, c)
+    static Value *fuse(BinaryOperator *Add, bool Policy, bool &Shared) {
+      bool Sub = Add->getOpcode() == Instruction::FSub;
+      BinaryOperator *Mul = getFusable(Add->getOperand(0), Add, Policy, Shared);
+      Value *C = Add->getOperand(1);
+      bool NegateProduct = false;
+
+      if (!Mul) {
+        Mul = getFusable(Add->getOperand(1), Add, Policy, Shared);
+        C = Add->getOperand(0);
+        NegateProduct = Sub;
+        if (!Mul)
+          return nullptr;
+      }
+
+      IRBuilder<> Builder(Add);
+      FastMathFlags FMF = Add->getFastMathFlags();
+      FMF &= Mul->getFastMathFlags();
+      Builder.setFastMathFlags(FMF);
+
+      Value *A = Mul->getOperand(0);
+      if (NegateProduct)
+        A = Builder.CreateFNeg(A);
+      else if (Sub)
+        C = Builder.CreateFNeg(C);
+
+      Intrinsic::ID ID = FusedWith == FMA ? Intrinsic::fma : Intrinsic::fmuladd;
+      CallInst *Fused = Builder.CreateIntrinsic(ID, {Add->getType()},
+                                                {A, Mul->getOperand(1), C});
+      Fused->setFastMathFlags(FMF);
+      Fused->takeName(Add);
+      Add->replaceAllUsesWith(Fused);
+      Add->eraseFromParent();
+      Mul->eraseFromParent();
+      return Fused;
+    }
+
+    bool runOnFunction(Function &F) override {
+      LoopInfo &LI = getAnalysis<LoopInfoWrapperPass>().getLoopInfo();
+      bool Policy = is_contained(Functions, "*") || is_contained(Functions, F.getName());
+      SmallVector<BinaryOperator *, 32> Adds;
+
+      for (Instruction &I : instructions(F))
+        if ((I.getOpcode() == Instruction::FAdd || I.getOpcode() == Instruction::FSub)
+            && allowed(&I, Policy))
+          Adds.push_back(cast<BinaryOperator>(&I));
+
+      // Fused operations by innermost loop, nullptr out of the loops
+      MapVector<Loop *, unsigned> Fused;
+      unsigned Total = 0, Shared = 0;
+
+      for (BinaryOperator *Add : Adds) {
+        BasicBlock *BB = Add->getParent();
+        bool HasShared = false;
+
+        if (!fuse(Add, Policy, HasShared)) {
+          Shared += HasShared;
+          continue;
+        }
+
+        Fused[LI.getLoopFor(BB)]++;
+        Total++;
+      }
+
+      if (!Total && !Shared)
+        return false;
+
+      errs() << "Function: " << F.getName() << ": " << Total << " fused, "
+             << Shared << " additions of products with other uses kept\n";
+
+      for (auto &Entry : Fused)
+        if (Entry.first)
+          errs() << "  Loop " << Entry.first->getHeader()->getName()
+                 << " (depth " << Entry.first->getLoopDepth() << "): "
+                 << Entry.second << " fused\n";
+        else
+          errs() << "  Out of the loops: " << Entry.second << " fused\n";
+
+      count_fused += Total;
+      count_shared += Shared;
+      return Total > 0;
+    }
+
+    bool doFinalization(Module &M) override {
+      errs() << "Fused multiply-adds: " << count_fused
+             << ", additions of products with other uses kept: " << count_shared << '\n';
+      return false;
+    }
+  };
+}
+
+char Contraction::ID = 0;
+uint64_t Contraction::count_fused = 0;
+uint64_t Contraction::count_shared = 0;
+static RegisterPass<Contraction> X("fast-fp-contract",
+                                   "Fuse multiplications and additions into fma");
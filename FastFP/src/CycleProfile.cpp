@@ -0,0 +1,72 @@
+//===- CycleProfile.cpp - Cycle profiles of the InsertRDTSC runtime -------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+
+#include "CycleProfile.h"
+
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/Support/LineIterator.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/raw_ostream.h"
+
+using namespace llvm;
+
+namespace fastfp {
+
+  bool CycleProfile::read(StringRef Path) {
+    auto Buffer = MemoryBuffer::getFile(Path);
+
+    if (!Buffer) {
+      errs() << "Cannot read cycle profile: " << Path << "\n";
+      return false;
+    }
+
+    line_iterator Line(**Buffer, /*SkipBlanks=*/true);
+    if (Line.is_at_end())
+      return false;
+
+    bool Indexed = Line->startswith("INDEX,");
+
+    for (++Line; !Line.is_at_end(); ++Line) {
+      SmallVector<StringRef, 8> Fields;
+      Line->split(Fields, ',');
+
+      if (Indexed) {
+        uint64_t Calls;
+        double Sum;
+        if (Fields.size() != 8 || Fields[2].getAsInteger(10, Calls)
+            || Fields[4].getAsDouble(Sum))
+          continue;
+
+        Entry &E = Functions[Fields[1]];
+        E.calls += Calls;
+        E.cycles += Sum;
+      }
+      else {
+        uint64_t Cycles;
+        if (Fields.size() != 6 || Fields[4].getAsInteger(10, Cycles))
+          continue;
+
+        Entry &E = Functions[Fields[5]];
+        E.calls++;
+        E.cycles += Cycles;
+      }
+    }
+
+    return true;
+  }
+
+  double CycleProfile::mean(StringRef FuncName) const {
+    auto It = Functions.find(FuncName);
+
+    if (It == Functions.end() || It->second.calls == 0)
+      return 0.0;
+
+    return It->second.cycles / It->second.calls;
+  }
+
+} // namespace fastfp
@@ -0,0 +1,45 @@
+//===- CycleProfile.h - Cycle profiles of the InsertRDTSC runtime ---------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// This file declares the reader of the cycles per function written by
+// libinsertrdtsc.so (raw output) or rdtsc-prof merge (indexed profile), used
+// to measure the speedup of the demoted functions.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef FASTFP_CYCLEPROFILE_H
+#define FASTFP_CYCLEPROFILE_H
+
+#include "llvm/ADT/StringMap.h"
+#include "llvm/ADT/StringRef.h"
+
+namespace fastfp {
+
+  class CycleProfile {
+  public:
+    // Read PID,TID,CORE ID START,CORE ID END,CYCLES,FUNCTION NAME or
+    // INDEX,FUNCTION NAME,CALLS,RUNS,CYCLES SUM,...
+    bool read(llvm::StringRef Path);
+
+    // Mean cycles per call of a function, 0 when it is not profiled
+    double mean(llvm::StringRef FuncName) const;
+
+    bool empty() const { return Functions.empty(); }
+
+  private:
+    struct Entry {
+      uint64_t calls = 0;
+      double cycles = 0.0;
+    };
+
+    llvm::StringMap<Entry> Functions;
+  };
+
+} // namespace fastfp
+
+#endif // FASTFP_CYCLEPROFILE_H
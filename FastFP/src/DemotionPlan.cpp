@@ -0,0 +1,52 @@
+//===- DemotionPlan.cpp - Demotion plans of fastfp-search -----------------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+
+#include "DemotionPlan.h"
+
+#include "llvm/Support/LineIterator.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/raw_ostream.h"
+
+using namespace llvm;
+
+namespace fastfp {
+
+  bool DemotionPlan::read(StringRef Path) {
+    auto Buffer = MemoryBuffer::getFile(Path);
+
+    if (!Buffer) {
+      errs() << "Cannot read demotion plan: " << Path << "\n";
+      return false;
+    }
+
+    // Skip the header, comments start with #
+    line_iterator Line(**Buffer, /*SkipBlanks=*/true, /*CommentMarker=*/'#');
+    if (Line.is_at_end())
+      return true;
+
+    for (++Line; !Line.is_at_end(); ++Line) {
+      StringRef Name, Index;
+      uint64_t I;
+
+      std::tie(Name, Index) = Line->rsplit(',');
+      if (Name.empty() || Index.trim().getAsInteger(10, I))
+        continue;
+
+      Functions[Name].insert(I);
+    }
+
+    return true;
+  }
+
+  bool DemotionPlan::contains(StringRef FuncName, uint64_t Index) const {
+    auto It = Functions.find(FuncName);
+
+    return It != Functions.end() && It->second.count(Index);
+  }
+
+} // namespace fastfp
@@ -0,0 +1,40 @@
+//===- DemotionPlan.h - Demotion plans of fastfp-search -------------------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// This file declares the reader of the demotion plans written by
+// fastfp-search: the double arithmetic operations, identified by their
+// function and their index in it, that FastFP may demote to float.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef FASTFP_DEMOTIONPLAN_H
+#define FASTFP_DEMOTIONPLAN_H
+
+#include "llvm/ADT/DenseSet.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/ADT/StringRef.h"
+
+namespace fastfp {
+
+  class DemotionPlan {
+  public:
+    // Read FUNCTION NAME,INDEX
+    bool read(llvm::StringRef Path);
+
+    // The operation Index of FuncName may be demoted
+    bool contains(llvm::StringRef FuncName, uint64_t Index) const;
+
+    bool empty() const { return Functions.empty(); }
+
+  private:
+    llvm::StringMap<llvm::DenseSet<uint64_t>> Functions;
+  };
+
+} // namespace fastfp
+
+#endif // FASTFP_DEMOTIONPLAN_H
@@ -0,0 +1,545 @@
+//===- FPRange.cpp - Ranges of floating-point values ----------------------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+
+#include "FPRange.h"
+
+#include "llvm/ADT/PostOrderIterator.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/Analysis/ValueTracking.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/GlobalVariable.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/IntrinsicInst.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <vector>
+
+using namespace llvm;
+
+namespace fastfp {
+
+  // Rounding to nearest is monotonic: the bounds of an operation are the
+  // operation on the bounds. One ulp more covers contracted operations.
+  static double down(double X) {
+    return X == 0.0 || std::isinf(X) ? X : std::nextafter(X, -INFINITY);
+  }
+
+  static double up(double X) {
+    return X == 0.0 || std::isinf(X) ? X : std::nextafter(X, INFINITY);
+  }
+
+  // inf - inf in a bound is the infinity of the bound
+  static double bound(double X, double IfNaN) {
+    return std::isnan(X) ? IfNaN : X;
+  }
+
+  FPRange FPRange::finite() {
+    FPRange R;
+    R.Lo = -DBL_MAX;
+    R.Hi = DBL_MAX;
+    R.MayNaN = false;
+    return R;
+  }
+
+  FPRange FPRange::constant(double C) {
+    FPRange R;
+
+    if (std::isnan(C)) {
+      R.Lo = R.Hi = 0.0;
+      R.Empty = true;
+      R.MayNaN = true;
+      return R;
+    }
+
+    R.Lo = R.Hi = C;
+    R.MayNaN = false;
+    return R;
+  }
+
+  FPRange FPRange::join(const FPRange &Other) const {
+    if (Empty && Other.Empty) {
+      FPRange R = empty();
+      R.MayNaN = MayNaN || Other.MayNaN;
+      return R;
+    }
+
+    FPRange R = Empty ? Other : *this;
+
+    if (!Empty && !Other.Empty) {
+      R.Lo = std::min(Lo, Other.Lo);
+      R.Hi = std::max(Hi, Other.Hi);
+    }
+
+    R.MayNaN = MayNaN || Other.MayNaN;
+    return R;
+  }
+
+  bool FPRange::operator==(const FPRange &Other) const {
+    if (Empty || Other.Empty)
+      return Empty == Other.Empty && MayNaN == Other.MayNaN;
+
+    return Lo == Other.Lo && Hi == Other.Hi && MayNaN == Other.MayNaN;
+  }
+
+  static FPRange add(const FPRange &A, const FPRange &B, bool Sub) {
+    FPRange R;
+
+    if (A.Empty || B.Empty) {
+      R = FPRange::empty();
+      R.MayNaN = A.MayNaN || B.MayNaN;
+      return R;
+    }
+
+    double BLo = Sub ? -B.Hi : B.Lo;
+    double BHi = Sub ? -B.Lo : B.Hi;
+
+    R.Lo = down(bound(A.Lo + BLo, -INFINITY));
+    R.Hi = up(bound(A.Hi + BHi, INFINITY));
+
+    // inf - inf
+    R.MayNaN = A.MayNaN || B.MayNaN || (A.Hi == INFINITY && BLo == -INFINITY)
+      || (A.Lo == -INFINITY && BHi == INFINITY);
+    return R;
+  }
+
+  static FPRange mul(const FPRange &A, const FPRange &B) {
+    FPRange R;
+
+    if (A.Empty || B.Empty) {
+      R = FPRange::empty();
+      R.MayNaN = A.MayNaN || B.MayNaN;
+      return R;
+    }
+
+    // 0 * inf is NaN, the other products bound the result
+    double P[4] = { A.Lo * B.Lo, A.Lo * B.Hi, A.Hi * B.Lo, A.Hi * B.Hi };
+    R.Lo = INFINITY;
+    R.Hi = -INFINITY;
+
+    for (double X : P) {
+      X = bound(X, 0.0);
+      R.Lo = std::min(R.Lo, X);
+      R.Hi = std::max(R.Hi, X);
+    }
+
+    R.Lo = down(R.Lo);
+    R.Hi = up(R.Hi);
+    R.MayNaN = A.MayNaN || B.MayNaN || (A.mayBeZero() && B.mayBeInf())
+      || (A.mayBeInf() && B.mayBeZero());
+    return R;
+  }
+
+  static FPRange div(const FPRange &A, const FPRange &B) {
+    FPRange R;
+
+    if (A.Empty || B.Empty) {
+      R = FPRange::empty();
+      R.MayNaN = A.MayNaN || B.MayNaN;
+      return R;
+    }
+
+    // 0 / 0 and inf / inf
+    R.MayNaN = A.MayNaN || B.MayNaN || (A.mayBeZero() && B.mayBeZero())
+      || (A.mayBeInf() && B.mayBeInf());
+
+    if (B.mayBeZero() || (A.mayBeInf() && B.mayBeInf()))
+      return R;
+
+    double Q[4] = { A.Lo / B.Lo, A.Lo / B.Hi, A.Hi / B.Lo, A.Hi / B.Hi };
+    R.Lo = INFINITY;
+    R.Hi = -INFINITY;
+
+    for (double X : Q) {
+      R.Lo = std::min(R.Lo, X);
+      R.Hi = std::max(R.Hi, X);
+    }
+
+    R.Lo = down(R.Lo);
+    R.Hi = up(R.Hi);
+    return R;
+  }
+
+  static FPRange neg(const FPRange &A) {
+    FPRange R = A;
+
+    if (!A.Empty) {
+      R.Lo = -A.Hi;
+      R.Hi = -A.Lo;
+    }
+
+    return R;
+  }
+
+  static FPRange abs(const FPRange &A) {
+    if (A.Empty || A.Lo >= 0.0)
+      return A;
+
+    if (A.Hi <= 0.0)
+      return neg(A);
+
+    FPRange R = A;
+    R.Lo = 0.0;
+    R.Hi = std::max(-A.Lo, A.Hi);
+    return R;
+  }
+
+  FPRangeAnalysis::FPRangeAnalysis(Function &F, ScalarEvolution &SE, bool AssumeFinite)
+    : F(F), SE(SE), AssumeFinite(AssumeFinite) {
+    solve();
+  }
+
+  FPRange FPRangeAnalysis::outside() {
+    return AssumeFinite ? FPRange::finite() : FPRange::unknown();
+  }
+
+  FPRange FPRangeAnalysis::get(Value *V) {
+    if (ConstantFP *C = dyn_cast<ConstantFP>(V)) {
+      APFloat Value = C->getValueAPF();
+      bool LosesInfo;
+
+      Value.convert(APFloat::IEEEdouble(), APFloat::rmNearestTiesToEven, &LosesInfo);
+      return FPRange::constant(Value.convertToDouble());
+    }
+
+    if (isa<Argument>(V))
+      return outside();
+
+    auto It = Ranges.find(V);
+    if (It != Ranges.end())
+      return It->second;
+
+    // Unreachable code, undef, vectors
+    return FPRange::unknown();
+  }
+
+  FPRange FPRangeAnalysis::fromInteger(Value *V, bool Signed) {
+    FPRange R;
+
+    if (!SE.isSCEVable(V->getType()))
+      return R;
+
+    ConstantRange CR = Signed ? SE.getSignedRange(SE.getSCEV(V))
+                              : SE.getUnsignedRange(SE.getSCEV(V));
+
+    R.Lo = Signed ? CR.getSignedMin().roundToDouble(true)
+                  : CR.getUnsignedMin().roundToDouble(false);
+    R.Hi = Signed ? CR.getSignedMax().roundToDouble(true)
+                  : CR.getUnsignedMax().roundToDouble(false);
+    R.MayNaN = false;
+    return R;
+  }
+
+  // Range of the doubles in a constant initializer
+  static FPRange fromInitializer(Constant *C) {
+    if (ConstantFP *CFP = dyn_cast<ConstantFP>(C)) {
+      APFloat Value = CFP->getValueAPF();
+      bool LosesInfo;
+
+      Value.convert(APFloat::IEEEdouble(), APFloat::rmNearestTiesToEven, &LosesInfo);
+      return FPRange::constant(Value.convertToDouble());
+    }
+
+    if (isa<ConstantAggregateZero>(C))
+      return FPRange::constant(0.0);
+
+    if (ConstantDataSequential *CDS = dyn_cast<ConstantDataSequential>(C)) {
+      if (!CDS->getElementType()->isFloatingPointTy())
+        return FPRange::unknown();
+
+      FPRange R = FPRange::empty();
+      for (unsigned i = 0; i < CDS->getNumElements(); i++)
+        R = R.join(fromInitializer(CDS->getElementAsConstant(i)));
+      return R;
+    }
+
+    if (isa<ConstantArray>(C) || isa<ConstantStruct>(C)) {
+      FPRange R = FPRange::empty();
+      for (Use &Op : C->operands())
+        R = R.join(fromInitializer(cast<Constant>(Op)));
+      return R;
+    }
+
+    // Integers and pointers of a structure do not matter, undef does
+    if (C->getType()->isIntegerTy() || C->getType()->isPointerTy())
+      return FPRange::empty();
+
+    return FPRange::unknown();
+  }
+
+  FPRange FPRangeAnalysis::fromMemory(Value *Ptr) {
+    const Value *Obj = getUnderlyingObject(Ptr);
+
+    if (const GlobalVariable *GV = dyn_cast<GlobalVariable>(Obj))
+      if (GV->isConstant() && GV->hasDefinitiveInitializer()) {
+        FPRange R = fromInitializer(const_cast<Constant *>(GV->getInitializer()));
+        return R.Empty && !R.MayNaN ? outside() : R;
+      }
+
+    auto It = Memory.find(Obj);
+    if (It != Memory.end())
+      return It->second;
+
+    return outside();
+  }
+
+  // Local storage only loaded and stored with floating-point values of one
+  // type: the range of its loads is the range of its stores (a double read
+  // through a float pointer has no relation to the stored ranges)
+  static bool isPrivate(AllocaInst *AI, SmallVectorImpl<StoreInst *> &Stores) {
+    SmallVector<Instruction *, 8> Worklist{AI};
+    Type *AccessTy = nullptr;
+
+    auto sameType = [&AccessTy](Type *Ty) {
+      if (!Ty->isFloatingPointTy() || (AccessTy && Ty != AccessTy))
+        return false;
+      AccessTy = Ty;
+      return true;
+    };
+
+    while (!Worklist.empty()) {
+      Instruction *P = Worklist.pop_back_val();
+
+      for (User *U : P->users()) {
+        Instruction *I = cast<Instruction>(U);
+
+        if (isa<BitCastInst>(I) || isa<GetElementPtrInst>(I))
+          Worklist.push_back(I);
+        else if (LoadInst *LI = dyn_cast<LoadInst>(I)) {
+          if (!sameType(LI->getType()))
+            return false;
+        }
+        else if (StoreInst *SI = dyn_cast<StoreInst>(I)) {
+          if (SI->getValueOperand() == P || !sameType(SI->getValueOperand()->getType()))
+            return false;
+          Stores.push_back(SI);
+        }
+        else if (!I->isLifetimeStartOrEnd())
+          return false;
+      }
+    }
+
+    return true;
+  }
+
+  FPRange FPRangeAnalysis::compute(Instruction *I) {
+    FPRange R;
+
+    switch (I->getOpcode()) {
+    case Instruction::FAdd:
+      return add(get(I->getOperand(0)), get(I->getOperand(1)), false);
+    case Instruction::FSub:
+      return add(get(I->getOperand(0)), get(I->getOperand(1)), true);
+    case Instruction::FMul:
+      return mul(get(I->getOperand(0)), get(I->getOperand(1)));
+    case Instruction::FDiv:
+      return div(get(I->getOperand(0)), get(I->getOperand(1)));
+    case Instruction::FRem: {
+      FPRange A = get(I->getOperand(0));
+      FPRange B = abs(get(I->getOperand(1)));
+
+      if (A.Empty || B.Empty)
+        return A.join(B);
+
+      R.Hi = B.Hi;
+      R.Lo = A.Lo >= 0.0 ? 0.0 : -B.Hi;
+      R.MayNaN = A.MayNaN || B.MayNaN || A.mayBeInf() || B.mayBeZero();
+      return R;
+    }
+    case Instruction::FNeg:
+      return neg(get(I->getOperand(0)));
+    case Instruction::SIToFP:
+      return fromInteger(I->getOperand(0), true);
+    case Instruction::UIToFP:
+      return fromInteger(I->getOperand(0), false);
+    case Instruction::FPExt:
+      return get(I->getOperand(0));
+    case Instruction::FPTrunc: {
+      R = get(I->getOperand(0));
+      if (!R.Empty) {
+        R.Lo = (float)R.Lo;
+        R.Hi = (float)R.Hi;
+      }
+      return R;
+    }
+    case Instruction::PHI: {
+      R = FPRange::empty();
+      for (Value *V : cast<PHINode>(I)->incoming_values())
+        R = R.join(get(V));
+      return R;
+    }
+    case Instruction::Select:
+      return get(I->getOperand(1)).join(get(I->getOperand(2)));
+    case Instruction::Load:
+      return fromMemory(cast<LoadInst>(I)->getPointerOperand());
+    default:
+      break;
+    }
+
+    IntrinsicInst *II = dyn_cast<IntrinsicInst>(I);
+    if (!II)
+      return isa<CallBase>(I) ? outside() : R;
+
+    switch (II->getIntrinsicID()) {
+    case Intrinsic::fabs:
+      return abs(get(II->getArgOperand(0)));
+    case Intrinsic::sqrt: {
+      FPRange A = get(II->getArgOperand(0));
+
+      if (A.Empty)
+        return A;
+
+      R.MayNaN = A.MayNaN || A.Lo < 0.0;
+      R.Lo = A.Lo > 0.0 ? down(std::sqrt(A.Lo)) : 0.0;
+      R.Hi = A.Hi > 0.0 ? up(std::sqrt(A.Hi)) : 0.0;
+      return R;
+    }
+    case Intrinsic::fma:
+    case Intrinsic::fmuladd:
+      return add(mul(get(II->getArgOperand(0)), get(II->getArgOperand(1))),
+                 get(II->getArgOperand(2)), false);
+    case Intrinsic::minnum:
+    case Intrinsic::maxnum: {
+      FPRange A = get(II->getArgOperand(0));
+      FPRange B = get(II->getArgOperand(1));
+
+      // With a NaN operand the result is the other operand
+      if (A.MayNaN || B.MayNaN || A.Empty || B.Empty) {
+        R = A.join(B);
+        R.MayNaN = A.MayNaN && B.MayNaN;
+        return R;
+      }
+
+      bool Min = II->getIntrinsicID() == Intrinsic::minnum;
+      R.Lo = Min ? std::min(A.Lo, B.Lo) : std::max(A.Lo, B.Lo);
+      R.Hi = Min ? std::min(A.Hi, B.Hi) : std::max(A.Hi, B.Hi);
+      R.MayNaN = false;
+      return R;
+    }
+    case Intrinsic::copysign: {
+      FPRange A = abs(get(II->getArgOperand(0)));
+      FPRange B = get(II->getArgOperand(1));
+
+      if (A.Empty || B.Empty)
+        return A.join(B);
+
+      R = A;
+      if (B.Hi < 0.0)
+        R = neg(A);
+      else if (B.mayBeZero() || B.Lo < 0.0)
+        R.Lo = -A.Hi;
+      return R;
+    }
+    case Intrinsic::floor:
+    case Intrinsic::ceil:
+    case Intrinsic::trunc:
+    case Intrinsic::round:
+    case Intrinsic::rint:
+    case Intrinsic::nearbyint: {
+      R = get(II->getArgOperand(0));
+      if (!R.Empty) {
+        R.Lo = std::floor(R.Lo);
+        R.Hi = std::ceil(R.Hi);
+      }
+      return R;
+    }
+    default:
+      return R;
+    }
+  }
+
+  // Float overflows to infinity
+  static FPRange clampToType(Type *Ty, FPRange R) {
+    if (!Ty->isFloatTy() || R.Empty)
+      return R;
+
+    if (R.Hi > FLT_MAX)
+      R.Hi = INFINITY;
+    if (R.Lo < -FLT_MAX)
+      R.Lo = -INFINITY;
+    return R;
+  }
+
+  // Bounds still moving go to infinity
+  static FPRange widen(const FPRange &Old, FPRange R) {
+    if (Old.Empty || R.Empty)
+      return R;
+
+    if (R.Lo < Old.Lo)
+      R.Lo = -INFINITY;
+    if (R.Hi > Old.Hi)
+      R.Hi = INFINITY;
+    return R;
+  }
+
+  void FPRangeAnalysis::solve() {
+    const unsigned WidenAfter = 3;
+    const unsigned MaxIterations = 32;
+    std::vector<Instruction *> Order;
+    std::vector<std::pair<AllocaInst *, SmallVector<StoreInst *, 4>>> Locals;
+
+    ReversePostOrderTraversal<Function *> RPOT(&F);
+    for (BasicBlock *BB : RPOT)
+      for (Instruction &I : *BB) {
+        if (I.getType()->isFloatingPointTy()) {
+          Order.push_back(&I);
+          Ranges[&I] = FPRange::empty();
+        }
+
+        if (AllocaInst *AI = dyn_cast<AllocaInst>(&I)) {
+          SmallVector<StoreInst *, 4> Stores;
+          if (isPrivate(AI, Stores)) {
+            Locals.push_back({AI, Stores});
+            Memory[AI] = FPRange::empty();
+          }
+        }
+      }
+
+    for (unsigned Iteration = 0; Iteration < MaxIterations; Iteration++) {
+      bool Changed = false;
+
+      for (auto &L : Locals) {
+        FPRange R = FPRange::empty();
+        for (StoreInst *SI : L.second)
+          R = R.join(get(SI->getValueOperand()));
+
+        FPRange &Old = Memory[L.first];
+        if (Iteration >= WidenAfter)
+          R = widen(Old, R);
+
+        if (R != Old) {
+          Old = R;
+          Changed = true;
+        }
+      }
+
+      for (Instruction *I : Order) {
+        FPRange R = clampToType(I->getType(), compute(I));
+        FPRange &Old = Ranges[I];
+
+        if (Iteration >= WidenAfter)
+          R = widen(Old, R);
+
+        if (R != Old) {
+          Old = R;
+          Changed = true;
+        }
+      }
+
+      if (!Changed)
+        return;
+    }
+
+    // Not stable: nothing is known
+    for (Instruction *I : Order)
+      Ranges[I] = FPRange::unknown();
+    for (auto &L : Locals)
+      Memory[L.first] = FPRange::unknown();
+  }
+
+} // namespace fastfp
@@ -0,0 +1,74 @@
+//===- FPRange.h - Ranges of floating-point values ------------------------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// This file declares an interval analysis of the floating-point values of a
+// function: the range of every value and whether it can be NaN. Integers
+// converted to floating point take their range from ScalarEvolution, loads
+// take the range of what is stored in their memory when it does not escape.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef FASTFP_FPRANGE_H
+#define FASTFP_FPRANGE_H
+
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/DenseSet.h"
+#include "llvm/Analysis/ScalarEvolution.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/Value.h"
+
+#include <cmath>
+
+namespace fastfp {
+
+  // [Lo, Hi], infinities included when they are the bounds
+  struct FPRange {
+    double Lo = -INFINITY;
+    double Hi = INFINITY;
+    bool MayNaN = true;
+    bool Empty = false; // Not computed yet
+
+    static FPRange unknown() { return FPRange(); }
+    static FPRange empty() { FPRange R; R.Empty = true; R.MayNaN = false; return R; }
+    static FPRange finite();
+    static FPRange constant(double C);
+
+    bool mayBeInf() const { return !Empty && (Lo == -INFINITY || Hi == INFINITY); }
+    bool mayBeZero() const { return !Empty && Lo <= 0.0 && Hi >= 0.0; }
+    bool isFinite() const { return !MayNaN && !mayBeInf(); }
+
+    FPRange join(const FPRange &Other) const;
+    bool operator==(const FPRange &Other) const;
+    bool operator!=(const FPRange &Other) const { return !(*this == Other); }
+  };
+
+  class FPRangeAnalysis {
+  public:
+    // AssumeFinite: the arguments, calls and loads of unknown memory are
+    // neither NaN nor infinite
+    FPRangeAnalysis(llvm::Function &F, llvm::ScalarEvolution &SE, bool AssumeFinite);
+
+    FPRange get(llvm::Value *V);
+
+  private:
+    llvm::Function &F;
+    llvm::ScalarEvolution &SE;
+    bool AssumeFinite;
+    llvm::DenseMap<llvm::Value *, FPRange> Ranges;
+    llvm::DenseMap<const llvm::Value *, FPRange> Memory;
+
+    void solve();
+    FPRange compute(llvm::Instruction *I);
+    FPRange fromInteger(llvm::Value *V, bool Signed);
+    FPRange fromMemory(llvm::Value *Ptr);
+    FPRange outside();
+  };
+
+} // namespace fastfp
+
+#endif // FASTFP_FPRANGE_H
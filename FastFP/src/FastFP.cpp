@@ -1,4 +1,4 @@
-//===- FastFP.cpp - Example code from "Writing an LLVM Pass" --------------===//
+//===- FastFP.cpp - Demotion of double precision code to float ------------===//
 //
 // Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
 // See https://llvm.org/LICENSE.txt for license information.
@@ -6,141 +6,546 @@
 //
 //===----------------------------------------------------------------------===//
 //
-// This file implements two versions of the LLVM "Hello World" pass described
-// in docs/WritingAnLLVMPass.html
+// This file implements the fast-fp pass, which retypes connected webs of
+// double values (or, with -fast-fp-loops, whole loop nests) to float. The
+// demotion can be restricted by a cost model, measured profiles, a precision
+// policy or a plan, and its sum reductions can keep a compensated or double
+// accumulator. The pass can also instrument the double operations with a
+// float shadow instead, to measure the error of the demotion.
 //
 //===----------------------------------------------------------------------===//
 
+#include "CycleProfile.h"
+#include "DemotionPlan.h"
+#include "LoopDemotion.h"
+#include "PrecisionPolicy.h"
+#include "PrecisionWeb.h"
+#include "Profitability.h"
+#include "Reduction.h"
+#include "ShadowValue.h"
+#include "VectorMath.h"
+
 #include "llvm/Pass.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/SmallPtrSet.h"
+#include "llvm/Analysis/LoopInfo.h"
+#include "llvm/Analysis/OptimizationRemarkEmitter.h"
+#include "llvm/Analysis/ScalarEvolution.h"
+#include "llvm/Analysis/TargetTransformInfo.h"
+#include "llvm/IR/Dominators.h"
 #include "llvm/IR/Function.h"
 #include "llvm/IR/Instructions.h"
-#include "llvm/Transforms/Utils/BasicBlockUtils.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/FormatVariadic.h"
 #include "llvm/Support/raw_ostream.h"
+#include "llvm/Transforms/Utils.h"
+#include "llvm/Transforms/Utils/LoopUtils.h"
+
+#include <algorithm>
+#include <memory>
+#include <utility>
+#include <vector>
 
 using namespace llvm;
+using namespace fastfp;
 
 #define DEBUG_TYPE "fast-fp"
 
+static cl::opt<bool>
+Loops("fast-fp-loops",
+      cl::desc("Demote the loop nests only, with their streamed arrays, and "
+               "report the vector cost of their innermost loops"),
+      cl::init(false));
+
+static cl::opt<bool>
+UseCostModel("fast-fp-cost-model",
+             cl::desc("Demote only the webs and loop nests whose "
+                      "TargetTransformInfo cost in float, conversions "
+                      "included, is lower than in double"),
+             cl::init(false));
+
+static cl::opt<std::string>
+BaseProfile("fast-fp-profile-base",
+            cl::desc("Cycles per function of the double version (InsertRDTSC "
+                     "output or rdtsc-prof profile)"),
+            cl::value_desc("filename"), cl::init(""));
+
+static cl::opt<std::string>
+DemotedProfile("fast-fp-profile-demoted",
+               cl::desc("Cycles per function of the demoted version"),
+               cl::value_desc("filename"), cl::init(""));
+
+static cl::opt<ReductionMode>
+Accumulation("fast-fp-reductions",
+             cl::desc("Accumulator of the sum reductions demoted to float"),
+             cl::values(clEnumValN(ReductionFloat, "float", "Float sum"),
+                        clEnumValN(ReductionKahan, "kahan",
+                                   "Float sum compensated with Kahan summation, "
+                                   "not vectorized"),
+                        clEnumValN(ReductionDouble, "double",
+                                   "Float addends accumulated in double")),
+             cl::init(ReductionFloat));
+
+static cl::opt<VectorLibrary>
+VectorLib("fast-fp-vector-library",
+          cl::desc("Vector math library of the float math calls created by "
+                   "the demotion, for the loop vectorizer"),
+          cl::values(clEnumValN(NoVectorLibrary, "none", "No vector variants"),
+                     clEnumValN(Libmvec, "libmvec",
+                                "glibc libmvec, x86-64 (link with -lmvec)")),
+          cl::init(NoVectorLibrary));
+
+// Precision analysis
+static cl::opt<bool>
+Shadow("fast-fp-shadow",
+       cl::desc("Run a float shadow of every double arithmetic operation and "
+                "record its relative error at runtime, without demoting "
+                "(link with libfastfp.so)"),
+       cl::init(false));
+
+static cl::opt<std::string>
+CandidatesFile("fast-fp-candidates",
+               cl::desc("Write the webs that can be demoted with the index of "
+                        "their operations, without demoting"),
+               cl::value_desc("filename"), cl::init(""));
+
+static cl::opt<std::string>
+PlanFile("fast-fp-plan",
+         cl::desc("Demote only the webs whose operations are all listed in a "
+                  "plan written by fastfp-search"),
+         cl::value_desc("filename"), cl::init(""));
+
 namespace {
   // FastFP - The first implementation
   struct FastFP : public FunctionPass {
     static char ID; // Pass identification, replacement for typeid
+    static uint64_t count_values;
+    static uint64_t count_conversions;
+
+    // Measured speedups
+    CycleProfile base_profile;
+    CycleProfile demoted_profile;
+
+    // Shadow mode: ids of the operations of the module
+    ShadowRuntime shadow_runtime;
+
+    // Operations the demotion is restricted to
+    DemotionPlan plan;
+    PrecisionPolicy policy;
+    std::unique_ptr<raw_fd_ostream> candidates;
 
     FastFP() : FunctionPass(ID) {}
 
+    void getAnalysisUsage(AnalysisUsage &AU) const override {
+      // Reductions are only recognized in loops with a preheader, by the
+      // demotion of the reductions and the vector cost of the loops
+      if (Loops || UseCostModel || Accumulation != ReductionFloat)
+        AU.addRequiredID(LoopSimplifyID);
+
+      if (Loops)
+        AU.addRequired<DominatorTreeWrapperPass>();
+
+      if (Loops || UseCostModel) {
+        AU.addRequired<LoopInfoWrapperPass>();
+        AU.addRequired<ScalarEvolutionWrapperPass>();
+        AU.addRequired<TargetTransformInfoWrapperPass>();
+      }
+    }
+
+    bool doInitialization(Module &M) override {
+      if (!BaseProfile.empty() && !DemotedProfile.empty()) {
+        base_profile.read(BaseProfile);
+        demoted_profile.read(DemotedProfile);
+      }
+
+      if (Shadow)
+        return insertShadowRuntime(M, shadow_runtime);
+
+      if ((!PlanFile.empty() && !plan.read(PlanFile)) || !policy.read(M))
+        exit(13);
+
+      if (!CandidatesFile.empty()) {
+        std::error_code EC;
+        candidates = std::make_unique<raw_fd_ostream>(CandidatesFile, EC, sys::fs::OF_Text);
+
+        if (EC) {
+          errs() << "Cannot write candidates: " << CandidatesFile << "\n";
+          exit(13);
+        }
+
+        *candidates << "FUNCTION NAME,WEB,INDEX\n";
+      }
+
+      return false;
+    }
+
     bool runOnFunction(Function &F) override {
-      // Basic block
-      for (BasicBlock &BB : F) {
-        // Instruction
-        for (Instruction &II : BB) {
-          // Work - Replace all double precision to simple precision
-          Instruction *I = &II;
-
-          if (AllocaInst *AI = dyn_cast<AllocaInst>(I)) {
-            if (AI->getAllocatedType()->getTypeID() == Type::DoubleTyID) {
-              errs() << "Encountered a double precision allocation\n";
-
-              //auto *old_target = AI;
-              //LLVMContext &context = F.getContext();
-              //Type *type = Type::getFloatTy(context);
-              //old_target->mutateType(old_target->getType()->getWithNewBitWidth(32));
-
-              //auto *old_target = AI;
-              //Value *d = old_target->getOperand(0);
-              //errs() << d->getParent()->getGlobalValueSummary();
-              //LLVMContext &context = F.getContext();
-              //Type *type = Type::getFloatTy(context);
-              //Value *f = UndefValue::get(type);
-              //d->replaceAllUsesWith(f);
-
-              //auto *old_target = AI;
-              //
-              ////get the type of long double and construct new AllocaInst
-              //LLVMContext &context = F.getContext();
-              //Type *type = Type::getFloatTy(context);
-              //AllocaInst *new_target = new AllocaInst(type, 0, "newfloat", old_target);
-              //
-              ////new_target->takeName(old_target);
-              ////transform(old_target, new_target, type);
-              ////old_target->eraseFromParent();
-              //
-              ////auto *nf = new AllocaInst(Type::getFloatTy(F.getContext()), 0, "new float");
-              ////BasicBlock::iterator ii(AI);
-              ////ReplaceInstWithInst(old_target->getParent()->getInstList(), ii, new_target);
-
-              //errs() << BB;
-              //errs() << old_target->getOperand(0)->getValueID();
-            }
-          }
-          else if (BinaryOperator *BO = dyn_cast<BinaryOperator>(I)) {
-            if (BO->getOperand(0)->getType()->getTypeID() == Type::DoubleTyID) {
-              //
-              errs() << "Encountered a double precision binary operator\n";
-
-              // Get instruction
-              auto *old_target = BO;
-
-              // Get operands
-              Value *a = old_target->getOperand(0);
-              Value *b = old_target->getOperand(1);
-
-              // Cast operands to float
-              CastInst *float_a =
-                new FPTruncInst(a, Type::getFloatTy(F.getContext()), "d2f_a", old_target);
-              CastInst *float_b =
-                new FPTruncInst(b, Type::getFloatTy(F.getContext()), "d2f_b", old_target);
-
-              // Make operation on cast operands
-              BinaryOperator *op =
-                BinaryOperator::Create(old_target->getOpcode(), float_a,
-                                       float_b, "op_a_b", old_target);
-
-              // Get lvalue of this op
-              Value *c = llvm::cast<Value>(op);
-
-              // Cast this lvalue to double
-              CastInst *double_c =
-                new FPExtInst(c, Type::getDoubleTy(F.getContext()), "f2d_c", old_target);
-
-              // Get lvalue of old target instruction and replace it by my result
-              Value *d = llvm::cast<Value>(old_target);
-              d->replaceAllUsesWith(double_c);
-
-              //
-              //old_target->eraseFromParent();
-            }
+      // Operations in instruction order, numbered before any rewriting
+      SmallVector<Instruction *, 32> Ops;
+      getDoubleArithmetic(F, Ops);
+
+      if (Shadow)
+        return !Ops.empty() && instrumentShadow(F, Ops, shadow_runtime);
+
+      // Found before the demotion, rewritten after
+      SmallPtrSet<BasicBlock *, 4> Reductions;
+      if (Accumulation != ReductionFloat && !candidates)
+        findDoubleReductions(F, Reductions);
+
+      if (Loops)
+        return runOnLoops(F, Reductions);
+
+      DenseMap<Instruction *, uint64_t> Index;
+      for (uint64_t i = 0; i < Ops.size(); i++)
+        Index[Ops[i]] = i;
+
+      // Work - Replace all double precision to simple precision, one web of
+      // connected values at a time
+      std::vector<Web> Webs;
+      findWebs(F, [](Instruction *) { return true; }, Webs);
+
+      if (candidates) {
+        writeCandidates(F, Webs, Index);
+        return false;
+      }
+
+      OptimizationRemarkEmitter ORE(&F);
+      std::unique_ptr<CostModel> Model;
+
+      // Loops of the precision policy
+      std::unique_ptr<DominatorTree> PolicyDT;
+      std::unique_ptr<LoopInfo> PolicyLI;
+
+      if (!policy.empty()) {
+        PolicyDT = std::make_unique<DominatorTree>(F);
+        PolicyLI = std::make_unique<LoopInfo>(*PolicyDT);
+      }
+
+      if (UseCostModel)
+        Model = std::make_unique<CostModel>(
+          F, getAnalysis<TargetTransformInfoWrapperPass>().getTTI(F),
+          getAnalysis<LoopInfoWrapperPass>().getLoopInfo(),
+          getAnalysis<ScalarEvolutionWrapperPass>().getSE(), VectorLib != NoVectorLibrary);
+
+      RetypeStats Total;
+      unsigned Retyped = 0;
+
+      for (Web &W : Webs) {
+        Instruction *At = getWebLocation(W);
+        unsigned Size = W.Members.size();
+
+        if (!W.Valid) {
+          errs() << "Function: " << F.getName() << " web of "
+                 << W.Members.size() << " values kept: " << W.Reason << "\n";
+          ORE.emit([&]() {
+            return OptimizationRemarkMissed(DEBUG_TYPE, "Escapes", At)
+              << "web of " << ore::NV("Values", Size) << " values kept in double: "
+              << ore::NV("Reason", W.Reason);
+          });
+          continue;
+        }
+
+        // Only moves values around, conversions would cost more
+        if (W.Arithmetic == 0) {
+          ORE.emit([&]() {
+            return OptimizationRemarkMissed(DEBUG_TYPE, "NoArithmetic", At)
+              << "web of " << ore::NV("Values", Size)
+              << " values kept in double: no arithmetic";
+          });
+          continue;
+        }
+
+        PrecisionMode Mode = PolicyLI ? getWebMode(W, *PolicyLI) : ModeMixed;
+        if (Mode == ModeDouble || Mode == ModeStorage) {
+          errs() << "Function: " << F.getName() << " web of " << Size
+                 << " values kept: policy " << getModeName(Mode) << "\n";
+          ORE.emit([&]() {
+            return OptimizationRemarkMissed(DEBUG_TYPE, "Policy", At)
+              << "web of " << ore::NV("Values", Size) << " values kept in double: policy "
+              << ore::NV("Mode", getModeName(Mode));
+          });
+          continue;
+        }
+
+        // Float: every web, whatever the plan and the cost model
+        if (Mode != ModeFloat && !PlanFile.empty() && !inPlan(F, W, Index)) {
+          ORE.emit([&]() {
+            return OptimizationRemarkMissed(DEBUG_TYPE, "NotInPlan", At)
+              << "web of " << ore::NV("Values", Size)
+              << " values kept in double: not in the plan";
+          });
+          continue;
+        }
+
+        WebCost Cost;
+        if (Model) {
+          Cost = Model->estimate(W);
+
+          if (Mode != ModeFloat && !Cost.profitable()) {
+            ORE.emit([&]() {
+              return addCosts(OptimizationRemarkMissed(DEBUG_TYPE, "NotProfitable", At)
+                              << "web of " << ore::NV("Values", Size)
+                              << " values kept in double: ", Cost);
+            });
+            continue;
           }
-//          else if (LoadInst *LI = dyn_cast<LoadInst>(I)) {
-//            if (LI->getOperand(0)->getType()->getArrayElementType()->getTypeID() == Type::DoubleTyID) {
-//              errs() << "Encountered a double precision load\n";
-//              auto *old_target = LI;
-//
-//              Value *a = old_target->getOperand(0);
-//              Type *type = Type::getFloatTy(F.getContext());
-//
-//              CastInst *float_a =
-//                new FPTruncInst(a, type, "conv", old_target);
-//
-//              CastInst *ptr_float_a =
-//                new FPTruncInst(float_a, Type::getFloatPtrTy(F.getContext()), "conv", old_target);
-//
-//              LoadInst *load = new LoadInst(type, ptr_float_a, "load", old_target);
-//
-//              this->find = true;
-//              this->B = &BB;
-//            }
-//          }
         }
+
+        ORE.emit([&]() {
+          OptimizationRemark R(DEBUG_TYPE, "Demoted", At);
+          R << "web of " << ore::NV("Values", Size) << " values demoted to float";
+          return Model ? addCosts(R << ": ", Cost) : R;
+        });
+
+        RetypeStats Stats = retypeWeb(F, W);
+        Total.Values += Stats.Values;
+        Total.Conversions += Stats.Conversions;
+        Total.Calls.append(Stats.Calls.begin(), Stats.Calls.end());
+        Retyped++;
+      }
+
+      if (Retyped)
+        errs() << "Function: " << F.getName() << " have " << Retyped
+               << " webs retyped to float, " << Total.Values << " values, "
+               << Total.Conversions << " conversions\n";
+
+      if (Retyped) {
+        reportCalls(F, Total.Calls);
+        reportReductions(F, rewriteReductions(F, Reductions, Accumulation));
+      }
+
+      count_values += Total.Values;
+      count_conversions += Total.Conversions;
+
+      return Retyped != 0;
+    }
+
+    // Most conservative mode of the arithmetic of a web
+    PrecisionMode getWebMode(Web &W, LoopInfo &LI) {
+      PrecisionMode Mode = ModeFloat;
+
+      for (Instruction *I : W.Members)
+        if (isDoubleArithmetic(I))
+          Mode = std::min(Mode, policy.at(I->getParent(), LI));
+
+      return Mode;
+    }
+
+    // First arithmetic operation of a web, for the remarks
+    static Instruction *getWebLocation(Web &W) {
+      for (Instruction *I : W.Members)
+        if (isDoubleArithmetic(I))
+          return I;
+
+      return W.Members.front();
+    }
+
+    template <typename RemarkT>
+    static RemarkT &addCosts(RemarkT &R, const WebCost &Cost) {
+      return R << "double cost " << ore::NV("DoubleCost", formatv("{0:f2}", Cost.Double).str())
+               << ", float cost " << ore::NV("FloatCost", formatv("{0:f2}", Cost.Float).str())
+               << ", conversions " << ore::NV("ConversionCost",
+                                              formatv("{0:f2}", Cost.Conversions).str());
+    }
+
+    bool inPlan(Function &F, Web &W, DenseMap<Instruction *, uint64_t> &Index) {
+      for (Instruction *I : W.Members) {
+        auto It = Index.find(I);
+        if (It != Index.end() && !plan.contains(F.getName(), It->second))
+          return false;
       }
 
       return true;
     }
 
+    // One line per operation of each web the function mode would demote
+    void writeCandidates(Function &F, std::vector<Web> &Webs,
+                         DenseMap<Instruction *, uint64_t> &Index) {
+      unsigned Number = 0;
+
+      for (Web &W : Webs) {
+        if (!W.Valid || W.Arithmetic == 0)
+          continue;
+
+        for (Instruction *I : W.Members) {
+          auto It = Index.find(I);
+          if (It != Index.end())
+            *candidates << F.getName() << "," << Number << "," << It->second << "\n";
+        }
+
+        Number++;
+      }
+    }
+
+    // Math calls demoted to float, with their vector variants
+    void reportCalls(Function &F, ArrayRef<CallInst *> Calls) {
+      for (CallInst *CI : Calls) {
+        SmallVector<std::string, 2> Variants = addVectorVariants(CI, VectorLib);
+
+        errs() << "Function: " << F.getName() << " call demoted to "
+               << CI->getCalledFunction()->getName();
+
+        for (size_t i = 0; i < Variants.size(); i++)
+          errs() << (i ? ", " : ", vector variants ") << Variants[i];
+
+        errs() << "\n";
+      }
+    }
+
+    void reportReductions(Function &F, ReductionStats Stats) {
+      if (Stats.Compensated)
+        errs() << "Function: " << F.getName() << " have " << Stats.Compensated
+               << " float sums compensated (Kahan)\n";
+
+      if (Stats.Widened)
+        errs() << "Function: " << F.getName() << " have " << Stats.Widened
+               << " float sums accumulated in double\n";
+
+      for (BasicBlock *Header : Stats.Kept)
+        errs() << "Loop: " << F.getName() << " " << Header->getName()
+               << ": float sum not recognized, kept in float\n";
+    }
+
+    bool runOnLoops(Function &F, SmallPtrSetImpl<BasicBlock *> &Reductions) {
+      DominatorTree &DT = getAnalysis<DominatorTreeWrapperPass>().getDomTree();
+      LoopInfo &LI = getAnalysis<LoopInfoWrapperPass>().getLoopInfo();
+      ScalarEvolution &SE = getAnalysis<ScalarEvolutionWrapperPass>().getSE();
+      const TargetTransformInfo &TTI =
+        getAnalysis<TargetTransformInfoWrapperPass>().getTTI(F);
+      OptimizationRemarkEmitter ORE(&F);
+      bool modified = false;
+
+      // Measured on the whole function
+      double Base = base_profile.mean(F.getName());
+      double Demoted = demoted_profile.mean(F.getName());
+
+      SmallVector<Loop *, 8> Nests(LI.begin(), LI.end());
+
+      for (Loop *L : Nests) {
+        // Most conservative mode of the loops of the nest
+        PrecisionMode Mode = ModeFloat;
+        for (Loop *Inner : L->getLoopsInPreorder())
+          Mode = std::min(Mode, policy.loop(Inner));
+
+        if (Mode == ModeDouble || Mode == ModeStorage) {
+          errs() << "Loop: " << F.getName() << " " << L->getHeader()->getName()
+                 << ": kept in double, policy " << getModeName(Mode) << "\n";
+          ORE.emit([&]() {
+            return OptimizationRemarkMissed(DEBUG_TYPE, "LoopPolicy",
+                                            L->getStartLoc(), L->getHeader())
+              << "loop nest kept in double: policy " << ore::NV("Mode", getModeName(Mode));
+          });
+          continue;
+        }
+
+        // Costs of the double version
+        std::vector<std::pair<Loop *, VectorCost>> Costs;
+        for (Loop *Inner : L->getLoopsInPreorder())
+          if (Inner->isInnermost())
+            Costs.push_back({Inner, estimateVectorCost(*Inner, SE, TTI, VectorLib != NoVectorLibrary)});
+
+        // Per iteration of the innermost loops the vectorizer would
+        // vectorize, the others run the same in both versions
+        WebCost Nest;
+        for (auto &C : Costs)
+          if (C.second.Vectorizable) {
+            Nest.Double += C.second.DoubleCost;
+            Nest.Float += C.second.FloatCost;
+          }
+
+        if (UseCostModel && Mode != ModeFloat && Nest.Double == 0.0) {
+          std::string Reason = Costs.empty() ? "no innermost loop" : Costs.front().second.Reason;
+
+          errs() << "Loop: " << F.getName() << " " << L->getHeader()->getName()
+                 << ": kept in double, not vectorized: " << Reason << "\n";
+          ORE.emit([&]() {
+            return OptimizationRemarkMissed(DEBUG_TYPE, "LoopNotProfitable",
+                                            L->getStartLoc(), L->getHeader())
+              << "loop nest kept in double, not vectorized: " << ore::NV("Reason", Reason);
+          });
+          continue;
+        }
+
+        if (UseCostModel && Mode != ModeFloat && !Nest.profitable()) {
+          errs() << "Loop: " << F.getName() << " " << L->getHeader()->getName()
+                 << format(": kept in double, double cost %.2f, float cost %.2f\n",
+                           Nest.Double, Nest.Float);
+          ORE.emit([&]() {
+            return addCosts(OptimizationRemarkMissed(DEBUG_TYPE, "LoopNotProfitable",
+                                                     L->getStartLoc(), L->getHeader())
+                            << "loop nest kept in double: ", Nest);
+          });
+          continue;
+        }
+
+        ORE.emit([&]() {
+          return addCosts(OptimizationRemark(DEBUG_TYPE, "LoopDemoted",
+                                             L->getStartLoc(), L->getHeader())
+                          << "loop nest demoted to float: ", Nest);
+        });
+
+        LoopDemotionStats Stats = demoteLoopNest(F, *L, DT, LI, SE);
+
+        errs() << "Loop: " << F.getName() << " " << L->getHeader()->getName()
+               << ": " << Stats.Streams << " arrays copied to float, "
+               << Stats.Webs << " webs retyped (" << Stats.KeptWebs << " kept), "
+               << Stats.Retyped.Values << " values, " << Stats.Retyped.Conversions
+               << " conversions\n";
+
+        for (auto &C : Costs) {
+          VectorCost &Cost = C.second;
+
+          errs() << "  Loop: " << C.first->getHeader()->getName() << " depth "
+                 << C.first->getLoopDepth() << format(": double x%u cost %.2f", Cost.DoubleVF,
+                                                      Cost.DoubleCost)
+                 << format(", float x%u cost %.2f", Cost.FloatVF, Cost.FloatCost)
+                 << format(", expected speedup %.2f", Cost.speedup());
+
+          if (Base > 0.0 && Demoted > 0.0)
+            errs() << format(", measured speedup %.2f (function)", Base / Demoted);
+
+          if (!Cost.Vectorizable)
+            errs() << ", not vectorized: " << Cost.Reason;
+
+          errs() << "\n";
+
+          // Ask the loop vectorizer for the float width
+          if (Cost.Vectorizable && Cost.FloatVF > 1) {
+            addStringMetadataToLoop(C.first, "llvm.loop.vectorize.width", Cost.FloatVF);
+            addStringMetadataToLoop(C.first, "llvm.loop.vectorize.enable", 1);
+          }
+        }
+
+        reportCalls(F, Stats.Retyped.Calls);
+
+        count_values += Stats.Retyped.Values;
+        count_conversions += Stats.Retyped.Conversions;
+        modified |= Stats.Streams || Stats.Webs;
+      }
+
+      if (modified)
+        reportReductions(F, rewriteReductions(F, Reductions, Accumulation));
+
+      return modified;
+    }
+
     bool doFinalization(Module &M) override {
+      if (Shadow || candidates) {
+        candidates.reset();
+        return false;
+      }
+
+      errs() << "Values retyped to float: " << count_values
+             << ", conversions: " << count_conversions << '\n';
       return false;
     }
   };
 }
 
 char FastFP::ID = 0;
+uint64_t FastFP::count_values = 0;
+uint64_t FastFP::count_conversions = 0;
 static RegisterPass<FastFP> X("fast-fp", "Fast Floating Point Pass");
@@ -0,0 +1,295 @@
+//===- FastMathFlags.cpp - Safe fast-math flags ----------------------------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// This file implements a pass that attaches fast-math flags to the
+// floating-point operations where they are safe: nnan, ninf and nsz where the
+// ranges of the operands and of the result prove them, and the flags a policy
+// allows in the loops of a function or in one loop (reassoc and contract to
+// vectorize reductions and form FMAs), instead of -ffast-math everywhere.
+//
+//===----------------------------------------------------------------------===//
+
+#include "FPRange.h"
+
+#include "llvm/Pass.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Analysis/LoopInfo.h"
+#include "llvm/Analysis/ScalarEvolution.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/InstIterator.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/IntrinsicInst.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IR/Operator.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <string>
+#include <vector>
+
+using namespace llvm;
+using namespace fastfp;
+
+#define DEBUG_TYPE "fast-fp-flags"
+
+static cl::list<std::string>
+Policy("fast-fp-flags-policy",
+       cl::desc("Flags allowed in the loops of a function, or in one loop by "
+                "the name of its header, as FUNCTION[/HEADER]=FLAG+FLAG... "
+                "(FLAG: reassoc, contract, arcp, afn, nnan, ninf, nsz, or "
+                "finite to assume finite arguments, calls and memory; "
+                "FUNCTION * for all the functions)"),
+       cl::CommaSeparated);
+
+namespace {
+  struct PolicyEntry {
+    std::string Function;
+    std::string Header; // Empty: every loop of the function
+    FastMathFlags Flags;
+    bool Finite = false;
+  };
+
+  enum FlagIndex { NNaN, NInf, NSZ, Reassoc, Contract, ARcp, AFn, FlagCount };
+
+  const char *FlagNames[FlagCount] = {
+    "nnan", "ninf", "nsz", "reassoc", "contract", "arcp", "afn"
+  };
+
+  struct FlagCounts {
+    uint64_t Proven[3] = {};
+    uint64_t Allowed[FlagCount] = {};
+  };
+
+  struct FastMathFlagsPass : public FunctionPass {
+    static char ID; // Pass identification, replacement for typeid
+    static FlagCounts Total;
+
+    std::vector<PolicyEntry> policy;
+
+    FastMathFlagsPass() : FunctionPass(ID) {}
+
+    void getAnalysisUsage(AnalysisUsage &AU) const override {
+      AU.setPreservesCFG();
+      AU.addRequired<LoopInfoWrapperPass>();
+      AU.addRequired<ScalarEvolutionWrapperPass>();
+    }
+
+    static bool setFlag(FastMathFlags &FMF, PolicyEntry &E, StringRef Name) {
+      if (Name == "reassoc") FMF.setAllowReassoc();
+      else if (Name == "contract") FMF.setAllowContract(true);
+      else if (Name == "arcp") FMF.setAllowReciprocal();
+      else if (Name == "afn") FMF.setApproxFunc();
+      else if (Name == "nnan") FMF.setNoNaNs();
+      else if (Name == "ninf") FMF.setNoInfs();
+      else if (Name == "nsz") FMF.setNoSignedZeros();
+      else if (Name == "finite") E.Finite = true;
+      else return false;
+      return true;
+    }
+
+    bool doInitialization(Module &M) override {
+      for (StringRef Entry : Policy) {
+        PolicyEntry E;
+        auto Scope = Entry.split('=');
+        auto Names = Scope.first.split('/');
+        SmallVector<StringRef, 8> Flags;
+
+        E.Function = Names.first.str();
+        E.Header = Names.second.str();
+        Scope.second.split(Flags, '+', -1, false);
+
+        if (E.Function.empty() || Flags.empty()) {
+          errs() << "Invalid fast-math policy: " << Entry << "\n";
+          exit(13);
+        }
+
+        for (StringRef Flag : Flags)
+          if (!setFlag(E.Flags, E, Flag)) {
+            errs() << "Unknown fast-math flag: " << Flag << "\n";
+            exit(13);
+          }
+
+        policy.push_back(E);
+      }
+
+      return false;
+    }
+
+    static bool matches(const PolicyEntry &E, Function &F) {
+      return E.Function == "*" || E.Function == F.getName();
+    }
+
+    // Flags the policy allows at an instruction: the instruction is in a loop
+    // of the function, or in the loop named by the entry
+    FastMathFlags allowed(Function &F, Instruction *I, LoopInfo &LI) {
+      FastMathFlags FMF;
+      Loop *Innermost = LI.getLoopFor(I->getParent());
+
+      if (!Innermost)
+        return FMF;
+
+      for (PolicyEntry &E : policy) {
+        if (!matches(E, F))
+          continue;
+
+        if (E.Header.empty()) {
+          FMF |= E.Flags;
+          continue;
+        }
+
+        for (Loop *L = Innermost; L; L = L->getParentLoop())
+          if (L->getHeader()->getName() == E.Header) {
+            FMF |= E.Flags;
+            break;
+          }
+      }
+
+      return FMF;
+    }
+
+    // Flags proven by the ranges of the operands and of the result
+    static FastMathFlags proven(Instruction *I, FPRangeAnalysis &RA) {
+      FastMathFlags FMF;
+      bool NoNaN = true, NoInf = true, NoZero = !isa<FCmpInst>(I);
+      SmallVector<Value *, 4> Values;
+
+      // Select and phi: the flags are about the values they choose
+      if (isa<SelectInst>(I))
+        Values.append({ I->getOperand(1), I->getOperand(2) });
+      else if (CallBase *CB = dyn_cast<CallBase>(I))
+        Values.append(CB->arg_begin(), CB->arg_end());
+      else
+        Values.append(I->op_begin(), I->op_end());
+
+      if (I->getType()->isFloatingPointTy())
+        Values.push_back(I);
+
+      for (Value *V : Values) {
+        if (!V->getType()->isFloatingPointTy())
+          continue;
+
+        FPRange R = RA.get(V);
+        NoNaN &= !R.MayNaN;
+        NoInf &= !R.mayBeInf();
+        NoZero &= !R.Empty && !R.mayBeZero();
+      }
+
+      if (NoNaN)
+        FMF.setNoNaNs();
+      if (NoInf)
+        FMF.setNoInfs();
+      if (NoZero)
+        FMF.setNoSignedZeros();
+      return FMF;
+    }
+
+    static void count(uint64_t *Counts, FastMathFlags Added, unsigned N) {
+      bool Set[FlagCount] = {
+        Added.noNaNs(), Added.noInfs(), Added.noSignedZeros(),
+        Added.allowReassoc(), Added.allowContract(), Added.allowReciprocal(),
+        Added.approxFunc()
+      };
+
+      for (unsigned i = 0; i < N; i++)
+        Counts[i] += Set[i];
+    }
+
+    static FastMathFlags added(FastMathFlags Before, FastMathFlags After) {
+      FastMathFlags FMF;
+      FMF.setNoNaNs(After.noNaNs() && !Before.noNaNs());
+      FMF.setNoInfs(After.noInfs() && !Before.noInfs());
+      FMF.setNoSignedZeros(After.noSignedZeros() && !Before.noSignedZeros());
+      FMF.setAllowReassoc(After.allowReassoc() && !Before.allowReassoc());
+      FMF.setAllowContract(After.allowContract() && !Before.allowContract());
+      FMF.setAllowReciprocal(After.allowReciprocal() && !Before.allowReciprocal());
+      FMF.setApproxFunc(After.approxFunc() && !Before.approxFunc());
+      return FMF;
+    }
+
+    bool runOnFunction(Function &F) override {
+      LoopInfo &LI = getAnalysis<LoopInfoWrapperPass>().getLoopInfo();
+      ScalarEvolution &SE = getAnalysis<ScalarEvolutionWrapperPass>().getSE();
+      bool Finite = false;
+      FlagCounts Counts;
+
+      for (PolicyEntry &E : policy)
+        Finite |= E.Finite && matches(E, F);
+
+      FPRangeAnalysis RA(F, SE, Finite);
+
+      for (Instruction &I : instructions(F)) {
+        // Calls to libm keep their semantics, intrinsics take the flags
+        if (!isa<FPMathOperator>(&I) || (isa<CallBase>(&I) && !isa<IntrinsicInst>(&I)))
+          continue;
+
+        FastMathFlags Before = I.getFastMathFlags();
+        FastMathFlags Proven = proven(&I, RA);
+        FastMathFlags After = Before;
+
+        After |= Proven;
+        After |= allowed(F, &I, LI);
+
+        if (!(After != Before))
+          continue;
+
+        FastMathFlags Known = Before;
+        Known |= Proven;
+
+        I.copyFastMathFlags(After);
+        count(Counts.Proven, added(Before, Proven), 3);
+        count(Counts.Allowed, added(Known, After), FlagCount);
+      }
+
+      uint64_t Changed = 0;
+      for (unsigned i = 0; i < 3; i++)
+        Changed += Counts.Proven[i];
+      for (unsigned i = 0; i < FlagCount; i++)
+        Changed += Counts.Allowed[i];
+
+      if (!Changed)
+        return false;
+
+      errs() << "Function: " << F.getName() << ": proven";
+      for (unsigned i = 0; i < 3; i++) {
+        errs() << (i ? ", " : " ") << FlagNames[i] << " " << Counts.Proven[i];
+        Total.Proven[i] += Counts.Proven[i];
+      }
+
+      const char *Separator = "; allowed";
+      for (unsigned i = 0; i < FlagCount; i++) {
+        Total.Allowed[i] += Counts.Allowed[i];
+        if (Counts.Allowed[i]) {
+          errs() << Separator << " " << FlagNames[i] << " " << Counts.Allowed[i];
+          Separator = ",";
+        }
+      }
+
+      errs() << "\n";
+      return true;
+    }
+
+    bool doFinalization(Module &M) override {
+      errs() << "Flags proven:";
+      for (unsigned i = 0; i < 3; i++)
+        errs() << (i ? ", " : " ") << FlagNames[i] << " " << Total.Proven[i];
+
+      errs() << "; allowed by the policy:";
+      for (unsigned i = 0; i < FlagCount; i++)
+        errs() << (i ? ", " : " ") << FlagNames[i] << " " << Total.Allowed[i];
+
+      errs() << "\n";
+      return false;
+    }
+  };
+}
+
+char FastMathFlagsPass::ID = 0;
+FlagCounts FastMathFlagsPass::Total;
+static RegisterPass<FastMathFlagsPass> X("fast-fp-flags",
+                                         "Attach the safe fast-math flags to floating-point operations");
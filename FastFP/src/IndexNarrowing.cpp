@@ -0,0 +1,433 @@
+//===- IndexNarrowing.cpp - 32-bit induction variables --------------------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// This file implements a companion pass of FastFP that narrows the 64-bit
+// induction variables of loops to 32 bits when ScalarEvolution proves, from
+// the trip count of the loop, that their values fit, with the integer
+// arithmetic and the comparisons computed from them in the loop. The other
+// users see the narrow values extended. Vectors of 32-bit indices hold twice
+// as many lanes, for the gathers and scatters of the vectorized loops.
+//
+//===----------------------------------------------------------------------===//
+
+#include "llvm/Pass.h"
+#include "llvm/ADT/DenseSet.h"
+#include "llvm/ADT/MapVector.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/Analysis/LoopInfo.h"
+#include "llvm/Analysis/ScalarEvolution.h"
+#include "llvm/Analysis/ScalarEvolutionExpressions.h"
+#include "llvm/Analysis/TargetTransformInfo.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/DataLayout.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Transforms/Utils.h"
+
+using namespace llvm;
+
+#define DEBUG_TYPE "fast-fp-narrow"
+
+namespace {
+  struct IndexNarrowing : public FunctionPass {
+    static char ID; // Pass identification, replacement for typeid
+    static uint64_t count_variables;
+    static uint64_t count_operations;
+    static uint64_t count_loops;
+
+    IndexNarrowing() : FunctionPass(ID) {}
+
+    void getAnalysisUsage(AnalysisUsage &AU) const override {
+      AU.addRequiredID(LoopSimplifyID);
+      AU.addRequired<LoopInfoWrapperPass>();
+      AU.addRequired<ScalarEvolutionWrapperPass>();
+      AU.addRequired<TargetTransformInfoWrapperPass>();
+    }
+
+    ScalarEvolution *SE = nullptr;
+    Type *NarrowTy = nullptr;
+
+    // Narrow version of the 64-bit values of the function, and the
+    // instructions of the loops they replace
+    MapVector<Value *, Value *> narrow;
+    DenseSet<Value *> pending;
+
+    // Bounds of the values narrowed: induction variables from the trip
+    // count, arithmetic from the bounds of the operands; the operations that
+    // cannot wrap under those bounds
+    DenseMap<Value *, APInt> maxima;
+    DenseSet<Value *> nowrap;
+    SmallVector<Instruction *, 16> replaced;
+
+    // Largest unsigned value of S in L, under the conditions guarding L
+    APInt getRangeMax(const SCEV *S, Loop *L) {
+      return SE->getUnsignedRange(SE->applyLoopGuards(S, L)).getUnsignedMax();
+    }
+
+    // Largest unsigned value of V in L, from the bounds of the operands of
+    // the arithmetic (kept once narrowed only: they improve as the inner
+    // loops are narrowed)
+    APInt getMax(Value *V, Loop *L) {
+      auto It = maxima.find(V);
+      if (It != maxima.end())
+        return It->second;
+
+      APInt Max = getRangeMax(SE->getSCEV(V), L);
+      Instruction *I = dyn_cast<Instruction>(V);
+      if (!I || !L->contains(I) || !I->getType()->isIntegerTy(64))
+        return Max;
+
+      unsigned Opcode = I->getOpcode();
+      if (Opcode != Instruction::Add && Opcode != Instruction::Mul && Opcode != Instruction::Shl)
+        return Max;
+
+      APInt A = getMax(I->getOperand(0), L);
+      APInt B = getMax(I->getOperand(1), L);
+      APInt R;
+      bool Overflow = false;
+
+      if (Opcode == Instruction::Add)
+        R = A.uadd_ov(B, Overflow);
+      else if (Opcode == Instruction::Mul)
+        R = A.umul_ov(B, Overflow);
+      else if (B.ult(64))
+        R = A.ushl_ov(B, Overflow);
+      else
+        Overflow = true;
+
+      if (!Overflow) {
+        nowrap.insert(I);
+        Max = APIntOps::umin(Max, R);
+      }
+
+      return Max;
+    }
+
+    bool fits(Value *V, Loop *L, unsigned Bits = 32) {
+      return getMax(V, L).getActiveBits() <= Bits;
+    }
+
+    // Largest value of an induction variable {Start,+,Step} and of its next
+    // value: with Start, Step and the backedge-taken count below 2^32,
+    // Start + Step * (Count + 1) cannot wrap and bounds them
+    bool boundInduction(PHINode *PN, const SCEVAddRecExpr *AR, Value *Next, Loop *L) {
+      const SCEVConstant *Step = dyn_cast<SCEVConstant>(AR->getStepRecurrence(*SE));
+      const SCEV *BTC = SE->getBackedgeTakenCount(L);
+      APInt Max = APIntOps::umax(getRangeMax(AR, L), getRangeMax(SE->getSCEV(Next), L));
+
+      if (Step && Step->getAPInt().isStrictlyPositive() && Step->getAPInt().getActiveBits() <= 32
+          && !isa<SCEVCouldNotCompute>(BTC) && getRangeMax(BTC, L).getActiveBits() <= 32
+          && getRangeMax(AR->getStart(), L).getActiveBits() <= 32) {
+        const SCEV *Last = SE->getAddExpr(AR->evaluateAtIteration(BTC, *SE), Step);
+        Max = APIntOps::umin(Max, getRangeMax(Last, L));
+      }
+
+      if (Max.getActiveBits() > 32)
+        return false;
+
+      maxima[PN] = Max;
+      maxima[Next] = Max;
+      return true;
+    }
+
+    static bool isNarrowable(Instruction *I) {
+      switch (I->getOpcode()) {
+      case Instruction::Add:
+      case Instruction::Sub:
+      case Instruction::Mul:
+      case Instruction::Shl:
+        return true;
+      default:
+        return false;
+      }
+    }
+
+    // V can be computed in 32 bits in L: constant, invariant, narrowed
+    // induction variable, or arithmetic of those whose result fits. An
+    // invariant truncated for another loop is checked again: the guards that
+    // bound it there may not hold in L.
+    bool canNarrow(Value *V, Loop *L) {
+      if (!V->getType()->isIntegerTy(64))
+        return false;
+
+      if (ConstantInt *C = dyn_cast<ConstantInt>(V))
+        return C->getValue().getActiveBits() <= 32;
+
+      if (L->isLoopInvariant(V))
+        return fits(V, L);
+
+      if (narrow.count(V) || pending.count(V))
+        return true;
+
+      Instruction *I = dyn_cast<Instruction>(V);
+      if (!I || !isNarrowable(I) || !fits(I, L))
+        return false;
+
+      return canNarrow(I->getOperand(0), L) && canNarrow(I->getOperand(1), L);
+    }
+
+    // The vectorizer takes its width from the widest type loaded, stored or
+    // reduced in the loop: 32-bit indices fill its vectors when it is 32 bits
+    // at most
+    unsigned getWidestType(Loop *L, const DataLayout &DL) {
+      unsigned Widest = 0;
+
+      for (BasicBlock *BB : L->blocks())
+        for (Instruction &I : *BB) {
+          Type *Ty = nullptr;
+
+          if (isa<LoadInst>(I) || isa<StoreInst>(I))
+            Ty = getLoadStoreType(&I);
+          else if (isa<PHINode>(I) && BB == L->getHeader() && !narrow.count(&I))
+            Ty = I.getType();
+
+          if (Ty && (Ty->isIntegerTy() || Ty->isFloatingPointTy()))
+            Widest = std::max(Widest, (unsigned)DL.getTypeSizeInBits(Ty).getFixedSize());
+        }
+
+      return Widest;
+    }
+
+    // Right after the definition of V
+    static Instruction *getInsertionPoint(Value *V) {
+      Instruction *I = dyn_cast<Instruction>(V);
+      if (!I)
+        return &*cast<Argument>(V)->getParent()->getEntryBlock().getFirstInsertionPt();
+
+      if (isa<PHINode>(I))
+        return &*I->getParent()->getFirstInsertionPt();
+
+      return I->getNextNode();
+    }
+
+    Value *createNarrow(Value *V, Loop *L) {
+      auto It = narrow.find(V);
+      if (It != narrow.end())
+        return It->second;
+
+      if (ConstantInt *C = dyn_cast<ConstantInt>(V))
+        return ConstantInt::get(NarrowTy, C->getZExtValue());
+
+      // Invariants: once, at their definition, for every loop
+      if (L->isLoopInvariant(V)) {
+        IRBuilder<> Builder(getInsertionPoint(V));
+        Value *T = Builder.CreateTrunc(V, NarrowTy, V->getName() + ".narrow");
+        narrow[V] = T;
+        return T;
+      }
+
+      BinaryOperator *BO = cast<BinaryOperator>(V);
+      Value *LHS = createNarrow(BO->getOperand(0), L);
+      Value *RHS = createNarrow(BO->getOperand(1), L);
+
+      IRBuilder<> Builder(BO);
+      BinaryOperator *N = cast<BinaryOperator>(
+        Builder.CreateBinOp(BO->getOpcode(), LHS, RHS, BO->getName() + ".narrow"));
+
+      // The 64-bit operation does not wrap and its result fits: neither does
+      // the 32-bit one. A subtraction whose result fits can still start from
+      // a negative i32 (2^31 - 1 computed as INT_MIN - 1): its operands must
+      // fit too.
+      if (BO->hasNoUnsignedWrap() || nowrap.count(BO)) {
+        N->setHasNoUnsignedWrap();
+        if (fits(BO, L, 31)
+            && (BO->getOpcode() != Instruction::Sub
+                || (fits(BO->getOperand(0), L, 31) && fits(BO->getOperand(1), L, 31))))
+          N->setHasNoSignedWrap();
+      }
+
+      narrow[V] = N;
+      maxima[V] = getMax(V, L);
+      replaced.push_back(BO);
+      return N;
+    }
+
+    // Header phi {Start,+,Step} whose values and next values fit in 32 bits
+    PHINode *narrowInduction(PHINode *PN, Loop *L) {
+      BasicBlock *Preheader = L->getLoopPreheader();
+      BasicBlock *Latch = L->getLoopLatch();
+      if (!PN->getType()->isIntegerTy(64) || !Preheader || !Latch)
+        return nullptr;
+
+      const SCEVAddRecExpr *AR = dyn_cast<SCEVAddRecExpr>(SE->getSCEV(PN));
+      if (!AR || AR->getLoop() != L || !AR->isAffine()
+          || !isa<SCEVConstant>(AR->getStepRecurrence(*SE)))
+        return nullptr;
+
+      Value *Start = PN->getIncomingValueForBlock(Preheader);
+      Value *Next = PN->getIncomingValueForBlock(Latch);
+      if (!canNarrow(Start, L) || !boundInduction(PN, AR, Next, L))
+        return nullptr;
+
+      pending.insert(PN);
+      bool Narrowable = canNarrow(Next, L);
+      pending.erase(PN);
+
+      if (!Narrowable)
+        return nullptr;
+
+      PHINode *N = PHINode::Create(NarrowTy, 2, PN->getName() + ".narrow", PN);
+      narrow[PN] = N;
+      replaced.push_back(PN);
+
+      N->addIncoming(createNarrow(Start, L), Preheader);
+      Value *NarrowNext = createNarrow(Next, L);
+      N->addIncoming(NarrowNext, Latch);
+
+      // i + Step with 0 < Step < 2^32 stays under 2^32 without wrapping 2^64
+      BinaryOperator *Inc = dyn_cast<BinaryOperator>(NarrowNext);
+      const APInt &Step = cast<SCEVConstant>(AR->getStepRecurrence(*SE))->getAPInt();
+      if (Inc && Inc->getOpcode() == Instruction::Add && Step.isStrictlyPositive()
+          && Step.getActiveBits() <= 32
+          && (Inc->getOperand(0) == N || Inc->getOperand(1) == N)) {
+        Inc->setHasNoUnsignedWrap();
+        if (fits(Next, L, 31))
+          Inc->setHasNoSignedWrap();
+      }
+
+      return N;
+    }
+
+    // Users of the narrowed values in L computed in 32 bits too
+    unsigned narrowUsers(Loop *L, SmallVectorImpl<Value *> &Worklist,
+                         SmallVectorImpl<ICmpInst *> &Compares) {
+      unsigned Operations = 0;
+
+      while (!Worklist.empty()) {
+        Value *V = Worklist.pop_back_val();
+
+        for (User *U : V->users()) {
+          Instruction *UserI = dyn_cast<Instruction>(U);
+          if (!UserI || !L->contains(UserI) || narrow.count(UserI))
+            continue;
+
+          if (ICmpInst *Cmp = dyn_cast<ICmpInst>(UserI)) {
+            // Signed comparisons of values below 2^31 only
+            bool Signed = Cmp->isSigned() && !(fits(Cmp->getOperand(0), L, 31)
+                                              && fits(Cmp->getOperand(1), L, 31));
+            if (!Signed && canNarrow(Cmp->getOperand(0), L)
+                && canNarrow(Cmp->getOperand(1), L) && !is_contained(Compares, Cmp))
+              Compares.push_back(Cmp);
+            continue;
+          }
+
+          if (canNarrow(UserI, L)) {
+            createNarrow(UserI, L);
+            Worklist.push_back(UserI);
+            Operations++;
+          }
+        }
+      }
+
+      return Operations;
+    }
+
+    bool runOnFunction(Function &F) override {
+      LoopInfo &LI = getAnalysis<LoopInfoWrapperPass>().getLoopInfo();
+      const TargetTransformInfo &TTI =
+        getAnalysis<TargetTransformInfoWrapperPass>().getTTI(F);
+      SE = &getAnalysis<ScalarEvolutionWrapperPass>().getSE();
+      NarrowTy = Type::getInt32Ty(F.getContext());
+
+      narrow.clear();
+      maxima.clear();
+      nowrap.clear();
+      replaced.clear();
+
+      unsigned Bits = TTI.getRegisterBitWidth(TargetTransformInfo::RGK_FixedWidthVector)
+        .getFixedSize();
+      unsigned Loops = 0;
+
+      // Outer loops first: their narrowed values are invariants of the inner
+      // loops
+      for (Loop *L : LI.getLoopsInPreorder()) {
+        SmallVector<Value *, 4> Worklist;
+        SmallVector<ICmpInst *, 4> Compares;
+        SmallVector<PHINode *, 4> Phis;
+
+        for (PHINode &PN : L->getHeader()->phis())
+          Phis.push_back(&PN);
+
+        unsigned Variables = 0;
+        for (PHINode *PN : Phis)
+          if (narrowInduction(PN, L)) {
+            Worklist.push_back(PN);
+            Worklist.push_back(PN->getIncomingValueForBlock(L->getLoopLatch()));
+            Variables++;
+          }
+
+        if (!Variables)
+          continue;
+
+        unsigned Operations = narrowUsers(L, Worklist, Compares);
+
+        for (ICmpInst *Cmp : Compares) {
+          IRBuilder<> Builder(Cmp);
+          Value *LHS = createNarrow(Cmp->getOperand(0), L);
+          Value *RHS = createNarrow(Cmp->getOperand(1), L);
+          Value *N = Builder.CreateICmp(Cmp->getPredicate(), LHS, RHS);
+          N->takeName(Cmp);
+          Cmp->replaceAllUsesWith(N);
+          Cmp->eraseFromParent();
+        }
+
+        unsigned Widest = getWidestType(L, F.getParent()->getDataLayout());
+
+        errs() << "Loop: " << F.getName() << " " << L->getHeader()->getName()
+               << ": " << Variables << " induction variables, " << Operations
+               << " operations, " << Compares.size() << " comparisons narrowed to 32 bits";
+        if (Bits >= 64 && L->isInnermost() && Widest && Widest <= 32)
+          errs() << ", index vectors x" << Bits / 64 << " -> x" << Bits / 32;
+        errs() << "\n";
+
+        count_variables += Variables;
+        count_operations += Operations;
+        Loops++;
+      }
+
+      if (!Loops)
+        return false;
+
+      // The other users read the narrow values extended
+      for (Instruction *I : replaced) {
+        Instruction *N = cast<Instruction>(narrow[I]);
+        bool Extended = any_of(I->users(), [&](User *U) { return !narrow.count(U); });
+
+        if (Extended) {
+          IRBuilder<> Builder(getInsertionPoint(N));
+          I->replaceAllUsesWith(Builder.CreateZExt(N, I->getType(), I->getName() + ".ext"));
+        }
+      }
+
+      for (Instruction *I : replaced)
+        I->dropAllReferences();
+      for (Instruction *I : replaced)
+        I->eraseFromParent();
+
+      SE->forgetAllLoops();
+      count_loops += Loops;
+      return true;
+    }
+
+    bool doFinalization(Module &M) override {
+      errs() << "Loops with 32-bit indices: " << count_loops << ", induction variables: "
+             << count_variables << ", operations: " << count_operations << '\n';
+      return false;
+    }
+  };
+}
+
+char IndexNarrowing::ID = 0;
+uint64_t IndexNarrowing::count_variables = 0;
+uint64_t IndexNarrowing::count_operations = 0;
+uint64_t IndexNarrowing::count_loops = 0;
+static RegisterPass<IndexNarrowing> X("fast-fp-narrow",
+                                      "Narrow 64-bit induction variables to 32 bits");
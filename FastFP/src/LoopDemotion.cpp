@@ -0,0 +1,470 @@
+//===- LoopDemotion.cpp - Precision demotion of loop nests ----------------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+
+#include "LoopDemotion.h"
+
+#include "llvm/ADT/MapVector.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/Analysis/IVDescriptors.h"
+#include "llvm/Analysis/ScalarEvolutionExpressions.h"
+#include "llvm/IR/DerivedTypes.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/IntrinsicInst.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Transforms/Utils/BasicBlockUtils.h"
+#include "llvm/Transforms/Utils/Cloning.h"
+#include "llvm/Transforms/Utils/Local.h"
+#include "llvm/Transforms/Utils/LoopUtils.h"
+#include "llvm/Transforms/Utils/ScalarEvolutionExpander.h"
+
+using namespace llvm;
+
+namespace fastfp {
+
+  static double toDouble(InstructionCost Cost) {
+    auto Value = Cost.getValue();
+    return Value ? (double)*Value : 1e9;
+  }
+
+  double vectorCost(Instruction &I, Type *Elt, unsigned VF,
+                    const TargetTransformInfo &TTI) {
+    const TargetTransformInfo::TargetCostKind Kind =
+      TargetTransformInfo::TCK_RecipThroughput;
+    LLVMContext &Ctx = I.getContext();
+    Type *DoubleTy = Type::getDoubleTy(Ctx);
+    Type *VecTy = VF == 1 ? Elt : FixedVectorType::get(Elt, VF);
+
+    if (LoadInst *LI = dyn_cast<LoadInst>(&I)) {
+      if (LI->getType() == DoubleTy)
+        return toDouble(TTI.getMemoryOpCost(Instruction::Load, VecTy,
+                                            std::min(LI->getAlign(), Align(Elt->getPrimitiveSizeInBits() / 8)),
+                                            LI->getPointerAddressSpace(), Kind));
+    }
+    else if (StoreInst *SI = dyn_cast<StoreInst>(&I)) {
+      if (SI->getValueOperand()->getType() == DoubleTy)
+        return toDouble(TTI.getMemoryOpCost(Instruction::Store, VecTy,
+                                            std::min(SI->getAlign(), Align(Elt->getPrimitiveSizeInBits() / 8)),
+                                            SI->getPointerAddressSpace(), Kind));
+    }
+    else if (FCmpInst *FC = dyn_cast<FCmpInst>(&I)) {
+      if (FC->getOperand(0)->getType() == DoubleTy)
+        return toDouble(TTI.getCmpSelInstrCost(Instruction::FCmp, VecTy,
+                                               CmpInst::makeCmpResultType(VecTy),
+                                               FC->getPredicate(), Kind));
+    }
+    else if (I.getType() == DoubleTy) {
+      if (isa<PHINode>(I))
+        return 0.0;
+
+      if (isa<BinaryOperator>(I) || isa<UnaryOperator>(I))
+        return toDouble(TTI.getArithmeticInstrCost(I.getOpcode(), VecTy, Kind));
+
+      if (isa<SelectInst>(I))
+        return toDouble(TTI.getCmpSelInstrCost(Instruction::Select, VecTy,
+                                               CmpInst::makeCmpResultType(VecTy),
+                                               CmpInst::BAD_ICMP_PREDICATE, Kind));
+
+      if (CastInst *CI = dyn_cast<CastInst>(&I)) {
+        // fpext from float disappears with the demotion
+        if (CI->getSrcTy()->isFloatTy() && Elt->isFloatTy())
+          return 0.0;
+
+        return toDouble(TTI.getCastInstrCost(CI->getOpcode(), VecTy,
+                                             VF == 1 ? CI->getSrcTy()
+                                                     : FixedVectorType::get(CI->getSrcTy(), VF),
+                                             TargetTransformInfo::CastContextHint::None,
+                                             Kind));
+      }
+
+      if (IntrinsicInst *II = dyn_cast<IntrinsicInst>(&I)) {
+        SmallVector<Type *, 3> Args(II->arg_size(), VecTy);
+        return toDouble(TTI.getIntrinsicInstrCost(
+                          IntrinsicCostAttributes(II->getIntrinsicID(), VecTy, Args),
+                          Kind));
+      }
+
+      // Scalarized
+      return VF * toDouble(TTI.getInstructionCost(&I, Kind));
+    }
+
+    // Same in both versions: once per vector iteration
+    return toDouble(TTI.getInstructionCost(&I, Kind));
+  }
+
+  VectorCost estimateVectorCost(Loop &L, ScalarEvolution &SE,
+                                const TargetTransformInfo &TTI, bool MathVariants) {
+    VectorCost Cost;
+    LLVMContext &Ctx = L.getHeader()->getContext();
+    unsigned Bits =
+      TTI.getRegisterBitWidth(TargetTransformInfo::RGK_FixedWidthVector).getFixedSize();
+
+    Cost.DoubleVF = std::max(1u, Bits / 64);
+    Cost.FloatVF = std::max(1u, Bits / 32);
+
+    if (!L.isInnermost() || !L.getExitingBlock()) {
+      Cost.Vectorizable = false;
+      Cost.Reason = "not an innermost loop with a single exit";
+    }
+    else if (!L.isLoopSimplifyForm()) {
+      Cost.Vectorizable = false;
+      Cost.Reason = "not in simplified form";
+    }
+    else if (isa<SCEVCouldNotCompute>(SE.getBackedgeTakenCount(&L))) {
+      Cost.Vectorizable = false;
+      Cost.Reason = "trip count not computable";
+    }
+
+    // The loop vectorizer keeps floating-point reductions in order unless
+    // they may be reassociated
+    for (PHINode &Phi : L.getHeader()->phis()) {
+      RecurrenceDescriptor RD;
+      if (!Cost.Vectorizable || !Phi.getType()->isFloatingPointTy())
+        continue;
+
+      if (!RecurrenceDescriptor::isReductionPHI(&Phi, &L, RD)) {
+        Cost.Vectorizable = false;
+        Cost.Reason = "floating-point recurrence that is not a reduction";
+      }
+      else if (!RD.getFastMathFlags().allowReassoc()) {
+        Cost.Vectorizable = false;
+        Cost.Reason = "floating-point reduction without reassociation";
+      }
+    }
+
+    for (BasicBlock *BB : L.blocks()) {
+      for (Instruction &I : *BB) {
+        // Math library calls get vector variants once demoted
+        CallBase *CB = dyn_cast<CallBase>(&I);
+        if (CB && !isa<IntrinsicInst>(CB) && !(MathVariants && !getFloatLibCall(CB).empty())
+            && Cost.Vectorizable) {
+          Cost.Vectorizable = false;
+          Cost.Reason = "call in the loop";
+        }
+
+        Cost.DoubleCost += vectorCost(I, Type::getDoubleTy(Ctx), Cost.DoubleVF, TTI)
+          / Cost.DoubleVF;
+        Cost.FloatCost += vectorCost(I, Type::getFloatTy(Ctx), Cost.FloatVF, TTI)
+          / Cost.FloatVF;
+      }
+    }
+
+    return Cost;
+  }
+
+  namespace {
+    // Array read or written at consecutive elements by every iteration
+    struct Stream {
+      const SCEV *Start = nullptr;
+      const SCEV *Count = nullptr;
+      Type *PtrTy = nullptr;
+      SmallVector<Instruction *, 4> Accesses;
+      bool Loaded = false;
+      bool Stored = false;
+      bool Valid = true;
+
+      Value *Double = nullptr; // First element in the original array
+      Value *Float = nullptr;  // Temporary buffer
+      Value *N = nullptr;      // Number of elements
+    };
+  }
+
+  // Noalias argument the pointer is based on
+  static Argument *getNoAliasBase(Value *Ptr, ScalarEvolution &SE) {
+    const SCEVUnknown *Base = dyn_cast<SCEVUnknown>(SE.getPointerBase(SE.getSCEV(Ptr)));
+    Argument *A = Base ? dyn_cast<Argument>(Base->getValue()) : nullptr;
+
+    return A && A->hasNoAliasAttr() ? A : nullptr;
+  }
+
+  // Insert before the terminator of BB a loop converting N elements from
+  // From to To, return the block after it
+  static BasicBlock *insertConvertLoop(BasicBlock *BB, Value *N, Value *From,
+                                       Type *FromTy, Value *To, Type *ToTy,
+                                       DominatorTree &DT, LoopInfo &LI,
+                                       const Twine &Name) {
+    LLVMContext &Ctx = BB->getContext();
+    Type *Int64Ty = Type::getInt64Ty(Ctx);
+    BasicBlock *Tail = SplitBlock(BB, BB->getTerminator(), &DT, &LI, nullptr,
+                                  Name + ".done");
+    BasicBlock *Copy = BasicBlock::Create(Ctx, Name, BB->getParent(), Tail);
+
+    BB->getTerminator()->eraseFromParent();
+    IRBuilder<> Builder(BB);
+    Builder.CreateCondBr(Builder.CreateICmpEQ(N, ConstantInt::get(Int64Ty, 0)),
+                         Tail, Copy);
+
+    Builder.SetInsertPoint(Copy);
+    PHINode *J = Builder.CreatePHI(Int64Ty, 2, "j");
+    Value *V = Builder.CreateLoad(FromTy, Builder.CreateInBoundsGEP(FromTy, From, J));
+    Builder.CreateStore(Builder.CreateFPCast(V, ToTy),
+                        Builder.CreateInBoundsGEP(ToTy, To, J));
+    Value *Next = Builder.CreateNUWAdd(J, ConstantInt::get(Int64Ty, 1));
+    Builder.CreateCondBr(Builder.CreateICmpULT(Next, N), Copy, Tail);
+
+    J->addIncoming(ConstantInt::get(Int64Ty, 0), BB);
+    J->addIncoming(Next, Copy);
+
+    DT.addNewBlock(Copy, BB);
+
+    Loop *CopyLoop = LI.AllocateLoop();
+    if (Loop *Parent = LI.getLoopFor(BB))
+      Parent->addChildLoop(CopyLoop);
+    else
+      LI.addTopLevelLoop(CopyLoop);
+    CopyLoop->addBasicBlockToLoop(Copy, LI);
+
+    return Tail;
+  }
+
+  // Run a double copy of the nest when Fallback is true, from the end of
+  // Check to Join. Check must end with a branch to the preheader of L and Join
+  // must follow the unique exit block, whose phis are merged in Join
+  static void versionLoop(Loop &L, Value *Fallback, BasicBlock *Check,
+                          BasicBlock *Join, DominatorTree &DT, LoopInfo &LI) {
+    BasicBlock *Exiting = L.getExitingBlock();
+    BasicBlock *Exit = L.getUniqueExitBlock();
+    SmallVector<BasicBlock *, 8> Blocks;
+    ValueToValueMapTy VMap;
+
+    cloneLoopWithPreheader(L.getLoopPreheader(), Check, &L, VMap, ".double", &LI, &DT,
+                           Blocks);
+    remapInstructionsInBlocks(Blocks, VMap);
+
+    BasicBlock *Preheader = cast<BasicBlock>(VMap[L.getLoopPreheader()]);
+    Check->getTerminator()->eraseFromParent();
+    BranchInst::Create(Preheader, L.getLoopPreheader(), Fallback, Check);
+
+    BasicBlock *ClonedExiting = cast<BasicBlock>(VMap[Exiting]);
+    ClonedExiting->getTerminator()->replaceSuccessorWith(Exit, Join);
+
+    // The exit has a single predecessor: its phis are the values live out of
+    // the nest, in LCSSA form
+    for (PHINode &PN : make_early_inc_range(Exit->phis())) {
+      PHINode *Merged = PHINode::Create(PN.getType(), 2, PN.getName() + ".merged",
+                                        &Join->front());
+      Value *V = PN.getIncomingValue(0);
+
+      PN.replaceAllUsesWith(Merged);
+      Merged->addIncoming(&PN, Exit);
+      Merged->addIncoming(VMap.count(V) ? (Value *)VMap[V] : V, ClonedExiting);
+    }
+
+    DT.changeImmediateDominator(Join, Check);
+  }
+
+  // Streams of the outermost loop over noalias arrays
+  static void findStreams(Loop &L, DominatorTree &DT, ScalarEvolution &SE,
+                          MapVector<Argument *, Stream> &Streams) {
+    BasicBlock *Header = L.getHeader();
+    BasicBlock *Latch = L.getLoopLatch();
+    BasicBlock *Exiting = L.getExitingBlock();
+    BasicBlock *Exit = L.getUniqueExitBlock();
+    const SCEV *BTC = SE.getBackedgeTakenCount(&L);
+
+    if (!L.getLoopPreheader() || !Latch || !Exiting || !Exit
+        || Exit->getSinglePredecessor() != Exiting || isa<SCEVCouldNotCompute>(BTC))
+      return;
+
+    Type *Int64Ty = Type::getInt64Ty(Header->getContext());
+    const SCEV *Iterations =
+      SE.getAddExpr(SE.getTruncateOrZeroExtend(BTC, Int64Ty), SE.getOne(Int64Ty));
+    const SCEV *Eight = SE.getConstant(Int64Ty, 8);
+
+    for (BasicBlock *BB : L.blocks()) {
+      // Executions of the block: every iteration, the last one included when
+      // the loop exits after it
+      const SCEV *Count = nullptr;
+      if (DT.dominates(BB, Latch)) {
+        if (Exiting == Latch || BB == Header)
+          Count = Iterations;
+        else if (Exiting == Header)
+          Count = SE.getTruncateOrZeroExtend(BTC, Int64Ty);
+      }
+
+      for (Instruction &I : *BB) {
+        if (CallBase *CB = dyn_cast<CallBase>(&I)) {
+          for (Value *Arg : CB->args())
+            if (Arg->getType()->isPointerTy())
+              if (Argument *A = getNoAliasBase(Arg, SE))
+                Streams[A].Valid = false;
+          continue;
+        }
+
+        Value *Ptr = getLoadStorePointerOperand(&I);
+        if (!Ptr)
+          continue;
+
+        Argument *A = getNoAliasBase(Ptr, SE);
+        if (!A)
+          continue;
+
+        Stream &S = Streams[A];
+        Type *Ty = getLoadStoreType(&I);
+        const SCEVAddRecExpr *AR = dyn_cast<SCEVAddRecExpr>(SE.getSCEV(Ptr));
+
+        if (!Count || !Ty->isDoubleTy()
+            || (isa<LoadInst>(I) && !cast<LoadInst>(I).isSimple())
+            || (isa<StoreInst>(I) && !cast<StoreInst>(I).isSimple())
+            || !AR || AR->getLoop() != &L || !AR->isAffine()
+            || AR->getStepRecurrence(SE) != Eight
+            || !SE.isLoopInvariant(AR->getStart(), &L)) {
+          S.Valid = false;
+          continue;
+        }
+
+        // One stream per array: copies of overlapping ranges would diverge
+        if (S.Start && (S.Start != AR->getStart() || S.Count != Count)) {
+          S.Valid = false;
+          continue;
+        }
+
+        S.Start = AR->getStart();
+        S.Count = Count;
+        S.PtrTy = Ptr->getType();
+        S.Accesses.push_back(&I);
+        S.Loaded |= isa<LoadInst>(I);
+        S.Stored |= isa<StoreInst>(I);
+      }
+    }
+  }
+
+  LoopDemotionStats demoteLoopNest(Function &F, Loop &L, DominatorTree &DT,
+                                   LoopInfo &LI, ScalarEvolution &SE) {
+    LoopDemotionStats Stats;
+    MapVector<Argument *, Stream> Streams;
+    LLVMContext &Ctx = F.getContext();
+    Module *M = F.getParent();
+    Type *Int64Ty = Type::getInt64Ty(Ctx);
+    Type *FloatTy = Type::getFloatTy(Ctx);
+    Type *DoubleTy = Type::getDoubleTy(Ctx);
+    PointerType *FloatPtrTy = PointerType::getUnqual(FloatTy);
+
+    findStreams(L, DT, SE, Streams);
+
+    FunctionCallee Malloc = M->getOrInsertFunction("malloc", Type::getInt8PtrTy(Ctx), Int64Ty);
+    FunctionCallee Free = M->getOrInsertFunction("free", Type::getVoidTy(Ctx),
+                                                 Type::getInt8PtrTy(Ctx));
+
+    // Buffers, allocated in the preheader
+    BasicBlock *Check = L.getLoopPreheader();
+    SCEVExpander Expander(SE, M->getDataLayout(), "fastfp");
+    Value *Fallback = nullptr;
+
+    for (auto &It : Streams) {
+      Stream &S = It.second;
+      if (!S.Valid || S.Accesses.empty())
+        continue;
+
+      Instruction *InsertPt = Check->getTerminator();
+      IRBuilder<> Builder(InsertPt);
+
+      S.N = Expander.expandCodeFor(S.Count, Int64Ty, InsertPt);
+      S.Double = Expander.expandCodeFor(S.Start, S.PtrTy, InsertPt);
+      Value *Bytes = Builder.CreateNUWMul(S.N, ConstantInt::get(Int64Ty, 4));
+      Value *Buffer = Builder.CreateCall(Malloc, {Bytes});
+      S.Float = Builder.CreateBitCast(Buffer, FloatPtrTy, It.first->getName() + ".f");
+
+      Value *Null = Builder.CreateIsNull(Buffer);
+      Fallback = Fallback ? Builder.CreateOr(Fallback, Null) : Null;
+    }
+
+    // The double nest runs when a buffer cannot be allocated, then joins the
+    // demoted one after the copies back
+    BasicBlock *Exit = L.getUniqueExitBlock();
+    BasicBlock *Join = nullptr;
+
+    if (Fallback) {
+      formLCSSARecursively(L, DT, &LI, &SE);
+      SplitBlock(Check, Check->getTerminator(), &DT, &LI, nullptr, "fastfp.ph");
+      Join = SplitBlock(Exit, &*Exit->getFirstInsertionPt(), &DT, &LI);
+      versionLoop(L, Fallback, Check, Join, DT, LI);
+    }
+
+    // Accesses of the demoted nest
+    for (auto &It : Streams) {
+      Stream &S = It.second;
+      if (!S.Float)
+        continue;
+
+      const SCEV *FloatPtr =
+        SE.getAddRecExpr(SE.getSCEV(S.Float), SE.getConstant(Int64Ty, 4), &L,
+                         SCEV::FlagNUW);
+
+      for (Instruction *I : S.Accesses) {
+        Value *Ptr = Expander.expandCodeFor(FloatPtr, FloatPtrTy, I);
+        Value *OldPtr = getLoadStorePointerOperand(I);
+        IRBuilder<> Access(I);
+
+        if (LoadInst *Load = dyn_cast<LoadInst>(I)) {
+          Value *New = Access.CreateAlignedLoad(FloatTy, Ptr, Align(4));
+          Load->replaceAllUsesWith(Access.CreateFPExt(New, DoubleTy));
+        }
+        else {
+          StoreInst *Store = cast<StoreInst>(I);
+          Access.CreateAlignedStore(Access.CreateFPTrunc(Store->getValueOperand(), FloatTy),
+                                    Ptr, Align(4));
+        }
+
+        I->eraseFromParent();
+        RecursivelyDeleteTriviallyDeadInstructions(OldPtr);
+      }
+
+      Stats.Streams++;
+    }
+
+    // Copies in the preheader and in the exit block
+    if (Stats.Streams) {
+      BasicBlock *Before = L.getLoopPreheader();
+      BasicBlock *Back = Exit;
+
+      for (auto &It : Streams) {
+        Stream &S = It.second;
+        if (!S.Float)
+          continue;
+
+        if (S.Loaded)
+          Before = insertConvertLoop(Before, S.N, S.Double, DoubleTy, S.Float, FloatTy,
+                                     DT, LI, "fastfp.copy");
+
+        if (S.Stored)
+          Back = insertConvertLoop(Back, S.N, S.Float, FloatTy, S.Double, DoubleTy,
+                                   DT, LI, "fastfp.copyback");
+      }
+
+      // Buffers not allocated are null
+      IRBuilder<> Builder(&*Join->getFirstInsertionPt());
+      for (auto &It : Streams)
+        if (It.second.Float)
+          Builder.CreateCall(Free, {Builder.CreateBitCast(It.second.Float,
+                                                          Type::getInt8PtrTy(Ctx))});
+    }
+
+    SE.forgetLoop(&L);
+
+    // Every web of the nest, moving values is worth it once arrays are float
+    std::vector<Web> Webs;
+    findWebs(F, [&](Instruction *I) { return L.contains(I); }, Webs);
+
+    for (Web &W : Webs) {
+      if (!W.Valid) {
+        Stats.KeptWebs++;
+        continue;
+      }
+
+      RetypeStats Retyped = retypeWeb(F, W);
+      Stats.Retyped.Values += Retyped.Values;
+      Stats.Retyped.Conversions += Retyped.Conversions;
+      Stats.Retyped.Calls.append(Retyped.Calls.begin(), Retyped.Calls.end());
+      Stats.Webs++;
+    }
+
+    return Stats;
+  }
+
+} // namespace fastfp
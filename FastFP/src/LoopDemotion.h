@@ -0,0 +1,76 @@
+//===- LoopDemotion.h - Precision demotion of loop nests ------------------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// This file declares the loop mode of FastFP: every double of a loop nest is
+// demoted to float, the arrays streamed by the nest through temporary float
+// copies, and the vector cost of the innermost loops is compared before and
+// after the demotion.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef FASTFP_LOOPDEMOTION_H
+#define FASTFP_LOOPDEMOTION_H
+
+#include "PrecisionWeb.h"
+
+#include "llvm/Analysis/LoopInfo.h"
+#include "llvm/Analysis/ScalarEvolution.h"
+#include "llvm/Analysis/TargetTransformInfo.h"
+#include "llvm/IR/Dominators.h"
+#include "llvm/IR/Function.h"
+
+#include <string>
+
+namespace fastfp {
+
+  // Vector cost of an innermost loop with its doubles and with floats, per
+  // scalar iteration at the widest vectorization factor of each type
+  struct VectorCost {
+    unsigned DoubleVF = 1;
+    unsigned FloatVF = 1;
+    double DoubleCost = 0.0;
+    double FloatCost = 0.0;
+    bool Vectorizable = true;
+    std::string Reason;
+
+    double speedup() const {
+      return FloatCost > 0.0 ? DoubleCost / FloatCost : 1.0;
+    }
+  };
+
+  // Cost of one vector instruction of VF elements of type Elt doing the work
+  // of I (its scalar version when VF is 1), or of I itself for the
+  // instructions that do not carry doubles
+  double vectorCost(llvm::Instruction &I, llvm::Type *Elt, unsigned VF,
+                    const llvm::TargetTransformInfo &TTI);
+
+  // MathVariants: the float math library calls will have vector variants
+  VectorCost estimateVectorCost(llvm::Loop &L, llvm::ScalarEvolution &SE,
+                                const llvm::TargetTransformInfo &TTI,
+                                bool MathVariants = false);
+
+  struct LoopDemotionStats {
+    unsigned Streams = 0;  // Arrays copied to float buffers
+    unsigned Webs = 0;     // Webs retyped
+    unsigned KeptWebs = 0; // Webs whose storage escapes
+    RetypeStats Retyped;
+  };
+
+  // Demote the doubles of a loop nest to float. An array read or written at
+  // consecutive elements by every iteration of the outermost loop, through a
+  // noalias pointer, is copied to a float buffer in the preheader and copied
+  // back in the exit block when it is written. A double copy of the nest runs
+  // when a buffer cannot be allocated. The dominator tree and the loop info
+  // are updated, the nest is left in LCSSA form.
+  LoopDemotionStats demoteLoopNest(llvm::Function &F, llvm::Loop &L,
+                                   llvm::DominatorTree &DT, llvm::LoopInfo &LI,
+                                   llvm::ScalarEvolution &SE);
+
+} // namespace fastfp
+
+#endif // FASTFP_LOOPDEMOTION_H
@@ -0,0 +1,210 @@
+//===- PrecisionPolicy.cpp - Precision of functions and loops -------------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+
+#include "PrecisionPolicy.h"
+
+#include "llvm/ADT/Optional.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/GlobalVariable.h"
+#include "llvm/IR/Metadata.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/JSON.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <string>
+
+using namespace llvm;
+
+// Shared by fast-fp and fast-fp-storage
+static cl::opt<std::string>
+PolicyFile("fast-fp-policy",
+           cl::desc("Precision of functions and loops, as a JSON object of "
+                    "FUNCTION or FUNCTION/HEADER (* for all the functions) to "
+                    "double, storage, mixed or float; overrides the annotations "
+                    "of the source"),
+           cl::value_desc("filename"), cl::init(""));
+
+namespace fastfp {
+
+  static const char *AnnotationPrefix = "fastfp:";
+  static const char *LoopAttribute = "fastfp.precision";
+
+  StringRef getModeName(PrecisionMode Mode) {
+    switch (Mode) {
+    case ModeDouble: return "double";
+    case ModeStorage: return "storage";
+    case ModeFloat: return "float";
+    default: return "mixed";
+    }
+  }
+
+  static bool parseMode(StringRef Name, PrecisionMode &Mode) {
+    if (Name == "double") Mode = ModeDouble;
+    else if (Name == "storage") Mode = ModeStorage;
+    else if (Name == "mixed") Mode = ModeMixed;
+    else if (Name == "float") Mode = ModeFloat;
+    else return false;
+    return true;
+  }
+
+  // __attribute__((annotate("fastfp:MODE"))) on a function
+  static bool readAnnotations(Module &M, DenseMap<const Function *, PrecisionMode> &Annotated) {
+    GlobalVariable *GV = M.getGlobalVariable("llvm.global.annotations");
+    if (!GV || !GV->hasInitializer())
+      return true;
+
+    ConstantArray *CA = dyn_cast<ConstantArray>(GV->getInitializer());
+    if (!CA)
+      return true;
+
+    for (Value *Op : CA->operands()) {
+      ConstantStruct *CS = dyn_cast<ConstantStruct>(Op);
+      if (!CS || CS->getNumOperands() < 2)
+        continue;
+
+      Function *F = dyn_cast<Function>(CS->getOperand(0)->stripPointerCasts());
+      GlobalVariable *Str = dyn_cast<GlobalVariable>(CS->getOperand(1)->stripPointerCasts());
+      if (!F || !Str || !Str->hasInitializer())
+        continue;
+
+      ConstantDataSequential *Data = dyn_cast<ConstantDataSequential>(Str->getInitializer());
+      if (!Data || !Data->isCString())
+        continue;
+
+      StringRef Text = Data->getAsCString();
+      if (!Text.consume_front(AnnotationPrefix))
+        continue;
+
+      PrecisionMode Mode;
+      if (!parseMode(Text, Mode)) {
+        errs() << "Unknown precision mode: " << Text << " (function "
+               << F->getName() << ")\n";
+        return false;
+      }
+
+      Annotated[F] = Mode;
+    }
+
+    return true;
+  }
+
+  // Mode of the fastfp.precision attribute of a loop, llvm.loop metadata
+  // written by the front end: !{!"fastfp.precision", !"float"}
+  static bool getLoopAttribute(const Loop *L, PrecisionMode &Mode) {
+    Optional<const MDOperand *> Op = findStringMetadataForLoop(L, LoopAttribute);
+    if (!Op || !*Op)
+      return false;
+
+    MDString *Name = dyn_cast<MDString>(**Op);
+    return Name && parseMode(Name->getString(), Mode);
+  }
+
+  static bool hasLoopAttributes(Module &M) {
+    for (Function &F : M)
+      for (BasicBlock &BB : F) {
+        Instruction *Term = BB.getTerminator();
+        MDNode *LoopID = Term ? Term->getMetadata(LLVMContext::MD_loop) : nullptr;
+        if (!LoopID)
+          continue;
+
+        for (const MDOperand &Op : LoopID->operands()) {
+          MDNode *Attr = dyn_cast<MDNode>(Op);
+          if (!Attr || Attr->getNumOperands() == 0)
+            continue;
+
+          MDString *Name = dyn_cast<MDString>(Attr->getOperand(0));
+          if (Name && Name->getString() == LoopAttribute)
+            return true;
+        }
+      }
+
+    return false;
+  }
+
+  bool PrecisionPolicy::read(Module &M) {
+    if (!readAnnotations(M, Annotated))
+      return false;
+
+    LoopMetadata = hasLoopAttributes(M);
+
+    if (PolicyFile.empty())
+      return true;
+
+    auto Buffer = MemoryBuffer::getFile(PolicyFile);
+    if (!Buffer) {
+      errs() << "Cannot read precision policy: " << PolicyFile << "\n";
+      return false;
+    }
+
+    Expected<json::Value> Root = json::parse((*Buffer)->getBuffer());
+    if (!Root) {
+      errs() << "Invalid precision policy: " << PolicyFile << ": "
+             << toString(Root.takeError()) << "\n";
+      return false;
+    }
+
+    json::Object *Object = Root->getAsObject();
+    if (!Object) {
+      errs() << "Invalid precision policy: " << PolicyFile << ": not an object\n";
+      return false;
+    }
+
+    for (auto &Entry : *Object) {
+      Optional<StringRef> Name = Entry.second.getAsString();
+      PrecisionMode Mode;
+
+      if (!Name || !parseMode(*Name, Mode)) {
+        errs() << "Unknown precision mode for " << Entry.first.str() << " in "
+               << PolicyFile << "\n";
+        return false;
+      }
+
+      Entries[Entry.first.str()] = Mode;
+    }
+
+    return true;
+  }
+
+  bool PrecisionPolicy::lookup(StringRef Key, PrecisionMode &Mode) const {
+    auto It = Entries.find(Key);
+    if (It == Entries.end())
+      return false;
+
+    Mode = It->second;
+    return true;
+  }
+
+  PrecisionMode PrecisionPolicy::function(Function &F) const {
+    PrecisionMode Mode = ModeMixed;
+    if (lookup(F.getName(), Mode) || lookup("*", Mode))
+      return Mode;
+
+    auto It = Annotated.find(&F);
+    return It != Annotated.end() ? It->second : ModeMixed;
+  }
+
+  PrecisionMode PrecisionPolicy::loop(Loop *L) const {
+    Function &F = *L->getHeader()->getParent();
+
+    for (; L; L = L->getParentLoop()) {
+      PrecisionMode Mode;
+      if (lookup((F.getName() + "/" + L->getHeader()->getName()).str(), Mode)
+          || getLoopAttribute(L, Mode))
+        return Mode;
+    }
+
+    return function(F);
+  }
+
+  PrecisionMode PrecisionPolicy::at(BasicBlock *BB, LoopInfo &LI) const {
+    Loop *L = LI.getLoopFor(BB);
+    return L ? loop(L) : function(*BB->getParent());
+  }
+
+} // namespace fastfp
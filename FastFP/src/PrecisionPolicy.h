@@ -0,0 +1,67 @@
+//===- PrecisionPolicy.h - Precision of functions and loops ---------------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// This file declares the precision policy of FastFP: the mode of each function
+// and loop, from the annotations of the source (annotate("fastfp:float") on
+// functions, fastfp.precision in the llvm.loop metadata of loops) and from a
+// JSON policy file that overrides them.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef FASTFP_PRECISIONPOLICY_H
+#define FASTFP_PRECISIONPOLICY_H
+
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Analysis/LoopInfo.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/Module.h"
+
+namespace fastfp {
+
+  // From the most to the least conservative: the mode of code under several
+  // scopes, or of a web spanning several, is the smallest
+  enum PrecisionMode {
+    ModeDouble,  // Nothing demoted
+    ModeStorage, // Arrays compressed by fast-fp-storage, arithmetic in double
+    ModeMixed,   // Webs chosen by the plan and the cost model (default)
+    ModeFloat    // Every web that can be demoted
+  };
+
+  llvm::StringRef getModeName(PrecisionMode Mode);
+
+  class PrecisionPolicy {
+  public:
+    // Read the annotations of M and the file of -fast-fp-policy
+    bool read(llvm::Module &M);
+
+    bool empty() const { return Entries.empty() && Annotated.empty() && !LoopMetadata; }
+
+    // Entry of the file for the function, or for *, or annotation
+    PrecisionMode function(llvm::Function &F) const;
+
+    // Mode of a loop: entry of the file FUNCTION/HEADER or metadata, or mode
+    // of the enclosing loop, or of the function
+    PrecisionMode loop(llvm::Loop *L) const;
+
+    // Mode of the innermost loop of BB, or of the function out of the loops
+    PrecisionMode at(llvm::BasicBlock *BB, llvm::LoopInfo &LI) const;
+
+  private:
+    // FUNCTION or FUNCTION/HEADER
+    llvm::StringMap<PrecisionMode> Entries;
+    llvm::DenseMap<const llvm::Function *, PrecisionMode> Annotated;
+    bool LoopMetadata = false;
+
+    bool lookup(llvm::StringRef Key, PrecisionMode &Mode) const;
+  };
+
+} // namespace fastfp
+
+#endif // FASTFP_PRECISIONPOLICY_H
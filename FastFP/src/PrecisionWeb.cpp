@@ -0,0 +1,533 @@
+//===- PrecisionWeb.cpp - Webs of double precision values -----------------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+
+#include "PrecisionWeb.h"
+
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/DenseSet.h"
+#include "llvm/ADT/EquivalenceClasses.h"
+#include "llvm/ADT/PostOrderIterator.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/DataLayout.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/IntrinsicInst.h"
+#include "llvm/IR/Module.h"
+
+using namespace llvm;
+
+namespace fastfp {
+
+  bool isDoubleBased(Type *Ty) {
+    if (ArrayType *ATy = dyn_cast<ArrayType>(Ty))
+      return isDoubleBased(ATy->getElementType());
+
+    return Ty->isDoubleTy();
+  }
+
+  Type *getFloatBased(Type *Ty) {
+    if (ArrayType *ATy = dyn_cast<ArrayType>(Ty))
+      return ArrayType::get(getFloatBased(ATy->getElementType()),
+                            ATy->getNumElements());
+
+    return Ty->isDoubleTy() ? Type::getFloatTy(Ty->getContext()) : Ty;
+  }
+
+  // Intrinsics with a float version computing the same function
+  static bool isRetypableIntrinsic(Instruction *I) {
+    IntrinsicInst *II = dyn_cast<IntrinsicInst>(I);
+    if (!II || !II->getType()->isDoubleTy())
+      return false;
+
+    switch (II->getIntrinsicID()) {
+    case Intrinsic::fabs:
+    case Intrinsic::fma:
+    case Intrinsic::fmuladd:
+    case Intrinsic::sqrt:
+    case Intrinsic::minnum:
+    case Intrinsic::maxnum:
+    case Intrinsic::copysign:
+    case Intrinsic::exp:
+    case Intrinsic::exp2:
+    case Intrinsic::log:
+    case Intrinsic::log2:
+    case Intrinsic::log10:
+    case Intrinsic::sin:
+    case Intrinsic::cos:
+    case Intrinsic::pow:
+    case Intrinsic::floor:
+    case Intrinsic::ceil:
+    case Intrinsic::trunc:
+    case Intrinsic::round:
+    case Intrinsic::rint:
+    case Intrinsic::nearbyint:
+      for (Value *Op : II->args())
+        if (!Op->getType()->isDoubleTy())
+          return false;
+      return true;
+    default:
+      return false;
+    }
+  }
+
+  StringRef getFloatLibCall(Instruction *I) {
+    static const StringMap<StringRef> FloatVersions = {
+      {"sqrt", "sqrtf"}, {"cbrt", "cbrtf"}, {"hypot", "hypotf"},
+      {"exp", "expf"}, {"exp2", "exp2f"}, {"expm1", "expm1f"},
+      {"log", "logf"}, {"log2", "log2f"}, {"log10", "log10f"}, {"log1p", "log1pf"},
+      {"pow", "powf"}, {"sin", "sinf"}, {"cos", "cosf"}, {"tan", "tanf"},
+      {"asin", "asinf"}, {"acos", "acosf"}, {"atan", "atanf"}, {"atan2", "atan2f"},
+      {"sinh", "sinhf"}, {"cosh", "coshf"}, {"tanh", "tanhf"},
+      {"erf", "erff"}, {"fabs", "fabsf"}, {"fmod", "fmodf"},
+      {"floor", "floorf"}, {"ceil", "ceilf"}, {"trunc", "truncf"}, {"round", "roundf"},
+      {"fmin", "fminf"}, {"fmax", "fmaxf"}, {"fma", "fmaf"},
+    };
+
+    CallInst *CI = dyn_cast<CallInst>(I);
+    if (!CI || isa<IntrinsicInst>(CI) || CI->isNoBuiltin() || !CI->getType()->isDoubleTy())
+      return StringRef();
+
+    // The C library, not a function of the program with the same name
+    Function *Callee = CI->getCalledFunction();
+    if (!Callee || !Callee->isDeclaration())
+      return StringRef();
+
+    for (Value *Arg : CI->args())
+      if (!Arg->getType()->isDoubleTy())
+        return StringRef();
+
+    auto It = FloatVersions.find(Callee->getName());
+    return It == FloatVersions.end() ? StringRef() : It->second;
+  }
+
+  CallInst *createFloatCall(IRBuilder<> &Builder, CallInst *CI, ArrayRef<Value *> Args) {
+    Type *FloatTy = Builder.getFloatTy();
+
+    if (IntrinsicInst *II = dyn_cast<IntrinsicInst>(CI))
+      return Builder.CreateIntrinsic(II->getIntrinsicID(), {FloatTy}, Args);
+
+    Function *Callee = CI->getCalledFunction();
+    Module *M = CI->getModule();
+    SmallVector<Type *, 3> Params(Args.size(), FloatTy);
+    FunctionCallee FloatF = M->getOrInsertFunction(getFloatLibCall(CI),
+                                                   FunctionType::get(FloatTy, Params, false),
+                                                   Callee->getAttributes());
+
+    CallInst *New = Builder.CreateCall(FloatF, Args);
+    New->setAttributes(CI->getAttributes());
+    New->setCallingConv(CI->getCallingConv());
+    New->setTailCallKind(CI->getTailCallKind());
+    return New;
+  }
+
+  bool isDoubleArithmetic(Instruction *I) {
+    if (isa<BinaryOperator>(I) || isa<UnaryOperator>(I))
+      return I->getType()->isDoubleTy();
+
+    return isRetypableIntrinsic(I) || !getFloatLibCall(I).empty();
+  }
+
+  void getDoubleArithmetic(Function &F, SmallVectorImpl<Instruction *> &Ops) {
+    for (BasicBlock &BB : F)
+      for (Instruction &I : BB)
+        if (isDoubleArithmetic(&I))
+          Ops.push_back(&I);
+  }
+
+  // Members of a web, pointers to retypable storage included
+  static bool isMember(Instruction *I, DenseSet<Instruction *> &Pointers,
+                       unsigned &Arithmetic) {
+    if (AllocaInst *AI = dyn_cast<AllocaInst>(I)) {
+      if (!isDoubleBased(AI->getAllocatedType()))
+        return false;
+
+      Pointers.insert(I);
+      return true;
+    }
+
+    if (GetElementPtrInst *GEP = dyn_cast<GetElementPtrInst>(I)) {
+      Instruction *Ptr = dyn_cast<Instruction>(GEP->getPointerOperand());
+      if (!Ptr || !Pointers.count(Ptr) || !isDoubleBased(GEP->getResultElementType()))
+        return false;
+
+      Pointers.insert(I);
+      return true;
+    }
+
+    if (LoadInst *LI = dyn_cast<LoadInst>(I)) {
+      Instruction *Ptr = dyn_cast<Instruction>(LI->getPointerOperand());
+      return Ptr && Pointers.count(Ptr) && LI->getType()->isDoubleTy();
+    }
+
+    if (StoreInst *SI = dyn_cast<StoreInst>(I)) {
+      Instruction *Ptr = dyn_cast<Instruction>(SI->getPointerOperand());
+      return Ptr && Pointers.count(Ptr)
+        && SI->getValueOperand()->getType()->isDoubleTy();
+    }
+
+    if (isDoubleArithmetic(I)) {
+      Arithmetic++;
+      return true;
+    }
+
+    if (isa<PHINode>(I) || isa<SelectInst>(I))
+      return I->getType()->isDoubleTy();
+
+    if (FCmpInst *FC = dyn_cast<FCmpInst>(I))
+      return FC->getOperand(0)->getType()->isDoubleTy();
+
+    // Sources: the float operand or the integer is converted once
+    if (FPExtInst *FE = dyn_cast<FPExtInst>(I)) {
+      Instruction *Src = dyn_cast<Instruction>(FE->getOperand(0));
+      return FE->getType()->isDoubleTy() && FE->getSrcTy()->isFloatTy()
+        && !(Src && Src->isTerminator());
+    }
+
+    if (isa<SIToFPInst>(I) || isa<UIToFPInst>(I))
+      return I->getType()->isDoubleTy();
+
+    return false;
+  }
+
+  // The storage of the web is only loaded, stored and indexed by the web
+  static bool checkPointer(Instruction *P, DenseSet<Instruction *> &Members,
+                           std::string &Reason) {
+    for (User *U : P->users()) {
+      Instruction *I = dyn_cast<Instruction>(U);
+
+      if (!I || !Members.count(I)) {
+        Reason = "address used outside of the web";
+        return false;
+      }
+
+      if (LoadInst *LI = dyn_cast<LoadInst>(I)) {
+        if (!LI->isSimple()) {
+          Reason = "volatile or atomic load";
+          return false;
+        }
+      }
+      else if (StoreInst *SI = dyn_cast<StoreInst>(I)) {
+        if (SI->getValueOperand() == P) {
+          Reason = "address stored";
+          return false;
+        }
+        if (!SI->isSimple()) {
+          Reason = "volatile or atomic store";
+          return false;
+        }
+      }
+      else if (!isa<GetElementPtrInst>(I)) {
+        Reason = "address used by " + std::string(I->getOpcodeName());
+        return false;
+      }
+    }
+
+    return true;
+  }
+
+  void findWebs(Function &F, function_ref<bool(Instruction *)> Filter,
+                std::vector<Web> &Webs) {
+    SmallVector<Instruction *, 64> Order;
+    DenseSet<Instruction *> Members;
+    DenseSet<Instruction *> Pointers;
+    DenseMap<Instruction *, unsigned> Arithmetic;
+    EquivalenceClasses<Instruction *> Classes;
+
+    // Pointers are defined before their uses in reverse post order
+    ReversePostOrderTraversal<Function *> RPOT(&F);
+    for (BasicBlock *BB : RPOT) {
+      for (Instruction &I : *BB) {
+        unsigned IsArithmetic = 0;
+
+        if (!Filter(&I) || !isMember(&I, Pointers, IsArithmetic))
+          continue;
+
+        Order.push_back(&I);
+        Members.insert(&I);
+        Classes.insert(&I);
+        Arithmetic[&I] = IsArithmetic;
+      }
+    }
+
+    // Connect every member with the members it uses
+    for (Instruction *I : Order)
+      for (Value *Op : I->operands())
+        if (Instruction *OpI = dyn_cast<Instruction>(Op))
+          if (Members.count(OpI))
+            Classes.unionSets(I, OpI);
+
+    DenseMap<Instruction *, unsigned> WebOf;
+    size_t First = Webs.size();
+
+    for (Instruction *I : Order) {
+      Instruction *Leader = Classes.getLeaderValue(I);
+      auto It = WebOf.find(Leader);
+
+      if (It == WebOf.end()) {
+        It = WebOf.insert({Leader, Webs.size()}).first;
+        Webs.emplace_back();
+      }
+
+      Web &W = Webs[It->second];
+      W.Members.push_back(I);
+      W.Arithmetic += Arithmetic[I];
+    }
+
+    for (size_t i = First; i < Webs.size(); i++)
+      for (Instruction *I : Webs[i].Members)
+        if (Pointers.count(I) && Webs[i].Valid)
+          Webs[i].Valid = checkPointer(I, Members, Webs[i].Reason);
+  }
+
+  namespace {
+    // Rewriting of one web
+    struct Retyper {
+      Function &F;
+      Web &W;
+      const DataLayout &DL;
+      Type *FloatTy;
+      DenseSet<Instruction *> Members;
+      DenseMap<Value *, Value *> Map;
+      DenseMap<std::pair<Value *, Instruction *>, Value *> Extended;
+      SmallVector<Instruction *, 8> Dead;
+      RetypeStats Stats;
+
+      Retyper(Function &F, Web &W)
+        : F(F), W(W), DL(F.getParent()->getDataLayout()),
+          FloatTy(Type::getFloatTy(F.getContext())),
+          Members(W.Members.begin(), W.Members.end()) {}
+
+      Align floatAlign(Align Original) {
+        return std::min(Original, DL.getABITypeAlign(FloatTy));
+      }
+
+      // Point right after a definition, or nullptr
+      Instruction *getInsertionPointAfter(Value *V) {
+        if (isa<Argument>(V))
+          return &*F.getEntryBlock().getFirstInsertionPt();
+
+        Instruction *I = dyn_cast<Instruction>(V);
+        if (!I || I->isTerminator())
+          return nullptr;
+
+        return isa<PHINode>(I) ? &*I->getParent()->getFirstInsertionPt()
+                               : I->getNextNode();
+      }
+
+      // Float version of an operand: values from outside of the web are
+      // truncated once, right after their definition
+      Value *getFloat(Value *V, Instruction *InsertBefore) {
+        auto It = Map.find(V);
+        if (It != Map.end())
+          return It->second;
+
+        if (ConstantFP *C = dyn_cast<ConstantFP>(V))
+          return ConstantExpr::getFPTrunc(C, FloatTy);
+
+        if (isa<UndefValue>(V))
+          return UndefValue::get(FloatTy);
+
+        Instruction *After = getInsertionPointAfter(V);
+        Value *Trunc = new FPTruncInst(V, FloatTy, V->getName() + ".f",
+                                       After ? After : InsertBefore);
+        Stats.Conversions++;
+
+        if (After)
+          Map[V] = Trunc;
+
+        return Trunc;
+      }
+
+      // Double version of a member for a user outside of the web, extended
+      // right before the user: the user may run less often than the member
+      Value *getDouble(Instruction *I, Use &U) {
+        Value *V = Map[I];
+        Instruction *User = cast<Instruction>(U.getUser());
+
+        if (Constant *C = dyn_cast<Constant>(V))
+          return ConstantExpr::getFPExtend(C, I->getType());
+
+        auto It = Extended.find({V, User});
+        if (It != Extended.end())
+          return It->second;
+
+        Instruction *InsertBefore = User;
+        if (PHINode *PN = dyn_cast<PHINode>(User))
+          InsertBefore = PN->getIncomingBlock(U)->getTerminator();
+
+        Value *Ext = new FPExtInst(V, I->getType(), V->getName() + ".d", InsertBefore);
+        Stats.Conversions++;
+
+        // A phi has one use per incoming block
+        if (!isa<PHINode>(User))
+          Extended[{V, User}] = Ext;
+
+        return Ext;
+      }
+
+      // A phi of a block with a single predecessor, e.g. the exit of a loop,
+      // becomes a float phi extended in its own block: extended in the
+      // predecessor, the value would be converted on every iteration
+      bool extendPhi(Instruction *I, PHINode *PN) {
+        if (!PN->getParent()->getSinglePredecessor())
+          return false;
+
+        PHINode *NewPN = PHINode::Create(FloatTy, 1, PN->getName() + ".f", PN);
+        NewPN->addIncoming(Map[I], PN->getIncomingBlock(0));
+
+        Value *Ext = new FPExtInst(NewPN, PN->getType(), PN->getName() + ".d",
+                                   &*PN->getParent()->getFirstInsertionPt());
+        Stats.Conversions++;
+
+        PN->replaceAllUsesWith(Ext);
+        Dead.push_back(PN);
+        return true;
+      }
+
+      void rewrite(Instruction *I) {
+        IRBuilder<> Builder(I);
+        Value *New = nullptr;
+
+        if (AllocaInst *AI = dyn_cast<AllocaInst>(I)) {
+          AllocaInst *NewAI = Builder.CreateAlloca(getFloatBased(AI->getAllocatedType()),
+                                                   AI->getArraySize());
+          NewAI->setAlignment(AI->getAlign());
+          New = NewAI;
+        }
+        else if (GetElementPtrInst *GEP = dyn_cast<GetElementPtrInst>(I)) {
+          SmallVector<Value *, 4> Indices(GEP->indices());
+          Type *Ty = getFloatBased(GEP->getSourceElementType());
+          Value *Ptr = Map[GEP->getPointerOperand()];
+          New = GEP->isInBounds() ? Builder.CreateInBoundsGEP(Ty, Ptr, Indices)
+                                  : Builder.CreateGEP(Ty, Ptr, Indices);
+        }
+        else if (LoadInst *LI = dyn_cast<LoadInst>(I)) {
+          New = Builder.CreateAlignedLoad(FloatTy, Map[LI->getPointerOperand()],
+                                          floatAlign(LI->getAlign()));
+        }
+        else if (StoreInst *SI = dyn_cast<StoreInst>(I)) {
+          Builder.CreateAlignedStore(getFloat(SI->getValueOperand(), SI),
+                                     Map[SI->getPointerOperand()],
+                                     floatAlign(SI->getAlign()));
+        }
+        else if (BinaryOperator *BO = dyn_cast<BinaryOperator>(I)) {
+          New = Builder.CreateBinOp(BO->getOpcode(), getFloat(BO->getOperand(0), I),
+                                    getFloat(BO->getOperand(1), I));
+        }
+        else if (UnaryOperator *UO = dyn_cast<UnaryOperator>(I)) {
+          New = Builder.CreateUnOp(UO->getOpcode(), getFloat(UO->getOperand(0), I));
+        }
+        else if (CallInst *CI = dyn_cast<CallInst>(I)) {
+          SmallVector<Value *, 3> Args;
+          for (Value *Op : CI->args())
+            Args.push_back(getFloat(Op, I));
+
+          CallInst *NewCI = createFloatCall(Builder, CI, Args);
+          Stats.Calls.push_back(NewCI);
+          New = NewCI;
+        }
+        else if (PHINode *PN = dyn_cast<PHINode>(I)) {
+          // Incoming values are set once every member is rewritten
+          New = Builder.CreatePHI(FloatTy, PN->getNumIncomingValues());
+        }
+        else if (SelectInst *Sel = dyn_cast<SelectInst>(I)) {
+          Value *Cond = Sel->getCondition();
+          if (Map.count(Cond))
+            Cond = Map[Cond];
+          New = Builder.CreateSelect(Cond, getFloat(Sel->getTrueValue(), I),
+                                     getFloat(Sel->getFalseValue(), I));
+        }
+        else if (FCmpInst *FC = dyn_cast<FCmpInst>(I)) {
+          New = Builder.CreateFCmp(FC->getPredicate(), getFloat(FC->getOperand(0), I),
+                                   getFloat(FC->getOperand(1), I));
+        }
+        else if (FPExtInst *FE = dyn_cast<FPExtInst>(I)) {
+          Map[I] = FE->getOperand(0);
+          return;
+        }
+        else if (CastInst *CI = dyn_cast<CastInst>(I)) {
+          New = Builder.CreateCast(CI->getOpcode(), CI->getOperand(0), FloatTy);
+        }
+
+        if (!New)
+          return;
+
+        if (Instruction *NewI = dyn_cast<Instruction>(New)) {
+          NewI->takeName(I);
+          if (isa<FPMathOperator>(NewI) && isa<FPMathOperator>(I))
+            NewI->copyFastMathFlags(I);
+          NewI->copyMetadata(*I);
+        }
+
+        Map[I] = New;
+        Stats.Values++;
+      }
+
+      RetypeStats run() {
+        for (Instruction *I : W.Members)
+          rewrite(I);
+
+        for (Instruction *I : W.Members) {
+          if (PHINode *PN = dyn_cast<PHINode>(I)) {
+            PHINode *NewPN = cast<PHINode>(Map[PN]);
+            for (unsigned i = 0; i < PN->getNumIncomingValues(); i++)
+              NewPN->addIncoming(getFloat(PN->getIncomingValue(i),
+                                          PN->getIncomingBlock(i)->getTerminator()),
+                                 PN->getIncomingBlock(i));
+          }
+        }
+
+        // Boundaries: users outside of the web get back a double, except the
+        // fptrunc to float which become useless
+        for (Instruction *I : W.Members) {
+          if (!Map.count(I) || I->getType()->isPointerTy())
+            continue;
+
+          if (isa<FCmpInst>(I)) {
+            I->replaceAllUsesWith(Map[I]);
+            continue;
+          }
+
+          for (Use &U : make_early_inc_range(I->uses())) {
+            Instruction *User = cast<Instruction>(U.getUser());
+            if (Members.count(User))
+              continue;
+
+            if (isa<FPTruncInst>(User) && User->getType() == FloatTy) {
+              User->replaceAllUsesWith(Map[I]);
+              Dead.push_back(User);
+            }
+            else if (!isa<PHINode>(User) || !extendPhi(I, cast<PHINode>(User)))
+              U.set(getDouble(I, U));
+          }
+        }
+
+        for (Instruction *I : Dead)
+          I->eraseFromParent();
+
+        for (Instruction *I : W.Members)
+          I->dropAllReferences();
+
+        for (Instruction *I : W.Members) {
+          if (!I->use_empty())
+            I->replaceAllUsesWith(UndefValue::get(I->getType()));
+          I->eraseFromParent();
+        }
+
+        return Stats;
+      }
+    };
+  }
+
+  RetypeStats retypeWeb(Function &F, Web &W) {
+    Retyper R(F, W);
+    return R.run();
+  }
+
+} // namespace fastfp
@@ -0,0 +1,89 @@
+//===- PrecisionWeb.h - Webs of double precision values -------------------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// This file declares the webs of FastFP: the connected def-use graphs of
+// double values (arithmetic, phis, selects, loads and stores through local
+// double storage, and the fcmp consuming them), retyped to float as a unit.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef FASTFP_PRECISIONWEB_H
+#define FASTFP_PRECISIONWEB_H
+
+#include "llvm/ADT/STLFunctionalExtras.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/Instruction.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/Type.h"
+
+#include <string>
+#include <vector>
+
+namespace fastfp {
+
+  struct Web {
+    // Members in reverse post order: every operand defined in the web comes
+    // before its users, except the incoming values of the phis
+    llvm::SmallVector<llvm::Instruction *, 16> Members;
+
+    // Number of arithmetic operations (binary operators, fneg, intrinsics,
+    // math library calls)
+    unsigned Arithmetic = 0;
+
+    // The local storage of the web escapes or is accessed in a way that
+    // cannot be retyped
+    bool Valid = true;
+    std::string Reason;
+  };
+
+  struct RetypeStats {
+    unsigned Values = 0;      // Members replaced by a float version
+    unsigned Conversions = 0; // fptrunc and fpext inserted at the boundaries
+    llvm::SmallVector<llvm::CallInst *, 4> Calls; // Float math calls created
+  };
+
+  // Double, or array of doubles
+  bool isDoubleBased(llvm::Type *Ty);
+
+  // Same type with float instead of double
+  llvm::Type *getFloatBased(llvm::Type *Ty);
+
+  // Binary operator, fneg, intrinsic or math library call with a float
+  // version, on doubles
+  bool isDoubleArithmetic(llvm::Instruction *I);
+
+  // Float version of a math library function of doubles (sin: sinf), or an
+  // empty name
+  llvm::StringRef getFloatLibCall(llvm::Instruction *I);
+
+  // Call to the float version of a double intrinsic or math library call,
+  // on float arguments
+  llvm::CallInst *createFloatCall(llvm::IRBuilder<> &Builder, llvm::CallInst *CI,
+                                  llvm::ArrayRef<llvm::Value *> Args);
+
+  // Double arithmetic of a function in instruction order: the position of an
+  // operation identifies it in the shadow profiles and the demotion plans
+  void getDoubleArithmetic(llvm::Function &F,
+                           llvm::SmallVectorImpl<llvm::Instruction *> &Ops);
+
+  // Find the webs made of the instructions accepted by Filter, in reachable
+  // blocks
+  void findWebs(llvm::Function &F,
+                llvm::function_ref<bool(llvm::Instruction *)> Filter,
+                std::vector<Web> &Webs);
+
+  // Retype a valid web to float: conversions are inserted only where the web
+  // reads or gives a double to the rest of the function, and the original
+  // members are erased
+  RetypeStats retypeWeb(llvm::Function &F, Web &W);
+
+} // namespace fastfp
+
+#endif // FASTFP_PRECISIONWEB_H
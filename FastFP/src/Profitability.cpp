@@ -0,0 +1,123 @@
+//===- Profitability.cpp - Cost of the demotion of a web ------------------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+
+#include "Profitability.h"
+
+#include "llvm/ADT/DenseSet.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/DerivedTypes.h"
+#include "llvm/IR/Instructions.h"
+
+using namespace llvm;
+
+namespace fastfp {
+
+  CostModel::CostModel(Function &F, const TargetTransformInfo &TTI, LoopInfo &LI,
+                       ScalarEvolution &SE, bool MathVariants)
+    : TTI(TTI), LI(LI), SE(SE), MathVariants(MathVariants), BPI(F, LI),
+      BFI(F, BPI, LI), EntryFreq(BFI.getEntryFreq()) {}
+
+  double CostModel::frequency(BasicBlock *BB) {
+    return BFI.getBlockFreq(BB).getFrequency() / EntryFreq;
+  }
+
+  std::pair<unsigned, unsigned> CostModel::widths(BasicBlock *BB) {
+    Loop *L = LI.getLoopFor(BB);
+    if (!L || !L->isInnermost())
+      return {1, 1};
+
+    auto It = Loops.find(L);
+    if (It == Loops.end())
+      It = Loops.insert({L, estimateVectorCost(*L, SE, TTI, MathVariants)}).first;
+
+    VectorCost &Cost = It->second;
+    if (!Cost.Vectorizable)
+      return {1, 1};
+
+    return {Cost.DoubleVF, Cost.FloatVF};
+  }
+
+  // fptrunc or fpext in a block, at the float width of the block
+  double CostModel::conversion(unsigned Opcode, BasicBlock *BB) {
+    LLVMContext &Ctx = BB->getContext();
+    unsigned VF = widths(BB).second;
+    Type *DoubleTy = Type::getDoubleTy(Ctx);
+    Type *FloatTy = Type::getFloatTy(Ctx);
+
+    if (VF > 1) {
+      DoubleTy = FixedVectorType::get(DoubleTy, VF);
+      FloatTy = FixedVectorType::get(FloatTy, VF);
+    }
+
+    bool Trunc = Opcode == Instruction::FPTrunc;
+    InstructionCost Cost =
+      TTI.getCastInstrCost(Opcode, Trunc ? FloatTy : DoubleTy, Trunc ? DoubleTy : FloatTy,
+                           TargetTransformInfo::CastContextHint::None,
+                           TargetTransformInfo::TCK_RecipThroughput);
+    auto Value = Cost.getValue();
+
+    return frequency(BB) * (Value ? (double)*Value : 1.0) / VF;
+  }
+
+  WebCost CostModel::estimate(Web &W) {
+    WebCost Cost;
+    DenseSet<Instruction *> Members(W.Members.begin(), W.Members.end());
+    DenseSet<Value *> Truncated;
+    LLVMContext &Ctx = W.Members.front()->getContext();
+    Type *DoubleTy = Type::getDoubleTy(Ctx);
+    Type *FloatTy = Type::getFloatTy(Ctx);
+    BasicBlock *Entry = &W.Members.front()->getFunction()->getEntryBlock();
+
+    for (Instruction *I : W.Members) {
+      BasicBlock *BB = I->getParent();
+      auto VF = widths(BB);
+      double Freq = frequency(BB);
+
+      Cost.Double += Freq * vectorCost(*I, DoubleTy, VF.first, TTI) / VF.first;
+      Cost.Float += Freq * vectorCost(*I, FloatTy, VF.second, TTI) / VF.second;
+
+      if (I->getType()->isPointerTy())
+        continue;
+
+      // Doubles read by the web: truncated once, at their definition
+      for (Value *Op : I->operands()) {
+        Instruction *OpI = dyn_cast<Instruction>(Op);
+
+        if (!Op->getType()->isDoubleTy() || (OpI && Members.count(OpI))
+            || (!OpI && !isa<Argument>(Op)))
+          continue;
+
+        if (Truncated.insert(Op).second)
+          Cost.Conversions += conversion(Instruction::FPTrunc, OpI ? OpI->getParent() : Entry);
+      }
+
+      if (isa<FCmpInst>(I) || isa<StoreInst>(I))
+        continue;
+
+      // Doubles given to the rest of the function: extended at each user,
+      // the truncations to float disappear
+      for (Use &U : I->uses()) {
+        Instruction *User = cast<Instruction>(U.getUser());
+        if (Members.count(User))
+          continue;
+
+        BasicBlock *At = User->getParent();
+        if (PHINode *PN = dyn_cast<PHINode>(User))
+          At = PN->getIncomingBlock(U);
+
+        if (isa<FPTruncInst>(User) && User->getType()->isFloatTy())
+          Cost.Conversions -= conversion(Instruction::FPTrunc, At);
+        else
+          Cost.Conversions += conversion(Instruction::FPExt, At);
+      }
+    }
+
+    return Cost;
+  }
+
+} // namespace fastfp
@@ -0,0 +1,67 @@
+//===- Profitability.h - Cost of the demotion of a web --------------------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// This file declares the cost model of FastFP: the TargetTransformInfo cost
+// of a web in double and in float, with the conversions at its boundaries,
+// weighted by block frequency and by the vector width of the loops the
+// vectorizer would vectorize.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef FASTFP_PROFITABILITY_H
+#define FASTFP_PROFITABILITY_H
+
+#include "LoopDemotion.h"
+#include "PrecisionWeb.h"
+
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/Analysis/BlockFrequencyInfo.h"
+#include "llvm/Analysis/BranchProbabilityInfo.h"
+#include "llvm/Analysis/LoopInfo.h"
+#include "llvm/Analysis/ScalarEvolution.h"
+#include "llvm/Analysis/TargetTransformInfo.h"
+
+namespace fastfp {
+
+  // Cycles per call of the function (reciprocal throughput)
+  struct WebCost {
+    double Double = 0.0;      // Members in double
+    double Float = 0.0;       // Members in float
+    double Conversions = 0.0; // fptrunc and fpext at the boundaries
+
+    bool profitable() const { return Float + Conversions < Double; }
+  };
+
+  class CostModel {
+  public:
+    CostModel(llvm::Function &F, const llvm::TargetTransformInfo &TTI,
+              llvm::LoopInfo &LI, llvm::ScalarEvolution &SE, bool MathVariants);
+
+    // Computed before the web is retyped
+    WebCost estimate(Web &W);
+
+  private:
+    const llvm::TargetTransformInfo &TTI;
+    llvm::LoopInfo &LI;
+    llvm::ScalarEvolution &SE;
+    bool MathVariants;
+    llvm::BranchProbabilityInfo BPI;
+    llvm::BlockFrequencyInfo BFI;
+    double EntryFreq;
+    llvm::DenseMap<llvm::Loop *, VectorCost> Loops;
+
+    double frequency(llvm::BasicBlock *BB);
+    // Widths of the double and float versions of the block: 1 out of the
+    // loops the vectorizer would vectorize
+    std::pair<unsigned, unsigned> widths(llvm::BasicBlock *BB);
+    double conversion(unsigned Opcode, llvm::BasicBlock *BB);
+  };
+
+} // namespace fastfp
+
+#endif // FASTFP_PROFITABILITY_H
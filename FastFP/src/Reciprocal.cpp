@@ -0,0 +1,207 @@
+//===- Reciprocal.cpp - Divisions by loop invariants as multiplications ---===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// This file implements a pass that replaces the floating-point divisions of a
+// loop by a value invariant in the loop with multiplications by its
+// reciprocal, computed once in the preheader, when the division allows it
+// (arcp) or the plan lists it. The reciprocal can be refined with one Newton
+// step. Divisions by a constant power of two become multiplications by its
+// exact inverse everywhere.
+//
+//===----------------------------------------------------------------------===//
+
+#include "DemotionPlan.h"
+#include "PrecisionWeb.h"
+
+#include "llvm/Pass.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/Analysis/LoopInfo.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/InstIterator.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/PatternMatch.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <utility>
+
+using namespace llvm;
+using namespace llvm::PatternMatch;
+using namespace fastfp;
+
+#define DEBUG_TYPE "fast-fp-reciprocal"
+
+static cl::opt<std::string>
+PlanFile("fast-fp-reciprocal-plan",
+         cl::desc("Divisions allowed to use a reciprocal without arcp, as "
+                  "FUNCTION NAME,INDEX (index among the double arithmetic of "
+                  "the function, as in the plans of fastfp-search)"),
+         cl::value_desc("filename"), cl::init(""));
+
+static cl::opt<bool>
+Newton("fast-fp-reciprocal-newton",
+       cl::desc("Refine each reciprocal with one Newton step (two fma)"),
+       cl::init(false));
+
+namespace {
+  struct Reciprocal : public FunctionPass {
+    static char ID; // Pass identification, replacement for typeid
+    static uint64_t count_divisions;
+    static uint64_t count_reciprocals;
+    static uint64_t count_exact;
+
+    DemotionPlan plan;
+
+    Reciprocal() : FunctionPass(ID) {}
+
+    void getAnalysisUsage(AnalysisUsage &AU) const override {
+      AU.setPreservesCFG();
+      AU.addRequired<LoopInfoWrapperPass>();
+    }
+
+    bool doInitialization(Module &M) override {
+      if (!PlanFile.empty() && !plan.read(PlanFile))
+        exit(13);
+
+      return false;
+    }
+
+    // x / 2^k is x * 2^-k, exactly
+    static bool replaceExact(BinaryOperator *Div) {
+      const APFloat *C;
+      if (!match(Div->getOperand(1), m_APFloat(C)))
+        return false;
+
+      APFloat Inverse(C->getSemantics());
+      if (!C->getExactInverse(&Inverse))
+        return false;
+
+      IRBuilder<> Builder(Div);
+      Value *Mul = Builder.CreateFMul(Div->getOperand(0),
+                                      ConstantFP::get(Div->getType(), Inverse));
+      cast<Instruction>(Mul)->copyFastMathFlags(Div);
+      Mul->takeName(Div);
+      Div->replaceAllUsesWith(Mul);
+      Div->eraseFromParent();
+      return true;
+    }
+
+    // Outermost loop with a preheader in which the divisor is invariant
+    static Loop *getHoistLoop(Loop *L, Value *Divisor) {
+      if (!L->isLoopInvariant(Divisor) || !L->getLoopPreheader())
+        return nullptr;
+
+      while (L->getParentLoop() && L->getParentLoop()->isLoopInvariant(Divisor)
+             && L->getParentLoop()->getLoopPreheader())
+        L = L->getParentLoop();
+
+      return L;
+    }
+
+    // 1 / d, or with one Newton step: e = 1 - d * r, r = r + r * e
+    static Value *createReciprocal(IRBuilder<> &Builder, Value *Divisor) {
+      Type *Ty = Divisor->getType();
+      Value *One = ConstantFP::get(Ty, 1.0);
+      Value *R = Builder.CreateFDiv(One, Divisor, Divisor->getName() + ".rcp");
+
+      if (!Newton)
+        return R;
+
+      Value *E = Builder.CreateIntrinsic(Intrinsic::fma, {Ty},
+                                         {Builder.CreateFNeg(Divisor), R, One}, nullptr,
+                                         Divisor->getName() + ".rcp.err");
+      return Builder.CreateIntrinsic(Intrinsic::fma, {Ty}, {R, E, R}, nullptr,
+                                     Divisor->getName() + ".rcp.nr");
+    }
+
+    bool runOnFunction(Function &F) override {
+      LoopInfo &LI = getAnalysis<LoopInfoWrapperPass>().getLoopInfo();
+      DenseMap<Instruction *, uint64_t> Index;
+      SmallVector<BinaryOperator *, 16> Divisions;
+
+      // Indexes of the plans, before any rewriting
+      SmallVector<Instruction *, 32> Ops;
+      getDoubleArithmetic(F, Ops);
+      for (uint64_t i = 0; i < Ops.size(); i++)
+        Index[Ops[i]] = i;
+
+      for (Instruction &I : instructions(F))
+        if (I.getOpcode() == Instruction::FDiv)
+          Divisions.push_back(cast<BinaryOperator>(&I));
+
+      unsigned Exact = 0, Rewritten = 0;
+      DenseMap<std::pair<Loop *, Value *>, Value *> Reciprocals;
+
+      for (BinaryOperator *Div : Divisions) {
+        if (replaceExact(Div)) {
+          Exact++;
+          continue;
+        }
+
+        Loop *L = LI.getLoopFor(Div->getParent());
+        Value *Divisor = Div->getOperand(1);
+
+        auto It = Index.find(Div);
+        bool Allowed = Div->hasAllowReciprocal()
+          || (It != Index.end() && plan.contains(F.getName(), It->second));
+
+        if (!L || !Allowed)
+          continue;
+
+        L = getHoistLoop(L, Divisor);
+        if (!L)
+          continue;
+
+        Value *&R = Reciprocals[{L, Divisor}];
+        if (!R) {
+          IRBuilder<> Builder(L->getLoopPreheader()->getTerminator());
+          R = createReciprocal(Builder, Divisor);
+        }
+
+        IRBuilder<> Builder(Div);
+        Value *Mul = Builder.CreateFMul(Div->getOperand(0), R);
+        if (Instruction *MulI = dyn_cast<Instruction>(Mul))
+          MulI->copyFastMathFlags(Div);
+
+        Mul->takeName(Div);
+        Div->replaceAllUsesWith(Mul);
+        Div->eraseFromParent();
+        Rewritten++;
+      }
+
+      if (!Exact && !Rewritten)
+        return false;
+
+      errs() << "Function: " << F.getName() << ": " << Rewritten
+             << " divisions by loop invariants with " << Reciprocals.size()
+             << " reciprocals, " << Exact << " divisions by powers of two\n";
+
+      count_divisions += Rewritten;
+      count_reciprocals += Reciprocals.size();
+      count_exact += Exact;
+      return true;
+    }
+
+    bool doFinalization(Module &M) override {
+      errs() << "Divisions replaced by reciprocals: " << count_divisions
+             << " (" << count_reciprocals << " reciprocals), by exact inverses: "
+             << count_exact << '\n';
+      return false;
+    }
+  };
+}
+
+char Reciprocal::ID = 0;
+uint64_t Reciprocal::count_divisions = 0;
+uint64_t Reciprocal::count_reciprocals = 0;
+uint64_t Reciprocal::count_exact = 0;
+static RegisterPass<Reciprocal> X("fast-fp-reciprocal",
+                                  "Replace divisions by loop invariants with reciprocals");
@@ -0,0 +1,353 @@
+//===- Reduction.cpp - Accurate sums of demoted reductions ----------------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+
+#include "Reduction.h"
+
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/SetVector.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/Analysis/LoopInfo.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/Dominators.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/Instructions.h"
+
+using namespace llvm;
+
+namespace fastfp {
+
+  namespace {
+    struct SumReduction {
+      PHINode *Phi;
+      Loop *L;
+      // Additions from the phi to the value of the next iteration
+      SmallVector<Instruction *, 4> Chain;
+    };
+  }
+
+  // Additions from a header phi to its value on the backedge, each one the
+  // only user in the loop of the previous one. Unlike isReductionPHI, the
+  // values may be used after the loop: the phi itself is when the loop is not
+  // rotated. fmuladd would need the product split from the sum.
+  static bool findChain(PHINode &Phi, Loop *L, SmallVectorImpl<Instruction *> &Chain) {
+    BasicBlock *Latch = L->getLoopLatch();
+    if (!Latch || Phi.getNumIncomingValues() != 2)
+      return false;
+
+    Value *Next = Phi.getIncomingValueForBlock(Latch);
+    Value *Cur = &Phi;
+
+    while (Cur != Next) {
+      Instruction *Add = nullptr;
+
+      for (User *U : Cur->users()) {
+        Instruction *UserI = cast<Instruction>(U);
+        if (!L->contains(UserI))
+          continue;
+
+        if (Add || UserI->getOpcode() != Instruction::FAdd
+            || UserI->getOperand(0) == UserI->getOperand(1))
+          return false;
+
+        Add = UserI;
+      }
+
+      if (!Add)
+        return false;
+
+      Chain.push_back(Add);
+      Cur = Add;
+    }
+
+    return !Chain.empty();
+  }
+
+  static void findSums(LoopInfo &LI, Type *Ty, SmallVectorImpl<SumReduction> &Sums) {
+    for (Loop *L : LI.getLoopsInPreorder()) {
+      // The initial value is extended in the preheader
+      if (!L->getLoopPreheader())
+        continue;
+
+      for (PHINode &Phi : L->getHeader()->phis()) {
+        SmallVector<Instruction *, 4> Chain;
+
+        if (Phi.getType() == Ty && findChain(Phi, L, Chain))
+          Sums.push_back({&Phi, L, Chain});
+      }
+    }
+  }
+
+  void findDoubleReductions(Function &F, SmallPtrSetImpl<BasicBlock *> &Headers) {
+    DominatorTree DT(F);
+    LoopInfo LI(DT);
+    SmallVector<SumReduction, 4> Sums;
+
+    findSums(LI, Type::getDoubleTy(F.getContext()), Sums);
+    for (SumReduction &S : Sums)
+      Headers.insert(S.Phi->getParent());
+  }
+
+  // Addend of a chain operation
+  static Value *getAddend(Instruction *I, Value *Acc) {
+    return I->getOperand(I->getOperand(0) == Acc ? 1 : 0);
+  }
+
+  // s + x becomes, with the compensation c of the rounding errors so far:
+  //   y = x - c, t = s + y, c = (t - s) - y, s = t
+  // The operations carry no fast-math flags, reassociation would cancel c.
+  static void compensate(SumReduction &S) {
+    Type *Ty = S.Phi->getType();
+    IRBuilder<> Builder(S.Phi);
+    PHINode *Comp = Builder.CreatePHI(Ty, S.Phi->getNumIncomingValues(),
+                                      S.Phi->getName() + ".comp");
+    Value *Sum = S.Phi;
+    Value *C = Comp;
+
+    for (Instruction *I : S.Chain) {
+      Builder.SetInsertPoint(I);
+
+      Value *Y = Builder.CreateFSub(getAddend(I, Sum), C, "kahan.y");
+      Value *T = Builder.CreateFAdd(Sum, Y);
+      C = Builder.CreateFSub(Builder.CreateFSub(T, Sum, "kahan.t"), Y, "kahan.c");
+
+      T->takeName(I);
+      I->replaceAllUsesWith(T);
+      I->eraseFromParent();
+      Sum = T;
+    }
+
+    for (unsigned i = 0; i < S.Phi->getNumIncomingValues(); i++) {
+      BasicBlock *BB = S.Phi->getIncomingBlock(i);
+      Comp->addIncoming(S.L->contains(BB) ? C : ConstantFP::get(Ty, 0.0), BB);
+    }
+  }
+
+  // Double version of a float value from outside of the loop: the double it
+  // was truncated from when there is one
+  static Value *extend(Value *V, IRBuilder<> &Builder) {
+    Type *DoubleTy = Builder.getDoubleTy();
+
+    if (FPTruncInst *Trunc = dyn_cast<FPTruncInst>(V))
+      if (Trunc->getOperand(0)->getType() == DoubleTy)
+        return Trunc->getOperand(0);
+
+    return Builder.CreateFPExt(V, DoubleTy);
+  }
+
+  static bool isExtension(User *U, Type *DoubleTy) {
+    return isa<FPExtInst>(U) && U->getType() == DoubleTy;
+  }
+
+  // Point right after a definition
+  static Instruction *getInsertionPointAfter(Instruction *I) {
+    return isa<PHINode>(I) ? &*I->getParent()->getFirstInsertionPt() : I->getNextNode();
+  }
+
+  // The phis after the loop that carry I, e.g. the LCSSA phi of the exit and
+  // the phi after the guard of a rotated loop, become double phis. Their
+  // fpext to double are replaced, their other users read a truncation.
+  static void widenExitPhis(Instruction *I, Loop *L, DenseMap<Value *, Value *> &Doubles) {
+    Type *DoubleTy = Doubles.lookup(I)->getType();
+    SmallSetVector<PHINode *, 4> Phis;
+    SmallVector<PHINode *, 4> Work;
+
+    for (User *U : I->users())
+      if (PHINode *PN = dyn_cast<PHINode>(U))
+        if (!L->contains(PN) && !Doubles.count(PN))
+          Work.push_back(PN);
+
+    while (!Work.empty()) {
+      PHINode *PN = Work.pop_back_val();
+      if (!Phis.insert(PN))
+        continue;
+
+      for (User *U : PN->users())
+        if (PHINode *UserPN = dyn_cast<PHINode>(U))
+          if (!Doubles.count(UserPN))
+            Work.push_back(UserPN);
+    }
+
+    for (PHINode *PN : Phis)
+      Doubles[PN] = PHINode::Create(DoubleTy, PN->getNumIncomingValues(), "", PN);
+
+    for (PHINode *PN : Phis) {
+      PHINode *New = cast<PHINode>(Doubles[PN]);
+
+      for (unsigned i = 0; i < PN->getNumIncomingValues(); i++) {
+        BasicBlock *BB = PN->getIncomingBlock(i);
+        Value *V = Doubles.lookup(PN->getIncomingValue(i));
+
+        if (!V) {
+          IRBuilder<> Builder(BB->getTerminator());
+          V = extend(PN->getIncomingValue(i), Builder);
+        }
+
+        New->addIncoming(V, BB);
+      }
+    }
+
+    for (PHINode *PN : Phis) {
+      PHINode *New = cast<PHINode>(Doubles[PN]);
+      Instruction *Trunc = nullptr;
+
+      for (User *U : make_early_inc_range(PN->users())) {
+        Instruction *UserI = cast<Instruction>(U);
+
+        if (isExtension(UserI, DoubleTy)) {
+          UserI->replaceAllUsesWith(New);
+          UserI->eraseFromParent();
+        }
+        else if (Doubles.count(UserI)) {
+          // Rewritten too, erased afterwards
+          UserI->replaceUsesOfWith(PN, UndefValue::get(PN->getType()));
+        }
+        else {
+          if (!Trunc)
+            Trunc = new FPTruncInst(New, PN->getType(), PN->getName() + ".f",
+                                    getInsertionPointAfter(New));
+          UserI->replaceUsesOfWith(PN, Trunc);
+        }
+      }
+
+      New->takeName(PN);
+    }
+
+    for (PHINode *PN : Phis)
+      PN->eraseFromParent();
+  }
+
+  // Users of a float value of the sum, out of the chain, take its double
+  // version: an fpext to double is replaced, the phis after the loop are
+  // widened, the others read a truncation, in the loop only for the users in
+  // the loop
+  static void replaceUses(Instruction *I, Loop *L, DenseMap<Value *, Value *> &Doubles) {
+    Instruction *D = cast<Instruction>(Doubles.lookup(I));
+    Type *DoubleTy = D->getType();
+    Instruction *Trunc = nullptr;
+
+    widenExitPhis(I, L, Doubles);
+
+    // Collected first: a user may use I several times
+    SmallSetVector<Instruction *, 8> Users;
+    for (User *U : I->users())
+      Users.insert(cast<Instruction>(U));
+
+    for (Instruction *UserI : Users) {
+      if (Doubles.count(UserI))
+        continue;
+
+      if (isExtension(UserI, DoubleTy)) {
+        UserI->replaceAllUsesWith(D);
+        UserI->eraseFromParent();
+        continue;
+      }
+
+      if (!L->contains(UserI)) {
+        UserI->replaceUsesOfWith(I, new FPTruncInst(D, I->getType(), I->getName() + ".f",
+                                                    UserI));
+        continue;
+      }
+
+      if (!Trunc)
+        Trunc = new FPTruncInst(D, I->getType(), I->getName() + ".f",
+                                getInsertionPointAfter(D));
+
+      UserI->replaceUsesOfWith(I, Trunc);
+    }
+  }
+
+  // The float addends are accumulated in double: each one is rounded to
+  // float, as in the demoted loop, and only the sum keeps double precision
+  static void widen(SumReduction &S) {
+    IRBuilder<> Builder(S.Phi);
+    PHINode *Acc = Builder.CreatePHI(Builder.getDoubleTy(), S.Phi->getNumIncomingValues(),
+                                     S.Phi->getName() + ".d");
+    SmallVector<Instruction *, 4> Replaced{S.Phi};
+    DenseMap<Value *, Value *> Doubles{{S.Phi, Acc}};
+    Value *Sum = S.Phi;
+    Value *D = Acc;
+
+    for (Instruction *I : S.Chain) {
+      Builder.SetInsertPoint(I);
+
+      Value *Addend = getAddend(I, Sum);
+      Value *Ext = Builder.CreateFPExt(Addend, Builder.getDoubleTy(), Addend->getName() + ".d");
+      Instruction *New = cast<Instruction>(Builder.CreateFAdd(D, Ext));
+      New->copyFastMathFlags(I);
+      New->copyMetadata(*I);
+      New->setName(I->getName() + ".d");
+
+      Replaced.push_back(I);
+      Doubles[I] = New;
+      Sum = I;
+      D = New;
+    }
+
+    for (unsigned i = 0; i < S.Phi->getNumIncomingValues(); i++) {
+      BasicBlock *BB = S.Phi->getIncomingBlock(i);
+
+      if (S.L->contains(BB))
+        Acc->addIncoming(D, BB);
+      else {
+        Builder.SetInsertPoint(BB->getTerminator());
+        Acc->addIncoming(extend(S.Phi->getIncomingValue(i), Builder), BB);
+      }
+    }
+
+    for (Instruction *I : Replaced)
+      replaceUses(I, S.L, Doubles);
+
+    for (Instruction *I : Replaced)
+      I->dropAllReferences();
+
+    for (Instruction *I : Replaced)
+      I->eraseFromParent();
+  }
+
+  ReductionStats rewriteReductions(Function &F, const SmallPtrSetImpl<BasicBlock *> &Headers,
+                                   ReductionMode Mode) {
+    ReductionStats Stats;
+
+    if (Mode == ReductionFloat || Headers.empty())
+      return Stats;
+
+    DominatorTree DT(F);
+    LoopInfo LI(DT);
+    SmallVector<SumReduction, 4> Sums;
+
+    SmallPtrSet<BasicBlock *, 4> Rewritten;
+    Type *FloatTy = Type::getFloatTy(F.getContext());
+
+    findSums(LI, FloatTy, Sums);
+
+    for (SumReduction &S : Sums) {
+      if (!Headers.count(S.Phi->getParent()))
+        continue;
+
+      Rewritten.insert(S.Phi->getParent());
+
+      if (Mode == ReductionKahan) {
+        compensate(S);
+        Stats.Compensated++;
+      }
+      else {
+        widen(S);
+        Stats.Widened++;
+      }
+    }
+
+    // A demoted loop has a float phi in its header
+    for (BasicBlock &BB : F)
+      if (Headers.count(&BB) && !Rewritten.count(&BB)
+          && any_of(BB.phis(), [&](PHINode &Phi) { return Phi.getType() == FloatTy; }))
+        Stats.Kept.push_back(&BB);
+
+    return Stats;
+  }
+
+} // namespace fastfp
@@ -0,0 +1,52 @@
+//===- Reduction.h - Accurate sums of demoted reductions ------------------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// This file declares the rewriting of the sum reductions FastFP demotes to
+// float: a float sum of a million elements keeps few significant digits, so
+// the accumulator is compensated (Kahan) or kept in double while the addends
+// are computed in float.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef FASTFP_REDUCTION_H
+#define FASTFP_REDUCTION_H
+
+#include "llvm/ADT/SmallPtrSet.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/IR/BasicBlock.h"
+#include "llvm/IR/Function.h"
+
+namespace fastfp {
+
+  enum ReductionMode {
+    ReductionFloat,  // Plain float accumulator
+    ReductionKahan,  // Float accumulator and its float compensation
+    ReductionDouble  // Float addends, double accumulator
+  };
+
+  struct ReductionStats {
+    unsigned Compensated = 0;
+    unsigned Widened = 0;
+    // Headers of the demoted loops whose float sum is not recognized
+    llvm::SmallVector<llvm::BasicBlock *, 2> Kept;
+  };
+
+  // Headers of the loops with a double sum reduction (chain of fadd), found
+  // before the demotion
+  void findDoubleReductions(llvm::Function &F,
+                            llvm::SmallPtrSetImpl<llvm::BasicBlock *> &Headers);
+
+  // Rewrite the float sum reductions of the loops with these headers, the
+  // ones the demotion produced
+  ReductionStats rewriteReductions(llvm::Function &F,
+                                   const llvm::SmallPtrSetImpl<llvm::BasicBlock *> &Headers,
+                                   ReductionMode Mode);
+
+} // namespace fastfp
+
+#endif // FASTFP_REDUCTION_H
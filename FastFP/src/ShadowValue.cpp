@@ -0,0 +1,271 @@
+//===- ShadowValue.cpp - Float shadow execution of double code ------------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+
+#include "ShadowValue.h"
+#include "PrecisionWeb.h"
+
+#include "llvm/ADT/PostOrderIterator.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/IntrinsicInst.h"
+#include "llvm/Transforms/Utils/ModuleUtils.h"
+
+#include <vector>
+
+using namespace llvm;
+
+namespace fastfp {
+
+  bool insertShadowRuntime(Module &M, ShadowRuntime &RT) {
+    auto &CTX = M.getContext();
+    IntegerType *Int64Ty = Type::getInt64Ty(CTX);
+    Type *DoubleTy = Type::getDoubleTy(CTX);
+    Type *FloatTy = Type::getFloatTy(CTX);
+    PointerType *PointerInt8Ty = Type::getInt8PtrTy(CTX);
+    PointerType *PointerInt64Ty = Type::getInt64PtrTy(CTX);
+
+    // Function, index and opcode of every operation of the module
+    std::vector<Constant *> names;
+    std::vector<Constant *> indexes;
+    std::vector<Constant *> opcodes;
+    StringMap<Constant *> strings;
+
+    auto getString = [&](StringRef Str) {
+      Constant *&C = strings[Str];
+      if (!C)
+        C = ConstantExpr::getPointerCast(
+              new GlobalVariable(M, ArrayType::get(Type::getInt8Ty(CTX), Str.size() + 1),
+                                 /*isConstant=*/true, GlobalValue::PrivateLinkage,
+                                 ConstantDataArray::getString(CTX, Str),
+                                 "__fastfp_shadow_string"),
+              PointerInt8Ty);
+      return C;
+    };
+
+    for (Function &F : M) {
+      if (F.isDeclaration())
+        continue;
+
+      SmallVector<Instruction *, 32> Ops;
+      getDoubleArithmetic(F, Ops);
+
+      if (Ops.empty())
+        continue;
+
+      RT.First[&F] = names.size();
+      Constant *name = getString(F.getName());
+
+      for (uint64_t i = 0; i < Ops.size(); i++) {
+        IntrinsicInst *II = dyn_cast<IntrinsicInst>(Ops[i]);
+        CallInst *CI = dyn_cast<CallInst>(Ops[i]);
+
+        names.push_back(name);
+        indexes.push_back(ConstantInt::get(Int64Ty, i));
+        opcodes.push_back(getString(II ? Intrinsic::getBaseName(II->getIntrinsicID())
+                                    : CI ? CI->getCalledFunction()->getName()
+                                    : StringRef(Ops[i]->getOpcodeName())));
+      }
+    }
+
+    if (names.empty())
+      return false;
+
+    ArrayType *NamesTy = ArrayType::get(PointerInt8Ty, names.size());
+    ArrayType *IndexesTy = ArrayType::get(Int64Ty, indexes.size());
+
+    GlobalVariable *names_array =
+      new GlobalVariable(M, NamesTy, /*isConstant=*/true, GlobalValue::PrivateLinkage,
+                         ConstantArray::get(NamesTy, names), "__fastfp_shadow_names");
+
+    GlobalVariable *indexes_array =
+      new GlobalVariable(M, IndexesTy, /*isConstant=*/true, GlobalValue::PrivateLinkage,
+                         ConstantArray::get(IndexesTy, indexes), "__fastfp_shadow_indexes");
+
+    GlobalVariable *opcodes_array =
+      new GlobalVariable(M, NamesTy, /*isConstant=*/true, GlobalValue::PrivateLinkage,
+                         ConstantArray::get(NamesTy, opcodes), "__fastfp_shadow_opcodes");
+
+    RT.Base = new GlobalVariable(M, Int64Ty, /*isConstant=*/false,
+                                 GlobalValue::InternalLinkage,
+                                 ConstantInt::get(Int64Ty, 0), "__fastfp_shadow_base");
+
+    /* Get fastfp_shadow_register */
+    FunctionCallee shadow_register =
+      M.getOrInsertFunction("fastfp_shadow_register",
+                            FunctionType::get(/*ReturnType=*/Int64Ty,
+                                              /*ArgType=*/
+                                              {Int64Ty,
+                                               PointerInt8Ty->getPointerTo(),
+                                               PointerInt64Ty,
+                                               PointerInt8Ty->getPointerTo()},
+                                              /*IsVarArgs=*/false));
+
+    /* Get fastfp_shadow_record */
+    RT.Record =
+      M.getOrInsertFunction("fastfp_shadow_record",
+                            FunctionType::get(/*ReturnType=*/Type::getVoidTy(CTX),
+                                              /*ArgType=*/{Int64Ty, DoubleTy, FloatTy},
+                                              /*IsVarArgs=*/false));
+
+    /* Get fastfp_shadow_record_add */
+    RT.RecordAdd =
+      M.getOrInsertFunction("fastfp_shadow_record_add",
+                            FunctionType::get(/*ReturnType=*/Type::getVoidTy(CTX),
+                                              /*ArgType=*/
+                                              {Int64Ty, DoubleTy, DoubleTy, DoubleTy,
+                                               FloatTy},
+                                              /*IsVarArgs=*/false));
+
+    // Module constructor
+    Function *ctor =
+      Function::Create(FunctionType::get(Type::getVoidTy(CTX), false),
+                       GlobalValue::InternalLinkage, "__fastfp_shadow_module_ctor", M);
+
+    IRBuilder<> Builder(BasicBlock::Create(CTX, "entry", ctor));
+
+    Value *base =
+      Builder.CreateCall(shadow_register,
+                         {ConstantInt::get(Int64Ty, names.size()),
+                          Builder.CreateConstInBoundsGEP2_64(NamesTy, names_array, 0, 0),
+                          Builder.CreateConstInBoundsGEP2_64(IndexesTy, indexes_array, 0, 0),
+                          Builder.CreateConstInBoundsGEP2_64(NamesTy, opcodes_array, 0, 0)});
+    Builder.CreateStore(base, RT.Base);
+    Builder.CreateRetVoid();
+
+    appendToGlobalCtors(M, ctor, /*Priority=*/0);
+
+    return true;
+  }
+
+  bool instrumentShadow(Function &F, ArrayRef<Instruction *> Ops, ShadowRuntime &RT) {
+    auto It = RT.First.find(&F);
+    if (It == RT.First.end())
+      return false;
+
+    IntegerType *Int64Ty = Type::getInt64Ty(F.getContext());
+    Type *FloatTy = Type::getFloatTy(F.getContext());
+
+    DenseMap<Instruction *, uint64_t> Id;
+    for (uint64_t i = 0; i < Ops.size(); i++)
+      Id[Ops[i]] = It->second + i;
+
+    IRBuilder<> BuilderEntry(&*F.getEntryBlock().getFirstInsertionPt());
+    Value *base = BuilderEntry.CreateLoad(Int64Ty, RT.Base, "shadow_base");
+
+    // Float shadow of each double carrying one
+    DenseMap<Value *, Value *> Shadow;
+    SmallVector<PHINode *, 8> Phis;
+
+    // Doubles without a shadow (loads, arguments) are truncated once, right
+    // after their definition
+    auto getShadow = [&](Value *V, Instruction *InsertBefore) -> Value * {
+      auto It = Shadow.find(V);
+      if (It != Shadow.end())
+        return It->second;
+
+      if (Constant *C = dyn_cast<Constant>(V))
+        return ConstantExpr::getFPTrunc(C, FloatTy);
+
+      Instruction *After = nullptr;
+      if (isa<Argument>(V))
+        After = cast<Instruction>(base)->getNextNode();
+      else if (Instruction *I = dyn_cast<Instruction>(V))
+        After = I->isTerminator() ? nullptr : I->getNextNode();
+
+      Value *Trunc = new FPTruncInst(V, FloatTy, V->getName() + ".s",
+                                     After ? After : InsertBefore);
+      if (After)
+        Shadow[V] = Trunc;
+
+      return Trunc;
+    };
+
+    ReversePostOrderTraversal<Function *> RPOT(&F);
+    for (BasicBlock *BB : RPOT) {
+      // The shadows are inserted behind the visited instruction
+      SmallVector<Instruction *, 32> Insts;
+      for (Instruction &I : *BB)
+        Insts.push_back(&I);
+
+      for (Instruction *I : Insts) {
+        if (!I->getType()->isDoubleTy())
+          continue;
+
+        if (PHINode *PN = dyn_cast<PHINode>(I)) {
+          PHINode *S = PHINode::Create(FloatTy, PN->getNumIncomingValues(),
+                                       PN->getName() + ".s", BB->getFirstNonPHI());
+          Shadow[PN] = S;
+          Phis.push_back(PN);
+          continue;
+        }
+
+        auto Op = Id.find(I);
+        if (Op == Id.end() && !isa<SelectInst>(I))
+          continue;
+
+        Instruction *Next = I->getNextNode();
+        IRBuilder<> Builder(Next);
+
+        if (SelectInst *SI = dyn_cast<SelectInst>(I)) {
+          Shadow[SI] = Builder.CreateSelect(SI->getCondition(),
+                                            getShadow(SI->getTrueValue(), Next),
+                                            getShadow(SI->getFalseValue(), Next),
+                                            SI->getName() + ".s");
+          continue;
+        }
+
+        Value *S;
+
+        if (BinaryOperator *BO = dyn_cast<BinaryOperator>(I))
+          S = Builder.CreateBinOp(BO->getOpcode(), getShadow(BO->getOperand(0), Next),
+                                  getShadow(BO->getOperand(1), Next));
+        else if (isa<UnaryOperator>(I))
+          S = Builder.CreateFNeg(getShadow(I->getOperand(0), Next));
+        else {
+          CallInst *CI = cast<CallInst>(I);
+          SmallVector<Value *, 3> Args;
+
+          for (Value *Arg : CI->args())
+            Args.push_back(getShadow(Arg, Next));
+
+          S = createFloatCall(Builder, CI, Args);
+        }
+
+        if (Instruction *SI = dyn_cast<Instruction>(S)) {
+          SI->copyFastMathFlags(I);
+          SI->setName(I->getName() + ".s");
+        }
+
+        Shadow[I] = S;
+
+        Value *id = Builder.CreateAdd(base, ConstantInt::get(Int64Ty, Op->second),
+                                      "shadow_id");
+
+        // The exponents of the operands measure the cancellation
+        if (I->getOpcode() == Instruction::FAdd || I->getOpcode() == Instruction::FSub)
+          Builder.CreateCall(RT.RecordAdd, {id, I->getOperand(0), I->getOperand(1), I, S});
+        else
+          Builder.CreateCall(RT.Record, {id, I, S});
+      }
+    }
+
+    for (PHINode *PN : Phis) {
+      PHINode *S = cast<PHINode>(Shadow[PN]);
+
+      for (unsigned i = 0; i < PN->getNumIncomingValues(); i++) {
+        BasicBlock *Pred = PN->getIncomingBlock(i);
+        S->addIncoming(getShadow(PN->getIncomingValue(i), Pred->getTerminator()), Pred);
+      }
+    }
+
+    return true;
+  }
+
+} // namespace fastfp
@@ -0,0 +1,51 @@
+//===- ShadowValue.h - Float shadow execution of double code --------------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// This file declares the shadow mode of FastFP: every double arithmetic
+// operation is executed a second time in float, on the float shadows of its
+// operands, and libfastfp.so records the relative error of the shadow and the
+// cancellations of the additions.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef FASTFP_SHADOWVALUE_H
+#define FASTFP_SHADOWVALUE_H
+
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/GlobalVariable.h"
+#include "llvm/IR/Instruction.h"
+#include "llvm/IR/Module.h"
+
+namespace fastfp {
+
+  struct ShadowRuntime {
+    // Id of the first operation of the module, given by the runtime
+    llvm::GlobalVariable *Base = nullptr;
+
+    // Id of the first operation of each function in the module
+    llvm::DenseMap<llvm::Function *, uint64_t> First;
+
+    llvm::FunctionCallee Record;
+    llvm::FunctionCallee RecordAdd;
+  };
+
+  // Register the double arithmetic of the module with fastfp_shadow_register
+  // in a module constructor. Returns false when there is none.
+  bool insertShadowRuntime(llvm::Module &M, ShadowRuntime &RT);
+
+  // Shadow the operations of Ops (getDoubleArithmetic order). Phis and selects
+  // carry the shadows, any other double (load, argument, call) is truncated
+  // again: the error accumulated through memory is not measured.
+  bool instrumentShadow(llvm::Function &F, llvm::ArrayRef<llvm::Instruction *> Ops,
+                        ShadowRuntime &RT);
+
+} // namespace fastfp
+
+#endif // FASTFP_SHADOWVALUE_H
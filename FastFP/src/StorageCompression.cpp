@@ -0,0 +1,732 @@
+//===- StorageCompression.cpp - Compressed storage of double arrays -------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// This file implements a pass that stores the double arrays allocated on the
+// heap (malloc, calloc, aligned_alloc) as float, half or bfloat while the code
+// keeps computing in double: loads are extended and stores truncated. The
+// functions the arrays are passed to are cloned for the compressed layout.
+//
+//===----------------------------------------------------------------------===//
+
+#include "CycleProfile.h"
+#include "PrecisionPolicy.h"
+
+#include "llvm/Pass.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/DenseSet.h"
+#include "llvm/ADT/SetVector.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/Analysis/BlockFrequencyInfo.h"
+#include "llvm/Analysis/BranchProbabilityInfo.h"
+#include "llvm/Analysis/LoopInfo.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/Dominators.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/InstrTypes.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Transforms/Utils/Cloning.h"
+
+#include <map>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+using namespace llvm;
+using namespace fastfp;
+
+#define DEBUG_TYPE "fast-fp-storage"
+
+enum StorageKind { StorageFloat, StorageHalf, StorageBFloat };
+
+static cl::opt<StorageKind>
+StorageType("fast-fp-storage-type",
+            cl::desc("Storage of the compressed arrays"),
+            cl::values(clEnumValN(StorageFloat, "float", "4 bytes"),
+                       clEnumValN(StorageHalf, "half",
+                                  "2 bytes, IEEE binary16 (range 6e-5 to 65504)"),
+                       clEnumValN(StorageBFloat, "bfloat",
+                                  "2 bytes, float range with 8 bits of mantissa")),
+            cl::init(StorageFloat));
+
+static cl::list<std::string>
+Arrays("fast-fp-storage-arrays",
+       cl::desc("Allocation sites to compress, as FUNCTION:INDEX (index of "
+                "the allocation in the function, default all)"),
+       cl::CommaSeparated);
+
+static cl::opt<std::string>
+BaseProfile("fast-fp-storage-profile-base",
+            cl::desc("Cycles per function of the double version (InsertRDTSC "
+                     "output or rdtsc-prof profile)"),
+            cl::value_desc("filename"), cl::init(""));
+
+static cl::opt<std::string>
+CompressedProfile("fast-fp-storage-profile-compressed",
+                  cl::desc("Cycles per function of the compressed version"),
+                  cl::value_desc("filename"), cl::init(""));
+
+namespace {
+  // Accesses through the pointers derived from one allocation or one argument,
+  // in one function
+  struct Family {
+    SmallVector<GetElementPtrInst *, 8> GEPs;
+    SmallVector<LoadInst *, 8> Loads;
+    SmallVector<StoreInst *, 8> Stores;
+    SmallVector<std::pair<CallBase *, unsigned>, 4> Calls;
+
+    // Frequency-weighted bytes loaded and stored, per call of the function
+    double Bytes = 0.0;
+
+    bool Valid = true;
+    std::string Reason;
+  };
+
+  struct Site {
+    CallInst *Call;
+    std::string Name; // FUNCTION:INDEX
+    Family Fam;
+  };
+
+  // StorageCompression - The first implementation
+  struct StorageCompression : public ModulePass {
+    static char ID; // Pass identification, replacement for typeid
+
+    // Bytes loaded and stored by each function, weighted by block frequency
+    DenseMap<Function *, double> function_bytes;
+    DenseMap<Instruction *, double> access_bytes;
+
+    // Families of the pointer arguments
+    std::map<std::pair<Function *, unsigned>, Family> arguments;
+    DenseSet<std::pair<Function *, unsigned>> checking;
+
+    // Clones for a set of compressed arguments, and their origin
+    std::map<std::pair<Function *, uint64_t>, Function *> clones;
+    DenseMap<Function *, std::pair<Function *, uint64_t>> origins;
+
+    // Functions reached by the compressed arrays, for the measured speedups
+    SetVector<Function *> reached;
+
+    CycleProfile base_profile;
+    CycleProfile compressed_profile;
+
+    // Without -fast-fp-storage-arrays, compress the allocations of the
+    // functions in storage mode only, if there is a policy
+    PrecisionPolicy policy;
+
+    // Storage actually used
+    StorageKind kind = StorageFloat;
+
+    StorageCompression() : ModulePass(ID) {}
+
+    bool runOnModule(Module &M) override {
+      if (!BaseProfile.empty() && !CompressedProfile.empty()) {
+        base_profile.read(BaseProfile);
+        compressed_profile.read(CompressedProfile);
+      }
+
+      if (!policy.read(M))
+        exit(13);
+
+      kind = StorageType;
+
+      // Without F16C, LLVM converts half with libcalls the runtime may not have
+      for (Function &F : M) {
+        if (kind != StorageHalf || F.isDeclaration())
+          continue;
+
+        if (!F.getFnAttribute("target-features").getValueAsString().contains("+f16c")) {
+          errs() << "Storage: half needs F16C (-mf16c), arrays stored as float\n";
+          kind = StorageFloat;
+        }
+      }
+
+      for (Function &F : M)
+        if (!F.isDeclaration())
+          weighAccesses(F);
+
+      std::vector<Site> Sites;
+      findSites(M, Sites);
+
+      unsigned Compressed = 0;
+      double Saved = 0.0;
+      bool Unknown = false;
+
+      // Every site is rewritten before the functions are cloned: the clones
+      // of an allocating function then see the compressed layout
+      std::vector<Site *> Selected;
+
+      for (Site &S : Sites) {
+        if (!isSelected(S))
+          continue;
+
+        if (!S.Fam.Valid) {
+          errs() << "Storage: " << S.Name << " kept in double: " << S.Fam.Reason << "\n";
+          continue;
+        }
+
+        report(S);
+
+        if (ConstantInt *C = dyn_cast_or_null<ConstantInt>(allocationSize(S.Call)))
+          Saved += C->getZExtValue() - C->getZExtValue() * storageSize() / 8;
+        else
+          Unknown = true;
+
+        compressAllocation(S.Call);
+
+        rewriteAccesses(S.Fam.GEPs, S.Fam.Loads, S.Fam.Stores);
+        Selected.push_back(&S);
+        Compressed++;
+      }
+
+      // One clone per set of arguments compressed together
+      DenseMap<CallBase *, uint64_t> Calls;
+
+      for (Site *S : Selected)
+        for (auto &C : S->Fam.Calls)
+          Calls[C.first] |= 1ULL << C.second;
+
+      redirect(Calls);
+      reportMeasured();
+
+      errs() << "Arrays stored as " << storageName() << ": " << Compressed
+             << ", functions cloned: " << clones.size() << ", bytes saved: "
+             << format("%.0f", Saved) << (Unknown ? " (and arrays of unknown size)" : "")
+             << "\n";
+
+      return Compressed != 0;
+    }
+
+    StringRef storageName() const {
+      switch (kind) {
+      case StorageHalf: return "half";
+      case StorageBFloat: return "bfloat";
+      default: return "float";
+      }
+    }
+
+    // Bytes of one element
+    unsigned storageSize() const {
+      return kind == StorageFloat ? 4 : 2;
+    }
+
+    Type *storageType(LLVMContext &CTX) const {
+      switch (kind) {
+      case StorageHalf: return Type::getHalfTy(CTX);
+      case StorageBFloat: return Type::getInt16Ty(CTX);
+      default: return Type::getFloatTy(CTX);
+      }
+    }
+
+    bool isSelected(Site &S) {
+      if (Arrays.empty())
+        return policy.empty() || policy.function(*S.Call->getFunction()) == ModeStorage;
+
+      for (const std::string &A : Arrays)
+        if (A == S.Name)
+          return true;
+
+      return false;
+    }
+
+    void weighAccesses(Function &F) {
+      const DataLayout &DL = F.getParent()->getDataLayout();
+      DominatorTree DT(F);
+      LoopInfo LI(DT);
+      BranchProbabilityInfo BPI(F, LI);
+      BlockFrequencyInfo BFI(F, BPI, LI);
+      double Entry = BFI.getEntryFreq();
+      double Total = 0.0;
+
+      for (BasicBlock &BB : F) {
+        double Freq = BFI.getBlockFreq(&BB).getFrequency() / Entry;
+
+        for (Instruction &I : BB) {
+          Type *Ty;
+
+          if (LoadInst *LD = dyn_cast<LoadInst>(&I))
+            Ty = LD->getType();
+          else if (StoreInst *ST = dyn_cast<StoreInst>(&I))
+            Ty = ST->getValueOperand()->getType();
+          else
+            continue;
+
+          double Bytes = Freq * DL.getTypeStoreSize(Ty).getFixedSize();
+          access_bytes[&I] = Bytes;
+          Total += Bytes;
+        }
+      }
+
+      function_bytes[&F] = Total;
+    }
+
+    static bool isAllocation(CallInst *CI) {
+      Function *Callee = CI->getCalledFunction();
+      if (!Callee || !Callee->isDeclaration() || !CI->getType()->isPointerTy())
+        return false;
+
+      StringRef Name = Callee->getName();
+      return Name == "malloc" || Name == "calloc" || Name == "aligned_alloc";
+    }
+
+    void findSites(Module &M, std::vector<Site> &Sites) {
+      for (Function &F : M) {
+        unsigned Index = 0;
+
+        for (BasicBlock &BB : F)
+          for (Instruction &I : BB) {
+            CallInst *CI = dyn_cast<CallInst>(&I);
+            if (!CI || !isAllocation(CI))
+              continue;
+
+            Site S;
+            S.Call = CI;
+            S.Name = (F.getName() + ":" + Twine(Index++)).str();
+            collect(CI, S.Fam);
+
+            // The pointer must only hold doubles
+            if (S.Fam.Valid && S.Fam.Loads.empty() && S.Fam.Stores.empty()
+                && S.Fam.Calls.empty())
+              continue;
+
+            Sites.push_back(std::move(S));
+          }
+      }
+
+      for (Site &S : Sites)
+        if (S.Fam.Valid)
+          checkCalls(S.Fam);
+    }
+
+    // Follow the pointers derived from Root in its function
+    void collect(Value *Root, Family &Fam) {
+      SmallVector<Value *, 8> Worklist{Root};
+      DenseSet<Value *> Visited{Root};
+
+      auto invalid = [&](const Twine &Reason) {
+        if (Fam.Valid)
+          Fam.Reason = Reason.str();
+        Fam.Valid = false;
+      };
+
+      while (!Worklist.empty() && Fam.Valid) {
+        Value *V = Worklist.pop_back_val();
+
+        for (User *U : V->users()) {
+          Instruction *I = dyn_cast<Instruction>(U);
+          if (!I) {
+            invalid("used by a constant");
+            break;
+          }
+
+          if (isa<BitCastInst>(I)) {
+            if (Visited.insert(I).second)
+              Worklist.push_back(I);
+          }
+          else if (GetElementPtrInst *GEP = dyn_cast<GetElementPtrInst>(I)) {
+            if (GEP->getPointerOperand() != V || !GEP->getSourceElementType()->isDoubleTy()) {
+              invalid("indexed as another type");
+              break;
+            }
+
+            Fam.GEPs.push_back(GEP);
+            if (Visited.insert(GEP).second)
+              Worklist.push_back(GEP);
+          }
+          else if (LoadInst *LD = dyn_cast<LoadInst>(I)) {
+            if (!LD->getType()->isDoubleTy() || !LD->isSimple()) {
+              invalid("loaded as another type");
+              break;
+            }
+
+            Fam.Loads.push_back(LD);
+            Fam.Bytes += access_bytes.lookup(LD);
+          }
+          else if (StoreInst *ST = dyn_cast<StoreInst>(I)) {
+            if (ST->getValueOperand() == V) {
+              invalid("address stored");
+              break;
+            }
+
+            if (!ST->getValueOperand()->getType()->isDoubleTy() || !ST->isSimple()) {
+              invalid("stored as another type");
+              break;
+            }
+
+            Fam.Stores.push_back(ST);
+            Fam.Bytes += access_bytes.lookup(ST);
+          }
+          else if (CallBase *CB = dyn_cast<CallBase>(I)) {
+            Function *Callee = CB->getCalledFunction();
+
+            if (Callee && Callee->getName() == "free" && CB->getArgOperand(0) == V)
+              continue;
+
+            if (!Callee || Callee->isDeclaration() || Callee->isVarArg()
+                || CB->getFunctionType() != Callee->getFunctionType()
+                || CB->arg_size() > 64) {
+              invalid("passed to " + (Callee ? Callee->getName() : StringRef("an indirect call")));
+              break;
+            }
+
+            for (unsigned i = 0; i < CB->arg_size(); i++)
+              if (CB->getArgOperand(i) == V)
+                Fam.Calls.push_back({CB, i});
+
+            if (CB->getCalledOperand() == V)
+              invalid("called");
+          }
+          else if (!isa<ICmpInst>(I)) {
+            invalid(Twine("used by ") + I->getOpcodeName());
+            break;
+          }
+        }
+      }
+    }
+
+    Family &getArgument(Function *F, unsigned ArgNo) {
+      auto Key = std::make_pair(F, ArgNo);
+      auto It = arguments.find(Key);
+
+      if (It != arguments.end())
+        return It->second;
+
+      Family &Fam = arguments[Key];
+      collect(F->getArg(ArgNo), Fam);
+      return Fam;
+    }
+
+    // A family is valid when the arguments it is passed to are, recursive
+    // calls included
+    bool checkCalls(Family &Fam) {
+      for (auto &C : Fam.Calls) {
+        Function *Callee = C.first->getCalledFunction();
+        auto Key = std::make_pair(Callee, C.second);
+
+        if (!checking.insert(Key).second)
+          continue;
+
+        Family &Arg = getArgument(Callee, C.second);
+        bool Valid = Arg.Valid && checkCalls(Arg);
+
+        checking.erase(Key);
+
+        if (!Valid) {
+          Fam.Valid = false;
+          Fam.Reason = ("passed to " + Callee->getName() + ": " + Arg.Reason).str();
+          return false;
+        }
+      }
+
+      return true;
+    }
+
+    // Bytes of the accesses of the array in each function it reaches
+    void collectReach(Family &Fam, Function *F, DenseMap<Function *, double> &Reach,
+                      DenseSet<std::pair<Function *, unsigned>> &Visited) {
+      Reach[F] += Fam.Bytes;
+
+      for (auto &C : Fam.Calls) {
+        Function *Callee = C.first->getCalledFunction();
+
+        if (Visited.insert({Callee, C.second}).second)
+          collectReach(getArgument(Callee, C.second), Callee, Reach, Visited);
+      }
+    }
+
+    unsigned countAccesses(Family &Fam, DenseSet<std::pair<Function *, unsigned>> &Visited,
+                           unsigned &Stores) {
+      unsigned Loads = Fam.Loads.size();
+      Stores += Fam.Stores.size();
+
+      for (auto &C : Fam.Calls) {
+        Function *Callee = C.first->getCalledFunction();
+
+        if (Visited.insert({Callee, C.second}).second)
+          Loads += countAccesses(getArgument(Callee, C.second), Visited, Stores);
+      }
+
+      return Loads;
+    }
+
+    void report(Site &S) {
+      DenseMap<Function *, double> Reach;
+      DenseSet<std::pair<Function *, unsigned>> Visited;
+      unsigned Stores = 0;
+
+      collectReach(S.Fam, S.Call->getFunction(), Reach, Visited);
+      Visited.clear();
+      unsigned Loads = countAccesses(S.Fam, Visited, Stores);
+
+      errs() << "Storage: " << S.Name << " (" << S.Call->getCalledFunction()->getName()
+             << ") stored as " << storageName() << ", ";
+
+      if (ConstantInt *C = dyn_cast_or_null<ConstantInt>(allocationSize(S.Call)))
+        errs() << C->getZExtValue() - C->getZExtValue() * storageSize() / 8 << " bytes saved";
+      else
+        errs() << 100 - 100 * storageSize() / 8 << "% of the bytes saved";
+
+      errs() << ", " << Loads << " loads, " << Stores << " stores\n";
+
+      // Memory bound: the time follows the bytes moved
+      for (Function &Fn : *S.Call->getModule()) {
+        auto R = Reach.find(&Fn);
+        if (R == Reach.end())
+          continue;
+
+        Function *F = &Fn;
+        double Before = function_bytes.lookup(F);
+        double After = Before - R->second * (1.0 - storageSize() / 8.0);
+
+        errs() << "  Function: " << F->getName()
+               << format(": estimated bandwidth improvement %.2f",
+                         After > 0.0 ? Before / After : 1.0) << "\n";
+
+        reached.insert(F);
+      }
+    }
+
+    // Once every clone exists: the compressed binary runs the clones, whose
+    // names LLVM may have uniqued (dotprod.storage.3), and the functions
+    // compressed in place
+    void reportMeasured() {
+      if (base_profile.empty() || compressed_profile.empty())
+        return;
+
+      for (Function *F : reached) {
+        double Base = base_profile.mean(F->getName());
+        bool Cloned = false;
+
+        if (Base == 0.0)
+          continue;
+
+        // Clones in the order they were created
+        for (Function &Clone : *F->getParent()) {
+          auto O = origins.find(&Clone);
+          if (O == origins.end() || O->second.first != F)
+            continue;
+
+          double Compressed = compressed_profile.mean(Clone.getName());
+          Cloned = true;
+
+          if (Compressed > 0.0)
+            errs() << "Storage: " << F->getName() << " (" << Clone.getName()
+                   << format("): measured speedup %.2f\n", Base / Compressed);
+        }
+
+        double Compressed = Cloned ? 0.0 : compressed_profile.mean(F->getName());
+
+        if (Compressed > 0.0)
+          errs() << "Storage: " << F->getName()
+                 << format(": measured speedup %.2f\n", Base / Compressed);
+      }
+    }
+
+    // Bytes allocated, null when calloc is not given constants
+    static Value *allocationSize(CallInst *CI) {
+      StringRef Name = CI->getCalledFunction()->getName();
+
+      if (Name == "aligned_alloc")
+        return CI->getArgOperand(1);
+
+      if (Name == "calloc") {
+        ConstantInt *N = dyn_cast<ConstantInt>(CI->getArgOperand(0));
+        ConstantInt *Size = dyn_cast<ConstantInt>(CI->getArgOperand(1));
+
+        if (N && Size)
+          return ConstantInt::get(N->getType(), N->getZExtValue() * Size->getZExtValue());
+        return nullptr;
+      }
+
+      return CI->getArgOperand(0);
+    }
+
+    void compressAllocation(CallInst *CI) {
+      StringRef Name = CI->getCalledFunction()->getName();
+      IRBuilder<> Builder(CI);
+      uint64_t Ratio = 8 / storageSize();
+
+      if (Name == "calloc") {
+        // calloc(n, size): the elements shrink, or the whole block when the
+        // element size is not a multiple of a double
+        Value *N = CI->getArgOperand(0);
+        Value *Size = CI->getArgOperand(1);
+        ConstantInt *C = dyn_cast<ConstantInt>(Size);
+
+        if (C && C->getZExtValue() % 8 == 0)
+          CI->setArgOperand(1, ConstantInt::get(C->getType(), C->getZExtValue() / Ratio));
+        else {
+          CI->setArgOperand(0, Builder.CreateUDiv(Builder.CreateMul(N, Size),
+                                                  ConstantInt::get(N->getType(), Ratio)));
+          CI->setArgOperand(1, ConstantInt::get(Size->getType(), 1));
+        }
+
+        return;
+      }
+
+      unsigned SizeArg = Name == "aligned_alloc" ? 1 : 0;
+      Value *Size = CI->getArgOperand(SizeArg);
+      Value *NewSize = Builder.CreateUDiv(Size, ConstantInt::get(Size->getType(), Ratio));
+
+      // aligned_alloc wants a multiple of the alignment
+      if (SizeArg == 1) {
+        Value *Align = CI->getArgOperand(0);
+        Value *Mask = Builder.CreateSub(Align, ConstantInt::get(Align->getType(), 1));
+        NewSize = Builder.CreateMul(Builder.CreateUDiv(Builder.CreateAdd(NewSize, Mask), Align),
+                                    Align);
+      }
+
+      CI->setArgOperand(SizeArg, NewSize);
+    }
+
+    // double to the storage type: bfloat keeps the upper half of the float,
+    // rounded to nearest even
+    Value *toStorage(IRBuilder<> &Builder, Value *V) {
+      LLVMContext &CTX = V->getContext();
+
+      // half goes through float: F16C converts floats only
+      Value *F = Builder.CreateFPTrunc(V, Type::getFloatTy(CTX));
+
+      if (kind != StorageBFloat)
+        return Builder.CreateFPTrunc(F, storageType(CTX));
+
+      Type *Int32Ty = Type::getInt32Ty(CTX);
+      Value *Bits = Builder.CreateBitCast(F, Int32Ty);
+      Value *Lsb = Builder.CreateAnd(Builder.CreateLShr(Bits, 16), 1);
+      Value *Rounded = Builder.CreateAdd(Bits, Builder.CreateAdd(Lsb, ConstantInt::get(Int32Ty, 0x7FFF)));
+      Value *Upper = Builder.CreateTrunc(Builder.CreateLShr(Rounded, 16), Type::getInt16Ty(CTX));
+
+      // A NaN must not round to infinity
+      return Builder.CreateSelect(Builder.CreateFCmpUNO(F, F),
+                                  ConstantInt::get(Type::getInt16Ty(CTX), 0x7FC0), Upper);
+    }
+
+    Value *fromStorage(IRBuilder<> &Builder, Value *S) {
+      LLVMContext &CTX = S->getContext();
+      Type *DoubleTy = Type::getDoubleTy(CTX);
+
+      if (kind != StorageBFloat)
+        return Builder.CreateFPExt(Builder.CreateFPExt(S, Type::getFloatTy(CTX)), DoubleTy);
+
+      Value *Bits = Builder.CreateShl(Builder.CreateZExt(S, Type::getInt32Ty(CTX)), 16);
+      return Builder.CreateFPExt(Builder.CreateBitCast(Bits, Type::getFloatTy(CTX)), DoubleTy);
+    }
+
+    // The pointers keep their double type, only the element size and the
+    // accesses change
+    void rewriteAccesses(ArrayRef<GetElementPtrInst *> GEPs, ArrayRef<LoadInst *> Loads,
+                         ArrayRef<StoreInst *> Stores) {
+      for (GetElementPtrInst *GEP : GEPs) {
+        IRBuilder<> Builder(GEP);
+        Type *Ty = storageType(GEP->getContext());
+        Value *Ptr = Builder.CreateBitCast(GEP->getPointerOperand(), Ty->getPointerTo(
+                                             GEP->getPointerAddressSpace()));
+        SmallVector<Value *, 2> Indices(GEP->idx_begin(), GEP->idx_end());
+        Value *New = GEP->isInBounds()
+          ? Builder.CreateInBoundsGEP(Ty, Ptr, Indices, GEP->getName())
+          : Builder.CreateGEP(Ty, Ptr, Indices, GEP->getName());
+
+        GEP->replaceAllUsesWith(Builder.CreateBitCast(New, GEP->getType()));
+        GEP->eraseFromParent();
+      }
+
+      for (LoadInst *LD : Loads) {
+        IRBuilder<> Builder(LD);
+        Type *Ty = storageType(LD->getContext());
+        Value *Ptr = Builder.CreateBitCast(LD->getPointerOperand(),
+                                           Ty->getPointerTo(LD->getPointerAddressSpace()));
+        LoadInst *New = Builder.CreateAlignedLoad(Ty, Ptr, Align(storageSize()),
+                                                  LD->getName() + ".c");
+        New->copyMetadata(*LD);
+
+        LD->replaceAllUsesWith(fromStorage(Builder, New));
+        LD->eraseFromParent();
+      }
+
+      for (StoreInst *ST : Stores) {
+        IRBuilder<> Builder(ST);
+        Type *Ty = storageType(ST->getContext());
+        Value *Ptr = Builder.CreateBitCast(ST->getPointerOperand(),
+                                           Ty->getPointerTo(ST->getPointerAddressSpace()));
+        StoreInst *New = Builder.CreateAlignedStore(toStorage(Builder, ST->getValueOperand()),
+                                                    Ptr, Align(storageSize()));
+        New->copyMetadata(*ST);
+
+        ST->eraseFromParent();
+      }
+    }
+
+    // Call the clone compressing the arguments of each call in Calls
+    void redirect(DenseMap<CallBase *, uint64_t> &Calls) {
+      for (auto &C : Calls) {
+        Function *Callee = C.first->getCalledFunction();
+        uint64_t Mask = C.second;
+        auto It = origins.find(Callee);
+
+        if (It != origins.end()) {
+          Callee = It->second.first;
+          Mask |= It->second.second;
+        }
+
+        C.first->setCalledFunction(getClone(Callee, Mask));
+      }
+    }
+
+    Function *getClone(Function *F, uint64_t Mask) {
+      auto Key = std::make_pair(F, Mask);
+      auto It = clones.find(Key);
+
+      if (It != clones.end())
+        return It->second;
+
+      ValueToValueMapTy VMap;
+      Function *Clone = CloneFunction(F, VMap);
+
+      Clone->setName(F->getName() + ".storage");
+      Clone->setLinkage(GlobalValue::InternalLinkage);
+      clones[Key] = Clone;
+      origins[Clone] = Key;
+
+      // The accesses of the original arguments, in the clone
+      SmallVector<GetElementPtrInst *, 16> GEPs;
+      SmallVector<LoadInst *, 16> Loads;
+      SmallVector<StoreInst *, 16> Stores;
+      DenseMap<CallBase *, uint64_t> Calls;
+
+      for (unsigned ArgNo = 0; ArgNo < F->arg_size(); ArgNo++) {
+        if (!(Mask & (1ULL << ArgNo)))
+          continue;
+
+        Family &Fam = getArgument(F, ArgNo);
+
+        for (GetElementPtrInst *GEP : Fam.GEPs)
+          GEPs.push_back(cast<GetElementPtrInst>(VMap[GEP]));
+        for (LoadInst *LD : Fam.Loads)
+          Loads.push_back(cast<LoadInst>(VMap[LD]));
+        for (StoreInst *ST : Fam.Stores)
+          Stores.push_back(cast<StoreInst>(VMap[ST]));
+        for (auto &C : Fam.Calls)
+          Calls[cast<CallBase>(VMap[C.first])] |= 1ULL << C.second;
+      }
+
+      rewriteAccesses(GEPs, Loads, Stores);
+      redirect(Calls);
+
+      return Clone;
+    }
+  };
+}
+
+char StorageCompression::ID = 0;
+static RegisterPass<StorageCompression> X("fast-fp-storage",
+                                          "Compressed storage of double arrays");
@@ -0,0 +1,135 @@
+//===- VectorMath.cpp - Vector variants of float math calls ---------------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+
+#include "VectorMath.h"
+
+#include "llvm/ADT/StringMap.h"
+#include "llvm/Analysis/TargetLibraryInfo.h"
+#include "llvm/Analysis/VectorUtils.h"
+#include "llvm/IR/DerivedTypes.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/IntrinsicInst.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Transforms/Utils/ModuleUtils.h"
+
+using namespace llvm;
+
+namespace fastfp {
+
+  // Float functions of libmvec (glibc 2.35, sin, cos, exp, log and pow since
+  // 2.22), by scalar name: SSE variant, AVX2 variant
+  static const VecDesc LibmvecFuncs[] = {
+    {"sinf", "_ZGVbN4v_sinf", ElementCount::getFixed(4)},
+    {"sinf", "_ZGVdN8v_sinf", ElementCount::getFixed(8)},
+    {"cosf", "_ZGVbN4v_cosf", ElementCount::getFixed(4)},
+    {"cosf", "_ZGVdN8v_cosf", ElementCount::getFixed(8)},
+    {"tanf", "_ZGVbN4v_tanf", ElementCount::getFixed(4)},
+    {"tanf", "_ZGVdN8v_tanf", ElementCount::getFixed(8)},
+    {"asinf", "_ZGVbN4v_asinf", ElementCount::getFixed(4)},
+    {"asinf", "_ZGVdN8v_asinf", ElementCount::getFixed(8)},
+    {"acosf", "_ZGVbN4v_acosf", ElementCount::getFixed(4)},
+    {"acosf", "_ZGVdN8v_acosf", ElementCount::getFixed(8)},
+    {"atanf", "_ZGVbN4v_atanf", ElementCount::getFixed(4)},
+    {"atanf", "_ZGVdN8v_atanf", ElementCount::getFixed(8)},
+    {"sinhf", "_ZGVbN4v_sinhf", ElementCount::getFixed(4)},
+    {"sinhf", "_ZGVdN8v_sinhf", ElementCount::getFixed(8)},
+    {"coshf", "_ZGVbN4v_coshf", ElementCount::getFixed(4)},
+    {"coshf", "_ZGVdN8v_coshf", ElementCount::getFixed(8)},
+    {"tanhf", "_ZGVbN4v_tanhf", ElementCount::getFixed(4)},
+    {"tanhf", "_ZGVdN8v_tanhf", ElementCount::getFixed(8)},
+    {"expf", "_ZGVbN4v_expf", ElementCount::getFixed(4)},
+    {"expf", "_ZGVdN8v_expf", ElementCount::getFixed(8)},
+    {"exp2f", "_ZGVbN4v_exp2f", ElementCount::getFixed(4)},
+    {"exp2f", "_ZGVdN8v_exp2f", ElementCount::getFixed(8)},
+    {"expm1f", "_ZGVbN4v_expm1f", ElementCount::getFixed(4)},
+    {"expm1f", "_ZGVdN8v_expm1f", ElementCount::getFixed(8)},
+    {"logf", "_ZGVbN4v_logf", ElementCount::getFixed(4)},
+    {"logf", "_ZGVdN8v_logf", ElementCount::getFixed(8)},
+    {"log2f", "_ZGVbN4v_log2f", ElementCount::getFixed(4)},
+    {"log2f", "_ZGVdN8v_log2f", ElementCount::getFixed(8)},
+    {"log10f", "_ZGVbN4v_log10f", ElementCount::getFixed(4)},
+    {"log10f", "_ZGVdN8v_log10f", ElementCount::getFixed(8)},
+    {"log1pf", "_ZGVbN4v_log1pf", ElementCount::getFixed(4)},
+    {"log1pf", "_ZGVdN8v_log1pf", ElementCount::getFixed(8)},
+    {"cbrtf", "_ZGVbN4v_cbrtf", ElementCount::getFixed(4)},
+    {"cbrtf", "_ZGVdN8v_cbrtf", ElementCount::getFixed(8)},
+    {"erff", "_ZGVbN4v_erff", ElementCount::getFixed(4)},
+    {"erff", "_ZGVdN8v_erff", ElementCount::getFixed(8)},
+    {"powf", "_ZGVbN4vv_powf", ElementCount::getFixed(4)},
+    {"powf", "_ZGVdN8vv_powf", ElementCount::getFixed(8)},
+    {"atan2f", "_ZGVbN4vv_atan2f", ElementCount::getFixed(4)},
+    {"atan2f", "_ZGVdN8vv_atan2f", ElementCount::getFixed(8)},
+    {"hypotf", "_ZGVbN4vv_hypotf", ElementCount::getFixed(4)},
+    {"hypotf", "_ZGVdN8vv_hypotf", ElementCount::getFixed(8)},
+  };
+
+  // Scalar name of a float math intrinsic
+  static StringRef getLibName(CallInst *CI) {
+    IntrinsicInst *II = dyn_cast<IntrinsicInst>(CI);
+    if (!II)
+      return CI->getCalledFunction() ? CI->getCalledFunction()->getName() : StringRef();
+
+    switch (II->getIntrinsicID()) {
+    case Intrinsic::sin: return "sinf";
+    case Intrinsic::cos: return "cosf";
+    case Intrinsic::exp: return "expf";
+    case Intrinsic::exp2: return "exp2f";
+    case Intrinsic::log: return "logf";
+    case Intrinsic::log2: return "log2f";
+    case Intrinsic::log10: return "log10f";
+    case Intrinsic::pow: return "powf";
+    default: return StringRef();
+    }
+  }
+
+  SmallVector<std::string, 2> addVectorVariants(CallInst *CI, VectorLibrary Lib) {
+    SmallVector<std::string, 2> Added;
+    Function *Callee = CI->getCalledFunction();
+    StringRef Name = getLibName(CI);
+
+    if (Lib == NoVectorLibrary || !Callee || Name.empty() || !CI->getType()->isFloatTy())
+      return Added;
+
+    // The 8 floats variants need AVX2
+    Function *F = CI->getFunction();
+    bool AVX2 = F->getFnAttribute("target-features").getValueAsString().contains("+avx2");
+    Module *M = F->getParent();
+
+    SmallVector<std::string, 8> Mappings;
+    VFABI::getVectorVariantNames(*CI, Mappings);
+
+    for (const VecDesc &D : LibmvecFuncs) {
+      if (D.ScalarFnName != Name || (D.VectorizationFactor.getFixedValue() == 8 && !AVX2))
+        continue;
+
+      std::string Mangled = VFABI::mangleTLIVectorName(D.VectorFnName, Callee->getName(),
+                                                       CI->arg_size(), D.VectorizationFactor);
+      if (is_contained(Mappings, Mangled))
+        continue;
+
+      // Declared and kept until the vectorizer uses it
+      if (!M->getFunction(D.VectorFnName)) {
+        Type *VecTy = VectorType::get(CI->getType(), D.VectorizationFactor);
+        SmallVector<Type *, 2> Params(CI->arg_size(), VecTy);
+        Function *VecF = Function::Create(FunctionType::get(VecTy, Params, false),
+                                          Function::ExternalLinkage, D.VectorFnName, M);
+        VecF->copyAttributesFrom(Callee);
+        appendToCompilerUsed(*M, {VecF});
+      }
+
+      Mappings.push_back(Mangled);
+      Added.push_back(D.VectorFnName.str());
+    }
+
+    if (!Added.empty())
+      VFABI::setVectorVariantNames(CI, Mappings);
+
+    return Added;
+  }
+
+} // namespace fastfp
@@ -0,0 +1,38 @@
+//===- VectorMath.h - Vector variants of float math calls -----------------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// This file declares the mapping of the float math calls FastFP creates to the
+// vector functions of a vector math library, so that the loop vectorizer can
+// vectorize the loops calling them.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef FASTFP_VECTORMATH_H
+#define FASTFP_VECTORMATH_H
+
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/IR/Instructions.h"
+
+#include <string>
+
+namespace fastfp {
+
+  enum VectorLibrary {
+    NoVectorLibrary,
+    Libmvec // glibc, x86-64 (SSE: 4 floats, AVX2: 8 floats), link with -lmvec
+  };
+
+  // Declare the vector functions of Lib computing the function of CI and
+  // list them in its vector-function-abi-variant attribute, as
+  // -vector-library does for the calls of the source. Returns the names of
+  // the vector functions.
+  llvm::SmallVector<std::string, 2> addVectorVariants(llvm::CallInst *CI, VectorLibrary Lib);
+
+} // namespace fastfp
+
+#endif // FASTFP_VECTORMATH_H
@@ -0,0 +1,35 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#define ALIGN 64
+#define N 1000000
+
+void damped(double *restrict x, double *restrict y, const uint64_t n)
+{
+  for (uint64_t i = 0; i < n; i++)
+    y[i] = sin(x[i]) * exp(-x[i]) + sqrt(x[i]);
+}
+
+int main(int argc, char **argv)
+{
+  double *restrict x = aligned_alloc(ALIGN, sizeof(double) * N);
+  double *restrict y = aligned_alloc(ALIGN, sizeof(double) * N);
+
+  for (uint64_t i = 0; i < N; i++)
+    x[i] = i * 1.0e-5;
+
+  damped(x, y, N);
+
+  double res = 0.0;
+  for (uint64_t i = 0; i < N; i++)
+    res += y[i];
+
+  printf("Sum: %e\n", res);
+
+  free(y);
+  free(x);
+
+  return 0;
+}
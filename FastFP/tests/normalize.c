@@ -0,0 +1,42 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#define ALIGN 64
+#define N 1000
+#define M 1000
+
+// Divide each row by its norm, then halve it
+void normalize(double *restrict a, const uint64_t n, const uint64_t m)
+{
+  for (uint64_t i = 0; i < n; i++) {
+    double norm = 0.0;
+    for (uint64_t j = 0; j < m; j++)
+      norm += a[i * m + j] * a[i * m + j];
+    norm = sqrt(norm);
+
+    for (uint64_t j = 0; j < m; j++)
+      a[i * m + j] = a[i * m + j] / norm / 2.0;
+  }
+}
+
+int main(int argc, char **argv)
+{
+  double *restrict a = aligned_alloc(ALIGN, sizeof(double) * N * M);
+
+  for (uint64_t i = 0; i < N * M; i++)
+    a[i] = (i % 97) * 1.0e-2 + 1.0;
+
+  normalize(a, N, M);
+
+  double res = 0.0;
+  for (uint64_t i = 0; i < N * M; i++)
+    res += a[i];
+
+  printf("Sum: %.17e\n", res);
+
+  free(a);
+
+  return 0;
+}
@@ -0,0 +1,523 @@
+#include <stdio.h>     // fprintf, snprintf
+#include <stdlib.h>    // atof, strtoull, system
+#include <stdint.h>    // uint64_t
+#include <string.h>    // strlen, memcmp, strtok
+#include <math.h>      // fabs, INFINITY
+#include <time.h>      // clock_gettime
+#include <unistd.h>    // getopt
+#include <sys/stat.h>  // mkdir
+#include <sys/wait.h>  // WIFEXITED, WEXITSTATUS
+
+#include "plan.h"
+
+//
+#define DEFAULT_BOUND 1e-6
+#define DEFAULT_RUNS 3
+#define DEFAULT_PLAN "fastfp-plan.csv"
+#define DEFAULT_WORKDIR "fastfp-search.d"
+#define DEFAULT_CC "clang -O2"
+#define DEFAULT_OPT "opt"
+#define COMMAND_LIMIT 8192
+
+/**
+ * Store the result of one configuration
+ */
+typedef struct test_s
+{
+  char *demoted;
+  int ok;
+  double error;
+  double time;
+} test_t;
+
+/**
+ * Store the state of the search
+ */
+typedef struct search_s
+{
+  const char *lib;
+  const char *input;
+  const char *opt;
+  const char *cc;
+  const char *workdir;
+  char args[COMMAND_LIMIT];
+  double bound;
+  uint64_t runs;
+  units_t units;
+  test_t *tests;
+  uint64_t ntests;
+  uint64_t capacity;
+} search_t;
+
+static void usage(const char *prog)
+{
+  fprintf(stderr,
+          "usage: %s [-e BOUND] [-r RUNS] [-s SHADOW] [-o PLAN] [-w WORKDIR]\n"
+          "       [-c CC] [-O OPT] -l LIB INPUT.bc [ARG...]\n"
+          "\n"
+          "Search the fastest demotion of INPUT.bc whose output stays within a\n"
+          "relative error of BOUND (default %.0e) from the double version, and\n"
+          "write it as a plan for -fast-fp-plan (default %s).\n"
+          "\n"
+          "  -l LIB    : LLVMFastFP.so\n"
+          "  -s SHADOW : fastfp-shadow.csv of a -fast-fp-shadow run, the webs\n"
+          "              with a larger error than BOUND stay in double\n"
+          "  -r RUNS   : runs per configuration, the fastest counts (default %d)\n"
+          "  -c CC     : compiler and flags (default \"%s\")\n"
+          "  -O OPT    : opt (default \"%s\")\n"
+          "  -w WORKDIR: temporary files (default %s)\n"
+          "  ARG...    : arguments of the program\n",
+          prog, DEFAULT_BOUND, DEFAULT_PLAN, DEFAULT_RUNS, DEFAULT_CC,
+          DEFAULT_OPT, DEFAULT_WORKDIR);
+  exit(1);
+}
+
+// Append a single quoted word to a command
+static void append_quoted(char *cmd, const char *arg)
+{
+  uint64_t n = strlen(cmd);
+
+  if (n + 4 * strlen(arg) + 4 >= COMMAND_LIMIT)
+    {
+      fprintf(stderr, "command too long\n");
+      exit(1);
+    }
+
+  cmd[n++] = '\'';
+
+  for (const char *c = arg; *c; c++)
+    {
+      // 'it'\''s'
+      if (*c == '\'')
+        {
+          memcpy(cmd + n, "'\\''", 4);
+          n += 4;
+        }
+      else
+        cmd[n++] = *c;
+    }
+
+  cmd[n++] = '\'';
+  cmd[n] = 0;
+}
+
+static int run(const char *cmd)
+{
+  int status = system(cmd);
+
+  return status != -1 && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+static double now(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// Every number printed by the program, in order
+static double *read_numbers(const char *path, uint64_t *n)
+{
+  FILE *file = fopen(path, "r");
+  double *numbers = NULL;
+  uint64_t capacity = 0;
+  char line[LINE_LIMIT];
+
+  *n = 0;
+
+  if (!file)
+    return NULL;
+
+  while (fgets(line, LINE_LIMIT, file))
+    {
+      for (char *tok = strtok(line, " \t\r\n,;:()[]{}="); tok;
+           tok = strtok(NULL, " \t\r\n,;:()[]{}="))
+        {
+          char *end;
+          double x = strtod(tok, &end);
+
+          if (end == tok || *end)
+            continue;
+
+          if (*n == capacity)
+            {
+              capacity = capacity ? 2 * capacity : 64;
+              numbers = realloc(numbers, sizeof(double) * capacity);
+
+              if (!numbers)
+                exit(12);
+            }
+
+          numbers[(*n)++] = x;
+        }
+    }
+
+  fclose(file);
+
+  return numbers;
+}
+
+// Largest relative error between the numbers of two outputs
+static double output_error(const char *reference, const char *output)
+{
+  uint64_t nr, no;
+  double *r = read_numbers(reference, &nr);
+  double *o = read_numbers(output, &no);
+  double error = nr == no ? 0.0 : INFINITY;
+
+  for (uint64_t i = 0; i < nr && nr == no; i++)
+    {
+      double e = r[i] == o[i] ? 0.0 : fabs((o[i] - r[i]) / (r[i] != 0.0 ? r[i] : 1.0));
+
+      if (!(e <= error))
+        error = e != e ? INFINITY : e;
+    }
+
+  free(r);
+  free(o);
+
+  return error;
+}
+
+// Build and run one configuration, the output goes to WORKDIR/OUTPUT
+static test_t *evaluate(search_t *s, const char *demoted, const char *output)
+{
+  uint64_t n = s->units.size;
+
+  for (uint64_t i = 0; i < s->ntests; i++)
+    if (memcmp(s->tests[i].demoted, demoted, n) == 0)
+      return s->tests + i;
+
+  if (s->ntests == s->capacity)
+    {
+      s->capacity = s->capacity ? 2 * s->capacity : 64;
+      s->tests = realloc(s->tests, sizeof(test_t) * s->capacity);
+
+      if (!s->tests)
+        exit(12);
+    }
+
+  test_t *t = s->tests + s->ntests++;
+  char path[COMMAND_LIMIT];
+  char cmd[COMMAND_LIMIT];
+
+  t->demoted = malloc(n + 1);
+  if (!t->demoted)
+    exit(12);
+
+  memcpy(t->demoted, demoted, n);
+  t->ok = 0;
+  t->error = INFINITY;
+  t->time = INFINITY;
+
+  //
+  snprintf(path, COMMAND_LIMIT, "%s/plan.csv", s->workdir);
+  FILE *file = fopen(path, "w");
+
+  if (!file)
+    {
+      fprintf(stderr, "cannot write plan: %s\n", path);
+      exit(13);
+    }
+
+  plan_write(&s->units, demoted, file);
+  fclose(file);
+
+  // Demote
+  snprintf(cmd, COMMAND_LIMIT, "%s -enable-new-pm=0 -load ", s->opt);
+  append_quoted(cmd, s->lib);
+  strcat(cmd, " -fast-fp -fast-fp-plan=");
+  append_quoted(cmd, path);
+  strcat(cmd, " ");
+  append_quoted(cmd, s->input);
+  strcat(cmd, " -o ");
+  snprintf(path, COMMAND_LIMIT, "%s/config.bc", s->workdir);
+  append_quoted(cmd, path);
+  strcat(cmd, " 2> /dev/null");
+
+  if (!run(cmd))
+    return t;
+
+  // Compile
+  snprintf(cmd, COMMAND_LIMIT, "%s ", s->cc);
+  append_quoted(cmd, path);
+  strcat(cmd, " -o ");
+  snprintf(path, COMMAND_LIMIT, "%s/config", s->workdir);
+  append_quoted(cmd, path);
+  strcat(cmd, " -lm");
+
+  if (!run(cmd))
+    return t;
+
+  // Run, the fastest run counts
+  cmd[0] = 0;
+  append_quoted(cmd, path);
+  strcat(cmd, s->args);
+  strcat(cmd, " > ");
+  snprintf(path, COMMAND_LIMIT, "%s/%s", s->workdir, output);
+  append_quoted(cmd, path);
+
+  for (uint64_t r = 0; r < s->runs; r++)
+    {
+      double start = now();
+
+      if (!run(cmd))
+        return t;
+
+      double time = now() - start;
+
+      if (time < t->time)
+        t->time = time;
+    }
+
+  char reference[COMMAND_LIMIT];
+  snprintf(reference, COMMAND_LIMIT, "%s/reference.out", s->workdir);
+
+  t->ok = 1;
+  t->error = output_error(reference, path);
+
+  //
+  uint64_t ndemoted = 0;
+  for (uint64_t i = 0; i < n; i++)
+    ndemoted += demoted[i];
+
+  fprintf(stdout, "config %4ld: %4ld/%ld webs demoted, error %.3e, time %.4lf s\n",
+          s->ntests - 1, ndemoted, n, t->error, t->time);
+  fflush(stdout);
+
+  return t;
+}
+
+// A configuration is kept when it meets the bound and is faster
+static int accept(search_t *s, const char *demoted, double *current)
+{
+  test_t *t = evaluate(s, demoted, "config.out");
+
+  if (!t->ok || t->error > s->bound || t->time >= *current)
+    return 0;
+
+  *current = t->time;
+  return 1;
+}
+
+/**
+ * Delta debugging over the webs kept in double, in the style of Precimonious:
+ * start with every web demoted, then keep one chunk of webs in double, or all
+ * but one chunk, until demoting one more web breaks the bound or is not
+ * faster. The chunks are made of neighbours in shadow error order.
+ */
+static void search(search_t *s, char *best, double *best_time)
+{
+  uint64_t n = s->units.size;
+  uint64_t *kept = malloc(sizeof(uint64_t) * (n + 1));
+  char *demoted = malloc(n + 1);
+  uint64_t nkept = n;
+  uint64_t div = 2;
+
+  if (!kept || !demoted)
+    exit(12);
+
+  for (uint64_t i = 0; i < n; i++)
+    kept[i] = i;
+
+  memset(demoted, 1, n);
+
+  if (n && accept(s, demoted, best_time))
+    {
+      memcpy(best, demoted, n);
+      nkept = 0;
+    }
+
+  while (nkept > 0)
+    {
+      int found = 0;
+
+      if (div > nkept)
+        div = nkept;
+
+      // Keep one chunk in double
+      for (uint64_t c = 0; c < div && !found; c++)
+        {
+          uint64_t start = c * nkept / div, end = (c + 1) * nkept / div;
+
+          memset(demoted, 1, n);
+          for (uint64_t i = start; i < end; i++)
+            demoted[kept[i]] = 0;
+
+          if (accept(s, demoted, best_time))
+            {
+              memmove(kept, kept + start, sizeof(uint64_t) * (end - start));
+              nkept = end - start;
+              div = 2;
+              found = 1;
+            }
+        }
+
+      // Keep all but one chunk in double
+      for (uint64_t c = 0; c < div && !found; c++)
+        {
+          uint64_t start = c * nkept / div, end = (c + 1) * nkept / div;
+
+          memset(demoted, 1, n);
+          for (uint64_t i = 0; i < nkept; i++)
+            if (i < start || i >= end)
+              demoted[kept[i]] = 0;
+
+          if (accept(s, demoted, best_time))
+            {
+              memmove(kept + start, kept + end, sizeof(uint64_t) * (nkept - end));
+              nkept -= end - start;
+              div = div > 2 ? div - 1 : 2;
+              found = 1;
+            }
+        }
+
+      if (found)
+        {
+          memcpy(best, demoted, n);
+          continue;
+        }
+
+      if (div >= nkept)
+        break;
+
+      div = 2 * div < nkept ? 2 * div : nkept;
+    }
+
+  free(demoted);
+  free(kept);
+}
+
+int main(int argc, char **argv)
+{
+  search_t s = { NULL, NULL, DEFAULT_OPT, DEFAULT_CC, DEFAULT_WORKDIR, { 0 },
+                 DEFAULT_BOUND, DEFAULT_RUNS, { 0, 0, NULL }, NULL, 0, 0 };
+  const char *shadow = NULL;
+  const char *output = DEFAULT_PLAN;
+  char path[COMMAND_LIMIT];
+  char cmd[COMMAND_LIMIT];
+  int opt;
+
+  while ((opt = getopt(argc, argv, "+e:r:s:o:w:c:O:l:")) != -1)
+    {
+      switch (opt)
+        {
+        case 'e': s.bound = atof(optarg); break;
+        case 'r': s.runs = strtoull(optarg, NULL, 10); break;
+        case 's': shadow = optarg; break;
+        case 'o': output = optarg; break;
+        case 'w': s.workdir = optarg; break;
+        case 'c': s.cc = optarg; break;
+        case 'O': s.opt = optarg; break;
+        case 'l': s.lib = optarg; break;
+        default: usage(argv[0]);
+        }
+    }
+
+  if (!s.lib || optind >= argc)
+    usage(argv[0]);
+
+  s.input = argv[optind];
+  if (s.runs == 0)
+    s.runs = 1;
+
+  for (int i = optind + 1; i < argc; i++)
+    {
+      strcat(s.args, " ");
+      append_quoted(s.args, argv[i]);
+    }
+
+  mkdir(s.workdir, 0755);
+
+  // Webs FastFP can demote
+  snprintf(path, COMMAND_LIMIT, "%s/candidates.csv", s.workdir);
+  snprintf(cmd, COMMAND_LIMIT, "%s -enable-new-pm=0 -load ", s.opt);
+  append_quoted(cmd, s.lib);
+  strcat(cmd, " -fast-fp -fast-fp-candidates=");
+  append_quoted(cmd, path);
+  strcat(cmd, " ");
+  append_quoted(cmd, s.input);
+  strcat(cmd, " -o /dev/null");
+
+  if (!run(cmd) || units_read_candidates(&s.units, path) != 0)
+    {
+      fprintf(stderr, "cannot get the candidates of: %s\n", s.input);
+      exit(13);
+    }
+
+  if (shadow)
+    {
+      if (units_read_shadow(&s.units, shadow) != 0)
+        {
+          fprintf(stderr, "cannot read shadow profile: %s\n", shadow);
+          exit(13);
+        }
+
+      units_sort(&s.units);
+
+      // Already too far from the double version on their own
+      while (s.units.size && s.units.entries[s.units.size - 1].max_error > s.bound)
+        {
+          unit_t *u = s.units.entries + --s.units.size;
+
+          fprintf(stdout, "kept: %s web %ld, shadow error %.3e\n",
+                  u->func_name, u->web, u->max_error);
+          free(u->indexes);
+        }
+    }
+
+  uint64_t n = s.units.size;
+  char *demoted = calloc(n + 1, 1);
+  char *best = calloc(n + 1, 1);
+
+  if (!demoted || !best)
+    exit(12);
+
+  // Double version
+  test_t *reference = evaluate(&s, demoted, "reference.out");
+
+  if (!reference->ok)
+    {
+      fprintf(stderr, "cannot build or run the double version of: %s\n", s.input);
+      exit(2);
+    }
+
+  reference->error = 0.0;
+
+  double best_time = reference->time;
+  search(&s, best, &best_time);
+
+  //
+  uint64_t ndemoted = 0;
+  for (uint64_t i = 0; i < n; i++)
+    ndemoted += best[i];
+
+  test_t *t = evaluate(&s, best, "config.out");
+  FILE *file = fopen(output, "w");
+
+  if (!file)
+    {
+      fprintf(stderr, "cannot write plan: %s\n", output);
+      exit(13);
+    }
+
+  fprintf(file, "# fastfp-search: %s, error bound %.3e, error %.3e, speedup %.2lf\n",
+          s.input, s.bound, t->error, reference->time / t->time);
+  plan_write(&s.units, best, file);
+  fclose(file);
+
+  fprintf(stdout, "plan: %s, %ld/%ld webs demoted, error %.3e, speedup %.2lf, %ld configurations\n",
+          output, ndemoted, n, t->error, reference->time / t->time, s.ntests);
+
+  for (uint64_t i = 0; i < s.ntests; i++)
+    free(s.tests[i].demoted);
+
+  free(s.tests);
+  free(best);
+  free(demoted);
+  units_free(&s.units);
+
+  return 0;
+}
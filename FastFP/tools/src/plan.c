@@ -0,0 +1,187 @@
+#include <stdio.h>  // fopen, fgets
+#include <stdlib.h> // realloc, strtoull, qsort
+#include <stdint.h> // uint64_t
+#include <string.h> // strncpy, strcmp, strchr
+
+#include "plan.h"
+
+void units_init(units_t *units)
+{
+  units->size = 0;
+  units->capacity = 0;
+  units->entries = NULL;
+}
+
+void units_free(units_t *units)
+{
+  for (uint64_t i = 0; i < units->size; i++)
+    free(units->entries[i].indexes);
+
+  free(units->entries);
+  units_init(units);
+}
+
+// Split a CSV line in at most n fields, in place
+static uint64_t split(char *line, char **fields, uint64_t n)
+{
+  uint64_t i = 0;
+
+  line[strcspn(line, "\r\n")] = 0;
+
+  while (i < n)
+    {
+      fields[i++] = line;
+
+      char *comma = strchr(line, ',');
+      if (!comma)
+        break;
+
+      *comma = 0;
+      line = comma + 1;
+    }
+
+  return i;
+}
+
+static unit_t *units_append(units_t *units, const char *func_name, uint64_t web)
+{
+  if (units->size == units->capacity)
+    {
+      uint64_t capacity = units->capacity ? 2 * units->capacity : 64;
+      unit_t *entries = realloc(units->entries, sizeof(unit_t) * capacity);
+
+      if (!entries)
+        exit(12);
+
+      units->entries = entries;
+      units->capacity = capacity;
+    }
+
+  unit_t *u = units->entries + units->size++;
+
+  memset(u, 0, sizeof(unit_t));
+  strncpy(u->func_name, func_name, FUNC_NAME_LIMIT - 1);
+  u->web = web;
+
+  return u;
+}
+
+int units_read_candidates(units_t *units, const char *path)
+{
+  FILE *file = fopen(path, "r");
+  char line[LINE_LIMIT];
+
+  if (!file)
+    return -1;
+
+  // Header
+  if (!fgets(line, LINE_LIMIT, file))
+    {
+      fclose(file);
+      return 0;
+    }
+
+  while (fgets(line, LINE_LIMIT, file))
+    {
+      char *fields[3];
+
+      if (split(line, fields, 3) != 3)
+        continue;
+
+      uint64_t web = strtoull(fields[1], NULL, 10);
+      unit_t *u = units->size ? units->entries + units->size - 1 : NULL;
+
+      // The operations of a web are contiguous
+      if (!u || u->web != web || strcmp(u->func_name, fields[0]) != 0)
+        u = units_append(units, fields[0], web);
+
+      uint64_t *indexes = realloc(u->indexes, sizeof(uint64_t) * (u->nops + 1));
+
+      if (!indexes)
+        exit(12);
+
+      u->indexes = indexes;
+      u->indexes[u->nops++] = strtoull(fields[2], NULL, 10);
+    }
+
+  fclose(file);
+
+  return 0;
+}
+
+int units_read_shadow(units_t *units, const char *path)
+{
+  FILE *file = fopen(path, "r");
+  char line[LINE_LIMIT];
+
+  if (!file)
+    return -1;
+
+  // Header
+  if (!fgets(line, LINE_LIMIT, file))
+    {
+      fclose(file);
+      return 0;
+    }
+
+  while (fgets(line, LINE_LIMIT, file))
+    {
+      char *fields[8];
+
+      if (split(line, fields, 8) != 8)
+        continue;
+
+      uint64_t index = strtoull(fields[1], NULL, 10);
+      double error = strtod(fields[5], NULL);
+
+      for (uint64_t i = 0; i < units->size; i++)
+        {
+          unit_t *u = units->entries + i;
+
+          if (strcmp(u->func_name, fields[0]) != 0)
+            continue;
+
+          for (uint64_t j = 0; j < u->nops; j++)
+            if (u->indexes[j] == index && error > u->max_error)
+              u->max_error = error;
+        }
+    }
+
+  fclose(file);
+
+  return 0;
+}
+
+static int compare_max_error(const void *a, const void *b)
+{
+  const unit_t *ua = a;
+  const unit_t *ub = b;
+
+  if (ua->max_error != ub->max_error)
+    return (ua->max_error > ub->max_error) - (ua->max_error < ub->max_error);
+
+  // Same error: by function and web
+  int names = strcmp(ua->func_name, ub->func_name);
+
+  return names ? names : (ua->web > ub->web) - (ua->web < ub->web);
+}
+
+void units_sort(units_t *units)
+{
+  qsort(units->entries, units->size, sizeof(unit_t), compare_max_error);
+}
+
+void plan_write(const units_t *units, const char *demoted, FILE *file)
+{
+  fprintf(file, "FUNCTION NAME,INDEX\n");
+
+  for (uint64_t i = 0; i < units->size; i++)
+    {
+      if (!demoted[i])
+        continue;
+
+      for (uint64_t j = 0; j < units->entries[i].nops; j++)
+        fprintf(file, "%s,%ld\n", units->entries[i].func_name,
+                units->entries[i].indexes[j]);
+    }
+}
@@ -0,0 +1,83 @@
+#ifndef _PLAN_H_
+#define _PLAN_H_
+
+//
+#include <stdio.h>  // FILE
+#include <stdint.h> // uint64_t
+
+//
+#define FUNC_NAME_LIMIT 256
+#define LINE_LIMIT 1024
+
+/**
+ * Store a web that FastFP can demote: the unit of the search
+ */
+typedef struct unit_s
+{
+  char func_name[FUNC_NAME_LIMIT];
+  uint64_t web;
+  uint64_t *indexes;
+  uint64_t nops;
+  double max_error;
+} unit_t;
+
+/**
+ * Store the units of a program
+ */
+typedef struct units_s
+{
+  uint64_t size;
+  uint64_t capacity;
+  unit_t *entries;
+} units_t;
+
+/**
+ * units_init - Initialize an empty list of units
+ * @param units: units
+ * @return
+ */
+void units_init(units_t *units);
+
+/**
+ * units_free - Release a list of units
+ * @param units: units
+ * @return
+ */
+void units_free(units_t *units);
+
+/**
+ * units_read_candidates - Read the webs written by -fast-fp-candidates
+ *                         (FUNCTION NAME,WEB,INDEX)
+ * @param units: units
+ * @param path : candidates file
+ * @return 0 on success, -1 if the file cannot be read
+ */
+int units_read_candidates(units_t *units, const char *path);
+
+/**
+ * units_read_shadow - Set the maximum shadow error of each unit from a
+ *                     libfastfp.so profile
+ * @param units: units
+ * @param path : shadow profile
+ * @return 0 on success, -1 if the file cannot be read
+ */
+int units_read_shadow(units_t *units, const char *path);
+
+/**
+ * units_sort - Sort the units by maximum shadow error, the lowest first
+ * @param units: units
+ * @return
+ */
+void units_sort(units_t *units);
+
+/**
+ * plan_write - Write the operations of the demoted units
+ *              (FUNCTION NAME,INDEX)
+ * @param units  : units
+ * @param demoted: demoted[i] is 1 if unit i is demoted
+ * @param file   : output
+ * @return
+ */
+void plan_write(const units_t *units, const char *demoted, FILE *file);
+
+#endif // _PLAN_H_
@@ -0,0 +1,190 @@
+#include <stdio.h>    // fprintf
+#include <stdint.h>   // uint64_t
+#include <stdlib.h>   // atoi, strtoull
+#include <string.h>   // strcmp
+#include <pthread.h>  // pthread_create, pthread_join
+#include <omp.h>      // omp_set_num_threads
+
+//
+#define DEPTH_RECURSION 10
+#define DEPTH_CHAIN 8
+#define MAX_THREADS 256
+
+// Read the time-stamp counter without calling a function, so the timer itself
+// is never instrumented by the pass
+#define BENCH_RDTSC() __builtin_ia32_rdtsc()
+
+// Keep the compiler from optimizing the kernels away
+volatile uint64_t sink = 0;
+
+/**
+ * Microkernels - one instrumented probe per call
+ */
+__attribute__((noinline)) void empty(void)
+{
+}
+
+__attribute__((noinline)) uint64_t leaf(uint64_t x)
+{
+  return x * 3 + 1;
+}
+
+__attribute__((noinline)) uint64_t recursion(uint64_t depth)
+{
+  if (depth == 0)
+    return 1;
+
+  return recursion(depth - 1) + 1;
+}
+
+__attribute__((noinline)) uint64_t chain_0(uint64_t x) { return x + 1; }
+__attribute__((noinline)) uint64_t chain_1(uint64_t x) { return chain_0(x) + 1; }
+__attribute__((noinline)) uint64_t chain_2(uint64_t x) { return chain_1(x) + 1; }
+__attribute__((noinline)) uint64_t chain_3(uint64_t x) { return chain_2(x) + 1; }
+__attribute__((noinline)) uint64_t chain_4(uint64_t x) { return chain_3(x) + 1; }
+__attribute__((noinline)) uint64_t chain_5(uint64_t x) { return chain_4(x) + 1; }
+__attribute__((noinline)) uint64_t chain_6(uint64_t x) { return chain_5(x) + 1; }
+__attribute__((noinline)) uint64_t chain_7(uint64_t x) { return chain_6(x) + 1; }
+
+/**
+ * Sequential kernels - return the number of probes executed
+ */
+uint64_t run_empty(uint64_t iters)
+{
+  for (uint64_t i = 0; i < iters; i++)
+    empty();
+
+  return iters;
+}
+
+uint64_t run_leaf(uint64_t iters)
+{
+  uint64_t acc = 0;
+
+  for (uint64_t i = 0; i < iters; i++)
+    acc += leaf(i);
+
+  sink = acc;
+  return iters;
+}
+
+uint64_t run_recursion(uint64_t iters)
+{
+  uint64_t acc = 0;
+
+  for (uint64_t i = 0; i < iters; i++)
+    acc += recursion(DEPTH_RECURSION);
+
+  sink = acc;
+  return iters * (DEPTH_RECURSION + 1);
+}
+
+uint64_t run_chain(uint64_t iters)
+{
+  uint64_t acc = 0;
+
+  for (uint64_t i = 0; i < iters; i++)
+    acc += chain_7(i);
+
+  sink = acc;
+  return iters * DEPTH_CHAIN;
+}
+
+/**
+ * Fan-out kernels - every thread runs the leaf kernel
+ */
+uint64_t run_omp(uint64_t iters, uint64_t nthreads)
+{
+  omp_set_num_threads(nthreads);
+
+#pragma omp parallel
+  {
+    uint64_t acc = 0;
+
+    for (uint64_t i = 0; i < iters; i++)
+      acc += leaf(i);
+
+    sink = acc;
+  }
+
+  return iters * nthreads;
+}
+
+void *pthread_kernel(void *arg)
+{
+  uint64_t iters = *(uint64_t *)arg;
+  uint64_t acc = 0;
+
+  for (uint64_t i = 0; i < iters; i++)
+    acc += leaf(i);
+
+  sink = acc;
+  return NULL;
+}
+
+uint64_t run_pthread(uint64_t iters, uint64_t nthreads)
+{
+  pthread_t tid[MAX_THREADS];
+
+  for (uint64_t i = 0; i < nthreads; i++)
+    pthread_create(tid + i, NULL, pthread_kernel, &iters);
+
+  for (uint64_t i = 0; i < nthreads; i++)
+    pthread_join(tid[i], NULL);
+
+  return iters * nthreads;
+}
+
+/**
+ * Usage: bench MODE KERNEL NTHREADS ITERS
+ *
+ * Print one CSV line on stderr: stdout belongs to the runtime summaries of the
+ * instrumented build.
+ */
+int main(int argc, char **argv)
+{
+  if (argc != 5)
+    {
+      fprintf(stderr, "usage: %s MODE KERNEL NTHREADS ITERS\n", argv[0]);
+      return 1;
+    }
+
+  char *mode = argv[1];
+  char *kernel = argv[2];
+  uint64_t nthreads = strtoull(argv[3], NULL, 10);
+  uint64_t iters = strtoull(argv[4], NULL, 10);
+  uint64_t probes = 0;
+
+  if (nthreads == 0 || nthreads > MAX_THREADS)
+    {
+      fprintf(stderr, "NTHREADS must be in [1, %d]\n", MAX_THREADS);
+      return 1;
+    }
+
+  uint64_t beg = BENCH_RDTSC();
+
+  if (strcmp(kernel, "empty") == 0)
+    probes = run_empty(iters);
+  else if (strcmp(kernel, "leaf") == 0)
+    probes = run_leaf(iters);
+  else if (strcmp(kernel, "recursion") == 0)
+    probes = run_recursion(iters);
+  else if (strcmp(kernel, "chain") == 0)
+    probes = run_chain(iters);
+  else if (strcmp(kernel, "omp") == 0)
+    probes = run_omp(iters, nthreads);
+  else if (strcmp(kernel, "pthread") == 0)
+    probes = run_pthread(iters, nthreads);
+  else
+    {
+      fprintf(stderr, "unknown kernel: %s\n", kernel);
+      return 1;
+    }
+
+  uint64_t end = BENCH_RDTSC();
+
+  fprintf(stderr, "%s,%s,%lu,%lu,%lu,%lu\n",
+          mode, kernel, nthreads, iters, probes, end - beg);
+
+  return 0;
+}
@@ -0,0 +1,67 @@
+#!/bin/sh
+#
+# Probe overhead benchmark
+#
+# Run every microkernel with the uninstrumented build and with each probe mode,
+# then print one CSV line per (mode, kernel, threads):
+#
+#   mode,kernel,threads,iters,probes,base_cycles,cycles,cycles_per_probe,overhead,efficiency
+#
+#   cycles_per_probe: (cycles - base_cycles) / probes
+#   overhead        : cycles / base_cycles
+#   efficiency      : weak scaling efficiency of the mode, i.e. cycles at one
+#                     thread / cycles at N threads (fan-out kernels only)
+#
+# Each measure is the minimum over REPEAT runs.
+
+MODES=${MODES:-"insert-rdtsc"}
+KERNELS=${KERNELS:-"empty leaf recursion chain"}
+FANOUT_KERNELS=${FANOUT_KERNELS:-"omp pthread"}
+THREADS=${THREADS:-"1 2 4 8"}
+ITERS=${ITERS:-500}
+REPEAT=${REPEAT:-5}
+
+# measure BINARY MODE KERNEL NTHREADS - print "probes cycles"
+measure()
+{
+  for r in $(seq $REPEAT); do
+    ./$1 $2 $3 $4 $ITERS 2>&1 >/dev/null | grep "^$2,"
+  done | awk -F, 'NR == 1 || $6 < min { min = $6; probes = $5 } END { print probes, min }'
+}
+
+# report MODE KERNEL NTHREADS BASE_CYCLES PROBES CYCLES ONE_THREAD_CYCLES
+report()
+{
+  awk -v mode=$1 -v kernel=$2 -v threads=$3 -v iters=$ITERS \
+      -v base=$4 -v probes=$5 -v cycles=$6 -v one=$7 'BEGIN {
+    printf "%s,%s,%d,%d,%d,%d,%d,%.2f,%.3f,%.3f\n",
+           mode, kernel, threads, iters, probes, base, cycles,
+           (cycles - base) / probes, cycles / base, one / cycles
+  }'
+}
+
+echo "mode,kernel,threads,iters,probes,base_cycles,cycles,cycles_per_probe,overhead,efficiency"
+
+for mode in $MODES; do
+  for kernel in $KERNELS $FANOUT_KERNELS; do
+    case " $FANOUT_KERNELS " in
+      *" $kernel "*) threads=$THREADS ;;
+      *) threads=1 ;;
+    esac
+
+    one=0
+    for n in $threads; do
+      set -- $(measure bench none $kernel $n)
+      base=$2
+      set -- $(measure bench_$mode $mode $kernel $n)
+      probes=$1
+      cycles=$2
+
+      if [ $one -eq 0 ]; then
+        one=$cycles
+      fi
+
+      report $mode $kernel $n $base $probes $cycles $one
+    done
+  done
+done
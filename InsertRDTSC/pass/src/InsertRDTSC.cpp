@@ -13,20 +13,49 @@
 
 // ref: https://github.com/banach-space/llvm-tutor/blob/main/lib/InjectFuncCall.cpp
 
+#include "ValueProfile.h"
+
 #include "llvm/Pass.h"
+#include "llvm/ADT/DenseMap.h"
 #include "llvm/IR/Module.h"
 #include "llvm/IR/IRBuilder.h"
 #include "llvm/IR/Instruction.h"
 #include "llvm/IR/Instructions.h"
+#include "llvm/Support/CommandLine.h"
 #include "llvm/Support/raw_ostream.h"
 
 #include "llvm/IR/LegacyPassManager.h"
 #include "llvm/Transforms/IPO/PassManagerBuilder.h"
+#include "llvm/Transforms/Utils/ModuleUtils.h"
+
+#include <vector>
 
 using namespace llvm;
+using namespace insertrdtsc;
 
 #define DEBUG_TYPE "insert-rdtsc"
 
+// Probe modes
+static cl::opt<bool>
+ShadowStack("insert-rdtsc-stack",
+            cl::desc("Maintain a per-thread stack of the active instrumented "
+                     "functions in the runtime (enter_function/exit_function)"),
+            cl::init(false));
+
+static cl::opt<bool>
+Values("insert-rdtsc-values",
+       cl::desc("Record the hottest values of the integer arguments of every "
+                "function in per-thread top-K tables of the runtime (build it "
+                "with VALUES=1)"),
+       cl::init(false));
+
+static cl::opt<bool>
+Targets("insert-rdtsc-targets",
+        cl::desc("Record the hottest callees of every indirect call site in "
+                 "per-thread top-K tables of the runtime (build it with "
+                 "VALUES=1)"),
+        cl::init(false));
+
 namespace {
 
   // InsertRDTSC - The first implementation
@@ -35,9 +64,321 @@ namespace {
     static char ID; // Pass identification, replacement for typeid
     uint64_t count_insertion = 0;
 
+    // Value profiling: slot of the first argument of each function, function
+    // and position of every slot of the module
+    DenseMap<Function *, uint64_t> first_slot;
+    std::vector<Constant *> slot_names;
+    std::vector<Constant *> slot_args;
+    GlobalVariable *slot_base = nullptr;
+    FunctionCallee insert_value;
+
+    // Target profiling: slot of the first indirect call of each function,
+    // function and index of every call site, functions whose address the
+    // runtime must name
+    DenseMap<Function *, uint64_t> first_site;
+    std::vector<Constant *> site_names;
+    std::vector<Constant *> site_indexes;
+    std::vector<Function *> address_taken;
+    GlobalVariable *site_base = nullptr;
+    FunctionCallee insert_target;
+
+    // Name of each function in the tables of the runtime
+    DenseMap<Function *, Constant *> name_constants;
+
     // Constructor
     InsertRDTSC() : ModulePass(ID) {}
 
+    Constant *getNameConstant(Module &M, Function &F) {
+      Constant *&name = name_constants[&F];
+
+      if (!name)
+        name =
+          ConstantExpr::getPointerCast(
+            new GlobalVariable(M, ArrayType::get(Type::getInt8Ty(M.getContext()),
+                                                 F.getName().size() + 1),
+                               /*isConstant=*/true,
+                               GlobalValue::PrivateLinkage,
+                               ConstantDataArray::getString(M.getContext(), F.getName()),
+                               "__insert_value_name"),
+            Type::getInt8PtrTy(M.getContext()));
+
+      return name;
+    }
+
+    // Number the profiled arguments of the module and declare insert_value
+    void prepareValueSlots(Module &M) {
+      auto &CTX = M.getContext();
+      IntegerType *Int64Ty = Type::getInt64Ty(CTX);
+
+      for (Function &F : M) {
+        if (F.isDeclaration())
+          continue;
+
+        SmallVector<Argument *, 8> Args;
+        getProfiledArguments(F, Args);
+
+        if (Args.empty())
+          continue;
+
+        first_slot[&F] = slot_names.size();
+        Constant *name = getNameConstant(M, F);
+
+        for (Argument *A : Args) {
+          slot_names.push_back(name);
+          slot_args.push_back(ConstantInt::get(Int64Ty, A->getArgNo()));
+        }
+      }
+
+      // Id of the first slot of the module, given by the runtime
+      slot_base =
+        new GlobalVariable(M, Int64Ty, /*isConstant=*/false,
+                           GlobalValue::InternalLinkage,
+                           ConstantInt::get(Int64Ty, 0),
+                           "__insert_value_base");
+
+      /* Get insert_value */
+      insert_value =
+        M.getOrInsertFunction("insert_value",
+                              FunctionType::get(/*ReturnType=*/Type::getVoidTy(CTX),
+                                                /*ArgType=*/{Int64Ty, Int64Ty},
+                                                /*IsVarArgs=*/false));
+
+      // Set attributes
+      dyn_cast<Function>(insert_value.getCallee())->setDoesNotThrow();
+    }
+
+    // Send every integer argument to the runtime at the entry of F
+    void insertValueProbes(Function &F, IRBuilder<> &Builder) {
+      auto It = first_slot.find(&F);
+      if (It == first_slot.end())
+        return;
+
+      IntegerType *Int64Ty = Builder.getInt64Ty();
+      SmallVector<Argument *, 8> Args;
+      getProfiledArguments(F, Args);
+
+      Value *base = Builder.CreateLoad(Int64Ty, slot_base, "value_base");
+
+      for (uint64_t i = 0; i < Args.size(); i++) {
+        Value *id = Builder.CreateAdd(base, ConstantInt::get(Int64Ty, It->second + i),
+                                      "value_id");
+
+        // Booleans are 0 or 1, other integers keep their sign
+        Value *value = Args[i]->getType()->isIntegerTy(1)
+          ? Builder.CreateZExt(Args[i], Int64Ty)
+          : Builder.CreateSExt(Args[i], Int64Ty);
+
+        Builder.CreateCall(insert_value, {id, value});
+      }
+    }
+
+    // Register the slots of the module in the runtime at load time
+    void insertValueModuleConstructor(Module &M) {
+      if (slot_names.empty())
+        return;
+
+      auto &CTX = M.getContext();
+      IntegerType *Int64Ty = Type::getInt64Ty(CTX);
+      PointerType *PointerInt8Ty = Type::getInt8PtrTy(CTX);
+      PointerType *PointerInt64Ty = Type::getInt64PtrTy(CTX);
+
+      ArrayType *NamesTy = ArrayType::get(PointerInt8Ty, slot_names.size());
+      ArrayType *ArgsTy = ArrayType::get(Int64Ty, slot_args.size());
+
+      GlobalVariable *names_array =
+        new GlobalVariable(M, NamesTy, /*isConstant=*/true,
+                           GlobalValue::PrivateLinkage,
+                           ConstantArray::get(NamesTy, slot_names),
+                           "__insert_value_names");
+
+      GlobalVariable *args_array =
+        new GlobalVariable(M, ArgsTy, /*isConstant=*/true,
+                           GlobalValue::PrivateLinkage,
+                           ConstantArray::get(ArgsTy, slot_args),
+                           "__insert_value_args");
+
+      /* Get insert_value_register */
+      FunctionCallee value_register =
+        M.getOrInsertFunction("insert_value_register",
+                              FunctionType::get(/*ReturnType=*/Int64Ty,
+                                                /*ArgType=*/
+                                                {Int64Ty,
+                                                 PointerInt8Ty->getPointerTo(),
+                                                 PointerInt64Ty},
+                                                /*IsVarArgs=*/false));
+
+      // Module constructor, created after the probes so that it is not timed
+      Function *ctor =
+        Function::Create(FunctionType::get(Type::getVoidTy(CTX), false),
+                         GlobalValue::InternalLinkage,
+                         "__insert_value_module_ctor", M);
+
+      IRBuilder<> Builder(BasicBlock::Create(CTX, "entry", ctor));
+
+      Value *base =
+        Builder.CreateCall(value_register,
+                           {ConstantInt::get(Int64Ty, slot_names.size()),
+                            Builder.CreateConstInBoundsGEP2_64(NamesTy, names_array, 0, 0),
+                            Builder.CreateConstInBoundsGEP2_64(ArgsTy, args_array, 0, 0)});
+      Builder.CreateStore(base, slot_base);
+      Builder.CreateRetVoid();
+
+      appendToGlobalCtors(M, ctor, /*Priority=*/0);
+    }
+
+    // Number the indirect call sites of the module, list the functions they
+    // can reach and declare insert_target
+    void prepareTargetSites(Module &M) {
+      auto &CTX = M.getContext();
+      IntegerType *Int64Ty = Type::getInt64Ty(CTX);
+
+      for (Function &F : M) {
+        if (!F.isIntrinsic() && F.hasAddressTaken())
+          address_taken.push_back(&F);
+
+        if (F.isDeclaration())
+          continue;
+
+        SmallVector<CallBase *, 8> Calls;
+        getIndirectCalls(F, Calls);
+
+        if (Calls.empty())
+          continue;
+
+        first_site[&F] = site_names.size();
+        Constant *name = getNameConstant(M, F);
+
+        for (uint64_t i = 0; i < Calls.size(); i++) {
+          site_names.push_back(name);
+          site_indexes.push_back(ConstantInt::get(Int64Ty, i));
+        }
+      }
+
+      // Id of the first call site of the module, given by the runtime
+      site_base =
+        new GlobalVariable(M, Int64Ty, /*isConstant=*/false,
+                           GlobalValue::InternalLinkage,
+                           ConstantInt::get(Int64Ty, 0),
+                           "__insert_target_base");
+
+      /* Get insert_target */
+      insert_target =
+        M.getOrInsertFunction("insert_target",
+                              FunctionType::get(/*ReturnType=*/Type::getVoidTy(CTX),
+                                                /*ArgType=*/
+                                                {Int64Ty, Type::getInt8PtrTy(CTX)},
+                                                /*IsVarArgs=*/false));
+
+      // Set attributes
+      dyn_cast<Function>(insert_target.getCallee())->setDoesNotThrow();
+    }
+
+    // Send the callee of every indirect call of F to the runtime, just
+    // before the call
+    void insertTargetProbes(Function &F) {
+      auto It = first_site.find(&F);
+      if (It == first_site.end())
+        return;
+
+      SmallVector<CallBase *, 8> Calls;
+      getIndirectCalls(F, Calls);
+
+      for (uint64_t i = 0; i < Calls.size(); i++) {
+        IRBuilder<> Builder(Calls[i]);
+        IntegerType *Int64Ty = Builder.getInt64Ty();
+
+        Value *base = Builder.CreateLoad(Int64Ty, site_base, "target_base");
+        Value *id = Builder.CreateAdd(base, ConstantInt::get(Int64Ty, It->second + i),
+                                      "target_id");
+        Value *target = Builder.CreatePointerCast(Calls[i]->getCalledOperand(),
+                                                  Builder.getInt8PtrTy());
+
+        Builder.CreateCall(insert_target, {id, target});
+      }
+    }
+
+    // Register the call sites and the address-taken functions of the module
+    // in the runtime at load time
+    void insertTargetModuleConstructor(Module &M) {
+      if (site_names.empty())
+        return;
+
+      auto &CTX = M.getContext();
+      IntegerType *Int64Ty = Type::getInt64Ty(CTX);
+      PointerType *PointerInt8Ty = Type::getInt8PtrTy(CTX);
+      PointerType *PointerInt64Ty = Type::getInt64PtrTy(CTX);
+
+      std::vector<Constant *> funcs;
+      std::vector<Constant *> func_names;
+
+      for (Function *F : address_taken) {
+        funcs.push_back(ConstantExpr::getPointerCast(F, PointerInt8Ty));
+        func_names.push_back(getNameConstant(M, *F));
+      }
+
+      ArrayType *NamesTy = ArrayType::get(PointerInt8Ty, site_names.size());
+      ArrayType *IndexesTy = ArrayType::get(Int64Ty, site_indexes.size());
+      ArrayType *FuncsTy = ArrayType::get(PointerInt8Ty, funcs.size());
+
+      GlobalVariable *names_array =
+        new GlobalVariable(M, NamesTy, /*isConstant=*/true,
+                           GlobalValue::PrivateLinkage,
+                           ConstantArray::get(NamesTy, site_names),
+                           "__insert_target_names");
+
+      GlobalVariable *indexes_array =
+        new GlobalVariable(M, IndexesTy, /*isConstant=*/true,
+                           GlobalValue::PrivateLinkage,
+                           ConstantArray::get(IndexesTy, site_indexes),
+                           "__insert_target_indexes");
+
+      GlobalVariable *funcs_array =
+        new GlobalVariable(M, FuncsTy, /*isConstant=*/true,
+                           GlobalValue::PrivateLinkage,
+                           ConstantArray::get(FuncsTy, funcs),
+                           "__insert_target_funcs");
+
+      GlobalVariable *func_names_array =
+        new GlobalVariable(M, FuncsTy, /*isConstant=*/true,
+                           GlobalValue::PrivateLinkage,
+                           ConstantArray::get(FuncsTy, func_names),
+                           "__insert_target_func_names");
+
+      /* Get insert_target_register */
+      FunctionCallee target_register =
+        M.getOrInsertFunction("insert_target_register",
+                              FunctionType::get(/*ReturnType=*/Int64Ty,
+                                                /*ArgType=*/
+                                                {Int64Ty,
+                                                 PointerInt8Ty->getPointerTo(),
+                                                 PointerInt64Ty,
+                                                 Int64Ty,
+                                                 PointerInt8Ty->getPointerTo(),
+                                                 PointerInt8Ty->getPointerTo()},
+                                                /*IsVarArgs=*/false));
+
+      // Module constructor, created after the probes so that it is not timed
+      Function *ctor =
+        Function::Create(FunctionType::get(Type::getVoidTy(CTX), false),
+                         GlobalValue::InternalLinkage,
+                         "__insert_target_module_ctor", M);
+
+      IRBuilder<> Builder(BasicBlock::Create(CTX, "entry", ctor));
+
+      Value *base =
+        Builder.CreateCall(target_register,
+                           {ConstantInt::get(Int64Ty, site_names.size()),
+                            Builder.CreateConstInBoundsGEP2_64(NamesTy, names_array, 0, 0),
+                            Builder.CreateConstInBoundsGEP2_64(IndexesTy, indexes_array, 0, 0),
+                            ConstantInt::get(Int64Ty, funcs.size()),
+                            Builder.CreateConstInBoundsGEP2_64(FuncsTy, funcs_array, 0, 0),
+                            Builder.CreateConstInBoundsGEP2_64(FuncsTy, func_names_array, 0, 0)});
+      Builder.CreateStore(base, site_base);
+      Builder.CreateRetVoid();
+
+      appendToGlobalCtors(M, ctor, /*Priority=*/0);
+    }
+
     // Run pass
     bool runOnModule(Module &M) override {
 
@@ -211,6 +552,33 @@ namespace {
         dyn_cast<Function>(analyze_function.getCallee());
       analyze_functionF->setDoesNotThrow();
 
+      /* Get enter_function and exit_function */
+      FunctionCallee enter_function;
+      FunctionCallee exit_function;
+
+      if (ShadowStack) {
+        FunctionType *enter_functionTy =
+          FunctionType::get(/*ReturnType=*/VoidTy,
+                            /*ArgType=*/PointerInt8Ty,
+                            /*IsVarArgs=*/false);
+
+        enter_function =
+          M.getOrInsertFunction("enter_function", enter_functionTy);
+
+        // Set attributes
+        dyn_cast<Function>(enter_function.getCallee())->setDoesNotThrow();
+
+        FunctionType *exit_functionTy =
+          FunctionType::get(/*ReturnType=*/VoidTy,
+                            /*IsVarArgs=*/false);
+
+        exit_function =
+          M.getOrInsertFunction("exit_function", exit_functionTy);
+
+        // Set attributes
+        dyn_cast<Function>(exit_function.getCallee())->setDoesNotThrow();
+      }
+
       // -------------------------------------------
       // Step 3: Declare and initialize global index
       // -------------------------------------------
@@ -237,6 +605,13 @@ namespace {
       // Global Variable Definitions
       global_count_calls->setInitializer(zero);
 
+      // Number the arguments and call sites recorded by the value probes
+      if (Values)
+        prepareValueSlots(M);
+
+      if (Targets)
+        prepareTargetSites(M);
+
       // ---------------------
       // Step 4: Insert  calls
       // ---------------------
@@ -248,6 +623,10 @@ namespace {
         // Get the name of the current function
         auto func_str = F.getName();
 
+        // Before the timing probes add their own calls
+        if (Targets)
+          insertTargetProbes(F);
+
         // -----------------------
         // Step 5: Insert at begin
         // -----------------------
@@ -277,6 +656,16 @@ namespace {
           new StoreInst(zero, cycle_end, begin_block);
           new StoreInst(zero, core_beg, begin_block);
           new StoreInst(zero, core_end, begin_block);
+
+          // Push the function on the runtime stack, out of the measure
+          if (ShadowStack)
+            BuilderBeg.CreateCall(enter_function,
+                                  BuilderBeg.CreateGlobalStringPtr(func_str));
+
+          // Record the argument values, out of the measure too
+          if (Values)
+            insertValueProbes(F, BuilderBeg);
+
           BuilderBeg.CreateCall(rdtscp, {cycle_beg, core_beg});
         }
 
@@ -344,6 +733,10 @@ namespace {
                 BuilderEnd.CreateCall(insert_function,
                                       {update_index, pid, tid, load_core_beg,
                                        load_core_end, cycle, FuncName});
+
+                // Pop the function from the runtime stack
+                if (ShadowStack)
+                  BuilderEnd.CreateCall(exit_function);
               }
 
               // ------------------------------------------
@@ -370,6 +763,12 @@ namespace {
         this->count_insertion++;
       }
 
+      if (Values)
+        insertValueModuleConstructor(M);
+
+      if (Targets)
+        insertTargetModuleConstructor(M);
+
       // If we modify the IR, then we need to specify with TRUE
       if (this->count_insertion != 0)
         return true;
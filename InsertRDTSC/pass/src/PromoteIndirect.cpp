@@ -0,0 +1,174 @@
+//===- PromoteIndirect.cpp - Target profile driven call promotion ---------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// This file implements a pass that reads the callees recorded by
+// -insert-rdtsc-targets and promotes the hottest targets of each indirect
+// call site (function pointer or virtual call) to direct calls, guarded by a
+// comparison of the called pointer, so that they can be inlined. The other
+// targets still go through the original indirect call. Every site gets a
+// report line with the share of its calls that the promoted targets cover.
+//
+//===----------------------------------------------------------------------===//
+
+#include "ValueProfile.h"
+
+#include "llvm/Pass.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/InstrTypes.h"
+#include "llvm/IR/MDBuilder.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Transforms/Utils/CallPromotionUtils.h"
+
+#include <algorithm>
+#include <string>
+#include <utility>
+#include <vector>
+
+using namespace llvm;
+using namespace insertrdtsc;
+
+#define DEBUG_TYPE "promote-indirect"
+
+static cl::list<std::string>
+ProfileFiles("promote-indirect-profile",
+             cl::desc("targets.csv outputs of runs instrumented with "
+                      "-insert-rdtsc-targets"),
+             cl::value_desc("filenames"), cl::CommaSeparated);
+
+static cl::opt<double>
+MinRate("promote-indirect-min-rate",
+        cl::desc("Promote a target that takes at least this fraction of the "
+                 "calls of its site"),
+        cl::init(0.3));
+
+static cl::opt<unsigned>
+MaxTargets("promote-indirect-max-targets",
+           cl::desc("Maximum number of targets promoted at one site"),
+           cl::init(2));
+
+static cl::opt<unsigned>
+MinCalls("promote-indirect-min-calls",
+         cl::desc("Minimum number of profiled calls of a site"),
+         cl::init(100));
+
+namespace {
+  // PromoteIndirect - The first implementation
+  struct PromoteIndirect : public ModulePass {
+    static char ID; // Pass identification, replacement for typeid
+    uint64_t count_sites = 0;
+    uint64_t count_promoted = 0;
+    uint64_t count_calls = 0;
+    uint64_t count_hits = 0;
+
+    TargetProfile profile;
+
+    PromoteIndirect() : ModulePass(ID) {}
+
+    static double percent(uint64_t Count, uint64_t Calls) {
+      return Calls ? 100.0 * Count / Calls : 0.0;
+    }
+
+    // Promote the hot targets of one site, from the hottest: each one is
+    // tested before the remaining indirect call
+    bool promoteSite(Module &M, Function &F, uint64_t Index, CallBase *CB) {
+      const SiteTargets *Site = profile.lookup(F.getName(), Index);
+      if (!Site || Site->calls < MinCalls)
+        return false;
+
+      SmallVector<std::pair<StringRef, uint64_t>, 8> Targets;
+      Site->sorted(Targets);
+
+      errs() << "Function: " << F.getName() << ": site " << Index << ": "
+             << Site->calls << " calls";
+
+      // Calls not yet covered by a promoted target, for the branch weights
+      uint64_t Remaining = Site->calls, Hits = 0;
+      unsigned Promoted = 0;
+      MDBuilder MDB(M.getContext());
+
+      for (auto &Target : Targets) {
+        if (Promoted >= MaxTargets || (double)Target.second / Site->calls < MinRate)
+          break;
+
+        errs() << ", " << Target.first << " ("
+               << format("%.2f", percent(Target.second, Site->calls)) << "%)";
+
+        Function *Callee = M.getFunction(Target.first);
+        const char *Reason = nullptr;
+
+        if (!Callee) {
+          errs() << " not in the module";
+          continue;
+        }
+
+        if (!isLegalToPromote(*CB, Callee, &Reason)) {
+          errs() << " kept: " << Reason;
+          continue;
+        }
+
+        // Space-saving can overestimate a count; weights are 32 bits
+        uint64_t Taken = std::min(Target.second, Remaining);
+        uint64_t NotTaken = Remaining - Taken;
+        while (Taken > UINT32_MAX || NotTaken > UINT32_MAX) {
+          Taken >>= 1;
+          NotTaken >>= 1;
+        }
+
+        promoteCallWithIfThenElse(*CB, Callee, MDB.createBranchWeights(Taken, NotTaken));
+        Remaining -= std::min(Target.second, Remaining);
+        Hits += Target.second;
+        Promoted++;
+      }
+
+      Hits = std::min(Hits, Site->calls);
+      errs() << ", hit rate " << format("%.2f", percent(Hits, Site->calls)) << "%\n";
+
+      count_calls += Site->calls;
+      count_hits += Hits;
+      count_sites += Promoted > 0;
+      count_promoted += Promoted;
+      return Promoted > 0;
+    }
+
+    bool runOnModule(Module &M) override {
+      for (const std::string &File : ProfileFiles)
+        if (!profile.read(File))
+          exit(13);
+
+      if (profile.empty())
+        return false;
+
+      // Sites are numbered before any promotion, as by the instrumentation
+      std::vector<std::pair<Function *, SmallVector<CallBase *, 8>>> Sites;
+      for (Function &F : M)
+        if (!F.isDeclaration()) {
+          Sites.push_back({&F, {}});
+          getIndirectCalls(F, Sites.back().second);
+        }
+
+      bool modified = false;
+      for (auto &Entry : Sites)
+        for (uint64_t i = 0; i < Entry.second.size(); i++)
+          modified |= promoteSite(M, *Entry.first, i, Entry.second[i]);
+
+      errs() << "Promoted targets: " << count_promoted << " at " << count_sites
+             << " sites, hit rate of the profiled sites: "
+             << format("%.2f", percent(count_hits, count_calls)) << "%\n";
+
+      return modified;
+    }
+  };
+}
+
+char PromoteIndirect::ID = 0;
+static RegisterPass<PromoteIndirect> X("promote-indirect",
+                                       "Promote hot indirect call targets to direct calls");
@@ -0,0 +1,313 @@
+//===- Specialize.cpp - Value profile driven function specialization ------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// This file implements a pass that reads the argument values recorded by
+// -insert-rdtsc-values and clones each function whose integer arguments
+// almost always take the same value, with these arguments replaced by the
+// constants. Every direct call of the function then tests the arguments and
+// calls the clone when they match, so that a constant trip count can be fully
+// unrolled or vectorized without a remainder, and the original otherwise.
+//
+//===----------------------------------------------------------------------===//
+
+#include "ValueProfile.h"
+
+#include "llvm/Pass.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/IR/Attributes.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/MDBuilder.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Transforms/Utils/BasicBlockUtils.h"
+#include "llvm/Transforms/Utils/Cloning.h"
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+using namespace llvm;
+using namespace insertrdtsc;
+
+#define DEBUG_TYPE "specialize-values"
+
+static cl::list<std::string>
+ProfileFiles("specialize-values-profile",
+             cl::desc("values.csv outputs of runs instrumented with "
+                      "-insert-rdtsc-values"),
+             cl::value_desc("filenames"), cl::CommaSeparated);
+
+static cl::opt<double>
+MinRate("specialize-values-min-rate",
+        cl::desc("Specialize on an argument whose hottest value is taken by "
+                 "at least this fraction of the calls"),
+        cl::init(0.9));
+
+static cl::opt<unsigned>
+MinCalls("specialize-values-min-calls",
+         cl::desc("Minimum number of profiled calls of a function"),
+         cl::init(100));
+
+static cl::opt<unsigned>
+MaxInstructions("specialize-values-max-insts",
+                cl::desc("Do not clone functions larger than this"),
+                cl::init(1000));
+
+namespace {
+  // Argument replaced by its hottest value in the clone
+  struct HotArgument {
+    Argument *A;
+    int64_t Value;
+    uint64_t Count;
+    uint64_t Calls;
+  };
+
+  // Specialize - The first implementation
+  struct Specialize : public ModulePass {
+    static char ID; // Pass identification, replacement for typeid
+    uint64_t count_specialized = 0;
+    uint64_t count_guarded = 0;
+    uint64_t count_direct = 0;
+
+    ValueProfile profile;
+
+    Specialize() : ModulePass(ID) {}
+
+    static std::string getArgumentName(Argument *A) {
+      return A->hasName() ? A->getName().str() : "#" + std::to_string(A->getArgNo());
+    }
+
+    void getHotArguments(Function &F, SmallVectorImpl<HotArgument> &Hot) {
+      SmallVector<Argument *, 8> Args;
+      getProfiledArguments(F, Args);
+
+      for (Argument *A : Args) {
+        const ArgumentValues *Values = profile.lookup(F.getName(), A->getArgNo());
+        int64_t Value;
+        uint64_t Count;
+
+        if (!Values || Values->calls < MinCalls || !Values->hottest(Value, Count))
+          continue;
+
+        if ((double)Count / (double)Values->calls >= MinRate)
+          Hot.push_back({A, Value, Count, Values->calls});
+      }
+    }
+
+    // Direct calls of F, musttail calls must keep their callee
+    static void getCallSites(Function &F, SmallVectorImpl<CallInst *> &Calls) {
+      for (User *U : F.users())
+        if (CallInst *CI = dyn_cast<CallInst>(U))
+          if (CI->getCalledOperand() == &F && !CI->isMustTailCall())
+            Calls.push_back(CI);
+    }
+
+    // Call of the clone with the attributes, flags and operand bundles of CI,
+    // without the replaced arguments: byval or zeroext arguments must still
+    // be passed as the clone declares them
+    static CallInst *createCall(IRBuilder<> &Builder, CallInst *CI, Function *Clone,
+                                ArrayRef<HotArgument> Hot) {
+      AttributeList Attrs = CI->getAttributes();
+      SmallVector<Value *, 8> Args;
+      SmallVector<AttributeSet, 8> ArgAttrs;
+
+      for (unsigned i = 0; i < CI->arg_size(); i++)
+        if (none_of(Hot, [i](const HotArgument &H) { return H.A->getArgNo() == i; })) {
+          Args.push_back(CI->getArgOperand(i));
+          ArgAttrs.push_back(Attrs.getParamAttrs(i));
+        }
+
+      SmallVector<OperandBundleDef, 2> Bundles;
+      CI->getOperandBundlesAsDefs(Bundles);
+
+      CallInst *Spec = Builder.CreateCall(Clone, Args, Bundles);
+      Spec->setAttributes(AttributeList::get(CI->getContext(), Attrs.getFnAttrs(),
+                                             Attrs.getRetAttrs(), ArgAttrs));
+      Spec->setCallingConv(CI->getCallingConv());
+      Spec->setTailCallKind(CI->getTailCallKind());
+      Spec->setDebugLoc(CI->getDebugLoc());
+      return Spec;
+    }
+
+    // Call the clone where the hot arguments of CI match, the original
+    // elsewhere; constant arguments are checked at compile time
+    bool dispatch(CallInst *CI, Function *Clone, ArrayRef<HotArgument> Hot,
+                  MDNode *Weights, bool &Guarded) {
+      IRBuilder<> Builder(CI);
+      Value *Cond = nullptr;
+
+      // Every constant first: nothing is emitted for a call that never matches
+      for (const HotArgument &H : Hot) {
+        // Same extension as the probes of -insert-rdtsc-values
+        if (ConstantInt *C = dyn_cast<ConstantInt>(CI->getArgOperand(H.A->getArgNo()))) {
+          int64_t Value = C->getType()->isIntegerTy(1) ? C->getZExtValue() : C->getSExtValue();
+          if (Value != H.Value)
+            return false;
+        }
+      }
+
+      for (const HotArgument &H : Hot) {
+        Value *Actual = CI->getArgOperand(H.A->getArgNo());
+        if (isa<ConstantInt>(Actual))
+          continue;
+
+        Value *Eq = Builder.CreateICmpEQ(Actual, ConstantInt::get(Actual->getType(), H.Value,
+                                                                  /*isSigned=*/true),
+                                         getArgumentName(H.A) + ".hot");
+        Cond = Cond ? Builder.CreateAnd(Cond, Eq) : Eq;
+      }
+
+      Guarded = Cond != nullptr;
+
+      if (!Cond) {
+        CallInst *Spec = createCall(Builder, CI, Clone, Hot);
+        Spec->takeName(CI);
+        CI->replaceAllUsesWith(Spec);
+        CI->eraseFromParent();
+        return true;
+      }
+
+      Instruction *ThenTerm, *ElseTerm;
+      SplitBlockAndInsertIfThenElse(Cond, CI, &ThenTerm, &ElseTerm, Weights);
+
+      // CI heads the join block, the original call goes to the else block
+      BasicBlock *Join = CI->getParent();
+      CI->moveBefore(ElseTerm);
+      ThenTerm->getParent()->setName("spec.call");
+      ElseTerm->getParent()->setName("spec.orig");
+      Join->setName("spec.join");
+
+      Builder.SetInsertPoint(ThenTerm);
+      CallInst *Spec = createCall(Builder, CI, Clone, Hot);
+
+      if (!CI->getType()->isVoidTy()) {
+        PHINode *PN = PHINode::Create(CI->getType(), 2, "", &Join->front());
+        PN->takeName(CI);
+        CI->replaceAllUsesWith(PN);
+        PN->addIncoming(Spec, ThenTerm->getParent());
+        PN->addIncoming(CI, ElseTerm->getParent());
+      }
+
+      return true;
+    }
+
+    bool specializeFunction(Function &F) {
+      SmallVector<HotArgument, 4> Hot;
+      getHotArguments(F, Hot);
+
+      if (Hot.empty())
+        return false;
+
+      errs() << "Function: " << F.getName() << ":";
+      for (const HotArgument &H : Hot)
+        errs() << " " << getArgumentName(H.A) << " = " << H.Value << " ("
+               << format("%.2f", 100.0 * H.Count / H.Calls) << "% of "
+               << H.Calls << " calls)";
+
+      SmallVector<CallInst *, 8> Calls;
+      getCallSites(F, Calls);
+
+      if (Calls.empty()) {
+        errs() << ", kept: no direct call\n";
+        return false;
+      }
+
+      uint64_t Size = F.getInstructionCount();
+      if (Size > MaxInstructions) {
+        errs() << ", kept: " << Size << " instructions\n";
+        return false;
+      }
+
+      ValueToValueMapTy VMap;
+      for (const HotArgument &H : Hot)
+        VMap[H.A] = ConstantInt::get(H.A->getType(), H.Value, /*isSigned=*/true);
+
+      Function *Clone = CloneFunction(&F, VMap);
+      Clone->setName(F.getName() + ".spec");
+      Clone->setLinkage(GlobalValue::InternalLinkage);
+      Clone->setVisibility(GlobalValue::DefaultVisibility);
+
+      // All the hot values together are at least as rare as the rarest one
+      uint64_t Hits = Hot[0].Count, Total = Hot[0].Calls;
+      for (const HotArgument &H : Hot)
+        if ((double)H.Count / H.Calls < (double)Hits / Total) {
+          Hits = H.Count;
+          Total = H.Calls;
+        }
+
+      // Weights are 32 bits; space-saving can overestimate a count
+      Hits = std::min(Hits, Total);
+      while (Total > UINT32_MAX) {
+        Hits >>= 1;
+        Total >>= 1;
+      }
+
+      MDNode *Weights = MDBuilder(F.getContext()).createBranchWeights(Hits, Total - Hits);
+      uint64_t Guarded = 0, Direct = 0, Mismatched = 0;
+
+      for (CallInst *CI : Calls) {
+        bool IsGuarded;
+
+        if (!dispatch(CI, Clone, Hot, Weights, IsGuarded))
+          Mismatched++;
+        else if (IsGuarded)
+          Guarded++;
+        else
+          Direct++;
+      }
+
+      // Every call passes other constants
+      if (!Guarded && !Direct) {
+        errs() << ", kept: " << Mismatched << " calls with other constants\n";
+        Clone->eraseFromParent();
+        return false;
+      }
+
+      errs() << ", " << Clone->getName() << ": " << Guarded << " guarded calls, "
+             << Direct << " direct calls, " << Mismatched << " calls with other constants\n";
+
+      count_specialized++;
+      count_guarded += Guarded;
+      count_direct += Direct;
+      return true;
+    }
+
+    bool runOnModule(Module &M) override {
+      for (const std::string &File : ProfileFiles)
+        if (!profile.read(File))
+          exit(13);
+
+      if (profile.empty())
+        return false;
+
+      // Clones are added to the module
+      std::vector<Function *> Functions;
+      for (Function &F : M)
+        if (!F.isDeclaration() && !F.isVarArg())
+          Functions.push_back(&F);
+
+      bool modified = false;
+      for (Function *F : Functions)
+        modified |= specializeFunction(*F);
+
+      errs() << "Specialized functions: " << count_specialized << ", guarded calls: "
+             << count_guarded << ", direct calls: " << count_direct << '\n';
+
+      return modified;
+    }
+  };
+}
+
+char Specialize::ID = 0;
+static RegisterPass<Specialize> X("specialize-values",
+                                  "Specialize functions on their hot argument values");
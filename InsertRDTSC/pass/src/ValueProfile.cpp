@@ -0,0 +1,154 @@
+//===- ValueProfile.cpp - Argument value profiles of InsertRDTSC ----------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+
+#include "ValueProfile.h"
+
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/Support/LineIterator.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/raw_ostream.h"
+
+using namespace llvm;
+
+namespace insertrdtsc {
+
+  void getProfiledArguments(Function &F, SmallVectorImpl<Argument *> &Args) {
+    for (Argument &A : F.args())
+      if (IntegerType *Ty = dyn_cast<IntegerType>(A.getType()))
+        if (Ty->getBitWidth() <= 64)
+          Args.push_back(&A);
+  }
+
+  void getIndirectCalls(Function &F, SmallVectorImpl<CallBase *> &Calls) {
+    for (BasicBlock &BB : F)
+      for (Instruction &I : BB)
+        if (CallBase *CB = dyn_cast<CallBase>(&I))
+          if (!CB->isInlineAsm()
+              && !isa<Function>(CB->getCalledOperand()->stripPointerCasts()))
+            Calls.push_back(CB);
+  }
+
+  bool ArgumentValues::hottest(int64_t &Value, uint64_t &Count) const {
+    Count = 0;
+
+    for (auto &Entry : counts)
+      if (Entry.second > Count) {
+        Value = Entry.first;
+        Count = Entry.second;
+      }
+
+    return Count > 0;
+  }
+
+  bool ValueProfile::read(StringRef Path) {
+    auto Buffer = MemoryBuffer::getFile(Path);
+
+    if (!Buffer) {
+      errs() << "Cannot read value profile: " << Path << "\n";
+      return false;
+    }
+
+    // Calls are repeated on every value of an argument, count them once per
+    // run: a run starts at its header
+    StringMap<std::map<unsigned, bool>> Seen;
+
+    for (line_iterator Line(**Buffer, /*SkipBlanks=*/true); !Line.is_at_end(); ++Line) {
+      SmallVector<StringRef, 5> Fields;
+      Line->split(Fields, ',');
+
+      unsigned Arg;
+      uint64_t Calls, Count;
+      int64_t Value;
+      if (Fields.size() != 5 || Fields[1].getAsInteger(10, Arg)
+          || Fields[2].getAsInteger(10, Calls)
+          || Fields[3].getAsInteger(10, Value)
+          || Fields[4].getAsInteger(10, Count)) {
+        Seen.clear();
+        continue;
+      }
+
+      ArgumentValues &Values = Functions[Fields[0]][Arg];
+      bool &Counted = Seen[Fields[0]][Arg];
+
+      if (!Counted)
+        Values.calls += Calls;
+
+      Counted = true;
+      Values.counts[Value] += Count;
+    }
+
+    return true;
+  }
+
+  const ArgumentValues *ValueProfile::lookup(StringRef FuncName, unsigned Arg) const {
+    auto It = Functions.find(FuncName);
+    if (It == Functions.end())
+      return nullptr;
+
+    auto ArgIt = It->second.find(Arg);
+    return ArgIt == It->second.end() ? nullptr : &ArgIt->second;
+  }
+
+  void SiteTargets::sorted(SmallVectorImpl<std::pair<StringRef, uint64_t>> &Targets) const {
+    for (auto &Entry : counts)
+      Targets.push_back({Entry.first, Entry.second});
+
+    llvm::stable_sort(Targets, [](const std::pair<StringRef, uint64_t> &A,
+                                  const std::pair<StringRef, uint64_t> &B) {
+      return A.second > B.second;
+    });
+  }
+
+  bool TargetProfile::read(StringRef Path) {
+    auto Buffer = MemoryBuffer::getFile(Path);
+
+    if (!Buffer) {
+      errs() << "Cannot read target profile: " << Path << "\n";
+      return false;
+    }
+
+    // Calls are repeated on every target of a site, as in values.csv
+    StringMap<std::map<unsigned, bool>> Seen;
+
+    for (line_iterator Line(**Buffer, /*SkipBlanks=*/true); !Line.is_at_end(); ++Line) {
+      SmallVector<StringRef, 5> Fields;
+      Line->split(Fields, ',');
+
+      unsigned Site;
+      uint64_t Calls, Count;
+      if (Fields.size() != 5 || Fields[1].getAsInteger(10, Site)
+          || Fields[2].getAsInteger(10, Calls)
+          || Fields[4].getAsInteger(10, Count)) {
+        Seen.clear();
+        continue;
+      }
+
+      SiteTargets &Targets = Functions[Fields[0]][Site];
+      bool &Counted = Seen[Fields[0]][Site];
+
+      if (!Counted)
+        Targets.calls += Calls;
+
+      Counted = true;
+      Targets.counts[Fields[3].str()] += Count;
+    }
+
+    return true;
+  }
+
+  const SiteTargets *TargetProfile::lookup(StringRef FuncName, unsigned Site) const {
+    auto It = Functions.find(FuncName);
+    if (It == Functions.end())
+      return nullptr;
+
+    auto SiteIt = It->second.find(Site);
+    return SiteIt == It->second.end() ? nullptr : &SiteIt->second;
+  }
+
+} // namespace insertrdtsc
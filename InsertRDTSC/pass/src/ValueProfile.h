@@ -0,0 +1,95 @@
+//===- ValueProfile.h - Argument value profiles of InsertRDTSC ------------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// This file declares the arguments profiled by -insert-rdtsc-values, the
+// indirect call sites profiled by -insert-rdtsc-targets and the readers of the
+// values.csv and targets.csv outputs of libinsertrdtsc.so, shared by the
+// instrumentation and the passes that consume them.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef INSERTRDTSC_VALUEPROFILE_H
+#define INSERTRDTSC_VALUEPROFILE_H
+
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/IR/Argument.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/InstrTypes.h"
+
+#include <map>
+#include <string>
+#include <utility>
+
+namespace insertrdtsc {
+
+  // Get the integer arguments of a function, the ones the runtime profiles;
+  // they are identified by their position in the function
+  void getProfiledArguments(llvm::Function &F,
+                            llvm::SmallVectorImpl<llvm::Argument *> &Args);
+
+  // Get the calls of a function without a static callee, in a stable order
+  // that identifies them across the instrumentation and the profile use
+  void getIndirectCalls(llvm::Function &F,
+                        llvm::SmallVectorImpl<llvm::CallBase *> &Calls);
+
+  // Hottest values of one argument
+  struct ArgumentValues {
+    uint64_t calls = 0;
+    std::map<int64_t, uint64_t> counts;
+
+    // Most frequent value and its count, false without any value
+    bool hottest(int64_t &Value, uint64_t &Count) const;
+  };
+
+  // Value profile: hottest values of each argument of each function
+  class ValueProfile {
+  public:
+    // Read a values.csv output (FUNCTION NAME,ARGUMENT,CALLS,VALUE,COUNT),
+    // several runs can be concatenated in one file
+    bool read(llvm::StringRef Path);
+
+    // Get the values of an argument or nullptr
+    const ArgumentValues *lookup(llvm::StringRef FuncName, unsigned Arg) const;
+
+    bool empty() const { return Functions.empty(); }
+
+  private:
+    llvm::StringMap<std::map<unsigned, ArgumentValues>> Functions;
+  };
+
+  // Hottest targets of one indirect call site
+  struct SiteTargets {
+    uint64_t calls = 0;
+    std::map<std::string, uint64_t> counts;
+
+    // Targets by decreasing count
+    void sorted(llvm::SmallVectorImpl<std::pair<llvm::StringRef, uint64_t>> &Targets) const;
+  };
+
+  // Target profile: hottest targets of each indirect call site of each
+  // function
+  class TargetProfile {
+  public:
+    // Read a targets.csv output (FUNCTION NAME,SITE,CALLS,TARGET,COUNT),
+    // several runs can be concatenated in one file
+    bool read(llvm::StringRef Path);
+
+    // Get the targets of a call site or nullptr
+    const SiteTargets *lookup(llvm::StringRef FuncName, unsigned Site) const;
+
+    bool empty() const { return Functions.empty(); }
+
+  private:
+    llvm::StringMap<std::map<unsigned, SiteTargets>> Functions;
+  };
+
+} // namespace insertrdtsc
+
+#endif // INSERTRDTSC_VALUEPROFILE_H
@@ -0,0 +1,45 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define ALIGN 64
+#define N 1000
+#define N_SAMPLES 100
+
+char *make_label(uint64_t i)
+{
+  char *label = malloc(32);
+  snprintf(label, 32, "label-%lu", i);
+
+  return label;
+}
+
+void churn(void)
+{
+  for (uint64_t i = 0; i < N; i++)
+    {
+      char *label = make_label(i);
+      label = realloc(label, 64);
+      free(label);
+    }
+}
+
+double *make_vector(uint64_t n)
+{
+  return aligned_alloc(ALIGN, sizeof(double) * n);
+}
+
+int main(int argc, char **argv)
+{
+  double *a = make_vector(N);
+  double *b = calloc(N, sizeof(double));
+
+  for (uint64_t i = 0; i < N_SAMPLES; i++)
+    churn();
+
+  free(b);
+  free(a);
+
+  return 0;
+}
@@ -0,0 +1,50 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#define N 1000
+#define N_SAMPLES 1000
+
+typedef double (*op_t)(double, double);
+
+static double add(double x, double y) { return x + y; }
+static double mul(double x, double y) { return x * y; }
+static double sub(double x, double y) { return x - y; }
+
+// Called through a pointer: nothing can be inlined until the hot target is
+// promoted to a direct call
+double reduce(op_t op, const double *a, const uint64_t n, double init)
+{
+  double r = init;
+
+  for (uint64_t i = 0; i < n; i++)
+    r = op(r, a[i]);
+
+  return r;
+}
+
+int main(int argc, char **argv)
+{
+  op_t ops[] = { add, mul, sub };
+  double *a = malloc(sizeof(double) * N);
+
+  for (uint64_t i = 0; i < N; i++)
+    a[i] = 1.0 + 1.0 / (i + 1);
+
+  // Mostly add, sometimes mul or sub: the choice is only known at runtime
+  uint64_t seed = argc > 1 ? strtoull(argv[1], NULL, 10) : 1;
+  double s = 0.0;
+
+  for (uint64_t i = 0; i < N_SAMPLES; i++)
+    {
+      seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+      uint64_t r = (seed >> 33) % 10;
+      s += reduce(ops[r < 8 ? 0 : r - 7], a, N, r == 8 ? 1.0 : 0.0);
+    }
+
+  printf("s = %e\n", s);
+
+  free(a);
+
+  return 0;
+}
@@ -0,0 +1,52 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <pthread.h>
+
+#define N_THREAD 4
+#define N_ITER 100000
+
+pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+pthread_rwlock_t rwlock = PTHREAD_RWLOCK_INITIALIZER;
+uint64_t counter = 0;
+
+void increment(void)
+{
+  pthread_mutex_lock(&mutex);
+  counter++;
+  pthread_mutex_unlock(&mutex);
+}
+
+uint64_t read_counter(void)
+{
+  pthread_rwlock_rdlock(&rwlock);
+  uint64_t value = counter;
+  pthread_rwlock_unlock(&rwlock);
+
+  return value;
+}
+
+void *thread_func(void *arg)
+{
+  for (uint64_t i = 0; i < N_ITER; i++)
+    {
+      increment();
+      read_counter();
+    }
+
+  return NULL;
+}
+
+int main(int argc, char **argv)
+{
+  pthread_t tid[N_THREAD];
+
+  for (uint64_t i = 0; i < N_THREAD; i++)
+    pthread_create(tid + i, NULL, thread_func, NULL);
+
+  for (uint64_t i = 0; i < N_THREAD; i++)
+    pthread_join(tid[i], NULL);
+
+  printf("counter: %lu\n", counter);
+
+  return 0;
+}
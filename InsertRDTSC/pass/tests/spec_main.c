@@ -0,0 +1,41 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#define ALIGN 64
+#define N 1000
+#define N_SAMPLES 1000
+
+void dotprod(double *restrict a, double *restrict b, double *restrict c, const uint64_t n)
+{
+  for (uint64_t i = 0; i < n; i++)
+    c[i] = a[i] * b[i];
+}
+
+int main(int argc, char **argv)
+{
+  double *restrict a = aligned_alloc(ALIGN, sizeof(double) * N);
+  double *restrict b = aligned_alloc(ALIGN, sizeof(double) * N);
+  double *restrict c = aligned_alloc(ALIGN, sizeof(double) * N);
+
+  for (uint64_t i = 0; i < N; i++)
+    {
+      a[i] = i * 0.5;
+      b[i] = i * 2.0;
+    }
+
+  // Almost always the full vectors, sometimes a prefix: n is only known at
+  // runtime
+  uint64_t n = argc > 1 ? strtoull(argv[1], NULL, 10) : N;
+
+  for (uint64_t i = 0; i < N_SAMPLES; i++)
+    dotprod(a, b, c, i % 100 == 0 ? n / 2 : n);
+
+  printf("c[%d] = %e\n", N - 1, c[N - 1]);
+
+  free(c);
+  free(b);
+  free(a);
+
+  return 0;
+}
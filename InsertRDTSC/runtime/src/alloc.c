@@ -0,0 +1,347 @@
+#include <stdio.h>    // fprintf
+#include <stdlib.h>   // qsort
+#include <stdint.h>   // uint64_t
+#include <sys/mman.h> // mmap, munmap
+
+#include "runtime.h"
+#include "alloc.h"
+
+//
+alloc_module_t __alloc = { NULL, NULL, 0 };
+
+// Charged when no instrumented function is active
+static const char *__alloc_unknown = "unknown";
+
+// Real functions, resolved by the linker thanks to --wrap
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t nmemb, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+void *__real_aligned_alloc(size_t alignment, size_t size);
+void __real_free(void *ptr);
+
+static void *map(uint64_t size)
+{
+  void *ptr = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+  return ptr == MAP_FAILED ? NULL : ptr;
+}
+
+void liballoc_initialize()
+{
+  // Pages are only touched when used
+  __alloc.stats = map(sizeof(alloc_stat_t) * ALLOC_FUNC_LIMIT);
+  __alloc.blocks = map(sizeof(alloc_block_t) * ALLOC_BLOCK_LIMIT);
+}
+
+static uint64_t hash_ptr(uintptr_t ptr)
+{
+  return (ptr >> 4) * 0x9e3779b97f4a7c15UL;
+}
+
+static alloc_stat_t *get_stat(void)
+{
+  const char *func_name = get_current_function();
+
+  if (!func_name)
+    func_name = __alloc_unknown;
+
+  if (!__alloc.stats)
+    return NULL;
+
+  uint64_t h = hash_ptr((uintptr_t)func_name);
+
+  for (uint64_t i = 0; i < ALLOC_FUNC_LIMIT; i++)
+    {
+      alloc_stat_t *stat = __alloc.stats + ((h + i) % ALLOC_FUNC_LIMIT);
+      const char *key = __atomic_load_n(&stat->func_name, __ATOMIC_ACQUIRE);
+
+      if (key == func_name)
+        return stat;
+
+      if (!key
+          && __atomic_compare_exchange_n(&stat->func_name, &key, func_name, 0,
+                                         __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+        return stat;
+
+      // Lost the race for this slot to the same function
+      if (key == func_name)
+        return stat;
+    }
+
+  return NULL;
+}
+
+static void insert_block(void *ptr, alloc_stat_t *stat, uint64_t size)
+{
+  if (!ptr || !__alloc.blocks)
+    return;
+
+  uint64_t h = hash_ptr((uintptr_t)ptr);
+
+  for (uint64_t i = 0; i < ALLOC_BLOCK_LIMIT; i++)
+    {
+      alloc_block_t *block = __alloc.blocks + ((h + i) % ALLOC_BLOCK_LIMIT);
+      uintptr_t key = __atomic_load_n(&block->ptr, __ATOMIC_ACQUIRE);
+
+      // A fresh pointer is never live, free and deleted slots can be reused
+      if ((key == 0 || key == ALLOC_TOMBSTONE)
+          && __atomic_compare_exchange_n(&block->ptr, &key, (uintptr_t)ptr, 0,
+                                         __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+        {
+          block->stat = stat;
+          block->size = size;
+          return;
+        }
+    }
+
+  __atomic_fetch_add(&__alloc.ndropped, 1, __ATOMIC_RELAXED);
+}
+
+static alloc_block_t *remove_block(void *ptr)
+{
+  if (!ptr || !__alloc.blocks)
+    return NULL;
+
+  uint64_t h = hash_ptr((uintptr_t)ptr);
+
+  for (uint64_t i = 0; i < ALLOC_BLOCK_LIMIT; i++)
+    {
+      alloc_block_t *block = __alloc.blocks + ((h + i) % ALLOC_BLOCK_LIMIT);
+      uintptr_t key = __atomic_load_n(&block->ptr, __ATOMIC_ACQUIRE);
+
+      if (key == 0)
+        return NULL;
+
+      if (key == (uintptr_t)ptr)
+        return block;
+    }
+
+  return NULL;
+}
+
+static void charge_alloc(void *ptr, uint64_t size, uint64_t cycles)
+{
+  alloc_stat_t *stat = get_stat();
+
+  if (!stat)
+    return;
+
+  __atomic_fetch_add(&stat->nallocs, 1, __ATOMIC_RELAXED);
+  __atomic_fetch_add(&stat->bytes, size, __ATOMIC_RELAXED);
+  __atomic_fetch_add(&stat->cycles, cycles, __ATOMIC_RELAXED);
+
+  if (!ptr)
+    return;
+
+  int64_t live = __atomic_add_fetch(&stat->live_bytes, (int64_t)size, __ATOMIC_RELAXED);
+  int64_t peak = __atomic_load_n(&stat->peak_bytes, __ATOMIC_RELAXED);
+
+  while (live > peak
+         && !__atomic_compare_exchange_n(&stat->peak_bytes, &peak, live, 1,
+                                         __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+    ;
+
+  insert_block(ptr, stat, size);
+}
+
+// Must run before the block goes back to the allocator: another thread can
+// get the same address and insert it as soon as it is freed
+static alloc_block_t release_block(void *ptr)
+{
+  alloc_block_t *block = remove_block(ptr);
+  alloc_block_t released = { 0, NULL, 0 };
+
+  // Live bytes belong to the allocating function
+  if (block)
+    {
+      released.stat = block->stat;
+      released.size = block->size;
+      __atomic_fetch_sub(&released.stat->live_bytes, (int64_t)released.size, __ATOMIC_RELAXED);
+      __atomic_store_n(&block->ptr, ALLOC_TOMBSTONE, __ATOMIC_RELEASE);
+    }
+
+  return released;
+}
+
+static void charge_free(uint64_t cycles)
+{
+  alloc_stat_t *stat = get_stat();
+
+  if (!stat)
+    return;
+
+  __atomic_fetch_add(&stat->nfrees, 1, __ATOMIC_RELAXED);
+  __atomic_fetch_add(&stat->cycles, cycles, __ATOMIC_RELAXED);
+}
+
+void *__wrap_malloc(size_t size)
+{
+  uint64_t beg = rdtsc();
+  void *ptr = __real_malloc(size);
+
+  charge_alloc(ptr, size, rdtsc() - beg);
+  return ptr;
+}
+
+void *__wrap_calloc(size_t nmemb, size_t size)
+{
+  uint64_t beg = rdtsc();
+  void *ptr = __real_calloc(nmemb, size);
+
+  charge_alloc(ptr, nmemb * size, rdtsc() - beg);
+  return ptr;
+}
+
+void *__wrap_realloc(void *ptr, size_t size)
+{
+  // The old block is released, the new one is charged to the caller
+  alloc_block_t old = release_block(ptr);
+
+  uint64_t beg = rdtsc();
+  void *new_ptr = __real_realloc(ptr, size);
+  uint64_t cycles = rdtsc() - beg;
+
+  // On failure, the old block is still live
+  if (ptr && !new_ptr && size != 0)
+    {
+      if (old.stat)
+        {
+          __atomic_fetch_add(&old.stat->live_bytes, (int64_t)old.size, __ATOMIC_RELAXED);
+          insert_block(ptr, old.stat, old.size);
+        }
+    }
+  else if (ptr)
+    charge_free(0);
+
+  if (size != 0)
+    charge_alloc(new_ptr, size, cycles);
+
+  return new_ptr;
+}
+
+void *__wrap_aligned_alloc(size_t alignment, size_t size)
+{
+  uint64_t beg = rdtsc();
+  void *ptr = __real_aligned_alloc(alignment, size);
+
+  charge_alloc(ptr, size, rdtsc() - beg);
+  return ptr;
+}
+
+void __wrap_free(void *ptr)
+{
+  if (!ptr)
+    return;
+
+  release_block(ptr);
+
+  uint64_t beg = rdtsc();
+  __real_free(ptr);
+
+  charge_free(rdtsc() - beg);
+}
+
+static int compare_bytes(const void *a, const void *b)
+{
+  const alloc_stat_t *sa = *(const alloc_stat_t **)a;
+  const alloc_stat_t *sb = *(const alloc_stat_t **)b;
+
+  return (sa->bytes < sb->bytes) - (sa->bytes > sb->bytes);
+}
+
+void liballoc_finalize()
+{
+  alloc_stat_t *stats[ALLOC_FUNC_LIMIT];
+  uint64_t n = 0;
+
+  if (!__alloc.stats)
+    return;
+
+  for (uint64_t i = 0; i < ALLOC_FUNC_LIMIT; i++)
+    {
+      if (__alloc.stats[i].func_name)
+        stats[n++] = __alloc.stats + i;
+    }
+
+  qsort(stats, n, sizeof(alloc_stat_t *), compare_bytes);
+
+  write_alloc_summary(stats, n);
+  write_alloc_info_in_csv_file(stats, n);
+
+  if (__alloc.ndropped)
+    fprintf(stderr, "insertrdtsc: %ld blocks not tracked, increase ALLOC_BLOCK_LIMIT\n",
+            __alloc.ndropped);
+
+  munmap(__alloc.stats, sizeof(alloc_stat_t) * ALLOC_FUNC_LIMIT);
+  munmap(__alloc.blocks, sizeof(alloc_block_t) * ALLOC_BLOCK_LIMIT);
+  __alloc.stats = NULL;
+  __alloc.blocks = NULL;
+}
+
+void write_alloc_summary(alloc_stat_t **stats, uint64_t nstats)
+{
+  //
+  fflush(stdout);
+
+  //
+  fprintf(stdout,
+          "============================= ALLOCATIONS SUMMARY =============================\n"
+          "\n"
+          "%12s  %12s  %16s  %16s  %16s  %s"
+          "\n",
+          "ALLOCS",
+          "FREES",
+          "BYTES",
+          "CYCLES",
+          "PEAK LIVE BYTES",
+          "FUNCTION NAME");
+
+  //
+  for (uint64_t i = 0; i < nstats; i++)
+    {
+      fprintf(stdout, "%12ld  %12ld  %16ld  %16ld  %16ld  %s\n",
+              stats[i]->nallocs,
+              stats[i]->nfrees,
+              stats[i]->bytes,
+              stats[i]->cycles,
+              stats[i]->peak_bytes,
+              stats[i]->func_name);
+    }
+
+  //
+  fprintf(stdout, "\n");
+  fflush(stdout);
+}
+
+void write_alloc_info_in_csv_file(alloc_stat_t **stats, uint64_t nstats)
+{
+  //
+  char name[OUTPUT_NAME_LIMIT];
+  get_output_name(name, sizeof(name), "allocs.csv");
+
+  FILE *file = fopen(name, "w");
+
+  if (!file)
+    exit(13);
+
+  //
+  fprintf(file, "ALLOCS,FREES,BYTES,CYCLES,LIVE BYTES,PEAK LIVE BYTES,FUNCTION NAME\n");
+
+  //
+  for (uint64_t i = 0; i < nstats; i++)
+    {
+      fprintf(file, "%ld,%ld,%ld,%ld,%ld,%ld,%s\n",
+              stats[i]->nallocs,
+              stats[i]->nfrees,
+              stats[i]->bytes,
+              stats[i]->cycles,
+              stats[i]->live_bytes,
+              stats[i]->peak_bytes,
+              stats[i]->func_name);
+    }
+
+  //
+  fflush(file);
+  fclose(file);
+}
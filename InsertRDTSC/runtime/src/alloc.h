@@ -0,0 +1,85 @@
+#ifndef _ALLOC_H_
+#define _ALLOC_H_
+
+//
+#include <stdint.h> // uint64_t, int64_t
+#include <stddef.h> // size_t
+
+//
+#define ALLOC_FUNC_LIMIT 4096
+#define ALLOC_BLOCK_LIMIT (1 << 20)
+#define ALLOC_TOMBSTONE ((uintptr_t)1)
+
+/**
+ * Store the allocations charged to one function
+ */
+typedef struct alloc_stat_s
+{
+  const char *func_name;
+  uint64_t nallocs;
+  uint64_t nfrees;
+  uint64_t bytes;
+  uint64_t cycles;
+  int64_t live_bytes;
+  int64_t peak_bytes;
+} alloc_stat_t;
+
+/**
+ * Store a live block and the function that allocated it
+ */
+typedef struct alloc_block_s
+{
+  uintptr_t ptr;
+  alloc_stat_t *stat;
+  uint64_t size;
+} alloc_block_t;
+
+/**
+ * Store the allocation module information - both tables are lock-free open
+ * addressing hash tables, filled with compare and swap
+ */
+typedef struct alloc_module_s
+{
+  alloc_stat_t *stats;
+  alloc_block_t *blocks;
+  uint64_t ndropped;
+} alloc_module_t;
+
+extern alloc_module_t __alloc;
+
+/**
+ * Allocation module constructor
+ */
+void liballoc_initialize() __attribute__((constructor));
+
+/**
+ * Allocation module destructor - write the statistics of every function
+ */
+void liballoc_finalize() __attribute__((destructor));
+
+/**
+ * Wrappers - link the program with -Wl,--wrap=SYMBOL for each of them
+ */
+void *__wrap_malloc(size_t size);
+void *__wrap_calloc(size_t nmemb, size_t size);
+void *__wrap_realloc(void *ptr, size_t size);
+void *__wrap_aligned_alloc(size_t alignment, size_t size);
+void __wrap_free(void *ptr);
+
+/**
+ * write_alloc_summary - Write allocation summary in stdout
+ * @param stats : statistics sorted by bytes
+ * @param nstats: number of statistics
+ * @return
+ */
+void write_alloc_summary(alloc_stat_t **stats, uint64_t nstats);
+
+/**
+ * write_alloc_info_in_csv_file - Write allocation statistics in CSV file
+ * @param stats : statistics sorted by bytes
+ * @param nstats: number of statistics
+ * @return
+ */
+void write_alloc_info_in_csv_file(alloc_stat_t **stats, uint64_t nstats);
+
+#endif // _ALLOC_H_
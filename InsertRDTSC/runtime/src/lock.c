@@ -0,0 +1,410 @@
+#define _GNU_SOURCE      // dladdr
+#include <stdio.h>       // fprintf
+#include <stdlib.h>      // calloc, qsort
+#include <stdint.h>      // uint64_t
+#include <string.h>      // memset
+#include <dlfcn.h>       // dladdr
+#include <pthread.h>     // pthread_*
+
+#include "runtime.h"
+#include "lock.h"
+
+//
+lock_module_t __lock = { PTHREAD_MUTEX_INITIALIZER, NULL, 0 };
+
+// Buffer and held locks of the current thread
+static __thread lock_buffer_t *__lock_buffer = NULL;
+static __thread lock_held_t __lock_held[LOCK_HELD_LIMIT];
+static __thread uint64_t __lock_nheld = 0;
+
+// Real functions, resolved by the linker thanks to --wrap
+int __real_pthread_mutex_lock(pthread_mutex_t *mutex);
+int __real_pthread_mutex_trylock(pthread_mutex_t *mutex);
+int __real_pthread_mutex_unlock(pthread_mutex_t *mutex);
+int __real_pthread_cond_wait(pthread_cond_t *cond, pthread_mutex_t *mutex);
+int __real_pthread_rwlock_rdlock(pthread_rwlock_t *rwlock);
+int __real_pthread_rwlock_wrlock(pthread_rwlock_t *rwlock);
+int __real_pthread_rwlock_tryrdlock(pthread_rwlock_t *rwlock);
+int __real_pthread_rwlock_trywrlock(pthread_rwlock_t *rwlock);
+int __real_pthread_rwlock_unlock(pthread_rwlock_t *rwlock);
+
+static lock_buffer_t *get_buffer(void)
+{
+  // Locks taken after the merge are not counted
+  if (__atomic_load_n(&__lock.finalized, __ATOMIC_ACQUIRE))
+    return NULL;
+
+  if (__lock_buffer)
+    return __lock_buffer;
+
+  // Buffers outlive their thread, they are merged by the destructor
+  lock_buffer_t *buffer = calloc(1, sizeof(lock_buffer_t));
+
+  if (!buffer)
+    return NULL;
+
+  __real_pthread_mutex_lock(&__lock.mutex);
+
+  if (__lock.finalized)
+    {
+      __real_pthread_mutex_unlock(&__lock.mutex);
+      free(buffer);
+      return NULL;
+    }
+
+  buffer->next = __lock.buffers;
+  __lock.buffers = buffer;
+  __real_pthread_mutex_unlock(&__lock.mutex);
+
+  __lock_buffer = buffer;
+  return buffer;
+}
+
+static lock_stat_t *get_stat(const void *lock, const void *caller)
+{
+  lock_buffer_t *buffer = get_buffer();
+
+  if (!buffer)
+    return NULL;
+
+  uint64_t h = ((uintptr_t)lock ^ ((uintptr_t)caller * 0x9e3779b97f4a7c15UL)) >> 4;
+
+  for (uint64_t i = 0; i < LOCK_STAT_LIMIT; i++)
+    {
+      lock_stat_t *stat = buffer->stats + ((h + i) % LOCK_STAT_LIMIT);
+
+      if (stat->lock == lock && stat->caller == caller)
+        return stat;
+
+      if (!stat->lock)
+        {
+          stat->lock = lock;
+          stat->caller = caller;
+          buffer->nstats++;
+          return stat;
+        }
+    }
+
+  buffer->ndropped++;
+  return NULL;
+}
+
+static void push_held(const void *lock, lock_stat_t *stat)
+{
+  if (!stat || __lock_nheld >= LOCK_HELD_LIMIT)
+    return;
+
+  __lock_held[__lock_nheld].lock = lock;
+  __lock_held[__lock_nheld].stat = stat;
+  __lock_held[__lock_nheld].cycles_beg = rdtsc();
+  __lock_nheld++;
+}
+
+static void pop_held(const void *lock)
+{
+  // Locks are usually released in reverse order
+  for (uint64_t i = __lock_nheld; i > 0; i--)
+    {
+      if (__lock_held[i - 1].lock == lock)
+        {
+          __lock_held[i - 1].stat->hold_cycles += rdtsc() - __lock_held[i - 1].cycles_beg;
+          __lock_held[i - 1] = __lock_held[__lock_nheld - 1];
+          __lock_nheld--;
+          return;
+        }
+    }
+}
+
+/**
+ * Take a lock: try first, so that only contended acquisitions are timed
+ */
+#define LOCK_ACQUIRE(lock, caller, try_lock, do_lock)                   \
+  do                                                                    \
+    {                                                                   \
+      lock_stat_t *stat = get_stat(lock, caller);                       \
+      int ret = try_lock;                                               \
+                                                                        \
+      if (ret != 0)                                                     \
+        {                                                               \
+          uint64_t beg = rdtsc();                                       \
+          ret = do_lock;                                                \
+                                                                        \
+          if (stat)                                                     \
+            {                                                           \
+              stat->wait_cycles += rdtsc() - beg;                       \
+              stat->ncontended++;                                       \
+            }                                                           \
+        }                                                               \
+                                                                        \
+      if (ret == 0 && stat)                                             \
+        {                                                               \
+          stat->nacquires++;                                            \
+          push_held(lock, stat);                                        \
+        }                                                               \
+                                                                        \
+      return ret;                                                       \
+    }                                                                   \
+  while (0)
+
+/**
+ * Try a lock: a failure counts as contention
+ */
+#define LOCK_TRY(lock, caller, try_lock)                                \
+  do                                                                    \
+    {                                                                   \
+      lock_stat_t *stat = get_stat(lock, caller);                       \
+      int ret = try_lock;                                               \
+                                                                        \
+      if (stat)                                                         \
+        {                                                               \
+          if (ret == 0)                                                 \
+            {                                                           \
+              stat->nacquires++;                                        \
+              push_held(lock, stat);                                    \
+            }                                                           \
+          else                                                          \
+            stat->ncontended++;                                         \
+        }                                                               \
+                                                                        \
+      return ret;                                                       \
+    }                                                                   \
+  while (0)
+
+int __wrap_pthread_mutex_lock(pthread_mutex_t *mutex)
+{
+  LOCK_ACQUIRE(mutex, __builtin_return_address(0),
+               __real_pthread_mutex_trylock(mutex),
+               __real_pthread_mutex_lock(mutex));
+}
+
+int __wrap_pthread_mutex_trylock(pthread_mutex_t *mutex)
+{
+  LOCK_TRY(mutex, __builtin_return_address(0),
+           __real_pthread_mutex_trylock(mutex));
+}
+
+int __wrap_pthread_mutex_unlock(pthread_mutex_t *mutex)
+{
+  pop_held(mutex);
+  return __real_pthread_mutex_unlock(mutex);
+}
+
+int __wrap_pthread_cond_wait(pthread_cond_t *cond, pthread_mutex_t *mutex)
+{
+  lock_stat_t *stat = get_stat(mutex, __builtin_return_address(0));
+
+  // The mutex is released while waiting
+  pop_held(mutex);
+
+  uint64_t beg = rdtsc();
+  int ret = __real_pthread_cond_wait(cond, mutex);
+
+  if (stat)
+    {
+      stat->cond_wait_cycles += rdtsc() - beg;
+      push_held(mutex, stat);
+    }
+
+  return ret;
+}
+
+int __wrap_pthread_rwlock_rdlock(pthread_rwlock_t *rwlock)
+{
+  LOCK_ACQUIRE(rwlock, __builtin_return_address(0),
+               __real_pthread_rwlock_tryrdlock(rwlock),
+               __real_pthread_rwlock_rdlock(rwlock));
+}
+
+int __wrap_pthread_rwlock_wrlock(pthread_rwlock_t *rwlock)
+{
+  LOCK_ACQUIRE(rwlock, __builtin_return_address(0),
+               __real_pthread_rwlock_trywrlock(rwlock),
+               __real_pthread_rwlock_wrlock(rwlock));
+}
+
+int __wrap_pthread_rwlock_tryrdlock(pthread_rwlock_t *rwlock)
+{
+  LOCK_TRY(rwlock, __builtin_return_address(0),
+           __real_pthread_rwlock_tryrdlock(rwlock));
+}
+
+int __wrap_pthread_rwlock_trywrlock(pthread_rwlock_t *rwlock)
+{
+  LOCK_TRY(rwlock, __builtin_return_address(0),
+           __real_pthread_rwlock_trywrlock(rwlock));
+}
+
+int __wrap_pthread_rwlock_unlock(pthread_rwlock_t *rwlock)
+{
+  pop_held(rwlock);
+  return __real_pthread_rwlock_unlock(rwlock);
+}
+
+static const char *caller_name(const void *caller)
+{
+  Dl_info info;
+
+  if (dladdr(caller, &info) && info.dli_sname)
+    return info.dli_sname;
+
+  return "unknown";
+}
+
+static const void *caller_function(const void *caller)
+{
+  Dl_info info;
+
+  // Merge the call sites of a same function
+  if (dladdr(caller, &info) && info.dli_saddr)
+    return info.dli_saddr;
+
+  return caller;
+}
+
+static int compare_wait(const void *a, const void *b)
+{
+  const lock_stat_t *sa = a;
+  const lock_stat_t *sb = b;
+
+  return (sa->wait_cycles < sb->wait_cycles) - (sa->wait_cycles > sb->wait_cycles);
+}
+
+void liblock_finalize()
+{
+  uint64_t nstats = 0;
+  uint64_t ndropped = 0;
+
+  // No buffer is added once finalized, the list can then be walked unlocked
+  __real_pthread_mutex_lock(&__lock.mutex);
+  __atomic_store_n(&__lock.finalized, 1, __ATOMIC_RELEASE);
+  __real_pthread_mutex_unlock(&__lock.mutex);
+
+  for (lock_buffer_t *b = __lock.buffers; b; b = b->next)
+    nstats += __atomic_load_n(&b->nstats, __ATOMIC_RELAXED);
+
+  lock_stat_t *stats = calloc(nstats + 1, sizeof(lock_stat_t));
+
+  if (!stats)
+    return;
+
+  // Merge the buffers of every thread by (lock, calling function)
+  uint64_t n = 0;
+
+  for (lock_buffer_t *b = __lock.buffers; b; b = b->next)
+    {
+      ndropped += b->ndropped;
+
+      for (uint64_t i = 0; i < LOCK_STAT_LIMIT; i++)
+        {
+          lock_stat_t *s = b->stats + i;
+
+          if (!s->lock)
+            continue;
+
+          const void *func = caller_function(s->caller);
+          uint64_t j = 0;
+
+          while (j < n && (stats[j].lock != s->lock || stats[j].caller != func))
+            j++;
+
+          // A thread still running may have added a statistic since
+          if (j == n && n == nstats)
+            {
+              ndropped++;
+              continue;
+            }
+
+          if (j == n)
+            {
+              stats[n].lock = s->lock;
+              stats[n].caller = func;
+              n++;
+            }
+
+          stats[j].nacquires += s->nacquires;
+          stats[j].ncontended += s->ncontended;
+          stats[j].wait_cycles += s->wait_cycles;
+          stats[j].hold_cycles += s->hold_cycles;
+          stats[j].cond_wait_cycles += s->cond_wait_cycles;
+        }
+    }
+
+  qsort(stats, n, sizeof(lock_stat_t), compare_wait);
+
+  write_lock_summary(stats, n);
+  write_lock_info_in_csv_file(stats, n);
+
+  if (ndropped)
+    fprintf(stderr, "insertrdtsc: %ld lock events dropped, increase LOCK_STAT_LIMIT\n",
+            ndropped);
+
+  free(stats);
+}
+
+void write_lock_summary(lock_stat_t *stats, uint64_t nstats)
+{
+  //
+  fflush(stdout);
+
+  //
+  fprintf(stdout,
+          "================================ LOCKS SUMMARY ================================\n"
+          "\n"
+          "%18s  %12s  %12s  %16s  %16s  %s"
+          "\n",
+          "LOCK",
+          "ACQUIRES",
+          "CONTENDED",
+          "WAIT CYCLES",
+          "HOLD CYCLES",
+          "FUNCTION NAME");
+
+  //
+  for (uint64_t i = 0; i < nstats; i++)
+    {
+      fprintf(stdout, "%18p  %12ld  %12ld  %16ld  %16ld  %s\n",
+              stats[i].lock,
+              stats[i].nacquires,
+              stats[i].ncontended,
+              stats[i].wait_cycles,
+              stats[i].hold_cycles,
+              caller_name(stats[i].caller));
+    }
+
+  //
+  fprintf(stdout, "\n");
+  fflush(stdout);
+}
+
+void write_lock_info_in_csv_file(lock_stat_t *stats, uint64_t nstats)
+{
+  //
+  char name[OUTPUT_NAME_LIMIT];
+  get_output_name(name, sizeof(name), "locks.csv");
+
+  FILE *file = fopen(name, "w");
+
+  if (!file)
+    exit(13);
+
+  //
+  fprintf(file,
+          "LOCK,ACQUIRES,CONTENDED,WAIT CYCLES,HOLD CYCLES,COND WAIT CYCLES,FUNCTION NAME\n");
+
+  //
+  for (uint64_t i = 0; i < nstats; i++)
+    {
+      fprintf(file, "%p,%ld,%ld,%ld,%ld,%ld,%s\n",
+              stats[i].lock,
+              stats[i].nacquires,
+              stats[i].ncontended,
+              stats[i].wait_cycles,
+              stats[i].hold_cycles,
+              stats[i].cond_wait_cycles,
+              caller_name(stats[i].caller));
+    }
+
+  //
+  fflush(file);
+  fclose(file);
+}
@@ -0,0 +1,95 @@
+#ifndef _LOCK_H_
+#define _LOCK_H_
+
+//
+#include <stdint.h>  // uint64_t
+#include <pthread.h> // pthread_mutex_t, pthread_cond_t, pthread_rwlock_t
+
+//
+#define LOCK_STAT_LIMIT 1024
+#define LOCK_HELD_LIMIT 16
+
+/**
+ * Store the statistics of one lock taken from one call site
+ */
+typedef struct lock_stat_s
+{
+  const void *lock;
+  const void *caller;
+  uint64_t nacquires;
+  uint64_t ncontended;
+  uint64_t wait_cycles;
+  uint64_t hold_cycles;
+  uint64_t cond_wait_cycles;
+} lock_stat_t;
+
+/**
+ * Store the lock statistics of one thread - open addressing hash table keyed
+ * by (lock, caller), only written by its thread
+ */
+typedef struct lock_buffer_s
+{
+  uint64_t nstats;
+  uint64_t ndropped;
+  lock_stat_t stats[LOCK_STAT_LIMIT];
+  struct lock_buffer_s *next;
+} lock_buffer_t;
+
+/**
+ * Store a lock held by the current thread
+ */
+typedef struct lock_held_s
+{
+  const void *lock;
+  lock_stat_t *stat;
+  uint64_t cycles_beg;
+} lock_held_t;
+
+/**
+ * Store the lock module information
+ */
+typedef struct lock_module_s
+{
+  pthread_mutex_t mutex;
+  lock_buffer_t *buffers;
+  uint64_t finalized;
+} lock_module_t;
+
+extern lock_module_t __lock;
+
+/**
+ * Lock module destructor - merge and write the statistics of every thread,
+ * the buffers are kept since other threads may still hold a pointer to theirs
+ */
+void liblock_finalize() __attribute__((destructor));
+
+/**
+ * Wrappers - link the program with -Wl,--wrap=SYMBOL for each of them
+ */
+int __wrap_pthread_mutex_lock(pthread_mutex_t *mutex);
+int __wrap_pthread_mutex_trylock(pthread_mutex_t *mutex);
+int __wrap_pthread_mutex_unlock(pthread_mutex_t *mutex);
+int __wrap_pthread_cond_wait(pthread_cond_t *cond, pthread_mutex_t *mutex);
+int __wrap_pthread_rwlock_rdlock(pthread_rwlock_t *rwlock);
+int __wrap_pthread_rwlock_wrlock(pthread_rwlock_t *rwlock);
+int __wrap_pthread_rwlock_tryrdlock(pthread_rwlock_t *rwlock);
+int __wrap_pthread_rwlock_trywrlock(pthread_rwlock_t *rwlock);
+int __wrap_pthread_rwlock_unlock(pthread_rwlock_t *rwlock);
+
+/**
+ * write_lock_summary - Write lock summary in stdout
+ * @param stats : merged statistics
+ * @param nstats: number of statistics
+ * @return
+ */
+void write_lock_summary(lock_stat_t *stats, uint64_t nstats);
+
+/**
+ * write_lock_info_in_csv_file - Write lock statistics in CSV file
+ * @param stats : merged statistics
+ * @param nstats: number of statistics
+ * @return
+ */
+void write_lock_info_in_csv_file(lock_stat_t *stats, uint64_t nstats);
+
+#endif // _LOCK_H_
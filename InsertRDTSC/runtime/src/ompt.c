@@ -0,0 +1,353 @@
+#define _GNU_SOURCE      // dladdr
+#include <stdio.h>       // fprintf
+#include <stdlib.h>      // aligned_alloc
+#include <stdint.h>      // uint64_t
+#include <string.h>      // memset
+#include <dlfcn.h>       // dladdr
+#include <pthread.h>     // pthread_mutex_t
+#include <omp-tools.h>   // ompt_*
+
+#include "runtime.h"
+#include "ompt.h"
+
+//
+omp_tool_t __omp;
+
+// Serialize the region lookup, done once per region instance by the master
+static pthread_mutex_t __omp_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// Begin of the barrier wait of the thread, a wait never encloses another one
+static __thread uint64_t __wait_beg = 0;
+
+// Begin of the implicit tasks run by the thread and of their loop, the task of
+// a nested region is pushed on top of the task that forks it
+static __thread uint64_t __task_beg[OMP_NESTING_LIMIT];
+static __thread uint64_t __loop_beg[OMP_NESTING_LIMIT];
+static __thread uint64_t __task_depth = 0;
+
+// Begin of the regions forked by the thread, nested regions are pushed on
+// top of the region that encloses them
+static __thread uint64_t __region_beg[OMP_NESTING_LIMIT];
+static __thread uint64_t __region_depth = 0;
+
+static void atomic_max(uint64_t *ptr, uint64_t value)
+{
+  uint64_t old = __atomic_load_n(ptr, __ATOMIC_RELAXED);
+
+  while (old < value
+         && !__atomic_compare_exchange_n(ptr, &old, value, 1,
+                                         __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+    ;
+}
+
+static omp_region_t *find_region(const void *codeptr_ra)
+{
+  omp_region_t *region = NULL;
+
+  pthread_mutex_lock(&__omp_lock);
+
+  for (uint64_t i = 0; i < __omp.nregions; i++)
+    {
+      if (__omp.regions[i].codeptr_ra == codeptr_ra)
+        {
+          region = __omp.regions + i;
+          break;
+        }
+    }
+
+  if (!region && __omp.nregions < OMP_REGION_LIMIT)
+    {
+      region = __omp.regions + __omp.nregions;
+      region->codeptr_ra = codeptr_ra;
+      __omp.nregions++;
+    }
+
+  pthread_mutex_unlock(&__omp_lock);
+
+  return region;
+}
+
+static void on_parallel_begin(__attribute__((unused)) ompt_data_t *encountering_task_data,
+                              __attribute__((unused)) const ompt_frame_t *encountering_task_frame,
+                              ompt_data_t *parallel_data,
+                              __attribute__((unused)) unsigned int requested_parallelism,
+                              __attribute__((unused)) int flags,
+                              const void *codeptr_ra)
+{
+  parallel_data->ptr = find_region(codeptr_ra);
+
+  // Deeper regions are counted but not timed
+  if (__region_depth < OMP_NESTING_LIMIT)
+    __region_beg[__region_depth] = rdtsc();
+
+  __region_depth++;
+}
+
+static void on_parallel_end(ompt_data_t *parallel_data,
+                            __attribute__((unused)) ompt_data_t *encountering_task_data,
+                            __attribute__((unused)) int flags,
+                            __attribute__((unused)) const void *codeptr_ra)
+{
+  omp_region_t *region = parallel_data->ptr;
+  uint64_t end = rdtsc();
+
+  if (__region_depth > 0)
+    __region_depth--;
+
+  if (!region)
+    return;
+
+  __atomic_fetch_add(&region->ninstances, 1, __ATOMIC_RELAXED);
+
+  if (__region_depth < OMP_NESTING_LIMIT)
+    __atomic_fetch_add(&region->cycles, end - __region_beg[__region_depth], __ATOMIC_RELAXED);
+}
+
+static void on_implicit_task(ompt_scope_endpoint_t endpoint,
+                             ompt_data_t *parallel_data,
+                             ompt_data_t *task_data,
+                             __attribute__((unused)) unsigned int actual_parallelism,
+                             unsigned int index,
+                             int flags)
+{
+  // The initial task is not part of a parallel region
+  if (flags & ompt_task_initial)
+    return;
+
+  if (endpoint == ompt_scope_begin)
+    {
+      omp_region_t *region = parallel_data ? parallel_data->ptr : NULL;
+
+      // Deeper tasks are pushed to stay balanced but are not timed
+      __task_depth++;
+      task_data->ptr = NULL;
+
+      if (!region || index >= OMP_THREAD_LIMIT || __task_depth > OMP_NESTING_LIMIT)
+        return;
+
+      task_data->ptr = region->threads + index;
+      atomic_max(&region->nthreads, (uint64_t)index + 1);
+      __task_beg[__task_depth - 1] = rdtsc();
+    }
+  else
+    {
+      omp_thread_t *thread = task_data->ptr;
+      uint64_t end = rdtsc();
+
+      if (__task_depth == 0)
+        return;
+
+      __task_depth--;
+
+      if (thread)
+        __atomic_fetch_add(&thread->task_cycles, end - __task_beg[__task_depth], __ATOMIC_RELAXED);
+    }
+}
+
+static void on_sync_region_wait(ompt_sync_region_t kind,
+                                ompt_scope_endpoint_t endpoint,
+                                __attribute__((unused)) ompt_data_t *parallel_data,
+                                ompt_data_t *task_data,
+                                __attribute__((unused)) const void *codeptr_ra)
+{
+  // Only barrier waits measure the load imbalance
+  if (kind == ompt_sync_region_taskwait || kind == ompt_sync_region_taskgroup
+      || kind == ompt_sync_region_reduction)
+    return;
+
+  omp_thread_t *thread = task_data ? task_data->ptr : NULL;
+
+  if (!thread)
+    return;
+
+  if (endpoint == ompt_scope_begin)
+    __wait_beg = rdtsc();
+  else
+    {
+      __atomic_fetch_add(&thread->wait_cycles, rdtsc() - __wait_beg, __ATOMIC_RELAXED);
+      __atomic_fetch_add(&thread->nbarriers, 1, __ATOMIC_RELAXED);
+    }
+}
+
+static void on_work(ompt_work_t wstype,
+                    ompt_scope_endpoint_t endpoint,
+                    __attribute__((unused)) ompt_data_t *parallel_data,
+                    ompt_data_t *task_data,
+                    __attribute__((unused)) uint64_t count,
+                    __attribute__((unused)) const void *codeptr_ra)
+{
+  omp_thread_t *thread = task_data ? task_data->ptr : NULL;
+
+  // Loops run inside a timed task, so the depth is in [1, OMP_NESTING_LIMIT]
+  if (wstype != ompt_work_loop || !thread
+      || __task_depth == 0 || __task_depth > OMP_NESTING_LIMIT)
+    return;
+
+  if (endpoint == ompt_scope_begin)
+    __loop_beg[__task_depth - 1] = rdtsc();
+  else
+    {
+      __atomic_fetch_add(&thread->loop_cycles, rdtsc() - __loop_beg[__task_depth - 1], __ATOMIC_RELAXED);
+      __atomic_fetch_add(&thread->nloops, 1, __ATOMIC_RELAXED);
+    }
+}
+
+static int ompt_initialize(ompt_function_lookup_t lookup,
+                           __attribute__((unused)) int initial_device_num,
+                           __attribute__((unused)) ompt_data_t *tool_data)
+{
+  ompt_set_callback_t set_callback =
+    (ompt_set_callback_t)lookup("ompt_set_callback");
+
+  __omp.nregions = 0;
+  __omp.regions = aligned_alloc(ALIGN, sizeof(omp_region_t) * OMP_REGION_LIMIT);
+
+  if (!__omp.regions)
+    return 0;
+
+  memset(__omp.regions, 0, sizeof(omp_region_t) * OMP_REGION_LIMIT);
+
+  set_callback(ompt_callback_parallel_begin, (ompt_callback_t)on_parallel_begin);
+  set_callback(ompt_callback_parallel_end, (ompt_callback_t)on_parallel_end);
+  set_callback(ompt_callback_implicit_task, (ompt_callback_t)on_implicit_task);
+  set_callback(ompt_callback_sync_region_wait, (ompt_callback_t)on_sync_region_wait);
+  set_callback(ompt_callback_work, (ompt_callback_t)on_work);
+
+  // Non-zero keeps the tool active
+  return 1;
+}
+
+static void ompt_finalize(__attribute__((unused)) ompt_data_t *tool_data)
+{
+  write_omp_region_summary();
+  write_omp_region_info_in_csv_file();
+
+  free(__omp.regions);
+  __omp.regions = NULL;
+  __omp.nregions = 0;
+}
+
+ompt_start_tool_result_t *ompt_start_tool(__attribute__((unused)) unsigned int omp_version,
+                                          __attribute__((unused)) const char *runtime_version)
+{
+  static ompt_start_tool_result_t result = { ompt_initialize, ompt_finalize, { 0 } };
+
+  return &result;
+}
+
+static const char *region_name(const omp_region_t *region)
+{
+  Dl_info info;
+
+  // Name of the function that forks the region
+  if (dladdr(region->codeptr_ra, &info) && info.dli_sname)
+    return info.dli_sname;
+
+  return "unknown";
+}
+
+static uint64_t busy_cycles(const omp_thread_t *thread)
+{
+  return thread->task_cycles > thread->wait_cycles
+    ? thread->task_cycles - thread->wait_cycles : 0;
+}
+
+void write_omp_region_summary(void)
+{
+  //
+  fflush(stdout);
+
+  //
+  fprintf(stdout,
+          "=========================== OPENMP REGIONS SUMMARY ===========================\n"
+          "\n"
+          "%18s  %8s  %8s  %16s  %16s  %16s  %9s  %s"
+          "\n",
+          "ADDRESS",
+          "CALLS",
+          "THREADS",
+          "CYCLES",
+          "BUSY AVG",
+          "WAIT AVG",
+          "IMBALANCE",
+          "FUNCTION NAME");
+
+  //
+  for (uint64_t i = 0; i < __omp.nregions; i++)
+    {
+      omp_region_t *region = __omp.regions + i;
+      uint64_t busy_max = 0;
+      uint64_t busy_sum = 0;
+      uint64_t wait_sum = 0;
+
+      for (uint64_t j = 0; j < region->nthreads; j++)
+        {
+          uint64_t busy = busy_cycles(region->threads + j);
+
+          busy_max = busy > busy_max ? busy : busy_max;
+          busy_sum += busy;
+          wait_sum += region->threads[j].wait_cycles;
+        }
+
+      // Imbalance factor: max / avg of the busy cycles, 1.0 is balanced
+      double nthreads = region->nthreads ? (double)region->nthreads : 1.0;
+      double busy_avg = (double)busy_sum / nthreads;
+      double imbalance = busy_avg > 0.0 ? (double)busy_max / busy_avg : 1.0;
+
+      fprintf(stdout, "%18p  %8ld  %8ld  %16ld  %16.0lf  %16.0lf  %9.2lf  %s\n",
+              region->codeptr_ra,
+              region->ninstances,
+              region->nthreads,
+              region->cycles,
+              busy_avg,
+              (double)wait_sum / nthreads,
+              imbalance,
+              region_name(region));
+    }
+
+  //
+  fprintf(stdout, "\n");
+  fflush(stdout);
+}
+
+void write_omp_region_info_in_csv_file(void)
+{
+  //
+  char name[OUTPUT_NAME_LIMIT];
+  get_output_name(name, sizeof(name), "omp.csv");
+
+  FILE *file = fopen(name, "w");
+
+  if (!file)
+    exit(13);
+
+  //
+  fprintf(file,
+          "ADDRESS,FUNCTION NAME,THREAD,TASK CYCLES,BUSY CYCLES,WAIT CYCLES,BARRIERS,LOOPS,LOOP CYCLES\n");
+
+  //
+  for (uint64_t i = 0; i < __omp.nregions; i++)
+    {
+      omp_region_t *region = __omp.regions + i;
+
+      for (uint64_t j = 0; j < region->nthreads; j++)
+        {
+          omp_thread_t *thread = region->threads + j;
+
+          fprintf(file, "%p,%s,%ld,%ld,%ld,%ld,%ld,%ld,%ld\n",
+                  region->codeptr_ra,
+                  region_name(region),
+                  j,
+                  thread->task_cycles,
+                  busy_cycles(thread),
+                  thread->wait_cycles,
+                  thread->nbarriers,
+                  thread->nloops,
+                  thread->loop_cycles);
+        }
+    }
+
+  //
+  fflush(file);
+  fclose(file);
+}
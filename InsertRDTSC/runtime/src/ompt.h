@@ -0,0 +1,70 @@
+#ifndef _OMPT_H_
+#define _OMPT_H_
+
+//
+#include <stdint.h>    // uint64_t
+#include <omp-tools.h> // ompt_*
+
+//
+#define OMP_REGION_LIMIT 256
+#define OMP_THREAD_LIMIT 256
+#define OMP_NESTING_LIMIT 16
+
+/**
+ * Store the time spent by one thread of a parallel region (over every
+ * instance of the region)
+ */
+typedef struct omp_thread_s
+{
+  uint64_t task_cycles;
+  uint64_t wait_cycles;
+  uint64_t nbarriers;
+  uint64_t nloops;
+  uint64_t loop_cycles;
+} omp_thread_t;
+
+/**
+ * Store a parallel region, identified by the return address of its fork
+ */
+typedef struct omp_region_s
+{
+  const void *codeptr_ra;
+  uint64_t ninstances;
+  uint64_t nthreads;
+  uint64_t cycles;
+  omp_thread_t threads[OMP_THREAD_LIMIT];
+} omp_region_t;
+
+/**
+ * Store the OMPT tool information
+ */
+typedef struct omp_tool_s
+{
+  uint64_t nregions;
+  omp_region_t *regions;
+} omp_tool_t;
+
+extern omp_tool_t __omp;
+
+/**
+ * ompt_start_tool - Entry point looked up by the OpenMP runtime
+ * @param omp_version    : OpenMP version of the runtime
+ * @param runtime_version: name of the runtime
+ * @return the tool initializer and finalizer
+ */
+ompt_start_tool_result_t *ompt_start_tool(unsigned int omp_version,
+                                          const char *runtime_version);
+
+/**
+ * write_omp_region_summary - Write per-region summary in stdout
+ * @return
+ */
+void write_omp_region_summary(void);
+
+/**
+ * write_omp_region_info_in_csv_file - Write per-thread region info in CSV file
+ * @return
+ */
+void write_omp_region_info_in_csv_file(void);
+
+#endif // _OMPT_H_
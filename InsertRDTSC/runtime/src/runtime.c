@@ -7,9 +7,19 @@
 #include <sys/sysinfo.h> // get_nprocs
 #include <sys/sysinfo.h> // get_nprocs_conf
 #include <string.h>      // strcpy
+#include <time.h>        // time, strftime
 
 #include "runtime.h"
 
+//
+function_t *__func = NULL;
+global_function_t *__glob_func = NULL;
+module_t __mod;
+
+// Stack of the active instrumented functions of the thread
+static __thread const char *__stack[STACK_LIMIT];
+static __thread uint64_t __stack_depth = 0;
+
 void libinsertrdtsc_initialize()
 {
   __func = aligned_alloc(ALIGN, sizeof(function_t) * CAPTURE_LIMIT);
@@ -35,6 +45,7 @@ void libinsertrdtsc_initialize()
   __mod.nprocs_avail = get_num_procs_available();
   __mod.nthreads = 0;
   __mod.nfuncs = 0;
+  __mod.start_time = time(NULL);
 }
 
 void libinsertrdtsc_finalize()
@@ -47,6 +58,10 @@ void insert_function(uint64_t index, uint64_t pid, uint64_t tid,
                      uint64_t proc_id_start, uint64_t proc_id_end,
                      uint64_t cycles, char *func_name)
 {
+  // Drop calls past the capture buffer
+  if (index >= CAPTURE_LIMIT)
+    return;
+
   __func[index].pid = pid;
   __func[index].tid = tid;
   __func[index].proc_id_start = proc_id_start;
@@ -57,6 +72,9 @@ void insert_function(uint64_t index, uint64_t pid, uint64_t tid,
 
 void analyze_function(uint64_t n)
 {
+  if (n > CAPTURE_LIMIT)
+    n = CAPTURE_LIMIT;
+
   // Core switch ratio
   uint64_t count_csr = 0;
 
@@ -151,8 +169,14 @@ void analyze_function(uint64_t n)
 
 void write_function_info(uint64_t n)
 {
+  if (n > CAPTURE_LIMIT)
+    n = CAPTURE_LIMIT;
+
   //
-  FILE *file = fopen("output-insert-rdtsc.raw", "w");
+  char name[OUTPUT_NAME_LIMIT];
+  get_output_name(name, sizeof(name), "raw");
+
+  FILE *file = fopen(name, "w");
 
   if (!file)
     exit(13);
@@ -193,8 +217,14 @@ void write_function_info(uint64_t n)
 
 void write_function_info_in_csv_file(uint64_t n)
 {
+  if (n > CAPTURE_LIMIT)
+    n = CAPTURE_LIMIT;
+
   //
-  FILE *file = fopen("output-insert-rdtsc.csv", "w");
+  char name[OUTPUT_NAME_LIMIT];
+  get_output_name(name, sizeof(name), "csv");
+
+  FILE *file = fopen(name, "w");
 
   if (!file)
     exit(13);
@@ -279,6 +309,47 @@ void write_module_summary(void)
   fflush(stdout);
 }
 
+void enter_function(const char *func_name)
+{
+  // Deeper calls are counted but not stored
+  if (__stack_depth < STACK_LIMIT)
+    __stack[__stack_depth] = func_name;
+
+  __stack_depth++;
+}
+
+void exit_function(void)
+{
+  if (__stack_depth > 0)
+    __stack_depth--;
+}
+
+const char *get_current_function(void)
+{
+  if (__stack_depth == 0)
+    return NULL;
+
+  return __stack_depth <= STACK_LIMIT ? __stack[__stack_depth - 1] : __stack[STACK_LIMIT - 1];
+}
+
+void get_output_name(char *name, uint64_t size, const char *ext)
+{
+  char host[HOST_NAME_LIMIT];
+  char date[32];
+
+  if (gethostname(host, sizeof(host)) != 0)
+    strcpy(host, "unknown");
+  host[sizeof(host) - 1] = '\0';
+
+  // Every process of the run shares the timestamp taken at load time
+  struct tm tm;
+  localtime_r(&__mod.start_time, &tm);
+  strftime(date, sizeof(date), "%Y%m%d-%H%M%S", &tm);
+
+  snprintf(name, size, "output-insert-rdtsc-%s-%ld-%s.%s",
+           host, get_pid(), date, ext);
+}
+
 uint64_t rdtsc(void)
 {
     uint32_t lo, hi;
@@ -4,10 +4,14 @@
 //
 #include <stdint.h>    // uint64_t
 #include <sys/types.h> // pid_t
+#include <time.h>      // time_t
 
 //
 #define ALIGN 32
 #define CAPTURE_LIMIT 10000
+#define HOST_NAME_LIMIT 64
+#define OUTPUT_NAME_LIMIT 256
+#define STACK_LIMIT 1024
 
 /**
  * Store function information (a call)
@@ -22,7 +26,7 @@ typedef struct function_s
   char func_name[256];
 } function_t;
 
-function_t *__func = NULL;
+extern function_t *__func;
 
 /**
  * Store global function information
@@ -36,7 +40,7 @@ typedef struct global_function_s
   char func_name[256];
 } global_function_t;
 
-global_function_t *__glob_func = NULL;
+extern global_function_t *__glob_func;
 
 /**
  * Store module information
@@ -49,9 +53,10 @@ typedef struct module_s
   uint64_t nfuncs;
   double core_switch_ratio;
   uint64_t list_threads[256];
+  time_t start_time;
 } module_t;
 
-module_t __mod;
+extern module_t __mod;
 
 /**
  * Library constructor - called ahen the library is loaded
@@ -110,6 +115,37 @@ void write_function_summary();
  */
 void write_module_summary(void);
 
+/**
+ * enter_function - Push a function on the stack of the current thread
+ *                  (inserted by the pass with -insert-rdtsc-stack)
+ * @param func_name: function name
+ * @return
+ */
+void enter_function(const char *func_name);
+
+/**
+ * exit_function - Pop the top function of the stack of the current thread
+ * @return
+ */
+void exit_function(void);
+
+/**
+ * get_current_function - Get the innermost active instrumented function of
+ *                        the current thread
+ * @return the function name or NULL outside of instrumented functions
+ */
+const char *get_current_function(void);
+
+/**
+ * get_output_name - Build the name of an output file of this run
+ *                   (output-insert-rdtsc-HOST-PID-DATE.EXT)
+ * @param name: buffer to fill
+ * @param size: size of the buffer
+ * @param ext : file extension
+ * @return
+ */
+void get_output_name(char *name, uint64_t size, const char *ext);
+
 /**
  * rdtsc - ReaD Time-Stamp Counter
  * @return the time-stamp counter
@@ -0,0 +1,469 @@
+#define _GNU_SOURCE   // dladdr
+#include <stdio.h>    // fprintf, snprintf
+#include <stdlib.h>   // calloc, qsort
+#include <stdint.h>   // uint64_t, int64_t
+#include <dlfcn.h>    // dladdr
+#include <sys/mman.h> // mmap, munmap
+
+#include "runtime.h"
+#include "values.h"
+
+//
+value_module_t __values = { 0, 0, { { 0 } }, 0, { { 0 } }, NULL };
+
+// Tables of the current thread
+static __thread value_thread_t *__value_thread = NULL;
+
+static void *map(uint64_t size)
+{
+  // Pages are only touched by the slots that run
+  void *ptr = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+  return ptr == MAP_FAILED ? NULL : ptr;
+}
+
+static uint64_t register_slots(value_kind_t kind, uint64_t nslots,
+                               const char **func_names, const uint64_t *indexes)
+{
+  uint64_t base = __atomic_fetch_add(&__values.nslots, nslots, __ATOMIC_RELAXED);
+  uint64_t m = __atomic_fetch_add(&__values.nmodules, 1, __ATOMIC_RELAXED);
+
+  if (m >= VALUE_MODULE_LIMIT || base + nslots > VALUE_SLOT_LIMIT)
+    {
+      fprintf(stderr, "insertrdtsc: too many arguments and call sites, increase VALUE_SLOT_LIMIT\n");
+
+      // Out of range, the values of the module are not counted
+      return VALUE_SLOT_LIMIT;
+    }
+
+  __values.modules[m].kind = kind;
+  __values.modules[m].base = base;
+  __values.modules[m].nslots = nslots;
+  __values.modules[m].func_names = func_names;
+  __values.modules[m].indexes = indexes;
+
+  return base;
+}
+
+uint64_t insert_value_register(uint64_t nslots, const char **func_names,
+                               const uint64_t *args)
+{
+  return register_slots(VALUE_ARGUMENT, nslots, func_names, args);
+}
+
+uint64_t insert_target_register(uint64_t nsites, const char **func_names,
+                                const uint64_t *sites, uint64_t nfuncs,
+                                void **funcs, const char **names)
+{
+  uint64_t m = __atomic_fetch_add(&__values.nfunctions, 1, __ATOMIC_RELAXED);
+
+  if (m < VALUE_MODULE_LIMIT)
+    {
+      __values.functions[m].nfuncs = nfuncs;
+      __values.functions[m].funcs = funcs;
+      __values.functions[m].names = names;
+    }
+
+  return register_slots(VALUE_TARGET, nsites, func_names, sites);
+}
+
+static value_thread_t *get_thread(void)
+{
+  if (__value_thread)
+    return __value_thread;
+
+  value_thread_t *thread = calloc(1, sizeof(value_thread_t));
+
+  if (!thread)
+    return NULL;
+
+  thread->entries = map(sizeof(value_entry_t) * VALUE_SLOT_LIMIT * VALUE_TOP_K);
+  thread->calls = map(sizeof(uint64_t) * VALUE_SLOT_LIMIT);
+
+  if (!thread->entries || !thread->calls)
+    {
+      if (thread->entries)
+        munmap(thread->entries, sizeof(value_entry_t) * VALUE_SLOT_LIMIT * VALUE_TOP_K);
+      if (thread->calls)
+        munmap(thread->calls, sizeof(uint64_t) * VALUE_SLOT_LIMIT);
+      free(thread);
+      return NULL;
+    }
+
+  // Tables outlive their thread, they are merged by the destructor
+  thread->next = __atomic_load_n(&__values.threads, __ATOMIC_ACQUIRE);
+
+  while (!__atomic_compare_exchange_n(&__values.threads, &thread->next, thread, 1,
+                                      __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+    ;
+
+  __value_thread = thread;
+  return thread;
+}
+
+static void count_value(uint64_t id, int64_t value)
+{
+  value_thread_t *thread = get_thread();
+
+  if (!thread || id >= VALUE_SLOT_LIMIT)
+    return;
+
+  value_entry_t *e = thread->entries + id * VALUE_TOP_K;
+  uint64_t min = 0;
+
+  thread->calls[id]++;
+
+  for (uint64_t i = 0; i < VALUE_TOP_K; i++)
+    {
+      if (e[i].value == value && e[i].count)
+        {
+          e[i].count++;
+
+          // Keep the hottest values first, so that they are found at once
+          if (i > 0 && e[i].count > e[i - 1].count)
+            {
+              value_entry_t tmp = e[i - 1];
+              e[i - 1] = e[i];
+              e[i] = tmp;
+            }
+
+          return;
+        }
+
+      if (!e[i].count)
+        {
+          e[i].value = value;
+          e[i].count = 1;
+          return;
+        }
+
+      if (e[i].count < e[min].count)
+        min = i;
+    }
+
+  // Space-saving: the new value inherits the count of the coldest one
+  e[min].value = value;
+  e[min].count++;
+}
+
+void insert_value(uint64_t id, int64_t value)
+{
+  count_value(id, value);
+}
+
+void insert_target(uint64_t id, void *target)
+{
+  count_value(id, (int64_t)(uintptr_t)target);
+}
+
+static int compare_value(const void *a, const void *b)
+{
+  const value_entry_t *ea = a;
+  const value_entry_t *eb = b;
+
+  return (ea->value > eb->value) - (ea->value < eb->value);
+}
+
+static int compare_count(const void *a, const void *b)
+{
+  const value_entry_t *ea = a;
+  const value_entry_t *eb = b;
+
+  return (ea->count < eb->count) - (ea->count > eb->count);
+}
+
+// Merge the entries of every thread for one slot, keep the VALUE_TOP_K
+// hottest in merged
+static void merge_slot(uint64_t id, value_entry_t *tmp, value_entry_t *merged)
+{
+  uint64_t n = 0;
+
+  for (value_thread_t *thread = __values.threads; thread; thread = thread->next)
+    for (uint64_t i = 0; i < VALUE_TOP_K; i++)
+      if (thread->entries[id * VALUE_TOP_K + i].count)
+        tmp[n++] = thread->entries[id * VALUE_TOP_K + i];
+
+  qsort(tmp, n, sizeof(value_entry_t), compare_value);
+
+  uint64_t m = 0;
+
+  for (uint64_t i = 0; i < n; i++)
+    {
+      if (m > 0 && tmp[m - 1].value == tmp[i].value)
+        tmp[m - 1].count += tmp[i].count;
+      else
+        tmp[m++] = tmp[i];
+    }
+
+  qsort(tmp, m, sizeof(value_entry_t), compare_count);
+
+  for (uint64_t i = 0; i < m && i < VALUE_TOP_K; i++)
+    merged[i] = tmp[i];
+}
+
+static int has_kind(value_kind_t kind)
+{
+  for (uint64_t m = 0; m < __values.nmodules && m < VALUE_MODULE_LIMIT; m++)
+    if (__values.modules[m].kind == kind && __values.modules[m].nslots)
+      return 1;
+
+  return 0;
+}
+
+// Name of a target: address-taken function of an instrumented module, else
+// dynamic symbol, else address
+static const char *target_name(int64_t value, char *buffer, uint64_t size)
+{
+  void *target = (void *)(uintptr_t)value;
+  Dl_info info;
+
+  for (uint64_t m = 0; m < __values.nfunctions && m < VALUE_MODULE_LIMIT; m++)
+    for (uint64_t i = 0; i < __values.functions[m].nfuncs; i++)
+      if (__values.functions[m].funcs[i] == target)
+        return __values.functions[m].names[i];
+
+  if (dladdr(target, &info) && info.dli_sname && info.dli_saddr == target)
+    return info.dli_sname;
+
+  snprintf(buffer, size, "%p", target);
+  return buffer;
+}
+
+void libvalues_finalize()
+{
+  if (!__values.threads)
+    return;
+
+  uint64_t nslots = __values.nslots < VALUE_SLOT_LIMIT ? __values.nslots : VALUE_SLOT_LIMIT;
+  uint64_t nthreads = 0;
+
+  for (value_thread_t *thread = __values.threads; thread; thread = thread->next)
+    nthreads++;
+
+  value_entry_t *entries = calloc(nslots * VALUE_TOP_K + 1, sizeof(value_entry_t));
+  value_entry_t *tmp = calloc(nthreads * VALUE_TOP_K, sizeof(value_entry_t));
+  uint64_t *calls = calloc(nslots + 1, sizeof(uint64_t));
+
+  if (entries && tmp && calls)
+    {
+      for (uint64_t id = 0; id < nslots; id++)
+        {
+          for (value_thread_t *thread = __values.threads; thread; thread = thread->next)
+            calls[id] += thread->calls[id];
+
+          if (calls[id])
+            merge_slot(id, tmp, entries + id * VALUE_TOP_K);
+        }
+
+      if (has_kind(VALUE_ARGUMENT))
+        {
+          write_value_summary(entries, calls);
+          write_value_info_in_csv_file(entries, calls);
+        }
+
+      if (has_kind(VALUE_TARGET))
+        {
+          write_target_summary(entries, calls);
+          write_target_info_in_csv_file(entries, calls);
+        }
+    }
+
+  value_thread_t *thread = __values.threads;
+
+  while (thread)
+    {
+      value_thread_t *next = thread->next;
+
+      munmap(thread->entries, sizeof(value_entry_t) * VALUE_SLOT_LIMIT * VALUE_TOP_K);
+      munmap(thread->calls, sizeof(uint64_t) * VALUE_SLOT_LIMIT);
+      free(thread);
+      thread = next;
+    }
+
+  __values.threads = NULL;
+
+  free(calls);
+  free(tmp);
+  free(entries);
+}
+
+void write_value_summary(const value_entry_t *entries, const uint64_t *calls)
+{
+  //
+  fflush(stdout);
+
+  //
+  fprintf(stdout,
+          "=============================== VALUES SUMMARY ===============================\n"
+          "\n"
+          "%16s  %20s  %10s  %8s  %s"
+          "\n",
+          "CALLS",
+          "HOTTEST VALUE",
+          "RATE",
+          "ARGUMENT",
+          "FUNCTION NAME");
+
+  //
+  for (uint64_t m = 0; m < __values.nmodules && m < VALUE_MODULE_LIMIT; m++)
+    {
+      value_slots_t *mod = __values.modules + m;
+
+      if (mod->kind != VALUE_ARGUMENT)
+        continue;
+
+      for (uint64_t i = 0; i < mod->nslots; i++)
+        {
+          uint64_t id = mod->base + i;
+
+          if (!calls[id])
+            continue;
+
+          fprintf(stdout, "%16ld  %20ld  %8.2lf %c  %8ld  %s\n",
+                  calls[id],
+                  entries[id * VALUE_TOP_K].value,
+                  100.0 * entries[id * VALUE_TOP_K].count / calls[id],
+                  '%',
+                  mod->indexes[i],
+                  mod->func_names[i]);
+        }
+    }
+
+  //
+  fprintf(stdout, "\n");
+  fflush(stdout);
+}
+
+void write_value_info_in_csv_file(const value_entry_t *entries, const uint64_t *calls)
+{
+  //
+  char name[OUTPUT_NAME_LIMIT];
+  get_output_name(name, sizeof(name), "values.csv");
+
+  FILE *file = fopen(name, "w");
+
+  if (!file)
+    exit(13);
+
+  //
+  fprintf(file, "FUNCTION NAME,ARGUMENT,CALLS,VALUE,COUNT\n");
+
+  //
+  for (uint64_t m = 0; m < __values.nmodules && m < VALUE_MODULE_LIMIT; m++)
+    {
+      value_slots_t *mod = __values.modules + m;
+
+      if (mod->kind != VALUE_ARGUMENT)
+        continue;
+
+      for (uint64_t i = 0; i < mod->nslots; i++)
+        {
+          uint64_t id = mod->base + i;
+
+          for (uint64_t k = 0; k < VALUE_TOP_K && entries[id * VALUE_TOP_K + k].count; k++)
+            fprintf(file, "%s,%ld,%ld,%ld,%ld\n",
+                    mod->func_names[i],
+                    mod->indexes[i],
+                    calls[id],
+                    entries[id * VALUE_TOP_K + k].value,
+                    entries[id * VALUE_TOP_K + k].count);
+        }
+    }
+
+  //
+  fflush(file);
+  fclose(file);
+}
+
+void write_target_summary(const value_entry_t *entries, const uint64_t *calls)
+{
+  char buffer[32];
+
+  //
+  fflush(stdout);
+
+  //
+  fprintf(stdout,
+          "=============================== TARGETS SUMMARY ==============================\n"
+          "\n"
+          "%16s  %10s  %8s  %-24s  %s"
+          "\n",
+          "CALLS",
+          "RATE",
+          "SITE",
+          "FUNCTION NAME",
+          "HOTTEST TARGET");
+
+  //
+  for (uint64_t m = 0; m < __values.nmodules && m < VALUE_MODULE_LIMIT; m++)
+    {
+      value_slots_t *mod = __values.modules + m;
+
+      if (mod->kind != VALUE_TARGET)
+        continue;
+
+      for (uint64_t i = 0; i < mod->nslots; i++)
+        {
+          uint64_t id = mod->base + i;
+
+          if (!calls[id])
+            continue;
+
+          fprintf(stdout, "%16ld  %8.2lf %c  %8ld  %-24s  %s\n",
+                  calls[id],
+                  100.0 * entries[id * VALUE_TOP_K].count / calls[id],
+                  '%',
+                  mod->indexes[i],
+                  mod->func_names[i],
+                  target_name(entries[id * VALUE_TOP_K].value, buffer, sizeof(buffer)));
+        }
+    }
+
+  //
+  fprintf(stdout, "\n");
+  fflush(stdout);
+}
+
+void write_target_info_in_csv_file(const value_entry_t *entries, const uint64_t *calls)
+{
+  char buffer[32];
+
+  //
+  char name[OUTPUT_NAME_LIMIT];
+  get_output_name(name, sizeof(name), "targets.csv");
+
+  FILE *file = fopen(name, "w");
+
+  if (!file)
+    exit(13);
+
+  //
+  fprintf(file, "FUNCTION NAME,SITE,CALLS,TARGET,COUNT\n");
+
+  //
+  for (uint64_t m = 0; m < __values.nmodules && m < VALUE_MODULE_LIMIT; m++)
+    {
+      value_slots_t *mod = __values.modules + m;
+
+      if (mod->kind != VALUE_TARGET)
+        continue;
+
+      for (uint64_t i = 0; i < mod->nslots; i++)
+        {
+          uint64_t id = mod->base + i;
+
+          for (uint64_t k = 0; k < VALUE_TOP_K && entries[id * VALUE_TOP_K + k].count; k++)
+            fprintf(file, "%s,%ld,%ld,%s,%ld\n",
+                    mod->func_names[i],
+                    mod->indexes[i],
+                    calls[id],
+                    target_name(entries[id * VALUE_TOP_K + k].value, buffer, sizeof(buffer)),
+                    entries[id * VALUE_TOP_K + k].count);
+        }
+    }
+
+  //
+  fflush(file);
+  fclose(file);
+}
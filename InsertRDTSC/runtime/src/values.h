@@ -0,0 +1,171 @@
+#ifndef _VALUES_H_
+#define _VALUES_H_
+
+//
+#include <stdint.h> // uint64_t, int64_t
+
+//
+#define VALUE_SLOT_LIMIT (1 << 16)
+#define VALUE_MODULE_LIMIT 1024
+#define VALUE_TOP_K 8
+
+/**
+ * Store one of the hottest values of an argument and its count
+ */
+typedef struct value_entry_s
+{
+  int64_t value;
+  uint64_t count;
+} value_entry_t;
+
+/**
+ * Kind of the slots of a module
+ */
+typedef enum value_kind_e
+{
+  VALUE_ARGUMENT, // integer argument of a function
+  VALUE_TARGET    // callee of an indirect call site
+} value_kind_t;
+
+/**
+ * Store the profiled arguments or call sites of an instrumented module: slot
+ * base + i is argument (or indirect call site) indexes[i] of function
+ * func_names[i]
+ */
+typedef struct value_slots_s
+{
+  value_kind_t kind;
+  uint64_t base;
+  uint64_t nslots;
+  const char **func_names;
+  const uint64_t *indexes;
+} value_slots_t;
+
+/**
+ * Store the address-taken functions of an instrumented module, to name the
+ * targets of its indirect calls (static functions included)
+ */
+typedef struct value_functions_s
+{
+  uint64_t nfuncs;
+  void **funcs;
+  const char **names;
+} value_functions_t;
+
+/**
+ * Store the tables of one thread: the VALUE_TOP_K entries of slot id start at
+ * entries[id * VALUE_TOP_K], calls[id] counts every value seen by the slot.
+ * Only written by its thread (space-saving top-K, no atomics)
+ */
+typedef struct value_thread_s
+{
+  value_entry_t *entries;
+  uint64_t *calls;
+  struct value_thread_s *next;
+} value_thread_t;
+
+/**
+ * Store the value module information
+ */
+typedef struct value_module_s
+{
+  uint64_t nslots;
+  uint64_t nmodules;
+  value_slots_t modules[VALUE_MODULE_LIMIT];
+  uint64_t nfunctions;
+  value_functions_t functions[VALUE_MODULE_LIMIT];
+  value_thread_t *threads;
+} value_module_t;
+
+extern value_module_t __values;
+
+/**
+ * Value module destructor - merge the tables of every thread and write the
+ * hottest values of every argument and targets of every indirect call site
+ */
+void libvalues_finalize() __attribute__((destructor));
+
+/**
+ * insert_value_register - Register the profiled arguments of a module (called
+ *                         by the module constructor inserted by the pass with
+ *                         -insert-rdtsc-values)
+ * @param nslots    : number of profiled arguments of the module
+ * @param func_names: function of each argument
+ * @param args      : position of each argument in its function
+ * @return the id of the first slot of the module, VALUE_SLOT_LIMIT (ignored
+ *         by insert_value) when the module does not fit
+ */
+uint64_t insert_value_register(uint64_t nslots, const char **func_names,
+                               const uint64_t *args);
+
+/**
+ * insert_value - Count a value of an argument in the table of the current
+ *                thread
+ * @param id   : slot id
+ * @param value: argument value, sign extended to 64 bits
+ * @return
+ */
+void insert_value(uint64_t id, int64_t value);
+
+/**
+ * insert_target_register - Register the indirect call sites of a module
+ *                          (called by the module constructor inserted by the
+ *                          pass with -insert-rdtsc-targets)
+ * @param nsites    : number of indirect call sites of the module
+ * @param func_names: function of each call site
+ * @param sites     : index of each call site in its function
+ * @param nfuncs    : number of address-taken functions of the module
+ * @param funcs     : address-taken functions
+ * @param names     : name of each address-taken function
+ * @return the id of the first slot of the module, VALUE_SLOT_LIMIT (ignored
+ *         by insert_target) when the module does not fit
+ */
+uint64_t insert_target_register(uint64_t nsites, const char **func_names,
+                                const uint64_t *sites, uint64_t nfuncs,
+                                void **funcs, const char **names);
+
+/**
+ * insert_target - Count the callee of an indirect call in the table of the
+ *                 current thread
+ * @param id    : slot id
+ * @param target: called function
+ * @return
+ */
+void insert_target(uint64_t id, void *target);
+
+/**
+ * write_value_summary - Write the hottest value of every argument in stdout
+ * @param entries: merged entries, sorted by count in each slot
+ * @param calls  : merged calls
+ * @return
+ */
+void write_value_summary(const value_entry_t *entries, const uint64_t *calls);
+
+/**
+ * write_value_info_in_csv_file - Write the hottest values of every argument
+ *                                in CSV file
+ * @param entries: merged entries, sorted by count in each slot
+ * @param calls  : merged calls
+ * @return
+ */
+void write_value_info_in_csv_file(const value_entry_t *entries, const uint64_t *calls);
+
+/**
+ * write_target_summary - Write the hottest target of every indirect call site
+ *                        in stdout
+ * @param entries: merged entries, sorted by count in each slot
+ * @param calls  : merged calls
+ * @return
+ */
+void write_target_summary(const value_entry_t *entries, const uint64_t *calls);
+
+/**
+ * write_target_info_in_csv_file - Write the hottest targets of every indirect
+ *                                 call site in CSV file
+ * @param entries: merged entries, sorted by count in each slot
+ * @param calls  : merged calls
+ * @return
+ */
+void write_target_info_in_csv_file(const value_entry_t *entries, const uint64_t *calls);
+
+#endif // _VALUES_H_
@@ -0,0 +1,253 @@
+#include <stdio.h>       // fprintf
+#include <stdlib.h>      // atoi, atof
+#include <stdint.h>      // uint64_t
+#include <string.h>      // strcmp
+#include <math.h>        // sqrt, erf
+#include <unistd.h>      // getopt
+#include <pthread.h>     // pthread_create, pthread_join
+#include <stdatomic.h>   // atomic_fetch_add
+#include <sys/sysinfo.h> // get_nprocs
+
+#include "profile.h"
+
+//
+#define DEFAULT_THRESHOLD 0.05
+#define DEFAULT_CONFIDENCE 0.95
+
+/**
+ * Shared state of the merge workers
+ */
+typedef struct merge_s
+{
+  char **paths;
+  uint64_t npaths;
+  atomic_uint_fast64_t next;
+  int error;
+} merge_t;
+
+static void usage(const char *prog)
+{
+  fprintf(stderr,
+          "usage: %s merge [-j JOBS] [-o OUTPUT] PROFILE...\n"
+          "       %s diff [-t THRESHOLD] [-c CONFIDENCE] BASE NEW\n"
+          "\n"
+          "merge: merge raw run outputs and indexed profiles into one indexed\n"
+          "       profile\n"
+          "diff : compare the mean cycles per call of two profiles, exit with 2\n"
+          "       when a function is slower by more than THRESHOLD (default %.2f)\n"
+          "       with a confidence of at least CONFIDENCE (default %.2f)\n",
+          prog, prog, DEFAULT_THRESHOLD, DEFAULT_CONFIDENCE);
+  exit(1);
+}
+
+static void *merge_worker(void *arg)
+{
+  merge_t *m = arg;
+  profile_t *prof = malloc(sizeof(profile_t));
+
+  if (!prof)
+    exit(12);
+
+  profile_init(prof);
+
+  for (uint64_t i = atomic_fetch_add(&m->next, 1); i < m->npaths;
+       i = atomic_fetch_add(&m->next, 1))
+    {
+      if (profile_read(prof, m->paths[i]) != 0)
+        {
+          fprintf(stderr, "cannot read profile: %s\n", m->paths[i]);
+          m->error = 1;
+        }
+    }
+
+  return prof;
+}
+
+static int merge(int argc, char **argv)
+{
+  uint64_t njobs = get_nprocs();
+  const char *output = NULL;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "j:o:")) != -1)
+    {
+      switch (opt)
+        {
+        case 'j': njobs = strtoull(optarg, NULL, 10); break;
+        case 'o': output = optarg; break;
+        default: usage("rdtsc-prof");
+        }
+    }
+
+  if (optind >= argc)
+    usage("rdtsc-prof");
+
+  merge_t m = { argv + optind, argc - optind, 0, 0 };
+
+  if (njobs == 0)
+    njobs = 1;
+  if (njobs > m.npaths)
+    njobs = m.npaths;
+
+  // Each worker reads whole files into its own profile, the partial profiles
+  // are reduced at the end
+  pthread_t *workers = malloc(sizeof(pthread_t) * njobs);
+  profile_t result;
+
+  if (!workers)
+    exit(12);
+
+  profile_init(&result);
+
+  for (uint64_t i = 0; i < njobs; i++)
+    pthread_create(workers + i, NULL, merge_worker, &m);
+
+  for (uint64_t i = 0; i < njobs; i++)
+    {
+      profile_t *prof;
+      pthread_join(workers[i], (void **)&prof);
+      profile_merge(&result, prof);
+      profile_free(prof);
+      free(prof);
+    }
+
+  free(workers);
+
+  FILE *file = output ? fopen(output, "w") : stdout;
+
+  if (!file)
+    {
+      fprintf(stderr, "cannot open output: %s\n", output);
+      exit(13);
+    }
+
+  profile_write(&result, file);
+
+  if (output)
+    fclose(file);
+
+  profile_free(&result);
+
+  return m.error;
+}
+
+/**
+ * Two-sided confidence that the means of two entries differ, from the Welch
+ * t statistic approximated by a normal distribution
+ */
+static double confidence(const profile_entry_t *a, const profile_entry_t *b)
+{
+  double ma = profile_mean(a);
+  double mb = profile_mean(b);
+
+  if (a->ncalls < 2 || b->ncalls < 2)
+    return 0.0;
+
+  double se = sqrt(profile_variance(a) / (double)a->ncalls
+                   + profile_variance(b) / (double)b->ncalls);
+
+  if (se == 0.0)
+    return ma == mb ? 0.0 : 1.0;
+
+  return erf(fabs(mb - ma) / se / sqrt(2.0));
+}
+
+static int diff(int argc, char **argv)
+{
+  double threshold = DEFAULT_THRESHOLD;
+  double level = DEFAULT_CONFIDENCE;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "t:c:")) != -1)
+    {
+      switch (opt)
+        {
+        case 't': threshold = atof(optarg); break;
+        case 'c': level = atof(optarg); break;
+        default: usage("rdtsc-prof");
+        }
+    }
+
+  if (argc - optind != 2)
+    usage("rdtsc-prof");
+
+  profile_t base;
+  profile_t new;
+
+  profile_init(&base);
+  profile_init(&new);
+
+  for (int i = 0; i < 2; i++)
+    {
+      if (profile_read(i == 0 ? &base : &new, argv[optind + i]) != 0)
+        {
+          fprintf(stderr, "cannot read profile: %s\n", argv[optind + i]);
+          exit(13);
+        }
+    }
+
+  fprintf(stdout,
+          "FUNCTION NAME,CALLS BASE,CALLS NEW,MEAN BASE,MEAN NEW,RATIO,CONFIDENCE,STATUS\n");
+
+  int regression = 0;
+  const profile_entry_t **sorted = profile_sorted(&new);
+
+  for (uint64_t i = 0; i < new.size; i++)
+    {
+      const profile_entry_t *n = sorted[i];
+      const profile_entry_t *b = profile_lookup(&base, n->func_name);
+
+      if (!b)
+        {
+          fprintf(stdout, "%s,0,%lu,,%.2lf,,,added\n",
+                  n->func_name, n->ncalls, profile_mean(n));
+          continue;
+        }
+
+      double ratio = profile_mean(b) > 0.0 ? profile_mean(n) / profile_mean(b) : 1.0;
+      double conf = confidence(b, n);
+      const char *status = "same";
+
+      if (conf >= level && ratio > 1.0 + threshold)
+        {
+          status = "slower";
+          regression = 1;
+        }
+      else if (conf >= level && ratio < 1.0 - threshold)
+        status = "faster";
+
+      fprintf(stdout, "%s,%lu,%lu,%.2lf,%.2lf,%.4lf,%.4lf,%s\n",
+              n->func_name, b->ncalls, n->ncalls,
+              profile_mean(b), profile_mean(n), ratio, conf, status);
+    }
+
+  free(sorted);
+  sorted = profile_sorted(&base);
+
+  for (uint64_t i = 0; i < base.size; i++)
+    {
+      if (!profile_lookup(&new, sorted[i]->func_name))
+        fprintf(stdout, "%s,%lu,0,%.2lf,,,,removed\n",
+                sorted[i]->func_name, sorted[i]->ncalls, profile_mean(sorted[i]));
+    }
+
+  free(sorted);
+  profile_free(&new);
+  profile_free(&base);
+
+  return regression ? 2 : 0;
+}
+
+int main(int argc, char **argv)
+{
+  if (argc < 2)
+    usage(argv[0]);
+
+  if (strcmp(argv[1], "merge") == 0)
+    return merge(argc - 1, argv + 1);
+  else if (strcmp(argv[1], "diff") == 0)
+    return diff(argc - 1, argv + 1);
+
+  usage(argv[0]);
+  return 1;
+}
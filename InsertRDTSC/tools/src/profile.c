@@ -0,0 +1,289 @@
+#include <stdio.h>  // fopen, fprintf
+#include <stdlib.h> // calloc, free, strtoull
+#include <stdint.h> // uint64_t
+#include <string.h> // strncmp, strncpy
+
+#include "profile.h"
+
+//
+#define RAW_HEADER "PID,TID,CORE ID START,CORE ID END,CYCLES,FUNCTION NAME"
+#define INDEXED_HEADER "INDEX,FUNCTION NAME,CALLS,RUNS,CYCLES SUM,CYCLES SUM SQ,CYCLES MIN,CYCLES MAX"
+
+// Names are stored cut to FUNC_NAME_LIMIT - 1 characters: they are hashed and
+// compared the same way, so that a long name always finds its entry
+static uint64_t hash(const char *str)
+{
+  // FNV-1a
+  uint64_t h = 14695981039346656037UL;
+
+  for (uint64_t n = 0; *str && n < FUNC_NAME_LIMIT - 1; str++, n++)
+    {
+      h ^= (unsigned char)*str;
+      h *= 1099511628211UL;
+    }
+
+  return h;
+}
+
+static void profile_alloc(profile_t *prof, uint64_t capacity)
+{
+  prof->size = 0;
+  prof->capacity = capacity;
+  prof->entries = calloc(capacity, sizeof(profile_entry_t));
+
+  if (!prof->entries)
+    exit(12);
+}
+
+static void profile_grow(profile_t *prof)
+{
+  profile_t old = *prof;
+
+  profile_alloc(prof, old.capacity * 2);
+
+  for (uint64_t i = 0; i < old.capacity; i++)
+    {
+      if (old.entries[i].func_name[0] != '\0')
+        *profile_find(prof, old.entries[i].func_name) = old.entries[i];
+    }
+
+  free(old.entries);
+}
+
+void profile_init(profile_t *prof)
+{
+  profile_alloc(prof, PROFILE_INITIAL_CAPACITY);
+}
+
+void profile_free(profile_t *prof)
+{
+  free(prof->entries);
+  prof->entries = NULL;
+  prof->size = 0;
+  prof->capacity = 0;
+}
+
+profile_entry_t *profile_lookup(const profile_t *prof, const char *func_name)
+{
+  uint64_t mask = prof->capacity - 1;
+
+  for (uint64_t i = hash(func_name) & mask;; i = (i + 1) & mask)
+    {
+      profile_entry_t *e = prof->entries + i;
+
+      if (e->func_name[0] == '\0')
+        return NULL;
+
+      if (strncmp(e->func_name, func_name, FUNC_NAME_LIMIT - 1) == 0)
+        return e;
+    }
+}
+
+profile_entry_t *profile_find(profile_t *prof, const char *func_name)
+{
+  // Keep the load factor under 1/2
+  if (2 * (prof->size + 1) > prof->capacity)
+    profile_grow(prof);
+
+  uint64_t mask = prof->capacity - 1;
+
+  for (uint64_t i = hash(func_name) & mask;; i = (i + 1) & mask)
+    {
+      profile_entry_t *e = prof->entries + i;
+
+      if (e->func_name[0] == '\0')
+        {
+          strncpy(e->func_name, func_name, FUNC_NAME_LIMIT - 1);
+          e->cycles_min = UINT64_MAX;
+          prof->size++;
+          return e;
+        }
+
+      if (strncmp(e->func_name, func_name, FUNC_NAME_LIMIT - 1) == 0)
+        return e;
+    }
+}
+
+void profile_add_call(profile_t *prof, const char *func_name, uint64_t cycles)
+{
+  profile_entry_t *e = profile_find(prof, func_name);
+
+  e->ncalls++;
+  e->nruns = 1;
+  e->cycles_sum += (double)cycles;
+  e->cycles_sum_sq += (double)cycles * (double)cycles;
+  e->cycles_min = cycles < e->cycles_min ? cycles : e->cycles_min;
+  e->cycles_max = cycles > e->cycles_max ? cycles : e->cycles_max;
+}
+
+static void merge_entry(profile_entry_t *d, const profile_entry_t *s)
+{
+  d->ncalls += s->ncalls;
+  d->nruns += s->nruns;
+  d->cycles_sum += s->cycles_sum;
+  d->cycles_sum_sq += s->cycles_sum_sq;
+  d->cycles_min = s->cycles_min < d->cycles_min ? s->cycles_min : d->cycles_min;
+  d->cycles_max = s->cycles_max > d->cycles_max ? s->cycles_max : d->cycles_max;
+}
+
+void profile_merge(profile_t *dst, const profile_t *src)
+{
+  for (uint64_t i = 0; i < src->capacity; i++)
+    {
+      const profile_entry_t *s = src->entries + i;
+
+      if (s->func_name[0] == '\0')
+        continue;
+
+      merge_entry(profile_find(dst, s->func_name), s);
+    }
+}
+
+static void strip_newline(char *line)
+{
+  line[strcspn(line, "\r\n")] = '\0';
+}
+
+static int read_raw(profile_t *prof, FILE *file)
+{
+  char line[LINE_LIMIT];
+  profile_t run;
+
+  // Accumulate in a local profile so that each function counts one run
+  profile_init(&run);
+
+  while (fgets(line, sizeof(line), file))
+    {
+      strip_newline(line);
+
+      // PID,TID,CORE ID START,CORE ID END,CYCLES,FUNCTION NAME
+      char *field = line;
+      for (int i = 0; i < 4 && field; i++)
+        {
+          field = strchr(field, ',');
+          field = field ? field + 1 : NULL;
+        }
+
+      char *func_name = field ? strchr(field, ',') : NULL;
+      if (!func_name)
+        continue;
+
+      profile_add_call(&run, func_name + 1, strtoull(field, NULL, 10));
+    }
+
+  profile_merge(prof, &run);
+  profile_free(&run);
+
+  return 0;
+}
+
+static int read_indexed(profile_t *prof, FILE *file)
+{
+  char line[LINE_LIMIT];
+
+  while (fgets(line, sizeof(line), file))
+    {
+      strip_newline(line);
+
+      profile_entry_t s;
+      uint64_t index;
+
+      if (sscanf(line, "%lu,%255[^,],%lu,%lu,%lf,%lf,%lu,%lu",
+                 &index, s.func_name, &s.ncalls, &s.nruns,
+                 &s.cycles_sum, &s.cycles_sum_sq,
+                 &s.cycles_min, &s.cycles_max) != 8)
+        continue;
+
+      merge_entry(profile_find(prof, s.func_name), &s);
+    }
+
+  return 0;
+}
+
+int profile_read(profile_t *prof, const char *path)
+{
+  FILE *file = fopen(path, "r");
+  char line[LINE_LIMIT];
+  int ret = -1;
+
+  if (!file)
+    return -1;
+
+  if (fgets(line, sizeof(line), file))
+    {
+      strip_newline(line);
+
+      if (strcmp(line, RAW_HEADER) == 0)
+        ret = read_raw(prof, file);
+      else if (strcmp(line, INDEXED_HEADER) == 0)
+        ret = read_indexed(prof, file);
+    }
+
+  fclose(file);
+  return ret;
+}
+
+static int compare_entries(const void *a, const void *b)
+{
+  const profile_entry_t *ea = *(const profile_entry_t **)a;
+  const profile_entry_t *eb = *(const profile_entry_t **)b;
+
+  return strcmp(ea->func_name, eb->func_name);
+}
+
+const profile_entry_t **profile_sorted(const profile_t *prof)
+{
+  const profile_entry_t **sorted = malloc(sizeof(profile_entry_t *) * (prof->size + 1));
+  uint64_t n = 0;
+
+  if (!sorted)
+    exit(12);
+
+  for (uint64_t i = 0; i < prof->capacity; i++)
+    {
+      if (prof->entries[i].func_name[0] != '\0')
+        sorted[n++] = prof->entries + i;
+    }
+
+  qsort(sorted, n, sizeof(profile_entry_t *), compare_entries);
+
+  return sorted;
+}
+
+void profile_write(const profile_t *prof, FILE *file)
+{
+  const profile_entry_t **sorted = profile_sorted(prof);
+
+  fprintf(file, "%s\n", INDEXED_HEADER);
+
+  for (uint64_t i = 0; i < prof->size; i++)
+    {
+      fprintf(file, "%lu,%s,%lu,%lu,%.17g,%.17g,%lu,%lu\n",
+              i,
+              sorted[i]->func_name,
+              sorted[i]->ncalls,
+              sorted[i]->nruns,
+              sorted[i]->cycles_sum,
+              sorted[i]->cycles_sum_sq,
+              sorted[i]->cycles_min,
+              sorted[i]->cycles_max);
+    }
+
+  free(sorted);
+}
+
+double profile_mean(const profile_entry_t *e)
+{
+  return e->ncalls ? e->cycles_sum / (double)e->ncalls : 0.0;
+}
+
+double profile_variance(const profile_entry_t *e)
+{
+  if (e->ncalls < 2)
+    return 0.0;
+
+  double n = (double)e->ncalls;
+  double var = (e->cycles_sum_sq - e->cycles_sum * e->cycles_sum / n) / (n - 1);
+
+  return var > 0.0 ? var : 0.0;
+}
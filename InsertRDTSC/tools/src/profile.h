@@ -0,0 +1,122 @@
+#ifndef _PROFILE_H_
+#define _PROFILE_H_
+
+//
+#include <stdio.h>  // FILE
+#include <stdint.h> // uint64_t
+
+//
+#define FUNC_NAME_LIMIT 256
+#define PROFILE_INITIAL_CAPACITY 1024
+#define LINE_LIMIT 1024
+
+/**
+ * Store the statistics of one function over every merged run
+ */
+typedef struct profile_entry_s
+{
+  uint64_t ncalls;
+  uint64_t nruns;
+  uint64_t cycles_min;
+  uint64_t cycles_max;
+  double cycles_sum;
+  double cycles_sum_sq;
+  char func_name[FUNC_NAME_LIMIT];
+} profile_entry_t;
+
+/**
+ * Store a profile - open addressing hash table keyed by function name
+ */
+typedef struct profile_s
+{
+  uint64_t size;
+  uint64_t capacity;
+  profile_entry_t *entries;
+} profile_t;
+
+/**
+ * profile_init - Initialize an empty profile
+ * @param prof: profile
+ * @return
+ */
+void profile_init(profile_t *prof);
+
+/**
+ * profile_free - Release a profile
+ * @param prof: profile
+ * @return
+ */
+void profile_free(profile_t *prof);
+
+/**
+ * profile_find - Find or insert the entry of a function
+ * @param prof     : profile
+ * @param func_name: function name
+ * @return the entry of the function
+ */
+profile_entry_t *profile_find(profile_t *prof, const char *func_name);
+
+/**
+ * profile_lookup - Find the entry of a function without inserting it
+ * @param prof     : profile
+ * @param func_name: function name
+ * @return the entry of the function or NULL
+ */
+profile_entry_t *profile_lookup(const profile_t *prof, const char *func_name);
+
+/**
+ * profile_add_call - Add one call of a function
+ * @param prof     : profile
+ * @param func_name: function name
+ * @param cycles   : cycles of the call
+ * @return
+ */
+void profile_add_call(profile_t *prof, const char *func_name, uint64_t cycles);
+
+/**
+ * profile_merge - Merge a profile into another one
+ * @param dst: destination profile
+ * @param src: source profile
+ * @return
+ */
+void profile_merge(profile_t *dst, const profile_t *src);
+
+/**
+ * profile_read - Read a raw run output (CSV written by the runtime) or an
+ *                indexed profile written by profile_write
+ * @param prof: profile to fill
+ * @param path: path of the file
+ * @return 0 on success, -1 otherwise
+ */
+int profile_read(profile_t *prof, const char *path);
+
+/**
+ * profile_write - Write an indexed profile sorted by function name
+ * @param prof: profile
+ * @param file: output file
+ * @return
+ */
+void profile_write(const profile_t *prof, FILE *file);
+
+/**
+ * profile_sorted - Get the entries sorted by function name
+ * @param prof: profile
+ * @return an array of prof->size pointers to free by the caller
+ */
+const profile_entry_t **profile_sorted(const profile_t *prof);
+
+/**
+ * profile_mean - Get the mean cycles per call of an entry
+ * @param e: entry
+ * @return the mean
+ */
+double profile_mean(const profile_entry_t *e);
+
+/**
+ * profile_variance - Get the variance of the cycles per call of an entry
+ * @param e: entry
+ * @return the unbiased variance
+ */
+double profile_variance(const profile_entry_t *e);
+
+#endif // _PROFILE_H_